@@ -0,0 +1,455 @@
+/*****************************************************************************/
+/* CascArchives.cpp                                 Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Lookup of files in CDN archives (local mirror of the CDN)                 */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  The first version of CascArchives.cpp              */
+/*****************************************************************************/
+
+#define __CASCLIB_SELF__
+#include "CascLib.h"
+#include "CascCommon.h"
+
+//-----------------------------------------------------------------------------
+// Local defines
+
+#define CASC_ARCHIVE_INDEX_VERSION      1           // Version of the archive index (in the footer)
+#define CASC_ARCHIVE_CHECKSUM_SIZE      8           // Size of the block checksums and of the footer hash
+#define CASC_ARCHIVE_INVALID_INDEX      0xFFFFFFFF  // The index belongs to an archive group
+
+//-----------------------------------------------------------------------------
+// Local structures
+
+// Footer at the end of the archive index (data/xx/yy/<archive>.index).
+// The index begins with blocks of entries (key, size, offset), followed by
+// the last key of each block, the checksum of each block and the footer
+typedef struct _CASC_ARCHIVE_INDEX_FOOTER
+{
+    BYTE TocHash[CASC_ARCHIVE_CHECKSUM_SIZE];       // Hash of the table of contents
+    BYTE Version;                                   // Must be 1
+    BYTE Reserved[2];
+    BYTE BlockSizeKb;                               // Size of one block of entries, in KB
+    BYTE OffsetBytes;                               // Size of the offset field. 6 for archive groups (archive index + offset)
+    BYTE SizeBytes;                                 // Size of the size field
+    BYTE KeyBytes;                                  // Size of the encoding key
+    BYTE ChecksumSize;                              // Size of the block checksums
+    BYTE ElementCount[4];                           // Number of entries (little endian)
+    BYTE FooterHash[CASC_ARCHIVE_CHECKSUM_SIZE];    // Hash of the footer
+
+} CASC_ARCHIVE_INDEX_FOOTER, *PCASC_ARCHIVE_INDEX_FOOTER;
+
+// Entries from all archive indexes, before they are sorted
+typedef struct _CASC_ARCHIVE_LOADER
+{
+    PCASC_ARCHIVE_ENTRY pEntries;                   // Array of the loaded entries
+    DWORD EntryCount;                               // Number of the loaded entries
+    DWORD EntryCountMax;                            // Capacity of the array
+
+} CASC_ARCHIVE_LOADER, *PCASC_ARCHIVE_LOADER;
+
+//-----------------------------------------------------------------------------
+// Local functions
+
+static int CompareArchiveEntries(const void *, const void * pvEntry1, const void * pvEntry2)
+{
+    return memcmp(((PCASC_ARCHIVE_ENTRY)pvEntry1)->IndexKey, ((PCASC_ARCHIVE_ENTRY)pvEntry2)->IndexKey, CASC_FILE_KEY_SIZE);
+}
+
+// Creates the name of a file in the CDN directory structure, e.g. "data/xx/yy/xxyy...."
+static TCHAR * CreateCdnFileName(TCascStorage * hs, const TCHAR * szSubDir, LPBYTE pbKey, DWORD cbKey, const TCHAR * szExtension)
+{
+    TCHAR * szFileName;
+    TCHAR * szFilePtr;
+    size_t nLength = _tcslen(hs->szDataPath);
+
+    szFileName = CascNewStr(hs->szDataPath, 1 + _tcslen(szSubDir) + 3 + 3 + 1 + (cbKey * 2) + _tcslen(szExtension));
+    if(szFileName != NULL)
+    {
+        // Make sure that there is a slash after the data path
+        szFilePtr = szFileName + nLength;
+        if(nLength > 0 && szFilePtr[-1] != '\\' && szFilePtr[-1] != '/')
+            *szFilePtr++ = _T('/');
+
+        // Append the subdirectory, two levels of subdirectories and the key
+        _tcscpy(szFilePtr, szSubDir);
+        szFilePtr += _tcslen(szSubDir);
+        szFilePtr = AppendBlobText(szFilePtr, pbKey, 1, _T('/'));
+        szFilePtr = AppendBlobText(szFilePtr, pbKey + 1, 1, _T('/'));
+        szFilePtr = AppendBlobText(szFilePtr, pbKey, cbKey, _T('/'));
+        _tcscpy(szFilePtr, szExtension);
+    }
+
+    return szFileName;
+}
+
+static bool ReserveArchiveEntries(PCASC_ARCHIVE_LOADER pLoader, DWORD dwNewEntries)
+{
+    PCASC_ARCHIVE_ENTRY pNewEntries;
+    DWORD EntryCountMax;
+
+    // Check for the overflow of the entry count
+    if(dwNewEntries > (0xFFFFFFFF - pLoader->EntryCount))
+        return false;
+
+    // Enlarge the array, if needed
+    if((pLoader->EntryCount + dwNewEntries) > pLoader->EntryCountMax)
+    {
+        EntryCountMax = CASCLIB_MAX(pLoader->EntryCountMax * 2, pLoader->EntryCount + dwNewEntries);
+        if(pLoader->pEntries != NULL)
+            pNewEntries = CASC_REALLOC(CASC_ARCHIVE_ENTRY, pLoader->pEntries, EntryCountMax);
+        else
+            pNewEntries = CASC_ALLOC(CASC_ARCHIVE_ENTRY, EntryCountMax);
+        if(pNewEntries == NULL)
+            return false;
+
+        pLoader->pEntries = pNewEntries;
+        pLoader->EntryCountMax = EntryCountMax;
+    }
+
+    return true;
+}
+
+// Parses one archive index. For an index of an archive group, the archive index
+// is stored in each entry (ArchiveIndex is CASC_ARCHIVE_INVALID_INDEX)
+static int ParseArchiveIndex(
+    PCASC_ARCHIVE_LOADER pLoader,
+    LPBYTE pbIndexFile,
+    ULONGLONG cbIndexFile,
+    DWORD ArchiveBase,
+    DWORD ArchiveIndex,
+    DWORD ArchiveCount)
+{
+    PCASC_ARCHIVE_INDEX_FOOTER pFooter;
+    PCASC_ARCHIVE_ENTRY pEntry;
+    LPBYTE pbBlock;
+    LPBYTE pbEntry;
+    DWORD EntriesPerBlock;
+    DWORD ElementCount;
+    DWORD BlockCount;
+    DWORD BlockSize;
+    DWORD EntrySize;
+    DWORD dwArchive;
+
+    // Verify the footer
+    if(cbIndexFile < sizeof(CASC_ARCHIVE_INDEX_FOOTER) || cbIndexFile > 0xFFFFFFFF)
+        return ERROR_BAD_FORMAT;
+    pFooter = (PCASC_ARCHIVE_INDEX_FOOTER)(pbIndexFile + cbIndexFile - sizeof(CASC_ARCHIVE_INDEX_FOOTER));
+    if(pFooter->Version != CASC_ARCHIVE_INDEX_VERSION || pFooter->ChecksumSize != CASC_ARCHIVE_CHECKSUM_SIZE || pFooter->BlockSizeKb == 0)
+        return ERROR_BAD_FORMAT;
+    if(pFooter->KeyBytes < CASC_FILE_KEY_SIZE || pFooter->KeyBytes > MD5_HASH_SIZE || pFooter->SizeBytes != 4)
+        return ERROR_BAD_FORMAT;
+    if(pFooter->OffsetBytes != ((ArchiveIndex == CASC_ARCHIVE_INVALID_INDEX) ? 6 : 4))
+        return ERROR_BAD_FORMAT;
+
+    // Calculate the layout of the blocks
+    EntrySize = pFooter->KeyBytes + pFooter->SizeBytes + pFooter->OffsetBytes;
+    BlockSize = pFooter->BlockSizeKb << 10;
+    BlockCount = (DWORD)((cbIndexFile - sizeof(CASC_ARCHIVE_INDEX_FOOTER)) / (BlockSize + pFooter->KeyBytes + pFooter->ChecksumSize));
+    EntriesPerBlock = BlockSize / EntrySize;
+    ElementCount = ConvertBytesToInteger_4_LE(pFooter->ElementCount);
+    if((ULONGLONG)ElementCount > (ULONGLONG)BlockCount * EntriesPerBlock)
+        return ERROR_BAD_FORMAT;
+
+    // Make sure that there is space for all entries
+    if(!ReserveArchiveEntries(pLoader, ElementCount))
+        return ERROR_NOT_ENOUGH_MEMORY;
+    pEntry = pLoader->pEntries + pLoader->EntryCount;
+
+    // Load the entries. The rest of each block is filled with zeros
+    pbBlock = pbIndexFile;
+    for(DWORD i = 0; i < BlockCount && ElementCount > 0; i++, pbBlock += BlockSize)
+    {
+        pbEntry = pbBlock;
+        for(DWORD j = 0; j < EntriesPerBlock && ElementCount > 0; j++, pbEntry += EntrySize)
+        {
+            // An entry with zero size is the padding
+            pEntry->EncodedSize = ConvertBytesToInteger_4(pbEntry + pFooter->KeyBytes);
+            if(pEntry->EncodedSize == 0)
+                break;
+
+            // Archive groups have 2-byte archive index before the offset
+            if(ArchiveIndex == CASC_ARCHIVE_INVALID_INDEX)
+            {
+                dwArchive = (pbEntry[pFooter->KeyBytes + 4] << 0x08) | pbEntry[pFooter->KeyBytes + 5];
+                pEntry->ArchiveOffset = ConvertBytesToInteger_4(pbEntry + pFooter->KeyBytes + 6);
+                if(dwArchive >= ArchiveCount)
+                    return ERROR_BAD_FORMAT;
+            }
+            else
+            {
+                dwArchive = ArchiveIndex;
+                pEntry->ArchiveOffset = ConvertBytesToInteger_4(pbEntry + pFooter->KeyBytes + 4);
+            }
+
+            memcpy(pEntry->IndexKey, pbEntry, CASC_FILE_KEY_SIZE);
+            pEntry->Padding = 0;
+            pEntry->ArchiveIndex = (USHORT)(ArchiveBase + dwArchive);
+            pLoader->EntryCount++;
+            ElementCount--;
+            pEntry++;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static int LoadArchiveIndexFile(
+    PCASC_ARCHIVE_LOADER pLoader,
+    const TCHAR * szIndexFile,
+    DWORD ArchiveBase,
+    DWORD ArchiveIndex,
+    DWORD ArchiveCount)
+{
+    TFileStream * pStream;
+    ULONGLONG FileSize = 0;
+    LPBYTE pbIndexFile;
+    DWORD dwEntryCount = pLoader->EntryCount;
+    int nError = ERROR_FILE_NOT_FOUND;
+
+    // Map the index file to memory
+    pStream = FileStream_OpenFile(szIndexFile, STREAM_FLAG_READ_ONLY | BASE_PROVIDER_MAP);
+    if(pStream != NULL)
+    {
+        pbIndexFile = FileStream_GetMappedData(pStream, &FileSize);
+        nError = (pbIndexFile != NULL) ? ParseArchiveIndex(pLoader, pbIndexFile, FileSize, ArchiveBase, ArchiveIndex, ArchiveCount) : ERROR_BAD_FORMAT;
+        FileStream_Close(pStream);
+    }
+
+    // Don't keep the entries of a damaged index
+    if(nError != ERROR_SUCCESS)
+        pLoader->EntryCount = dwEntryCount;
+    return nError;
+}
+
+// Loads the index of the archive group. If there is none, it loads the indexes
+// of all archives that are present. The group index is created by the game client,
+// so a mirror of the CDN usually doesn't have it
+static void LoadArchiveGroupIndexes(
+    TCascStorage * hs,
+    PCASC_ARCHIVE_LOADER pLoader,
+    const TCHAR * szSubDir,
+    PQUERY_KEY pArchiveGroup,
+    PQUERY_KEY pArchiveArray,
+    DWORD ArchiveCount,
+    DWORD ArchiveBase)
+{
+    TCHAR * szIndexFile;
+    int nError = ERROR_FILE_NOT_FOUND;
+
+    // Try the index of the archive group first
+    if(pArchiveGroup->pbData != NULL && pArchiveGroup->cbData != 0)
+    {
+        szIndexFile = CreateCdnFileName(hs, szSubDir, pArchiveGroup->pbData, pArchiveGroup->cbData, _T(".index"));
+        if(szIndexFile != NULL)
+        {
+            nError = LoadArchiveIndexFile(pLoader, szIndexFile, ArchiveBase, CASC_ARCHIVE_INVALID_INDEX, ArchiveCount);
+            CASC_FREE(szIndexFile);
+        }
+    }
+
+    // Load the indexes of the single archives
+    if(nError != ERROR_SUCCESS && pArchiveArray != NULL)
+    {
+        for(DWORD i = 0; i < ArchiveCount; i++)
+        {
+            szIndexFile = CreateCdnFileName(hs, szSubDir, pArchiveArray[i].pbData, pArchiveArray[i].cbData, _T(".index"));
+            if(szIndexFile != NULL)
+            {
+                LoadArchiveIndexFile(pLoader, szIndexFile, ArchiveBase, i, ArchiveCount);
+                CASC_FREE(szIndexFile);
+            }
+        }
+    }
+}
+
+// Sorts the loaded entries by the index key, so they can be binary-searched
+static int CreateArchiveEntryTable(TCascStorage * hs, PCASC_ARCHIVE_LOADER pLoader)
+{
+    PCASC_ARCHIVE_ENTRY * ppEntries;
+    PCASC_ARCHIVE_ENTRY pSortedEntries;
+
+    // Allocate the array of pointers for sorting and the sorted array
+    ppEntries = CASC_ALLOC(PCASC_ARCHIVE_ENTRY, pLoader->EntryCount);
+    pSortedEntries = CASC_ALLOC(CASC_ARCHIVE_ENTRY, pLoader->EntryCount);
+    if(ppEntries == NULL || pSortedEntries == NULL)
+    {
+        if(pSortedEntries != NULL)
+            CASC_FREE(pSortedEntries);
+        if(ppEntries != NULL)
+            CASC_FREE(ppEntries);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Sort the entries
+    for(DWORD i = 0; i < pLoader->EntryCount; i++)
+        ppEntries[i] = pLoader->pEntries + i;
+    qsort_pointer_array((void **)ppEntries, pLoader->EntryCount, CompareArchiveEntries, NULL);
+    for(DWORD i = 0; i < pLoader->EntryCount; i++)
+        pSortedEntries[i] = ppEntries[i][0];
+
+    // Give the table to the storage
+    hs->pArchiveEntries = pSortedEntries;
+    hs->ArchiveEntryCount = pLoader->EntryCount;
+    CASC_FREE(ppEntries);
+    return ERROR_SUCCESS;
+}
+
+// Loads the archive indexes and the patch archive indexes. Must be called
+// with the archive lock held, or before the storage is used by other threads
+static int LoadArchiveEntries(TCascStorage * hs)
+{
+    CASC_ARCHIVE_LOADER Loader = {NULL, 0, 0};
+    DWORD dwTotalCount = hs->ArchiveCount + hs->PatchArchiveCount;
+    int nError = ERROR_FILE_NOT_FOUND;
+
+    // Only try to load the indexes once
+    if(hs->bArchiveIndexesLoaded)
+        return (hs->pArchiveEntries != NULL) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+    hs->bArchiveIndexesLoaded = true;
+
+    // The archive number must fit into the archive entry
+    if(hs->szDataPath == NULL || dwTotalCount == 0 || dwTotalCount > 0xFFFF)
+        return ERROR_FILE_NOT_FOUND;
+
+    // Patch archives are numbered after the normal archives
+    LoadArchiveGroupIndexes(hs, &Loader, _T("data"), &hs->ArchiveGroup, hs->pArchiveArray, hs->ArchiveCount, 0);
+    LoadArchiveGroupIndexes(hs, &Loader, _T("patch"), &hs->PatchArchiveGroup, hs->pPatchArchiveArray, hs->PatchArchiveCount, hs->ArchiveCount);
+
+    // Prepare the sorted table and the array of the archive streams
+    if(Loader.EntryCount != 0)
+    {
+        hs->ArchiveStreams = CASC_ALLOC(TFileStream *, dwTotalCount);
+        if(hs->ArchiveStreams != NULL)
+        {
+            memset(hs->ArchiveStreams, 0, dwTotalCount * sizeof(TFileStream *));
+            nError = CreateArchiveEntryTable(hs, &Loader);
+        }
+        else
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    if(Loader.pEntries != NULL)
+        CASC_FREE(Loader.pEntries);
+    return nError;
+}
+
+//-----------------------------------------------------------------------------
+// Public functions
+
+// Loading all indexes takes long, so it uses its own lock. Threads that need
+// a file from the archives wait for the result; the storage lock stays free
+int LoadArchiveIndexes(TCascStorage * hs)
+{
+    int nError;
+
+    CascLock_Enter(&hs->ArchiveLock);
+    nError = LoadArchiveEntries(hs);
+    CascLock_Leave(&hs->ArchiveLock);
+    return nError;
+}
+
+// Finds the file in the CDN archives. The archive indexes are loaded
+// on the first call, which happens when the file is not in the local index
+PCASC_ARCHIVE_ENTRY FindArchiveEntry(TCascStorage * hs, PQUERY_KEY pIndexKey)
+{
+    PCASC_ARCHIVE_ENTRY pEntry;
+    size_t nLeft = 0;
+    size_t nRight;
+    size_t nMiddle;
+    int nResult;
+
+    // Make sure that the archive indexes are loaded
+    if(pIndexKey->cbData < CASC_FILE_KEY_SIZE || LoadArchiveIndexes(hs) != ERROR_SUCCESS)
+        return NULL;
+    nRight = hs->ArchiveEntryCount;
+
+    // Binary search in the sorted archive entries
+    while(nLeft < nRight)
+    {
+        nMiddle = nLeft + (nRight - nLeft) / 2;
+        pEntry = hs->pArchiveEntries + nMiddle;
+
+        nResult = memcmp(pEntry->IndexKey, pIndexKey->pbData, CASC_FILE_KEY_SIZE);
+        if(nResult == 0)
+            return pEntry;
+
+        if(nResult < 0)
+            nLeft = nMiddle + 1;
+        else
+            nRight = nMiddle;
+    }
+
+    return NULL;
+}
+
+// Opens the CDN archive. Patch archives follow after the normal archives
+TFileStream * OpenArchiveStream(TCascStorage * hs, DWORD ArchiveIndex)
+{
+    TFileStream * pStream = NULL;
+    PQUERY_KEY pArchiveKey;
+    TCHAR * szArchiveFile;
+
+    if(ArchiveIndex < hs->ArchiveCount)
+    {
+        pArchiveKey = hs->pArchiveArray + ArchiveIndex;
+        szArchiveFile = CreateCdnFileName(hs, _T("data"), pArchiveKey->pbData, pArchiveKey->cbData, _T(""));
+    }
+    else
+    {
+        pArchiveKey = hs->pPatchArchiveArray + (ArchiveIndex - hs->ArchiveCount);
+        szArchiveFile = CreateCdnFileName(hs, _T("patch"), pArchiveKey->pbData, pArchiveKey->cbData, _T(""));
+    }
+
+    if(szArchiveFile != NULL)
+    {
+        pStream = OpenDataFileStream(hs, szArchiveFile);
+        CASC_FREE(szArchiveFile);
+    }
+
+    return pStream;
+}
+
+// Opens a file that is stored in the CDN directory as a standalone file
+// (e.g. ENCODING). Needs the full encoding key, because that is the file name
+TFileStream * OpenLooseFileStream(TCascStorage * hs, PQUERY_KEY pEncodingKey)
+{
+    TFileStream * pStream = NULL;
+    TCHAR * szFileName;
+
+    if(hs->szDataPath != NULL && pEncodingKey->cbData >= MD5_HASH_SIZE)
+    {
+        szFileName = CreateCdnFileName(hs, _T("data"), pEncodingKey->pbData, MD5_HASH_SIZE, _T(""));
+        if(szFileName != NULL)
+        {
+            pStream = FileStream_OpenFile(szFileName, STREAM_FLAG_READ_ONLY | STREAM_PROVIDER_FLAT | BASE_PROVIDER_FILE);
+            CASC_FREE(szFileName);
+        }
+    }
+
+    return pStream;
+}
+
+void FreeArchiveIndexes(TCascStorage * hs)
+{
+    DWORD dwTotalCount = hs->ArchiveCount + hs->PatchArchiveCount;
+
+    // Close the archive streams
+    if(hs->ArchiveStreams != NULL)
+    {
+        for(DWORD i = 0; i < dwTotalCount; i++)
+        {
+            if(hs->ArchiveStreams[i] != NULL)
+                FileStream_Close(hs->ArchiveStreams[i]);
+        }
+        CASC_FREE(hs->ArchiveStreams);
+    }
+    hs->ArchiveStreams = NULL;
+
+    // Free the archive entries
+    if(hs->pArchiveEntries != NULL)
+        CASC_FREE(hs->pArchiveEntries);
+    hs->pArchiveEntries = NULL;
+    hs->ArchiveEntryCount = 0;
+}
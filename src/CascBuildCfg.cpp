@@ -205,27 +205,10 @@ static int StringBlobToBinaryBlob(
     pBlob->cbData = 0;
 
     // Convert the blob
-    while(pbBlobBegin < pbBlobEnd)
-    {
-        BYTE DigitOne;
-        BYTE DigitTwo;
-
-        DigitOne = (BYTE)(AsciiToUpperTable_BkSlash[pbBlobBegin[0]] - '0');
-        if(DigitOne > 9)
-            DigitOne -= 'A' - '9' - 1;
-
-        DigitTwo = (BYTE)(AsciiToUpperTable_BkSlash[pbBlobBegin[1]] - '0');
-        if(DigitTwo > 9)
-            DigitTwo -= 'A' - '9' - 1;
-
-        if(DigitOne > 0x0F || DigitTwo > 0x0F || pBlob->cbData >= MAX_CASC_KEY_LENGTH)
-            return ERROR_BAD_FORMAT;
-
-        pBlob->pbData[pBlob->cbData++] = (DigitOne << 0x04) | DigitTwo;
-        pbBlobBegin += 2;
-    }
-
-    return ERROR_SUCCESS;
+    if((size_t)(pbBlobEnd - pbBlobBegin) > (MAX_CASC_KEY_LENGTH * 2))
+        return ERROR_BAD_FORMAT;
+    pBlob->cbData = (DWORD)(pbBlobEnd - pbBlobBegin) / 2;
+    return BinaryFromString((const char *)pbBlobBegin, (pbBlobEnd - pbBlobBegin), pBlob->pbData);
 }
 
 static bool GetNextFileLine(PQUERY_KEY pFileBlob, LPBYTE * ppbLineBegin, LPBYTE * ppbLineEnd)
@@ -23,6 +23,9 @@
 
 #include "CascPort.h"
 #include "common/Common.h"
+#include "common/Threads.h"
+#include "common/Arena.h"
+#include "common/WildCard.h"
 #include "common/Map.h"
 #include "common/FileStream.h"
 #include "common/ListFile.h"
@@ -111,6 +114,17 @@ typedef struct _CASC_MAPPING_TABLE
 
 } CASC_MAPPING_TABLE, *PCASC_MAPPING_TABLE;
 
+// Entry of the CDN archive index, see CascArchives.cpp
+typedef struct _CASC_ARCHIVE_ENTRY
+{
+    BYTE IndexKey[CASC_FILE_KEY_SIZE];              // The first 9 bytes of the encoding key
+    BYTE Padding;
+    USHORT ArchiveIndex;                            // Index of the archive. Patch archives follow after the normal archives
+    DWORD ArchiveOffset;                            // Offset of the BLTE data in the archive
+    DWORD EncodedSize;                              // Size of the BLTE data in the archive
+
+} CASC_ARCHIVE_ENTRY, *PCASC_ARCHIVE_ENTRY;
+
 typedef struct _CASC_FILE_FRAME
 {
     DWORD FrameArchiveOffset;                       // Archive file pointer corresponding to the begin of the frame
@@ -118,6 +132,7 @@ typedef struct _CASC_FILE_FRAME
     DWORD CompressedSize;                           // Compressed size of the file
     DWORD FrameSize;                                // Size of the frame
     BYTE  md5[MD5_HASH_SIZE];                       // MD5 hash of the file sector
+    bool  bVerified;                                // The MD5 of the frame has already been checked (see CascGetFileView)
 } CASC_FILE_FRAME, *PCASC_FILE_FRAME;
 
 typedef struct _CASC_ENCODING_HEADER
@@ -164,6 +179,7 @@ typedef struct _TCascStorage
     DWORD dwBuildNumber;                            // Game build number
     DWORD dwFileBeginDelta;                         // This is number of bytes to shift back from archive offset (from index entry) to actual begin of file data
     DWORD dwDefaultLocale;                          // Default locale, read from ".build.info"
+    DWORD dwOpenFlags;                              // CASC_STOR_XXX flags given to CascOpenStorageEx
     
     QUERY_KEY CdnConfigKey;
     QUERY_KEY CdnBuildKey;
@@ -176,6 +192,12 @@ typedef struct _TCascStorage
     QUERY_KEY PatchArchiveGroup;                    // Name of the patch group archive file
     DWORD PatchArchiveCount;                        // Number of patch archives in the array
 
+    PCASC_ARCHIVE_ENTRY pArchiveEntries;            // Entries of all CDN archive indexes, sorted by the index key
+    DWORD ArchiveEntryCount;                        // Number of archive entries
+    TFileStream ** ArchiveStreams;                  // Open CDN archives (ArchiveCount + PatchArchiveCount)
+    CASC_LOCK ArchiveLock;                          // Protects the loading of the CDN archive indexes
+    bool bArchiveIndexesLoaded;                     // True if the CDN archive indexes have been loaded (or looked for)
+
     QUERY_KEY RootKey;
     QUERY_KEY PatchKey;
     QUERY_KEY DownloadKey;
@@ -187,6 +209,7 @@ typedef struct _TCascStorage
     DWORD EncodingKeys;
 
     TFileStream * DataFileArray[CASC_MAX_DATA_FILES]; // Data file handles
+    CASC_LOCK StorageLock;                          // Protects lazy opening of the data files
 
     CASC_MAPPING_TABLE KeyMapping[CASC_INDEX_COUNT]; // Key mapping
     PCASC_MAP pIndexEntryMap;                       // Map of index entries
@@ -206,7 +229,9 @@ typedef struct _TCascFile
     
     DWORD FilePointer;                              // Current file pointer
 
-    DWORD ArchiveIndex;                             // Index of the archive (data.###)
+    DWORD ArchiveIndex;                             // Index of the archive (data.###, or the CDN archive if bCdnFile is set)
+    bool bCdnFile;                                  // The file is stored in CDN format, i.e. without the header area
+    bool bOwnStream;                                // The stream belongs to the file (a loose file in the CDN directory)
     DWORD HeaderOffset;                             // Offset of the BLTE header, relative to the begin of the archive
     DWORD HeaderSize;                               // Length of the BLTE header
     DWORD FramesOffset;                             // Offset of the frame data, relative to the begin of the archive
@@ -221,6 +246,7 @@ typedef struct _TCascFile
     DWORD cbFileCache;                              // Size of the file cache
     DWORD CacheStart;                               // Starting offset in the cache
     DWORD CacheEnd;                                 // Ending offset in the cache
+    DWORD ReadAheadEnd;                             // End of the data file range advised for readahead
 
 #ifdef CASCLIB_TEST     // Extra fields for analyzing the file size problem
     DWORD FileSize_RootEntry;                       // File size, from the root entry
@@ -239,6 +265,7 @@ typedef struct _TCascSearch
     TCHAR * szListFile;                             // Name of the listfile
     void * pCache;                                  // Listfile cache
     char * szMask;                                  // Search mask
+    CASC_WILDCARD WildCard;                         // Search mask, compiled
     char szFileName[MAX_PATH];                      // Buffer for the file name
 
     // Provider-specific data
@@ -246,9 +273,19 @@ typedef struct _TCascSearch
     size_t RootSearchPhase;                         // Root-specific phase value for search phase
     size_t IndexLevel1;                             // Root-specific search context
     size_t IndexLevel2;                             // Root-specific search context
+    size_t EncodingIndexEnd;                        // End of the searched range of the encoding table (nameless search)
     DWORD dwState;                                  // Pointer to the search state (0 = listfile, 1 = nameless, 2 = done)
-
-    BYTE BitArray[1];                               // Bit array of encoding keys. Set for each entry that has already been reported
+    DWORD dwRootIndex;                              // Index of the found root entry, if the root handler reports it
+    PCASC_INDEX_ENTRY pIndexEntry;                  // Index entry of the last found file
+    PCASC_ROOT_JOIN pJoinTable;                     // Root entries joined with encoding and index entries (CASC_FIND_SORT_BY_LOCATION only)
+    void * pSortedSearch;                           // Files sorted by location (CASC_FIND_SORT_BY_LOCATION only)
+    DWORD dwPartIndex;                              // Index of the searched part (partitioned search only)
+    DWORD dwPartCount;                              // Number of parts of the search. Zero if not partitioned
+    const char * szFoundName;                       // Name of the last found file, NULL if none
+    CASC_FIND_ITEM PendingItem;                     // Found file that did not fit to the caller's buffer (CascFindNextFiles)
+    bool bItemPending;                              // True if PendingItem is valid
+
+    LPBYTE BitArray;                                // Bit array of encoding keys. Set for each entry that has already been reported
 
 } TCascSearch;
 
@@ -292,6 +329,16 @@ ULONGLONG ConvertBytesToInteger_5(LPBYTE ValueAsBytes);
 
 int LoadBuildInfo(TCascStorage * hs);
 int CheckGameDirectory(TCascStorage * hs, TCHAR * szDirectory);
+TCHAR * AppendBlobText(TCHAR * szBuffer, LPBYTE pbData, DWORD cbData, TCHAR chSeparator);
+
+//-----------------------------------------------------------------------------
+// Support for CDN archives
+
+int LoadArchiveIndexes(TCascStorage * hs);
+PCASC_ARCHIVE_ENTRY FindArchiveEntry(TCascStorage * hs, PQUERY_KEY pIndexKey);
+TFileStream * OpenArchiveStream(TCascStorage * hs, DWORD ArchiveIndex);
+TFileStream * OpenLooseFileStream(TCascStorage * hs, PQUERY_KEY pEncodingKey);
+void FreeArchiveIndexes(TCascStorage * hs);
 
 //-----------------------------------------------------------------------------
 // Internal file functions
@@ -304,6 +351,14 @@ PCASC_INDEX_ENTRY    FindIndexEntry(TCascStorage * hs, PQUERY_KEY pIndexKey);
 
 int CascDecompress(void * pvOutBuffer, PDWORD pcbOutBuffer, void * pvInBuffer, DWORD cbInBuffer);
 
+TFileStream * OpenDataFileStream(TCascStorage * hs, const TCHAR * szFileName);
+int   LoadRawFileData(TCascFile * hf, LPBYTE * ppbRawBuffer, LPBYTE * ppbRawData, PDWORD pcbRawData, bool * pbAligned);
+void  FreeRawData(LPBYTE pbRawBuffer, bool bAligned);
+DWORD GetDecodedFileSize(TCascFile * hf);
+int   DecodeRawFileData(TCascFile * hf, LPBYTE pbRawData, LPBYTE pbFileData);
+
+int   CreateExtractedFileName(const TCHAR * szTargetDir, const char * szFileName, TCHAR ** pszLocalFile);
+
 //-----------------------------------------------------------------------------
 // Support for ROOT file
 
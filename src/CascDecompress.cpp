@@ -12,72 +12,492 @@
 #include "CascLib.h"
 #include "CascCommon.h"
 
+#ifdef CASCLIB_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 //-----------------------------------------------------------------------------
-// Local functions
+// Local defines
+
+// Maximum nesting of BLTE blocks in 'F' frames
+#define BLTE_MAX_NESTING    8
+
+// Size of one entry in the BLTE frame table
+#define BLTE_FRAME_SIZE     0x18
 
-static int Decompress_ZLIB(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer)
+typedef int (*DECOMPRESS_ROUTINE)(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth);
+
+typedef struct _CASC_CODEC
 {
-    z_stream z;                        // Stream information for zlib
-    int nResult;
+    BYTE CodecId;                                   // The first byte of the encoded frame
+    DECOMPRESS_ROUTINE PfnDecompress;               // Decompression routine
 
-    // Fill the stream structure for zlib
-    z.next_in   = pbInBuffer;
-    z.avail_in  = cbInBuffer;
-    z.total_in  = cbInBuffer;
-    z.next_out  = pbOutBuffer;
-    z.avail_out = *pcbOutBuffer;
-    z.total_out = 0;
-    z.zalloc    = NULL;
-    z.zfree     = NULL;
-
-    // Initialize the decompression structure
-    if((nResult = inflateInit(&z)) == Z_OK)
+} CASC_CODEC;
+
+// Codecs registered by CascRegisterCodec. They take precedence over the built-in ones.
+// The codecs can be registered while other threads decompress,
+// so the entries are only accessed by the interlocked pointer functions
+static void * UserCodecs[0x100];
+
+static int DecompressBlock(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth);
+
+//-----------------------------------------------------------------------------
+// Inflate backend for the 'Z' frames, selected at build time.
+// The size of the decompressed frame is always known in advance, so both
+// backends decompress the whole frame in one call. The decompressor state
+// is kept per thread and reused for all frames decompressed by that thread
+
+// Decompressor state of one thread. The states are linked together, so that
+// the states of threads that are still running can be freed on unload
+typedef struct _CASC_INFLATE_STATE
+{
+    struct _CASC_INFLATE_STATE * pPrev;
+    struct _CASC_INFLATE_STATE * pNext;
+#ifdef CASCLIB_USE_LIBDEFLATE
+    struct libdeflate_decompressor * pDecompressor;
+#else
+    z_stream Stream;
+#endif
+
+} CASC_INFLATE_STATE, *PCASC_INFLATE_STATE;
+
+static CASC_ONCE InflateOnce = CASC_ONCE_INIT;
+static CASC_LOCK InflateLock;                       // Guards the list of the states
+static CASC_TLS InflateTls;                         // State of the current thread
+static PCASC_INFLATE_STATE pFirstInflateState;
+static bool bInflateReady;
+
+static void FreeInflateState(PCASC_INFLATE_STATE pState)
+{
+#ifdef CASCLIB_USE_LIBDEFLATE
+    libdeflate_free_decompressor(pState->pDecompressor);
+#else
+    inflateEnd(&pState->Stream);
+#endif
+    CASC_FREE(pState);
+}
+
+static void UnlinkInflateState(PCASC_INFLATE_STATE pState)
+{
+    CascLock_Enter(&InflateLock);
+    if(pState->pPrev != NULL)
+        pState->pPrev->pNext = pState->pNext;
+    else
+        pFirstInflateState = pState->pNext;
+    if(pState->pNext != NULL)
+        pState->pNext->pPrev = pState->pPrev;
+    CascLock_Leave(&InflateLock);
+}
+
+// Called when a thread that has a state exits
+static void WINAPI InflateState_ThreadExit(void * pvState)
+{
+    PCASC_INFLATE_STATE pState = (PCASC_INFLATE_STATE)pvState;
+
+    UnlinkInflateState(pState);
+    FreeInflateState(pState);
+}
+
+// Called on the first decompression of a 'Z' frame
+static void InflateState_Init()
+{
+    if(CascTls_Init(&InflateTls, InflateState_ThreadExit))
+    {
+        CascLock_Init(&InflateLock);
+        bInflateReady = true;
+    }
+}
+
+// The slot must be freed when the library is unloaded. Otherwise, the exiting
+// threads would call the destructor that is no longer in the memory
+static void InflateState_Unload()
+{
+    PCASC_INFLATE_STATE pState;
+
+    if(bInflateReady)
+    {
+        // On Windows, freeing the slot calls the destructor for all threads
+        CascTls_Free(&InflateTls);
+        while((pState = pFirstInflateState) != NULL)
+        {
+            pFirstInflateState = pState->pNext;
+            FreeInflateState(pState);
+        }
+        CascLock_Free(&InflateLock);
+    }
+}
+
+static CASC_UNLOAD InflateUnload = {InflateState_Unload};
+
+static PCASC_INFLATE_STATE GetInflateState()
+{
+    PCASC_INFLATE_STATE pState;
+
+    // Reuse the state of this thread
+    CascOnce_Run(&InflateOnce, InflateState_Init);
+    if(bInflateReady == false)
+        return NULL;
+    if((pState = (PCASC_INFLATE_STATE)CascTls_GetValue(&InflateTls)) != NULL)
+        return pState;
+
+    // Create a new state for this thread
+    if((pState = CASC_ALLOC(CASC_INFLATE_STATE, 1)) != NULL)
     {
-        // Call zlib to decompress the data
-        nResult = inflate(&z, Z_NO_FLUSH);
-        inflateEnd(&z);
+        memset(pState, 0, sizeof(CASC_INFLATE_STATE));
+#ifdef CASCLIB_USE_LIBDEFLATE
+        pState->pDecompressor = libdeflate_alloc_decompressor();
+        if(pState->pDecompressor == NULL)
+#else
+        if(inflateInit(&pState->Stream) != Z_OK)
+#endif
+        {
+            CASC_FREE(pState);
+            return NULL;
+        }
+
+        CascLock_Enter(&InflateLock);
+        pState->pNext = pFirstInflateState;
+        if(pFirstInflateState != NULL)
+            pFirstInflateState->pPrev = pState;
+        pFirstInflateState = pState;
+        CascLock_Leave(&InflateLock);
+
+        CascTls_SetValue(&InflateTls, pState);
+    }
+
+    return pState;
+}
+
+#ifdef CASCLIB_USE_LIBDEFLATE
+
+static int Decompress_ZLIB(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
+{
+    PCASC_INFLATE_STATE pState;
+    enum libdeflate_result Result;
+    size_t cbDecompressed = 0;
+
+    CASCLIB_UNUSED(dwDepth);
+
+    // Get the decompressor of this thread
+    if((pState = GetInflateState()) == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Decompress the frame. The actual size may be less than the buffer size
+    Result = libdeflate_zlib_decompress(pState->pDecompressor, pbInBuffer, cbInBuffer, pbOutBuffer, *pcbOutBuffer, &cbDecompressed);
+    if(Result != LIBDEFLATE_SUCCESS)
+        return ERROR_FILE_CORRUPT;
 
-        // Give the size of the uncompressed data
-        *pcbOutBuffer = z.total_out;
+    // Give the size of the uncompressed data
+    *pcbOutBuffer = (DWORD)cbDecompressed;
+    return ERROR_SUCCESS;
+}
+
+#else   // CASCLIB_USE_LIBDEFLATE
+
+// Frees the state of this thread; the next frame creates a new one
+static void DropInflateState(PCASC_INFLATE_STATE pState)
+{
+    CascTls_SetValue(&InflateTls, NULL);
+    UnlinkInflateState(pState);
+    FreeInflateState(pState);
+}
+
+static int Decompress_ZLIB(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
+{
+    PCASC_INFLATE_STATE pState;
+    z_stream * pStream;
+    int nResult;
+
+    CASCLIB_UNUSED(dwDepth);
+
+    // Get the inflate stream of this thread. Resetting it keeps the inflate window
+    if((pState = GetInflateState()) == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+    pStream = &pState->Stream;
+    if(inflateReset(pStream) != Z_OK)
+    {
+        DropInflateState(pState);
+        return ERROR_FILE_CORRUPT;
     }
+
+    // Fill the stream structure for zlib
+    pStream->next_in   = pbInBuffer;
+    pStream->avail_in  = cbInBuffer;
+    pStream->next_out  = pbOutBuffer;
+    pStream->avail_out = *pcbOutBuffer;
+
+    // Decompress the whole frame at once. With Z_FINISH, zlib decodes
+    // directly to the output buffer and skips updating the sliding window.
+    // A full output buffer is not an error; the caller checks the size
+    nResult = inflate(pStream, Z_FINISH);
+    if(nResult == Z_BUF_ERROR && pStream->avail_out == 0)
+        nResult = Z_OK;
+
+    // Give the size of the uncompressed data
+    *pcbOutBuffer = (DWORD)pStream->total_out;
     
     // Return an error code
     return (nResult == Z_OK || nResult == Z_STREAM_END) ? ERROR_SUCCESS : ERROR_FILE_CORRUPT;
 }
 
+#endif  // CASCLIB_USE_LIBDEFLATE
+
 //-----------------------------------------------------------------------------
-// Public functions
+// Uncompressed frames ('N')
 
-int CascDecompress(void * pvOutBuffer, PDWORD pcbOutBuffer, void * pvInBuffer, DWORD cbInBuffer)
+static int Decompress_NONE(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
 {
-    LPBYTE pbOutBuffer = (LPBYTE)pvOutBuffer;
-    LPBYTE pbInBuffer = (LPBYTE)pvInBuffer;
-    DWORD cbOutBuffer = *pcbOutBuffer;   // Current size of the output buffer
-    BYTE uCompression;                  // Decompressions applied to the data
+    CASCLIB_UNUSED(dwDepth);
 
-    // Verify buffer sizes
-    if(cbInBuffer <= 1)
-        return 0;
+    if(cbInBuffer > *pcbOutBuffer)
+        return ERROR_FILE_CORRUPT;
 
-    // Get applied compression types and decrement data length
-    uCompression = *pbInBuffer++;
-    cbInBuffer--;
+    memcpy(pbOutBuffer, pbInBuffer, cbInBuffer);
+    *pcbOutBuffer = cbInBuffer;
+    return ERROR_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// LZ4 frames ('4'). The frame begins with a header:
+//
+//  BYTE  Version;                  // Must be 1
+//  BYTE  DecompressedSize[8];      // Size of the decompressed data, big endian
+//  BYTE  BlockShift;               // Size of one block is (1 << BlockShift)
+//
+// The header is followed by LZ4 blocks. Each block decompresses to
+// the block size, except the last one. Matches may refer to previous blocks
+
+static LPBYTE ReadLZ4Length(LPBYTE pbInput, LPBYTE pbInputEnd, size_t * PtrLength)
+{
+    BYTE OneByte;
+
+    do
+    {
+        if(pbInput >= pbInputEnd)
+            return NULL;
+        OneByte = *pbInput++;
+        PtrLength[0] += OneByte;
+    }
+    while(OneByte == 0xFF);
+
+    return pbInput;
+}
+
+// Decodes one LZ4 block. Returns pointer to the input data after the block, or NULL on error
+static LPBYTE DecodeLZ4Block(LPBYTE pbOutBuffer, LPBYTE pbOutput, LPBYTE pbOutputEnd, LPBYTE pbInput, LPBYTE pbInputEnd)
+{
+    LPBYTE pbMatch;
+    size_t cbLiterals;
+    size_t cbMatch;
+    size_t Offset;
+    BYTE Token;
+
+    while(pbInput < pbInputEnd)
+    {
+        // Copy the literals
+        Token = *pbInput++;
+        cbLiterals = (Token >> 4);
+        if(cbLiterals == 0x0F && (pbInput = ReadLZ4Length(pbInput, pbInputEnd, &cbLiterals)) == NULL)
+            return NULL;
+        if(cbLiterals > (size_t)(pbInputEnd - pbInput) || cbLiterals > (size_t)(pbOutputEnd - pbOutput))
+            return NULL;
+        memcpy(pbOutput, pbInput, cbLiterals);
+        pbOutput += cbLiterals;
+        pbInput += cbLiterals;
+
+        // The last sequence of the block has literals only
+        if(pbOutput >= pbOutputEnd)
+            return pbInput;
+
+        // Load the match offset and length
+        if((pbInputEnd - pbInput) < 2)
+            return NULL;
+        Offset = pbInput[0] | (pbInput[1] << 0x08);
+        pbInput += 2;
+        cbMatch = (Token & 0x0F);
+        if(cbMatch == 0x0F && (pbInput = ReadLZ4Length(pbInput, pbInputEnd, &cbMatch)) == NULL)
+            return NULL;
+        cbMatch += 4;
+
+        if(Offset == 0 || Offset > (size_t)(pbOutput - pbOutBuffer) || cbMatch > (size_t)(pbOutputEnd - pbOutput))
+            return NULL;
+        pbMatch = pbOutput - Offset;
+
+        // The match may overlap the output; then it repeats the last bytes
+        if(Offset >= cbMatch)
+        {
+            memcpy(pbOutput, pbMatch, cbMatch);
+            pbOutput += cbMatch;
+        }
+        else
+        {
+            while(cbMatch-- > 0)
+                *pbOutput++ = *pbMatch++;
+        }
+
+        // The block is complete. The next byte belongs to the next block
+        if(pbOutput >= pbOutputEnd)
+            return pbInput;
+    }
+
+    return NULL;
+}
+
+static int Decompress_LZ4(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
+{
+    LPBYTE pbInputEnd = pbInBuffer + cbInBuffer;
+    LPBYTE pbOutput = pbOutBuffer;
+    LPBYTE pbOutputEnd;
+    LPBYTE pbBlockEnd;
+    DWORD cbDecompressed;
+    DWORD cbBlock;
+
+    CASCLIB_UNUSED(dwDepth);
+
+    // Verify the header
+    if(cbInBuffer < 0x0A || pbInBuffer[0] != 1 || pbInBuffer[9] > 31)
+        return ERROR_BAD_FORMAT;
+    if(ConvertBytesToInteger_4(pbInBuffer + 1) != 0)
+        return ERROR_FILE_CORRUPT;
+
+    // Check the decompressed size
+    cbDecompressed = ConvertBytesToInteger_4(pbInBuffer + 5);
+    if(cbDecompressed > *pcbOutBuffer)
+        return ERROR_FILE_CORRUPT;
+    cbBlock = (1 << pbInBuffer[9]);
+    pbInBuffer += 0x0A;
+
+    // Decode all blocks
+    pbOutputEnd = pbOutBuffer + cbDecompressed;
+    while(pbOutput < pbOutputEnd)
+    {
+        pbBlockEnd = pbOutput + CASCLIB_MIN(cbBlock, (DWORD)(pbOutputEnd - pbOutput));
+        pbInBuffer = DecodeLZ4Block(pbOutBuffer, pbOutput, pbBlockEnd, pbInBuffer, pbInputEnd);
+        if(pbInBuffer == NULL)
+            return ERROR_FILE_CORRUPT;
+        pbOutput = pbBlockEnd;
+    }
+
+    *pcbOutBuffer = cbDecompressed;
+    return ERROR_SUCCESS;
+}
 
-    // Perform the decompressions
-    switch(uCompression)
+//-----------------------------------------------------------------------------
+// Frames with nested BLTE data ('F'). The frame contains a complete BLTE block,
+// with the same layout as the data file entries (see LoadCdnFileHeader)
+
+static int Decompress_BLTE(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
+{
+    LPBYTE pbInputEnd = pbInBuffer + cbInBuffer;
+    LPBYTE pbFrameTable;
+    LPBYTE pbFrameData;
+    DWORD cbOutBuffer = *pcbOutBuffer;
+    DWORD cbOutput = 0;
+    DWORD cbEncoded;
+    DWORD cbFrame;
+    DWORD dwHeaderSize;
+    DWORD dwFrameCount;
+    int nError;
+
+    // Don't let damaged data recurse indefinitely
+    if(dwDepth >= BLTE_MAX_NESTING)
+        return ERROR_FILE_CORRUPT;
+
+    // Verify the BLTE signature
+    if(cbInBuffer < 8 || ConvertBytesToInteger_4_LE(pbInBuffer) != BLTE_HEADER_SIGNATURE)
+        return ERROR_BAD_FORMAT;
+    dwHeaderSize = ConvertBytesToInteger_4(pbInBuffer + 4);
+
+    // Without a frame table, the rest of the block is a single frame
+    if(dwHeaderSize == 0)
+        return DecompressBlock(pbOutBuffer, pcbOutBuffer, pbInBuffer + 8, cbInBuffer - 8, dwDepth + 1);
+
+    // Verify the frame table
+    if(dwHeaderSize < 0x0C || dwHeaderSize > cbInBuffer || pbInBuffer[8] != 0x0F)
+        return ERROR_BAD_FORMAT;
+    dwFrameCount = ConvertBytesToInteger_3(pbInBuffer + 9);
+    if(dwFrameCount == 0 || (dwHeaderSize - 0x0C) != (dwFrameCount * BLTE_FRAME_SIZE))
+        return ERROR_BAD_FORMAT;
+
+    // Decompress all frames, one after another
+    pbFrameTable = pbInBuffer + 0x0C;
+    pbFrameData = pbInBuffer + dwHeaderSize;
+    for(DWORD i = 0; i < dwFrameCount; i++, pbFrameTable += BLTE_FRAME_SIZE)
     {
-        case 'N':   // Uncompressed
+        cbEncoded = ConvertBytesToInteger_4(pbFrameTable);
+        cbFrame = ConvertBytesToInteger_4(pbFrameTable + 4);
+        if(cbEncoded > (DWORD)(pbInputEnd - pbFrameData) || cbFrame > (cbOutBuffer - cbOutput))
+            return ERROR_FILE_CORRUPT;
+
+        // Verify the frame MD5
+        if(!VerifyDataBlockHash(pbFrameData, cbEncoded, pbFrameTable + 8))
+            return ERROR_FILE_CORRUPT;
+
+        nError = DecompressBlock(pbOutBuffer + cbOutput, &cbFrame, pbFrameData, cbEncoded, dwDepth + 1);
+        if(nError != ERROR_SUCCESS)
+            return nError;
+        if(cbFrame != ConvertBytesToInteger_4(pbFrameTable + 4))
+            return ERROR_FILE_CORRUPT;
+
+        pbFrameData += cbEncoded;
+        cbOutput += cbFrame;
+    }
+
+    *pcbOutBuffer = cbOutput;
+    return ERROR_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+// Codec dispatcher
+
+static const CASC_CODEC BuiltInCodecs[] =
+{
+    {'N', Decompress_NONE},
+    {'Z', Decompress_ZLIB},
+    {'4', Decompress_LZ4},
+    {'F', Decompress_BLTE}
+};
+
+static int DecompressBlock(LPBYTE pbOutBuffer, PDWORD pcbOutBuffer, LPBYTE pbInBuffer, DWORD cbInBuffer, DWORD dwDepth)
+{
+    DECOMPRESS_CALLBACK PfnUserCodec;
+    BYTE CodecId;
 
-            assert(cbOutBuffer == cbInBuffer);
-            memcpy(pbOutBuffer, pbInBuffer, cbInBuffer);
-            *pcbOutBuffer = cbOutBuffer;
-            return ERROR_SUCCESS;
+    // Each frame has at least the codec byte. A frame without data
+    // is passed to the codec, which gives zero bytes or an error
+    if(cbInBuffer == 0)
+        return ERROR_FILE_CORRUPT;
+
+    // Get the codec and decrement data length
+    CodecId = *pbInBuffer++;
+    cbInBuffer--;
 
-        case 'Z':   // ZLIB
-            
-            return Decompress_ZLIB(pbOutBuffer, pcbOutBuffer, pbInBuffer, cbInBuffer);
+    // Codecs registered by the caller come first
+    PfnUserCodec = (DECOMPRESS_CALLBACK)CascInterlockedReadPointer(&UserCodecs[CodecId]);
+    if(PfnUserCodec != NULL)
+        return PfnUserCodec(pbOutBuffer, pcbOutBuffer, pbInBuffer, cbInBuffer);
+
+    // Find the built-in codec
+    for(size_t i = 0; i < sizeof(BuiltInCodecs) / sizeof(BuiltInCodecs[0]); i++)
+    {
+        if(BuiltInCodecs[i].CodecId == CodecId)
+            return BuiltInCodecs[i].PfnDecompress(pbOutBuffer, pcbOutBuffer, pbInBuffer, cbInBuffer, dwDepth);
     }
 
-    assert(false);
     return ERROR_NOT_SUPPORTED;
 }
+
+//-----------------------------------------------------------------------------
+// Public functions
+
+int CascDecompress(void * pvOutBuffer, PDWORD pcbOutBuffer, void * pvInBuffer, DWORD cbInBuffer)
+{
+    return DecompressBlock((LPBYTE)pvOutBuffer, pcbOutBuffer, (LPBYTE)pvInBuffer, cbInBuffer, 0);
+}
+
+bool WINAPI CascRegisterCodec(BYTE CodecId, DECOMPRESS_CALLBACK PfnDecompress)
+{
+    // Threads that are decompressing a frame right now may still use the previous codec
+    CascInterlockedExchangePointer(&UserCodecs[CodecId], (void *)PfnDecompress);
+    return true;
+}
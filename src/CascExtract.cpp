@@ -0,0 +1,471 @@
+/*****************************************************************************/
+/* CascExtract.cpp                                  Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Multithreaded extraction of many files from the storage                   */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  The first version of CascExtract.cpp               */
+/*****************************************************************************/
+
+#define __CASCLIB_SELF__
+#include "CascLib.h"
+#include "CascCommon.h"
+
+//-----------------------------------------------------------------------------
+// Local defines
+
+#define CASC_EXTRACT_JOBS_PER_THREAD    4           // Max number of files in flight per worker thread
+#define CASC_EXTRACT_MAX_BYTES          0x10000000  // Max number of bytes held by the files in flight
+
+//-----------------------------------------------------------------------------
+// Local structures
+
+// One file going through the pipeline: read -> decode -> write
+typedef struct _CASC_EXTRACT_JOB
+{
+    struct _CASC_EXTRACT_JOB * pNext;               // Next job in the queue
+    HANDLE hFile;                                   // Open handle to the CASC file
+    LPBYTE pbRawBuffer;                             // Buffer with the raw data (may be aligned for direct I/O)
+    LPBYTE pbRawData;                               // Raw data of all frames, as loaded from the data file
+    LPBYTE pbFileData;                              // Decoded file data
+    DWORD cbRawData;                                // Size of the raw data
+    DWORD cbFileData;                               // Size of the decoded file data
+    bool bRawAligned;                               // The raw buffer is from FileStream_AllocAligned
+    int nError;                                     // Result of the job so far
+    char szFileName[MAX_PATH];                      // Name of the file, relative to the target directory
+
+} CASC_EXTRACT_JOB, *PCASC_EXTRACT_JOB;
+
+typedef struct _CASC_EXTRACT_QUEUE
+{
+    PCASC_EXTRACT_JOB pFirst;
+    PCASC_EXTRACT_JOB pLast;
+
+} CASC_EXTRACT_QUEUE, *PCASC_EXTRACT_QUEUE;
+
+typedef struct _CASC_EXTRACT_CONTEXT
+{
+    HANDLE hStorage;                                // Storage handle
+    HANDLE hFind;                                   // Search handle. Only used by the reader
+    CASC_FIND_DATA FindData;                        // The next file to be read
+    const TCHAR * szTargetDir;                      // Target directory
+    EXTRACT_PROGRESS_CALLBACK PfnCallback;          // Progress callback
+    void * pvUserData;                              // User data for the callback
+
+    CASC_LOCK CallbackLock;                         // Serializes the calls to the progress callback
+    CASC_LOCK Lock;                                 // Guards everything below
+    CASC_COND Cond;                                 // Signaled when a queue or the in-flight counters change
+    CASC_EXTRACT_QUEUE DecodeQueue;                 // Files loaded, waiting for decode
+    CASC_EXTRACT_QUEUE WriteQueue;                  // Files decoded, waiting for write
+    ULONGLONG BytesInFlight;                        // Memory held by the files in flight
+    DWORD dwInFlight;                               // Number of files in flight
+    DWORD dwMaxInFlight;                            // Max number of files in flight
+    bool bReaderBusy;                               // True if a thread is reading from the data files
+    bool bSearchDone;                               // True if no more files will be read
+    bool bCancelled;                                // True if the callback has cancelled the extraction
+    CASC_EXTRACT_PROGRESS Progress;                 // Progress information for the callback
+
+} CASC_EXTRACT_CONTEXT, *PCASC_EXTRACT_CONTEXT;
+
+//-----------------------------------------------------------------------------
+// Local functions
+
+static void PushJob(PCASC_EXTRACT_QUEUE pQueue, PCASC_EXTRACT_JOB pJob)
+{
+    pJob->pNext = NULL;
+    if(pQueue->pLast != NULL)
+        pQueue->pLast->pNext = pJob;
+    else
+        pQueue->pFirst = pJob;
+    pQueue->pLast = pJob;
+}
+
+static PCASC_EXTRACT_JOB PopJob(PCASC_EXTRACT_QUEUE pQueue)
+{
+    PCASC_EXTRACT_JOB pJob = pQueue->pFirst;
+
+    if(pJob != NULL)
+    {
+        pQueue->pFirst = pJob->pNext;
+        if(pQueue->pFirst == NULL)
+            pQueue->pLast = NULL;
+    }
+
+    return pJob;
+}
+
+static void FreeJob(PCASC_EXTRACT_JOB pJob)
+{
+    if(pJob->pbRawBuffer != NULL)
+        FreeRawData(pJob->pbRawBuffer, pJob->bRawAligned);
+    if(pJob->hFile != NULL)
+        CascCloseFile(pJob->hFile);
+    if(pJob->pbFileData != NULL)
+        CASC_FREE(pJob->pbFileData);
+    CASC_FREE(pJob);
+}
+
+// Read stage. Takes the next found file and loads its raw data.
+// Only one thread at a time, so the data files are read sequentially.
+// Sets pbSearchDone to true if there are no more files
+static PCASC_EXTRACT_JOB ReadNextFile(PCASC_EXTRACT_CONTEXT pContext, bool * pbSearchDone)
+{
+    PCASC_EXTRACT_JOB pJob;
+    TCascFile * hf;
+    QUERY_KEY EncodingKey;
+
+    // Allocate new job
+    pJob = CASC_ALLOC(CASC_EXTRACT_JOB, 1);
+    if(pJob == NULL)
+        return NULL;
+    memset(pJob, 0, sizeof(CASC_EXTRACT_JOB));
+
+    // Files without name are extracted under their encoding key
+    if(pContext->FindData.szFileName[0] != 0)
+        strcpy(pJob->szFileName, pContext->FindData.szFileName);
+    else
+        StringFromMD5(pContext->FindData.EncodingKey, pJob->szFileName);
+
+    // Open the file and load its raw data
+    EncodingKey.pbData = pContext->FindData.EncodingKey;
+    EncodingKey.cbData = MD5_HASH_SIZE;
+    if(CascOpenFileByEncodingKey(pContext->hStorage, &EncodingKey, 0, &pJob->hFile))
+    {
+        hf = IsValidFileHandle(pJob->hFile);
+        pJob->nError = LoadRawFileData(hf, &pJob->pbRawBuffer, &pJob->pbRawData, &pJob->cbRawData, &pJob->bRawAligned);
+    }
+    else
+    {
+        pJob->nError = GetLastError();
+        pJob->hFile = NULL;
+    }
+
+    // Move to the next file
+    if(!CascFindNextFile(pContext->hFind, &pContext->FindData))
+        pbSearchDone[0] = true;
+    return pJob;
+}
+
+// Decode stage. Verifies and decompresses the file frames
+static void DecodeExtractedFile(PCASC_EXTRACT_JOB pJob)
+{
+    TCascFile * hf = IsValidFileHandle(pJob->hFile);
+
+    // Allocate buffer for the decoded data
+    pJob->cbFileData = GetDecodedFileSize(hf);
+    pJob->pbFileData = CASC_ALLOC(BYTE, pJob->cbFileData + 1);
+    if(pJob->pbFileData == NULL)
+    {
+        pJob->nError = ERROR_NOT_ENOUGH_MEMORY;
+        return;
+    }
+
+    // Decode the data. Note that the frames may give more data than the file size
+    pJob->nError = DecodeRawFileData(hf, pJob->pbRawData, pJob->pbFileData);
+    if(pJob->cbFileData > hf->FileSize)
+        pJob->cbFileData = hf->FileSize;
+
+    // The raw data are not needed anymore
+    FreeRawData(pJob->pbRawBuffer, pJob->bRawAligned);
+    pJob->pbRawBuffer = NULL;
+    pJob->pbRawData = NULL;
+    pJob->cbRawData = 0;
+}
+
+// Creates the name of the local file for an extracted file. The name comes from
+// the storage (listfile, root file or CDN) and must not lead out of the target
+// directory. Empty, "." and ".." components, absolute names and drive letters
+// are rejected with ERROR_INVALID_PARAMETER
+int CreateExtractedFileName(const TCHAR * szTargetDir, const char * szFileName, TCHAR ** pszLocalFile)
+{
+    const char * szNameEnd = szFileName + strlen(szFileName);
+    const char * szComponent = szFileName;
+    const char * szSeparator;
+    TCHAR * szLocalFile;
+    TCHAR * szPathPtr;
+    size_t nTargetLength = _tcslen(szTargetDir);
+    size_t nLength;
+
+    // Verify all components of the name. A leading separator gives an empty component
+    for(;;)
+    {
+        for(szSeparator = szComponent; szSeparator < szNameEnd && szSeparator[0] != '\\' && szSeparator[0] != '/'; szSeparator++);
+        nLength = (size_t)(szSeparator - szComponent);
+
+        if(nLength == 0 || (szComponent[0] == '.' && (nLength == 1 || (nLength == 2 && szComponent[1] == '.'))))
+            return ERROR_INVALID_PARAMETER;
+        if(memchr(szComponent, ':', nLength) != NULL)
+            return ERROR_INVALID_PARAMETER;
+
+        if(szSeparator >= szNameEnd)
+            break;
+        szComponent = szSeparator + 1;
+    }
+
+    // Create the local file name
+    szLocalFile = CombinePathAndString(szTargetDir, szFileName, (size_t)(szNameEnd - szFileName));
+    if(szLocalFile == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // The file names in CASC use backslashes
+    while(nTargetLength > 0 && szTargetDir[nTargetLength - 1] == _T(PATH_SEPARATOR))
+        nTargetLength--;
+    for(szPathPtr = szLocalFile + nTargetLength; szPathPtr[0] != 0; szPathPtr++)
+    {
+        if(szPathPtr[0] == _T('\\') || szPathPtr[0] == _T('/'))
+            szPathPtr[0] = _T(PATH_SEPARATOR);
+    }
+
+    // The name must still be in the target directory
+    if(nTargetLength != 0 && (_tcsncmp(szLocalFile, szTargetDir, nTargetLength) || szLocalFile[nTargetLength] != _T(PATH_SEPARATOR)))
+    {
+        CASC_FREE(szLocalFile);
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    pszLocalFile[0] = szLocalFile;
+    return ERROR_SUCCESS;
+}
+
+// Write stage. Creates the local file and writes the decoded data to it
+static int WriteExtractedFile(PCASC_EXTRACT_CONTEXT pContext, PCASC_EXTRACT_JOB pJob)
+{
+    TFileStream * pStream;
+    ULONGLONG ByteOffset = 0;
+    TCHAR * szLocalFile = NULL;
+    int nError;
+
+    // Create the local file name
+    nError = CreateExtractedFileName(pContext->szTargetDir, pJob->szFileName, &szLocalFile);
+    if(nError != ERROR_SUCCESS)
+        return nError;
+
+    // Create the file. If it fails, create the directories and retry
+    pStream = FileStream_CreateFile(szLocalFile, 0);
+    if(pStream == NULL)
+    {
+        ForceCreatePath(szLocalFile);
+        pStream = FileStream_CreateFile(szLocalFile, 0);
+    }
+
+    // Write the data
+    if(pStream != NULL)
+    {
+        if(pJob->cbFileData != 0 && !FileStream_Write(pStream, &ByteOffset, pJob->pbFileData, pJob->cbFileData))
+            nError = GetLastError();
+        FileStream_Close(pStream);
+    }
+    else
+        nError = GetLastError();
+
+    CASC_FREE(szLocalFile);
+    return nError;
+}
+
+// Called without the lock when a job leaves the pipeline. The callback and
+// freeing the job happen outside the lock, so they don't stall other workers
+static void FinishJob(PCASC_EXTRACT_CONTEXT pContext, PCASC_EXTRACT_JOB pJob)
+{
+    CASC_EXTRACT_PROGRESS Progress;
+    ULONGLONG cbJobData = pJob->cbRawData + pJob->cbFileData;
+    bool bReport;
+    bool bContinue = true;
+
+    // The callback lock keeps the calls in the order of the progress updates
+    CascLock_Enter(&pContext->CallbackLock);
+
+    // Update the progress. Cancelled jobs are not reported
+    CascLock_Enter(&pContext->Lock);
+    bReport = (pContext->bCancelled == false);
+    if(bReport)
+    {
+        if(pJob->nError == ERROR_SUCCESS)
+        {
+            pContext->Progress.dwFilesExtracted++;
+            pContext->Progress.BytesWritten += pJob->cbFileData;
+        }
+        else
+        {
+            pContext->Progress.dwFilesFailed++;
+        }
+        Progress = pContext->Progress;
+    }
+    CascLock_Leave(&pContext->Lock);
+
+    // Call the callback. If it returns false, stop reading new files
+    if(bReport && pContext->PfnCallback != NULL)
+    {
+        Progress.szFileName = pJob->szFileName;
+        Progress.nError = pJob->nError;
+        bContinue = pContext->PfnCallback(pContext->pvUserData, &Progress);
+    }
+    CascLock_Leave(&pContext->CallbackLock);
+    FreeJob(pJob);
+
+    // Release the slot
+    CascLock_Enter(&pContext->Lock);
+    if(bContinue == false)
+    {
+        pContext->bCancelled = true;
+        pContext->bSearchDone = true;
+    }
+    pContext->BytesInFlight -= cbJobData;
+    pContext->dwInFlight--;
+    CascCond_Broadcast(&pContext->Cond);
+    CascLock_Leave(&pContext->Lock);
+}
+
+// The worker routine. Each thread does whatever stage has work, preferring the
+// later stages so that the memory of the files in flight is released first
+static void ExtractWorker(void * pvContext)
+{
+    PCASC_EXTRACT_CONTEXT pContext = (PCASC_EXTRACT_CONTEXT)pvContext;
+    PCASC_EXTRACT_JOB pJob;
+    DWORD cbJobData;
+    bool bSearchDone;
+    bool bCancelled;
+
+    CascLock_Enter(&pContext->Lock);
+    for(;;)
+    {
+        // Write stage
+        if((pJob = PopJob(&pContext->WriteQueue)) != NULL)
+        {
+            bCancelled = pContext->bCancelled;
+            CascLock_Leave(&pContext->Lock);
+            if(pJob->nError == ERROR_SUCCESS && bCancelled == false)
+                pJob->nError = WriteExtractedFile(pContext, pJob);
+            FinishJob(pContext, pJob);
+            CascLock_Enter(&pContext->Lock);
+            continue;
+        }
+
+        // Decode stage
+        if((pJob = PopJob(&pContext->DecodeQueue)) != NULL)
+        {
+            cbJobData = pJob->cbRawData + pJob->cbFileData;
+            bCancelled = pContext->bCancelled;
+            CascLock_Leave(&pContext->Lock);
+            if(pJob->nError == ERROR_SUCCESS && bCancelled == false)
+                DecodeExtractedFile(pJob);
+            CascLock_Enter(&pContext->Lock);
+
+            pContext->BytesInFlight = pContext->BytesInFlight - cbJobData + pJob->cbRawData + pJob->cbFileData;
+            PushJob(&pContext->WriteQueue, pJob);
+            CascCond_Broadcast(&pContext->Cond);
+            continue;
+        }
+
+        // Read stage. Only if there is not too much data in flight
+        if(pContext->bSearchDone == false && pContext->bReaderBusy == false)
+        {
+            if(pContext->dwInFlight == 0 || (pContext->dwInFlight < pContext->dwMaxInFlight && pContext->BytesInFlight < CASC_EXTRACT_MAX_BYTES))
+            {
+                pContext->bReaderBusy = true;
+                pContext->dwInFlight++;
+                bSearchDone = false;
+                CascLock_Leave(&pContext->Lock);
+                pJob = ReadNextFile(pContext, &bSearchDone);
+                CascLock_Enter(&pContext->Lock);
+                pContext->bReaderBusy = false;
+                if(bSearchDone)
+                    pContext->bSearchDone = true;
+
+                // If we failed to allocate the job, stop the extraction
+                if(pJob != NULL)
+                {
+                    pContext->BytesInFlight += pJob->cbRawData;
+                    PushJob(&pContext->DecodeQueue, pJob);
+                }
+                else
+                {
+                    pContext->Progress.dwFilesFailed++;
+                    pContext->bSearchDone = true;
+                    pContext->dwInFlight--;
+                }
+
+                CascCond_Broadcast(&pContext->Cond);
+                continue;
+            }
+        }
+
+        // Nothing more to do?
+        if(pContext->bSearchDone && pContext->bReaderBusy == false && pContext->dwInFlight == 0)
+            break;
+
+        // Wait until another thread moves a job
+        CascCond_Wait(&pContext->Cond, &pContext->Lock);
+    }
+    CascLock_Leave(&pContext->Lock);
+}
+
+//-----------------------------------------------------------------------------
+// Public functions
+
+bool WINAPI CascExtractFiles(
+    HANDLE hStorage,
+    const char * szMask,
+    const TCHAR * szListFile,
+    const TCHAR * szTargetDir,
+    DWORD dwThreadCount,
+    EXTRACT_PROGRESS_CALLBACK PfnCallback,
+    void * pvUserData)
+{
+    CASC_EXTRACT_CONTEXT Context;
+    int nError = ERROR_SUCCESS;
+
+    // Check parameters
+    if(IsValidStorageHandle(hStorage) == NULL)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    if(szMask == NULL || szTargetDir == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Use one thread per processor by default
+    if(dwThreadCount == 0)
+        dwThreadCount = CascGetProcessorCount();
+    dwThreadCount = CASCLIB_MIN(dwThreadCount, CASC_MAX_WORKER_THREADS);
+
+    // Prepare the extraction context
+    memset(&Context, 0, sizeof(CASC_EXTRACT_CONTEXT));
+    Context.hStorage = hStorage;
+    Context.szTargetDir = szTargetDir;
+    Context.PfnCallback = PfnCallback;
+    Context.pvUserData = pvUserData;
+    Context.dwMaxInFlight = dwThreadCount * CASC_EXTRACT_JOBS_PER_THREAD;
+
+    // The files are read in the order as they are stored in the data files
+    Context.hFind = CascFindFirstFileEx(hStorage, szMask, &Context.FindData, szListFile, CASC_FIND_SORT_BY_LOCATION);
+    if(Context.hFind == NULL)
+    {
+        nError = GetLastError();
+        return (nError == ERROR_NO_MORE_FILES || nError == ERROR_SUCCESS);
+    }
+
+    // Run the pipeline
+    CascLock_Init(&Context.CallbackLock);
+    CascLock_Init(&Context.Lock);
+    CascCond_Init(&Context.Cond);
+    CascRunWorkers(ExtractWorker, &Context, dwThreadCount);
+    CascCond_Free(&Context.Cond);
+    CascLock_Free(&Context.Lock);
+    CascLock_Free(&Context.CallbackLock);
+    CascFindClose(Context.hFind);
+
+    // Return the result
+    if(Context.bCancelled)
+        nError = ERROR_CANCELLED;
+    else if(Context.Progress.dwFilesFailed != 0)
+        nError = ERROR_CAN_NOT_COMPLETE;
+
+    if(nError != ERROR_SUCCESS)
+        SetLastError(nError);
+    return (nError == ERROR_SUCCESS);
+}
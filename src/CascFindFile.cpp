@@ -12,6 +12,31 @@
 #include "CascLib.h"
 #include "CascCommon.h"
 
+//-----------------------------------------------------------------------------
+// Local structures
+
+// File found by the search that is sorted by file location
+typedef struct _CASC_SORTED_ITEM
+{
+    ULONGLONG FileOffset;                           // Archive index and archive offset, from the index entry
+    BYTE EncodingKey[MD5_HASH_SIZE];                // Encoding key of the file
+    DWORD NameOffset;                               // Offset of the file name in the name arena (CASC_INVALID_ARENA_OFFSET if none)
+    DWORD dwLocaleFlags;                            // Locale flags of the file
+    DWORD dwFileSize;                               // Size of the file
+
+} CASC_SORTED_ITEM, *PCASC_SORTED_ITEM;
+
+typedef struct _CASC_SORTED_SEARCH
+{
+    PCASC_SORTED_ITEM pItems;                       // All found files, in the order as they were found
+    PCASC_SORTED_ITEM * SortedItems;                // Pointers to the found files, sorted by the file location
+    size_t ItemCount;                               // Number of found files
+    size_t ItemCountMax;                            // Capacity of the item array
+    size_t ItemIndex;                               // Index of the next file to be returned
+    CASC_ARENA NameArena;                           // Names of the found files
+
+} CASC_SORTED_SEARCH, *PCASC_SORTED_SEARCH;
+
 //-----------------------------------------------------------------------------
 // Local functions
 
@@ -22,6 +47,16 @@ static TCascSearch * IsValidSearchHandle(HANDLE hFind)
     return (pSearch != NULL && pSearch->szClassName != NULL && !strcmp(pSearch->szClassName, "TCascSearch") && pSearch->szMask != NULL) ? pSearch : NULL;
 }
 
+static void FreeSortedSearch(PCASC_SORTED_SEARCH pSorted)
+{
+    if(pSorted->SortedItems != NULL)
+        CASC_FREE(pSorted->SortedItems);
+    if(pSorted->pItems != NULL)
+        CASC_FREE(pSorted->pItems);
+    Arena_Free(&pSorted->NameArena);
+    CASC_FREE(pSorted);
+}
+
 static void FreeSearchHandle(TCascSearch * pSearch)
 {
     // Only if the storage handle is valid
@@ -41,35 +76,41 @@ static void FreeSearchHandle(TCascSearch * pSearch)
     // Free the file cache and frame array
     if(pSearch->szMask != NULL)
         CASC_FREE(pSearch->szMask);
+    WildCard_Free(&pSearch->WildCard);
     if(pSearch->szListFile != NULL)
         CASC_FREE(pSearch->szListFile);
 //  if(pSearch->pStruct1C != NULL)
 //      delete pSearch->pStruct1C;
     if(pSearch->pCache != NULL)
         ListFile_Free(pSearch->pCache);
+    if(pSearch->pSortedSearch != NULL)
+        FreeSortedSearch((PCASC_SORTED_SEARCH)pSearch->pSortedSearch);
 
     // Free the structure itself
     pSearch->szClassName = NULL;
     CASC_FREE(pSearch);
 }
 
-static TCascSearch * AllocateSearchHandle(TCascStorage * hs, const TCHAR * szListFile, const char * szMask)
+static TCascSearch * AllocateSearchHandle(TCascStorage * hs, const TCHAR * szListFile, const char * szMask, bool bBitArray = true)
 {
     TCascSearch * pSearch;
-    size_t cbToAllocate;
+    size_t cbToAllocate = sizeof(TCascSearch);
 
-    // When using the MNDX info, do not allocate the extra bit array
-    cbToAllocate = sizeof(TCascSearch) + ((hs->pEncodingMap->TableSize + 7) / 8);
+    // The bit array is placed right after the search structure.
+    // It is not needed when only searching encoding keys
+    if(bBitArray)
+        cbToAllocate += ((hs->pEncodingMap->TableSize + 7) / 8);
     pSearch = (TCascSearch *)CASC_ALLOC(BYTE, cbToAllocate);
     if(pSearch != NULL)
     {
         // Initialize the structure
         memset(pSearch, 0, cbToAllocate);
         pSearch->szClassName = "TCascSearch";
+        pSearch->BitArray = bBitArray ? (LPBYTE)(pSearch + 1) : NULL;
         
         // Save the search handle
         pSearch->hs = hs;
-        hs->dwRefCount++;
+        CascInterlockedIncrement(&hs->dwRefCount);
 
         // If the mask was not given, use default
         if(szMask == NULL)
@@ -86,9 +127,9 @@ static TCascSearch * AllocateSearchHandle(TCascStorage * hs, const TCHAR * szLis
             }
         }
 
-        // Allocate the search mask
+        // Allocate the search mask and compile it
         pSearch->szMask = CascNewStr(szMask, 0);
-        if(pSearch->szMask == NULL)
+        if(pSearch->szMask == NULL || WildCard_Compile(&pSearch->WildCard, szMask) != ERROR_SUCCESS)
         {
             FreeSearchHandle(pSearch);
             return NULL;
@@ -100,30 +141,59 @@ static TCascSearch * AllocateSearchHandle(TCascStorage * hs, const TCHAR * szLis
 
 // Perform searching using root-specific provider.
 // The provider may need the listfile
-static bool DoStorageSearch_RootFile(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
+static bool DoStorageSearch_RootFile(TCascSearch * pSearch, PCASC_FIND_ITEM pItem)
 {
     PCASC_ENCODING_ENTRY pEncodingEntry;
     PCASC_INDEX_ENTRY pIndexEntry;
+    PCASC_ROOT_JOIN pJoinEntry;
+    PCASC_ROOT_JOIN pJoinTable = pSearch->pJoinTable;
+    TRootHandler * pRootHandler = pSearch->hs->pRootHandler;
     QUERY_KEY EncodingKey;
     QUERY_KEY IndexKey;
     LPBYTE pbEncodingKey;
     DWORD EncodingIndex = 0;
     DWORD LocaleFlags = 0;
     DWORD FileSize = CASC_INVALID_SIZE;
+    DWORD JoinFileSize = CASC_INVALID_SIZE;
     DWORD ByteIndex;
     DWORD BitMask;
 
     for(;;)
     {
         // Attempt to find (the next) file from the root entry
-        pbEncodingKey = RootHandler_Search(pSearch->hs->pRootHandler, pSearch, &FileSize, &LocaleFlags);
+        pSearch->dwRootIndex = CASC_INVALID_ROOT_INDEX;
+        pbEncodingKey = RootHandler_Search(pRootHandler, pSearch, &FileSize, &LocaleFlags);
         if(pbEncodingKey == NULL)
             return false;
 
-        // Verify whether the encoding key exists in the encoding table
-        EncodingKey.pbData = pbEncodingKey;
-        EncodingKey.cbData = MD5_HASH_SIZE;
-        pEncodingEntry = FindEncodingEntry(pSearch->hs, &EncodingKey, &EncodingIndex);
+        // If the root handler told us the index of the root entry,
+        // the encoding entry and the index entry are already known
+        if(pJoinTable != NULL && pSearch->dwRootIndex < pRootHandler->dwEntryCount)
+        {
+            pJoinEntry = pJoinTable + pSearch->dwRootIndex;
+            pEncodingEntry = pJoinEntry->pEncodingEntry;
+            pIndexEntry = pJoinEntry->pIndexEntry;
+            EncodingIndex = pJoinEntry->EncodingIndex;
+            JoinFileSize = pJoinEntry->FileSize;
+        }
+        else
+        {
+            // Verify whether the encoding key exists in the encoding table
+            EncodingKey.pbData = pbEncodingKey;
+            EncodingKey.cbData = MD5_HASH_SIZE;
+            pEncodingEntry = FindEncodingEntry(pSearch->hs, &EncodingKey, &EncodingIndex);
+            pIndexEntry = NULL;
+
+            // Locate the index entry
+            if(pEncodingEntry != NULL)
+            {
+                IndexKey.pbData = GET_INDEX_KEY(pEncodingEntry);
+                IndexKey.cbData = MD5_HASH_SIZE;
+                pIndexEntry = FindIndexEntry(pSearch->hs, &IndexKey);
+                JoinFileSize = ConvertBytesToInteger_4(pEncodingEntry->FileSizeBE);
+            }
+        }
+
         if(pEncodingEntry != NULL)
         {
             // Mark the item as already found
@@ -133,30 +203,27 @@ static bool DoStorageSearch_RootFile(TCascSearch * pSearch, PCASC_FIND_DATA pFin
             BitMask   = 1 << (EncodingIndex & 0x07);
             pSearch->BitArray[ByteIndex] |= BitMask;
             
-            // Locate the index entry
-            IndexKey.pbData = GET_INDEX_KEY(pEncodingEntry);
-            IndexKey.cbData = MD5_HASH_SIZE;
-            pIndexEntry = FindIndexEntry(pSearch->hs, &IndexKey);
+            // Skip the files that are not in the index
             if(pIndexEntry == NULL)
                 continue;
 
             // If we retrieved the file size directly from the root provider, use it
             // Otherwise, we need to retrieve it from the encoding entry
             if(FileSize == CASC_INVALID_SIZE)
-                FileSize = ConvertBytesToInteger_4(pEncodingEntry->FileSizeBE);
+                FileSize = JoinFileSize;
 
             // Fill-in the found file
-            strcpy(pFindData->szFileName, pSearch->szFileName);
-            memcpy(pFindData->EncodingKey, pEncodingEntry->EncodingKey, MD5_HASH_SIZE);
-            pFindData->szPlainName = (char *)GetPlainFileName(pFindData->szFileName);
-            pFindData->dwLocaleFlags = LocaleFlags;
-            pFindData->dwFileSize = FileSize;
+            memcpy(pItem->EncodingKey, pEncodingEntry->EncodingKey, MD5_HASH_SIZE);
+            pItem->dwLocaleFlags = LocaleFlags;
+            pItem->dwFileSize = FileSize;
+            pSearch->szFoundName = pSearch->szFileName;
+            pSearch->pIndexEntry = pIndexEntry;
             return true;
         }
     }
 }
 
-static bool DoStorageSearch_EncodingKey(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
+static bool DoStorageSearch_EncodingKey(TCascSearch * pSearch, PCASC_FIND_ITEM pItem)
 {
     PCASC_ENCODING_ENTRY pEncodingEntry;
     PCASC_INDEX_ENTRY pIndexEntry;
@@ -165,13 +232,15 @@ static bool DoStorageSearch_EncodingKey(TCascSearch * pSearch, PCASC_FIND_DATA p
     DWORD ByteIndex;
     DWORD BitMask;
 
-    // Check for encoding keys that haven't been found yet
-    while(pSearch->IndexLevel1 < hs->pEncodingMap->TableSize)
+    // Check for encoding keys that haven't been found yet.
+    // EncodingIndexEnd is the end of the searched range of the encoding table
+    while(pSearch->IndexLevel1 < pSearch->EncodingIndexEnd)
     {
-        // Check if that entry has been reported before
+        // Check if that entry has been reported before.
+        // Searches over a part of the encoding table report all entries
         ByteIndex = (DWORD)(pSearch->IndexLevel1 / 8);
         BitMask = 1 << (pSearch->IndexLevel1 & 0x07);
-        if((pSearch->BitArray[ByteIndex] & BitMask) == 0)
+        if(pSearch->BitArray == NULL || (pSearch->BitArray[ByteIndex] & BitMask) == 0)
         {
             // Locate the index entry
             pEncodingEntry  = (PCASC_ENCODING_ENTRY)hs->pEncodingMap->HashTable[pSearch->IndexLevel1];
@@ -183,14 +252,14 @@ static bool DoStorageSearch_EncodingKey(TCascSearch * pSearch, PCASC_FIND_DATA p
                 if(pIndexEntry != NULL)
                 {
                     // Fill-in the found file
-                    memcpy(pFindData->EncodingKey, pEncodingEntry->EncodingKey, MD5_HASH_SIZE);
-                    pFindData->szFileName[0] = 0;
-                    pFindData->szPlainName = NULL;
-                    pFindData->dwLocaleFlags = CASC_LOCALE_NONE;
-                    pFindData->dwFileSize = ConvertBytesToInteger_4(pEncodingEntry->FileSizeBE);
-
-                    // Mark the entry as already-found
-                    pSearch->BitArray[ByteIndex] |= BitMask;
+                    memcpy(pItem->EncodingKey, pEncodingEntry->EncodingKey, MD5_HASH_SIZE);
+                    pItem->dwLocaleFlags = CASC_LOCALE_NONE;
+                    pItem->dwFileSize = ConvertBytesToInteger_4(pEncodingEntry->FileSizeBE);
+                    pSearch->szFoundName = NULL;
+                    pSearch->pIndexEntry = pIndexEntry;
+
+                    // Continue with the next entry next time
+                    pSearch->IndexLevel1++;
                     return true;
                 }
             }
@@ -204,7 +273,7 @@ static bool DoStorageSearch_EncodingKey(TCascSearch * pSearch, PCASC_FIND_DATA p
     return false;
 }
 
-static bool DoStorageSearch(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
+static bool DoStorageSearch(TCascSearch * pSearch, PCASC_FIND_ITEM pItem)
 {
     // State 0: No search done yet
     if(pSearch->dwState == 0)
@@ -212,7 +281,7 @@ static bool DoStorageSearch(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
         // Does the search specify listfile?
         if(pSearch->szListFile != NULL)
             pSearch->pCache = ListFile_OpenExternal(pSearch->szListFile);
-        
+
         // Move the search phase to the listfile searching
         pSearch->IndexLevel1 = 0;
         pSearch->dwState++;
@@ -221,18 +290,20 @@ static bool DoStorageSearch(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
     // State 1: Searching the list file
     if(pSearch->dwState == 1)
     {
-        if(DoStorageSearch_RootFile(pSearch, pFindData))
+        if(DoStorageSearch_RootFile(pSearch, pItem))
             return true;
 
         // Move to the nameless search state
         pSearch->IndexLevel1 = 0;
+        pSearch->EncodingIndexEnd = pSearch->hs->pEncodingMap->TableSize;
         pSearch->dwState++;
     }
 
     // State 2: Searching the remaining entries
-    if(pSearch->dwState == 2)
+    // Partitioned search only reports the named entries
+    if(pSearch->dwState == 2 && pSearch->dwPartCount == 0)
     {
-        if(DoStorageSearch_EncodingKey(pSearch, pFindData))
+        if(DoStorageSearch_EncodingKey(pSearch, pItem))
             return true;
 
         // Move to the final search state
@@ -242,6 +313,160 @@ static bool DoStorageSearch(TCascSearch * pSearch, PCASC_FIND_DATA pFindData)
     return false;
 }
 
+static int CompareSortedItems_FilePos(const void *, const void * pvItem1, const void * pvItem2)
+{
+    PCASC_SORTED_ITEM pItem1 = (PCASC_SORTED_ITEM)pvItem1;
+    PCASC_SORTED_ITEM pItem2 = (PCASC_SORTED_ITEM)pvItem2;
+
+    // The archive index is in the upper bits of the file offset,
+    // so this compares the archive index first, then the archive offset
+    if(pItem1->FileOffset < pItem2->FileOffset)
+        return -1;
+    if(pItem1->FileOffset > pItem2->FileOffset)
+        return +1;
+
+    // Keep the files with the same location in the order they were found
+    return (pItem1 < pItem2) ? -1 : (pItem1 > pItem2) ? +1 : 0;
+}
+
+static int InsertSortedItem(PCASC_SORTED_SEARCH pSorted, PCASC_FIND_ITEM pFindItem, const char * szFileName, PCASC_INDEX_ENTRY pIndexEntry)
+{
+    PCASC_SORTED_ITEM pNewItems;
+    PCASC_SORTED_ITEM pItem;
+    size_t ItemCountMax;
+
+    // Enlarge the item array, if needed
+    if(pSorted->ItemCount >= pSorted->ItemCountMax)
+    {
+        ItemCountMax = (pSorted->ItemCountMax != 0) ? (pSorted->ItemCountMax * 2) : 0x1000;
+        pNewItems = CASC_REALLOC(CASC_SORTED_ITEM, pSorted->pItems, ItemCountMax);
+        if(pNewItems == NULL)
+            return ERROR_NOT_ENOUGH_MEMORY;
+
+        pSorted->pItems = pNewItems;
+        pSorted->ItemCountMax = ItemCountMax;
+    }
+
+    // Fill the item
+    pItem = pSorted->pItems + pSorted->ItemCount;
+    pItem->FileOffset = ConvertBytesToInteger_5(pIndexEntry->FileOffsetBE);
+    memcpy(pItem->EncodingKey, pFindItem->EncodingKey, MD5_HASH_SIZE);
+    pItem->NameOffset = CASC_INVALID_ARENA_OFFSET;
+    pItem->dwLocaleFlags = pFindItem->dwLocaleFlags;
+    pItem->dwFileSize = pFindItem->dwFileSize;
+
+    // Copy the name, if any
+    if(szFileName != NULL && szFileName[0] != 0)
+    {
+        if(Arena_InsertString(&pSorted->NameArena, szFileName, strlen(szFileName), &pItem->NameOffset) == NULL)
+            return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    pSorted->ItemCount++;
+    return ERROR_SUCCESS;
+}
+
+// Performs the complete search and sorts the found files by their location in the data files.
+// The files are then returned in the order as they are stored, so reading them is near-sequential
+static int CreateSortedSearch(TCascSearch * pSearch)
+{
+    PCASC_SORTED_SEARCH pSorted;
+    CASC_FIND_ITEM FindItem;
+    int nError = ERROR_SUCCESS;
+
+    // Allocate the sorted search
+    pSorted = CASC_ALLOC(CASC_SORTED_SEARCH, 1);
+    if(pSorted == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+    memset(pSorted, 0, sizeof(CASC_SORTED_SEARCH));
+    Arena_Init(&pSorted->NameArena);
+
+    // All files will be searched, so it pays off to join the root entries
+    // with the encoding and index entries first. This is optional;
+    // if the join is not available, the search looks them up per entry
+    if(RootHandler_CreateJoin(pSearch->hs) == ERROR_SUCCESS)
+        pSearch->pJoinTable = pSearch->hs->pRootHandler->pJoinTable;
+
+    // Collect all files
+    while(nError == ERROR_SUCCESS && DoStorageSearch(pSearch, &FindItem))
+        nError = InsertSortedItem(pSorted, &FindItem, pSearch->szFoundName, pSearch->pIndexEntry);
+
+    // Sort the files by archive index and archive offset
+    if(nError == ERROR_SUCCESS && pSorted->ItemCount != 0)
+    {
+        pSorted->SortedItems = CASC_ALLOC(PCASC_SORTED_ITEM, pSorted->ItemCount);
+        if(pSorted->SortedItems != NULL)
+        {
+            for(size_t i = 0; i < pSorted->ItemCount; i++)
+                pSorted->SortedItems[i] = pSorted->pItems + i;
+            qsort_pointer_array((void **)pSorted->SortedItems, pSorted->ItemCount, CompareSortedItems_FilePos, NULL);
+        }
+        else
+        {
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+        }
+    }
+
+    if(nError != ERROR_SUCCESS)
+    {
+        FreeSortedSearch(pSorted);
+        return nError;
+    }
+
+    pSearch->pSortedSearch = pSorted;
+    return ERROR_SUCCESS;
+}
+
+static bool DoSortedSearch(TCascSearch * pSearch, PCASC_FIND_ITEM pFindItem)
+{
+    PCASC_SORTED_SEARCH pSorted = (PCASC_SORTED_SEARCH)pSearch->pSortedSearch;
+    PCASC_SORTED_ITEM pItem;
+
+    // Are there any more files?
+    if(pSorted->ItemIndex >= pSorted->ItemCount)
+        return false;
+    pItem = pSorted->SortedItems[pSorted->ItemIndex++];
+
+    // Fill-in the found file. The name stays in the arena
+    pSearch->szFoundName = NULL;
+    if(pItem->NameOffset != CASC_INVALID_ARENA_OFFSET)
+        pSearch->szFoundName = ARENA_POINTER(&pSorted->NameArena, pItem->NameOffset);
+    memcpy(pFindItem->EncodingKey, pItem->EncodingKey, MD5_HASH_SIZE);
+    pFindItem->dwLocaleFlags = pItem->dwLocaleFlags;
+    pFindItem->dwFileSize = pItem->dwFileSize;
+    return true;
+}
+
+// Finds the next file. The name of the file is in pSearch->szFoundName
+static bool DoSearch(TCascSearch * pSearch, PCASC_FIND_ITEM pFindItem)
+{
+    // Was there a file that did not fit into the caller's buffer?
+    if(pSearch->bItemPending)
+    {
+        memcpy(pFindItem, &pSearch->PendingItem, sizeof(CASC_FIND_ITEM));
+        pSearch->bItemPending = false;
+        return true;
+    }
+
+    if(pSearch->pSortedSearch != NULL)
+        return DoSortedSearch(pSearch, pFindItem);
+    return DoStorageSearch(pSearch, pFindItem);
+}
+
+static void FillFindData(TCascSearch * pSearch, PCASC_FIND_ITEM pFindItem, PCASC_FIND_DATA pFindData)
+{
+    pFindData->szFileName[0] = 0;
+    pFindData->szPlainName = NULL;
+    if(pSearch->szFoundName != NULL && pSearch->szFoundName[0] != 0)
+    {
+        strcpy(pFindData->szFileName, pSearch->szFoundName);
+        pFindData->szPlainName = (char *)GetPlainFileName(pFindData->szFileName);
+    }
+    memcpy(pFindData->EncodingKey, pFindItem->EncodingKey, MD5_HASH_SIZE);
+    pFindData->dwLocaleFlags = pFindItem->dwLocaleFlags;
+    pFindData->dwFileSize = pFindItem->dwFileSize;
+}
+
 //-----------------------------------------------------------------------------
 // Public functions
 
@@ -250,6 +475,16 @@ HANDLE WINAPI CascFindFirstFile(
     const char * szMask,
     PCASC_FIND_DATA pFindData,
     const TCHAR * szListFile)
+{
+    return CascFindFirstFileEx(hStorage, szMask, pFindData, szListFile, 0);
+}
+
+HANDLE WINAPI CascFindFirstFileEx(
+    HANDLE hStorage,
+    const char * szMask,
+    PCASC_FIND_DATA pFindData,
+    const TCHAR * szListFile,
+    DWORD dwSearchFlags)
 {
     TCascStorage * hs;
     TCascSearch * pSearch = NULL;
@@ -273,10 +508,14 @@ HANDLE WINAPI CascFindFirstFile(
             nError = ERROR_NOT_ENOUGH_MEMORY;
     }
 
+    // If the caller wants the files sorted, we need to find them all first
+    if(nError == ERROR_SUCCESS && (dwSearchFlags & CASC_FIND_SORT_BY_LOCATION))
+        nError = CreateSortedSearch(pSearch);
+
     // Perform search
     if(nError == ERROR_SUCCESS)
     {
-        if(!DoStorageSearch(pSearch, pFindData))
+        if(!CascFindNextFile((HANDLE)pSearch, pFindData))
             nError = ERROR_NO_MORE_FILES;
     }
 
@@ -284,17 +523,132 @@ HANDLE WINAPI CascFindFirstFile(
     {
         if(pSearch != NULL)
             FreeSearchHandle(pSearch);
+        SetLastError(nError);
         pSearch = NULL;
     }
     
     return (HANDLE)pSearch;
 }
 
+HANDLE WINAPI CascFindFirstFilePart(
+    HANDLE hStorage,
+    const char * szMask,
+    PCASC_FIND_DATA pFindData,
+    DWORD dwPartIndex,
+    DWORD dwPartCount)
+{
+    TCascStorage * hs;
+    TCascSearch * pSearch = NULL;
+    int nError = ERROR_SUCCESS;
+
+    // Check parameters
+    if((hs = IsValidStorageHandle(hStorage)) == NULL)
+        nError = ERROR_INVALID_HANDLE;
+    if(szMask == NULL || pFindData == NULL || dwPartCount == 0 || dwPartIndex >= dwPartCount)
+        nError = ERROR_INVALID_PARAMETER;
+
+    // The root handler must be able to split the search
+    if(nError == ERROR_SUCCESS)
+    {
+        if(hs->pRootHandler == NULL || (hs->pRootHandler->dwRootFlags & ROOT_FLAG_PARTITIONED_SEARCH) == 0)
+            nError = ERROR_NOT_SUPPORTED;
+    }
+
+    // Init the search structure and search handle
+    if(nError == ERROR_SUCCESS)
+    {
+        // Clear the entire search structure
+        memset(pFindData, 0, sizeof(CASC_FIND_DATA));
+
+        // Allocate the search handle
+        pSearch = AllocateSearchHandle(hs, NULL, szMask);
+        if(pSearch == NULL)
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Perform search
+    if(nError == ERROR_SUCCESS)
+    {
+        pSearch->dwPartIndex = dwPartIndex;
+        pSearch->dwPartCount = dwPartCount;
+
+        if(!CascFindNextFile((HANDLE)pSearch, pFindData))
+            nError = ERROR_NO_MORE_FILES;
+    }
+
+    if(nError != ERROR_SUCCESS)
+    {
+        if(pSearch != NULL)
+            FreeSearchHandle(pSearch);
+        SetLastError(nError);
+        pSearch = NULL;
+    }
+
+    return (HANDLE)pSearch;
+}
+
+// Searches one of dwPartCount disjoint parts of the encoding table.
+// Reports all encoding keys that have an index entry, with no names.
+// Each part has its own search handle, so the parts can be searched in parallel
+HANDLE WINAPI CascFindFirstEncodingKeyPart(
+    HANDLE hStorage,
+    PCASC_FIND_DATA pFindData,
+    DWORD dwPartIndex,
+    DWORD dwPartCount)
+{
+    TCascStorage * hs;
+    TCascSearch * pSearch = NULL;
+    ULONGLONG TableSize;
+    int nError = ERROR_SUCCESS;
+
+    // Check parameters
+    if((hs = IsValidStorageHandle(hStorage)) == NULL)
+        nError = ERROR_INVALID_HANDLE;
+    if(pFindData == NULL || dwPartCount == 0 || dwPartIndex >= dwPartCount)
+        nError = ERROR_INVALID_PARAMETER;
+
+    // Init the search structure and search handle
+    if(nError == ERROR_SUCCESS)
+    {
+        // Clear the entire search structure
+        memset(pFindData, 0, sizeof(CASC_FIND_DATA));
+
+        // Allocate the search handle. No need for the bit array
+        pSearch = AllocateSearchHandle(hs, NULL, "*", false);
+        if(pSearch == NULL)
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Perform search
+    if(nError == ERROR_SUCCESS)
+    {
+        // Start directly with the nameless search, limited to our part of the table
+        TableSize = hs->pEncodingMap->TableSize;
+        pSearch->IndexLevel1 = (size_t)((TableSize * dwPartIndex) / dwPartCount);
+        pSearch->EncodingIndexEnd = (size_t)((TableSize * (dwPartIndex + 1)) / dwPartCount);
+        pSearch->dwState = 2;
+
+        if(!CascFindNextFile((HANDLE)pSearch, pFindData))
+            nError = ERROR_NO_MORE_FILES;
+    }
+
+    if(nError != ERROR_SUCCESS)
+    {
+        if(pSearch != NULL)
+            FreeSearchHandle(pSearch);
+        SetLastError(nError);
+        pSearch = NULL;
+    }
+
+    return (HANDLE)pSearch;
+}
+
 bool WINAPI CascFindNextFile(
     HANDLE hFind,
     PCASC_FIND_DATA pFindData)
 {
     TCascSearch * pSearch;
+    CASC_FIND_ITEM FindItem;
 
     pSearch = IsValidSearchHandle(hFind);
     if(pSearch == NULL || pFindData == NULL)
@@ -304,7 +658,71 @@ bool WINAPI CascFindNextFile(
     }
 
     // Perform search
-    return DoStorageSearch(pSearch, pFindData);
+    if(!DoSearch(pSearch, &FindItem))
+        return false;
+
+    FillFindData(pSearch, &FindItem, pFindData);
+    return true;
+}
+
+// Returns up to dwMaxItems files at once. The file names are stored
+// in the name buffer; the items contain offsets of the names in the buffer
+bool WINAPI CascFindNextFiles(
+    HANDLE hFind,
+    PCASC_FIND_ITEM pItems,
+    DWORD dwMaxItems,
+    char * szNameBuffer,
+    DWORD cbNameBuffer,
+    PDWORD pdwItemCount)
+{
+    TCascSearch * pSearch;
+    PCASC_FIND_ITEM pItem = pItems;
+    DWORD dwItemCount = 0;
+    DWORD cbNameUsed = 0;
+    DWORD cbFileName;
+
+    pSearch = IsValidSearchHandle(hFind);
+    if(pSearch == NULL || pItems == NULL || dwMaxItems == 0 || pdwItemCount == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Fill as many items as possible
+    while(dwItemCount < dwMaxItems && DoSearch(pSearch, pItem))
+    {
+        pItem->NameOffset = CASC_INVALID_NAME_OFFSET;
+
+        // Copy the name, if any
+        if(pSearch->szFoundName != NULL && pSearch->szFoundName[0] != 0)
+        {
+            // If the name does not fit, keep the file for the next call
+            cbFileName = (DWORD)strlen(pSearch->szFoundName) + 1;
+            if(szNameBuffer == NULL || (cbNameUsed + cbFileName) > cbNameBuffer)
+            {
+                memcpy(&pSearch->PendingItem, pItem, sizeof(CASC_FIND_ITEM));
+                pSearch->bItemPending = true;
+                break;
+            }
+
+            memcpy(szNameBuffer + cbNameUsed, pSearch->szFoundName, cbFileName);
+            pItem->NameOffset = cbNameUsed;
+            cbNameUsed += cbFileName;
+        }
+
+        dwItemCount++;
+        pItem++;
+    }
+
+    // Nothing found at all?
+    pdwItemCount[0] = dwItemCount;
+    if(dwItemCount == 0)
+    {
+        SetLastError(pSearch->bItemPending ? ERROR_INSUFFICIENT_BUFFER : ERROR_NO_MORE_FILES);
+        return false;
+    }
+
+    return true;
 }
                
 bool WINAPI CascFindClose(HANDLE hFind)
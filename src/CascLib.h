@@ -82,10 +82,19 @@ extern "C" {
 
 // Values for CascOpenStorage
 #define CASC_STOR_XXXXX             0x00000001  // Not used
+#define CASC_STOR_MAP_DATA_FILES    0x00000002  // Map the data files to memory. Allows CascGetFileView to return the data without copying
+#define CASC_STOR_DIRECT_IO         0x00000004  // Read the data files bypassing the system cache. For scans that read everything once
+#define CASC_STOR_CACHE_LISTFILE    0x00000008  // Save a binary index of the listfile next to it (<listfile>.idx) and reuse it next time
 
 // Values for CascOpenFile
 #define CASC_FILE_XXXXX             0x00000001  // Not used
 
+// Flags for CascFindFirstFileEx
+#define CASC_FIND_SORT_BY_LOCATION  0x00000001  // Return the files sorted by their position in the data files
+
+// Value of CASC_FIND_ITEM::NameOffset for files without name
+#define CASC_INVALID_NAME_OFFSET    0xFFFFFFFF
+
 // Flags for file stream
 #define BASE_PROVIDER_FILE          0x00000000  // Base data source is a file
 #define BASE_PROVIDER_MAP           0x00000001  // Base data source is memory-mapped file
@@ -101,6 +110,8 @@ extern "C" {
 #define STREAM_FLAG_READ_ONLY       0x00000100  // Stream is read only
 #define STREAM_FLAG_WRITE_SHARE     0x00000200  // Allow write sharing when open for write
 #define STREAM_FLAG_USE_BITMAP      0x00000400  // If the file has a file bitmap, load it and use it
+#define STREAM_FLAG_HANDLE_POOL     0x00000800  // Read-only file whose handle can be closed and reopened (see CascSetFileHandleLimit)
+#define STREAM_FLAG_DIRECT_IO       0x00001000  // Read the file bypassing the system cache (O_DIRECT), if the file system allows it
 #define STREAM_OPTIONS_MASK         0x0000FF00  // Mask for stream options
 
 #define STREAM_PROVIDERS_MASK       0x000000FF  // Mask to get stream providers
@@ -166,6 +177,9 @@ extern "C" {
 // Flags for CascGetStorageInfo
 #define CASC_FEATURE_LISTFILE       0x00000001  // The storage supports listfile
 
+// Value for CascSetFileHandleLimit
+#define CASC_HANDLE_LIMIT_NONE      0xFFFFFFFF  // No limit for open data file handles (default)
+
 //-----------------------------------------------------------------------------
 // Structures
 
@@ -197,11 +211,48 @@ typedef struct _CASC_FIND_DATA
 
 } CASC_FIND_DATA, *PCASC_FIND_DATA;
 
+// Compact search result for CascFindNextFiles. The file names are stored
+// in the name buffer given by the caller, as zero-terminated strings
+typedef struct _CASC_FIND_ITEM
+{
+    BYTE   EncodingKey[MD5_HASH_SIZE];          // Encoding key
+    DWORD  NameOffset;                          // Offset of the file name in the name buffer (CASC_INVALID_NAME_OFFSET if the file has no name)
+    DWORD  dwLocaleFlags;                       // Locale flags (WoW only)
+    DWORD  dwFileSize;                          // Size of the file
+
+} CASC_FIND_ITEM, *PCASC_FIND_ITEM;
+
+// Progress information for CascExtractFiles
+typedef struct _CASC_EXTRACT_PROGRESS
+{
+    const char * szFileName;                    // Name of the file that has just been processed
+    int    nError;                              // Result of extracting the file
+    DWORD  dwFilesExtracted;                    // Number of files extracted so far
+    DWORD  dwFilesFailed;                       // Number of files that failed to extract
+    ULONGLONG BytesWritten;                     // Total number of bytes written so far
+
+} CASC_EXTRACT_PROGRESS, *PCASC_EXTRACT_PROGRESS;
+
+// Information about the data file handles, shared by all storages in the process
+typedef struct _CASC_FILE_HANDLE_INFO
+{
+    DWORD  dwMaxHandles;                        // Maximum number of open data file handles (CASC_HANDLE_LIMIT_NONE if no limit)
+    DWORD  dwOpenHandles;                       // Number of data file handles that are open now
+    ULONGLONG ReopenCount;                      // Number of times a data file had to be opened again
+    ULONGLONG CloseCount;                       // Number of handles closed to stay within the limit
+
+} CASC_FILE_HANDLE_INFO, *PCASC_FILE_HANDLE_INFO;
+
 //-----------------------------------------------------------------------------
 // Callback functions
 
 typedef struct TFileStream TFileStream;
 typedef void (WINAPI * STREAM_DOWNLOAD_CALLBACK)(void * pvUserData, ULONGLONG ByteOffset, DWORD dwTotalBytes);
+typedef bool (WINAPI * EXTRACT_PROGRESS_CALLBACK)(void * pvUserData, PCASC_EXTRACT_PROGRESS pProgress);   // Return false to cancel
+
+// Decompresses one frame. The input data begin after the codec byte, the output buffer
+// has the size of the decompressed frame. Returns ERROR_SUCCESS or an error code
+typedef int (WINAPI * DECOMPRESS_CALLBACK)(void * pvOutBuffer, PDWORD pcbOutBuffer, void * pvInBuffer, DWORD cbInBuffer);
 
 //-----------------------------------------------------------------------------
 // We have our own qsort implementation, optimized for sorting array of pointers
@@ -212,21 +263,33 @@ void qsort_pointer_array(void ** base, size_t num, int (*compare)(const void *,
 // Functions for storage manipulation
 
 bool  WINAPI CascOpenStorage(const TCHAR * szDataPath, DWORD dwLocaleMask, HANDLE * phStorage);
+bool  WINAPI CascOpenStorageEx(const TCHAR * szDataPath, DWORD dwLocaleMask, DWORD dwOpenFlags, HANDLE * phStorage);
 bool  WINAPI CascGetStorageInfo(HANDLE hStorage, CASC_STORAGE_INFO_CLASS InfoClass, void * pvStorageInfo, size_t cbStorageInfo, size_t * pcbLengthNeeded);
 bool  WINAPI CascCloseStorage(HANDLE hStorage);
 
+bool  WINAPI CascSetFileHandleLimit(DWORD dwMaxHandles);
+bool  WINAPI CascGetFileHandleInfo(PCASC_FILE_HANDLE_INFO pInfo);
+bool  WINAPI CascRegisterCodec(BYTE CodecId, DECOMPRESS_CALLBACK PfnDecompress);    // NULL restores the built-in codec
+
 bool  WINAPI CascOpenFileByIndexKey(HANDLE hStorage, PQUERY_KEY pIndexKey, DWORD dwFlags, HANDLE * phFile);
 bool  WINAPI CascOpenFileByEncodingKey(HANDLE hStorage, PQUERY_KEY pEncodingKey, DWORD dwFlags, HANDLE * phFile);
 bool  WINAPI CascOpenFile(HANDLE hStorage, const char * szFileName, DWORD dwLocale, DWORD dwFlags, HANDLE * phFile);
 DWORD WINAPI CascGetFileSize(HANDLE hFile, PDWORD pdwFileSizeHigh);
 DWORD WINAPI CascSetFilePointer(HANDLE hFile, LONG lFilePos, LONG * plFilePosHigh, DWORD dwMoveMethod);
 bool  WINAPI CascReadFile(HANDLE hFile, void * lpBuffer, DWORD dwToRead, PDWORD pdwRead);
+bool  WINAPI CascGetFileView(HANDLE hFile, const void ** ppvData, PDWORD pcbData);
 bool  WINAPI CascCloseFile(HANDLE hFile);
 
 HANDLE WINAPI CascFindFirstFile(HANDLE hStorage, const char * szMask, PCASC_FIND_DATA pFindData, const TCHAR * szListFile);
+HANDLE WINAPI CascFindFirstFileEx(HANDLE hStorage, const char * szMask, PCASC_FIND_DATA pFindData, const TCHAR * szListFile, DWORD dwSearchFlags);
+HANDLE WINAPI CascFindFirstFilePart(HANDLE hStorage, const char * szMask, PCASC_FIND_DATA pFindData, DWORD dwPartIndex, DWORD dwPartCount);
+HANDLE WINAPI CascFindFirstEncodingKeyPart(HANDLE hStorage, PCASC_FIND_DATA pFindData, DWORD dwPartIndex, DWORD dwPartCount);
 bool  WINAPI CascFindNextFile(HANDLE hFind, PCASC_FIND_DATA pFindData);
+bool  WINAPI CascFindNextFiles(HANDLE hFind, PCASC_FIND_ITEM pItems, DWORD dwMaxItems, char * szNameBuffer, DWORD cbNameBuffer, PDWORD pdwItemCount);
 bool  WINAPI CascFindClose(HANDLE hFind);
 
+bool  WINAPI CascExtractFiles(HANDLE hStorage, const char * szMask, const TCHAR * szListFile, const TCHAR * szTargetDir, DWORD dwThreadCount, EXTRACT_PROGRESS_CALLBACK PfnCallback, void * pvUserData);
+
 //-----------------------------------------------------------------------------
 // GetLastError/SetLastError support for non-Windows platform
 
@@ -106,6 +106,7 @@ class TGenericArray
     void SetMaxItems_PATH_STOP(DWORD NewMaxItemCount);
 
     void InsertOneItem_CHAR(char OneChar);
+    void InsertItems_CHARS(const char * NewItems, DWORD NewItemCount);
     void InsertOneItem_PATH_STOP(PATH_STOP & NewItem);
 
     void sub_19583A0(DWORD NewItemCount);
@@ -242,6 +243,7 @@ class TNameIndexStruct
     bool CheckNameFragment(TMndxFindResult * pStruct1C, DWORD dwFragOffs);
     bool CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWORD dwFragOffs);
     void CopyNameFragment(TMndxFindResult * pStruct1C, DWORD dwFragOffs);
+    bool IsFragmentBlockValid(DWORD dwFragOffs);
 
     void ExchangeWith(TNameIndexStruct & Target);
     int LoadFromStream(TByteStream & InStream);
@@ -345,6 +347,7 @@ typedef struct _MAR_FILE
     TFileNameDatabasePtr * pDatabasePtr;
     LPBYTE pbMarData;
     DWORD cbMarData;
+    bool bMarDataCopied;                        // If true, pbMarData is an own copy. Otherwise, it points into the ROOT file
 } MAR_FILE, *PMAR_FILE;
 
 //-----------------------------------------------------------------------------
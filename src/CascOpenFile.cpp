@@ -68,13 +68,76 @@ static TCascFile * CreateFileHandle(TCascStorage * hs, PCASC_INDEX_ENTRY pIndexE
         hf->FileSize = hf->CompressedSize;
 
         // Increment the number of references to the archive
-        hs->dwRefCount++;
+        CascInterlockedIncrement(&hs->dwRefCount);
         hf->hs = hs;
     }
 
     return hf;
 }
 
+// Creates handle to a file that is not in the local storage, but in the CDN directory.
+// The file is either in one of the CDN archives or it is a standalone file
+static TCascFile * CreateCdnFileHandle(TCascStorage * hs, PQUERY_KEY pIndexKey)
+{
+    PCASC_ARCHIVE_ENTRY pArchiveEntry;
+    TFileStream * pStream = NULL;
+    ULONGLONG StreamSize = 0;
+    TCascFile * hf;
+
+    // Find the file in the CDN archives. If it's not there, look for a loose file
+    pArchiveEntry = FindArchiveEntry(hs, pIndexKey);
+    if(pArchiveEntry == NULL)
+    {
+        pStream = OpenLooseFileStream(hs, pIndexKey);
+        if(pStream == NULL)
+            return NULL;
+
+        FileStream_GetSize(pStream, &StreamSize);
+        if(StreamSize > 0xFFFFFFFF)
+        {
+            FileStream_Close(pStream);
+            return NULL;
+        }
+    }
+
+    // Allocate the CASC file structure
+    hf = (TCascFile *)CASC_ALLOC(TCascFile, 1);
+    if(hf != NULL)
+    {
+        // Initialize the structure. Files in the CDN directory
+        // begin directly with the BLTE header
+        memset(hf, 0, sizeof(TCascFile));
+        hf->szClassName = "TCascFile";
+        hf->bCdnFile = true;
+
+        if(pArchiveEntry != NULL)
+        {
+            hf->ArchiveIndex = pArchiveEntry->ArchiveIndex;
+            hf->HeaderOffset = pArchiveEntry->ArchiveOffset;
+            hf->CompressedSize = pArchiveEntry->EncodedSize;
+        }
+        else
+        {
+            hf->pStream = pStream;
+            hf->bOwnStream = true;
+            hf->CompressedSize = (DWORD)StreamSize;
+        }
+
+        // See CreateFileHandle
+        hf->FileSize = hf->CompressedSize;
+
+        // Increment the number of references to the archive
+        CascInterlockedIncrement(&hs->dwRefCount);
+        hf->hs = hs;
+    }
+    else if(pStream != NULL)
+    {
+        FileStream_Close(pStream);
+    }
+
+    return hf;
+}
+
 static bool OpenFileByIndexKey(TCascStorage * hs, PQUERY_KEY pIndexKey, DWORD dwFlags, TCascFile ** ppCascFile)
 {
     PCASC_INDEX_ENTRY pIndexEntry;
@@ -82,21 +145,20 @@ static bool OpenFileByIndexKey(TCascStorage * hs, PQUERY_KEY pIndexKey, DWORD dw
 
     CASCLIB_UNUSED(dwFlags);
 
-    // Find the key entry in the array of file keys
+    // Find the key entry in the array of file keys. If the file
+    // is not in the local storage, try the CDN directory
     pIndexEntry = FindIndexEntry(hs, pIndexKey);
-    if(pIndexEntry == NULL)
-        nError = ERROR_FILE_NOT_FOUND;
-
-    // Create the file handle structure
-    if(nError == ERROR_SUCCESS)
-    {
+    if(pIndexEntry != NULL)
         ppCascFile[0] = CreateFileHandle(hs, pIndexEntry);
-        if(ppCascFile[0] == NULL)
-            nError = ERROR_FILE_NOT_FOUND;
-    }
+    else
+        ppCascFile[0] = CreateCdnFileHandle(hs, pIndexKey);
+
+    // Check whether the file handle was created
+    if(ppCascFile[0] == NULL)
+        nError = ERROR_FILE_NOT_FOUND;
 
 #ifdef CASCLIB_TEST
-    if(nError == ERROR_SUCCESS && ppCascFile[0] != NULL)
+    if(nError == ERROR_SUCCESS && pIndexEntry != NULL)
     {
         ppCascFile[0]->FileSize_IdxEntry = ConvertBytesToInteger_4_LE(pIndexEntry->FileSizeLE);
     }
@@ -258,6 +320,11 @@ bool WINAPI CascCloseFile(HANDLE hFile)
             CascCloseStorage((HANDLE)hf->hs);
         hf->hs = NULL;
 
+        // Close the stream of a loose CDN file
+        if(hf->bOwnStream && hf->pStream != NULL)
+            FileStream_Close(hf->pStream);
+        hf->pStream = NULL;
+
         // Free the file cache and frame array
         if(hf->pbFileCache != NULL)
             CASC_FREE(hf->pbFileCache);
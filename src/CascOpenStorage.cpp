@@ -629,6 +629,17 @@ static int LoadIndexFiles(TCascStorage * hs)
     memset(IndexArray, 0, sizeof(IndexArray));
     memset(OldIndexArray, 0, sizeof(OldIndexArray));
     nError = ScanIndexDirectory(hs->szIndexPath, IndexDirectory_OnFileFound, IndexArray, OldIndexArray, hs);
+
+    // If there are no local index files, the storage may be a mirror of the CDN.
+    // All files are then loaded from the CDN archives
+    if(nError == ERROR_SUCCESS && hs->szIndexFormat == NULL)
+    {
+        nError = LoadArchiveIndexes(hs);
+        if(nError == ERROR_SUCCESS)
+            nError = CreateArrayOfIndexEntries(hs);
+        return nError;
+    }
+
     if(nError == ERROR_SUCCESS)
     {
         // Load each index file
@@ -864,6 +875,8 @@ static int LoadRootFile(TCascStorage * hs, DWORD dwLocaleMask)
         {
             case CASC_MNDX_ROOT_SIGNATURE:
                 nError = RootHandler_CreateMNDX(hs, pbRootFile, cbRootFile);
+                if(nError == ERROR_SUCCESS)     // The MNDX handler keeps the ROOT file
+                    pbRootFile = NULL;
                 break;
 
             case CASC_DIABLO3_ROOT_SIGNATURE:
@@ -893,7 +906,8 @@ static int LoadRootFile(TCascStorage * hs, DWORD dwLocaleMask)
 #endif
 
     // Free the root file
-    CASC_FREE(pbRootFile);
+    if(pbRootFile != NULL)
+        CASC_FREE(pbRootFile);
     return nError;
 }
 
@@ -925,6 +939,9 @@ static TCascStorage * FreeCascStorage(TCascStorage * hs)
                 hs->DataFileArray[i] = NULL;
             }
         }
+        FreeArchiveIndexes(hs);
+        CascLock_Free(&hs->ArchiveLock);
+        CascLock_Free(&hs->StorageLock);
 
         // Close all key mappings
         for(i = 0; i < CASC_INDEX_COUNT; i++)
@@ -973,6 +990,11 @@ static TCascStorage * FreeCascStorage(TCascStorage * hs)
 // Public functions
 
 bool WINAPI CascOpenStorage(const TCHAR * szDataPath, DWORD dwLocaleMask, HANDLE * phStorage)
+{
+    return CascOpenStorageEx(szDataPath, dwLocaleMask, 0, phStorage);
+}
+
+bool WINAPI CascOpenStorageEx(const TCHAR * szDataPath, DWORD dwLocaleMask, DWORD dwOpenFlags, HANDLE * phStorage)
 {
     TCascStorage * hs;        
     int nError = ERROR_SUCCESS;
@@ -990,7 +1012,10 @@ bool WINAPI CascOpenStorage(const TCHAR * szDataPath, DWORD dwLocaleMask, HANDLE
         hs->szClassName = "TCascStorage";
         hs->dwFileBeginDelta = 0xFFFFFFFF;
         hs->dwDefaultLocale = CASC_LOCALE_ENUS | CASC_LOCALE_ENGB;
+        hs->dwOpenFlags = dwOpenFlags;
         hs->dwRefCount = 1;
+        CascLock_Init(&hs->StorageLock);
+        CascLock_Init(&hs->ArchiveLock);
         nError = InitializeCascDirectories(hs, szDataPath);
     }
 
@@ -1101,15 +1126,29 @@ bool WINAPI CascCloseStorage(HANDLE hStorage)
         return false;
     }
 
-    // Only free the storage if the reference count reaches 0
-    if(hs->dwRefCount == 1)
-    {
+    // Only free the storage if the reference count reaches 0.
+    // The count may be changed by other threads that read files
+    if(CascInterlockedDecrement(&hs->dwRefCount) == 0)
         FreeCascStorage(hs);
-        return true;
+    return true;
+}
+
+// Limits the number of data file handles that are open in the process.
+// The limit is shared by all storages. Data files whose handles were closed
+// because of the limit are opened again when needed
+bool WINAPI CascSetFileHandleLimit(DWORD dwMaxHandles)
+{
+    return FileStream_SetHandleLimit(dwMaxHandles);
+}
+
+bool WINAPI CascGetFileHandleInfo(PCASC_FILE_HANDLE_INFO pInfo)
+{
+    if(pInfo == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
     }
 
-    // Just decrement number of references
-    hs->dwRefCount--;
+    FileStream_GetHandleInfo(pInfo);
     return true;
 }
-
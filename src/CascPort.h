@@ -67,6 +67,12 @@
   #include <dirent.h>
   #include <errno.h>
   #include <stddef.h>
+  #include <time.h>
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <netdb.h>
+  #include <poll.h>
 
   // Support for PowerPC on Max OS X
   #if (__ppc__ == 1) || (__POWERPC__ == 1) || (_ARCH_PPC == 1)
@@ -111,6 +117,12 @@
   #include <ctype.h>
   #include <assert.h>
   #include <errno.h>
+  #include <time.h>
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <netdb.h>
+  #include <poll.h>
 
   #define PATH_SEPARATOR     '/'
   #define CREATE_DIRECTORY(name)    mkdir(name, 0755)
@@ -194,6 +206,8 @@
   #define stat64  stat
   #define fstat64 fstat
   #define lseek64 lseek
+  #define pread64 pread
+  #define pwrite64 pwrite
   #define ftruncate64 ftruncate
   #define off64_t off_t
   #define O_LARGEFILE 0
@@ -216,6 +230,7 @@
   #define ERROR_HANDLE_EOF               1002        // No such error code under Linux
   #define ERROR_CAN_NOT_COMPLETE         1003        // No such error code under Linux
   #define ERROR_FILE_CORRUPT             1004        // No such error code under Linux
+  #define ERROR_CANCELLED                1005        // No such error code under Linux
 #endif
 
 //-----------------------------------------------------------------------------
@@ -12,6 +12,11 @@
 #include "CascLib.h"
 #include "CascCommon.h"
 
+//-----------------------------------------------------------------------------
+// Local defines
+
+#define CASC_READAHEAD_SIZE     0x00100000      // How much of the following frames is read ahead when a file is read front to back
+
 //-----------------------------------------------------------------------------
 // Local structures
 
@@ -35,7 +40,24 @@ static int EnsureDataStreamIsOpen(TCascFile * hf)
     TCHAR * szDataFile;
     TCHAR szPlainName[0x40];
 
-    // If the file is not open yet, do it
+    // Loose files from the CDN directory have their own stream
+    if(hf->bOwnStream)
+        return (hf->pStream != NULL) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+
+    // Files from the CDN archives share the archive streams
+    if(hf->bCdnFile)
+    {
+        CascLock_Enter(&hs->StorageLock);
+        if(hs->ArchiveStreams[hf->ArchiveIndex] == NULL)
+            hs->ArchiveStreams[hf->ArchiveIndex] = OpenArchiveStream(hs, hf->ArchiveIndex);
+        hf->pStream = hs->ArchiveStreams[hf->ArchiveIndex];
+        CascLock_Leave(&hs->StorageLock);
+        return (hf->pStream != NULL) ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+    }
+
+    // If the file is not open yet, do it. More threads may be reading
+    // files from the same storage, so the data file must only be open once
+    CascLock_Enter(&hs->StorageLock);
     if(hs->DataFileArray[hf->ArchiveIndex] == NULL)
     {
         // Prepare the name of the data file
@@ -46,11 +68,12 @@ static int EnsureDataStreamIsOpen(TCascFile * hf)
         if(szDataFile != NULL)
         {
             // Open the stream
-            pStream = FileStream_OpenFile(szDataFile, STREAM_FLAG_READ_ONLY | STREAM_PROVIDER_FLAT | BASE_PROVIDER_FILE);
+            pStream = OpenDataFileStream(hs, szDataFile);
             hs->DataFileArray[hf->ArchiveIndex] = pStream;
             CASC_FREE(szDataFile);
         }
     }
+    CascLock_Leave(&hs->StorageLock);
 
     // Return error or success
     hf->pStream = hs->DataFileArray[hf->ArchiveIndex];
@@ -89,6 +112,7 @@ static int LoadFileFrames(TCascFile * hf)
                 hf->pFrames[i].CompressedSize = ConvertBytesToInteger_4(pFileFrame->CompressedSize);
                 hf->pFrames[i].FrameSize = ConvertBytesToInteger_4(pFileFrame->FrameSize);
                 memcpy(hf->pFrames[i].md5, pFileFrame->md5, MD5_HASH_SIZE);
+                hf->pFrames[i].bVerified = false;
 
                 ArchiveFileOffset += hf->pFrames[i].CompressedSize;
                 FrameOffset += hf->pFrames[i].FrameSize;
@@ -116,6 +140,47 @@ static int LoadFileFrames(TCascFile * hf)
     return nError;
 }
 
+// Files in the CDN directory have no header area. The BLTE header
+// is at the begin of the file and the size covers just the BLTE data
+static int LoadCdnFileHeader(TCascFile * hf)
+{
+    ULONGLONG FileOffset = hf->HeaderOffset;
+    BYTE Header[0x0C];
+
+    // Load the signature, the header size and the frame count.
+    // Files with just one frame have no frame count
+    if(hf->CompressedSize < 8)
+        return ERROR_BAD_FORMAT;
+    if(!FileStream_Read(hf->pStream, &FileOffset, Header, CASCLIB_MIN(hf->CompressedSize, sizeof(Header))))
+        return ERROR_FILE_CORRUPT;
+
+    // Verify the BLTE signature
+    if(ConvertBytesToInteger_4_LE(Header) != BLTE_HEADER_SIGNATURE)
+        return ERROR_BAD_FORMAT;
+
+    // Load the size of the frame headers
+    hf->HeaderSize = ConvertBytesToInteger_4(Header + 4);
+    if(hf->HeaderSize & 0x80000000)
+        return ERROR_BAD_FORMAT;
+
+    // Retrieve the frame count. If there is just one frame, it follows the header
+    if(hf->HeaderSize != 0)
+    {
+        if(hf->CompressedSize < sizeof(Header) || Header[8] != 0x0F)
+            return ERROR_BAD_FORMAT;
+        hf->FrameCount = ConvertBytesToInteger_3(Header + 9);
+        if(hf->FrameCount == 0)
+            return ERROR_BAD_FORMAT;
+    }
+    else
+    {
+        hf->CompressedSize -= 8;
+        hf->FrameCount = 1;
+    }
+
+    return ERROR_SUCCESS;
+}
+
 static int EnsureHeaderAreaIsLoaded(TCascFile * hf)
 {
     TCascStorage * hs = hf->hs;
@@ -131,6 +196,10 @@ static int EnsureHeaderAreaIsLoaded(TCascFile * hf)
     if(nError != ERROR_SUCCESS)
         return nError;
 
+    // Files in the CDN directory begin directly with the BLTE header
+    if(hf->bCdnFile)
+        return (hf->FrameCount == 0) ? LoadCdnFileHeader(hf) : ERROR_SUCCESS;
+
     // Make sure that we already know the shift
     // to the begin of file data.
     // Note that older builds of Heroes of the Storm have entries pointing
@@ -231,6 +300,7 @@ static int EnsureFrameHeadersLoaded(TCascFile * hf)
                 hf->pFrames[0].CompressedSize = hf->CompressedSize;
                 hf->pFrames[0].FrameSize      = hf->FileSize;
                 memset(hf->pFrames[0].md5, 0, MD5_HASH_SIZE);
+                hf->pFrames[0].bVerified = false;
             }
         }
 
@@ -265,6 +335,322 @@ static PCASC_FILE_FRAME FindFileFrame(TCascFile * hf, DWORD FilePointer)
     return NULL;
 }
 
+// Loads raw data from the data file. If the data file is open for direct I/O,
+// the read is extended to aligned boundaries, so it goes from the disk directly
+// to the buffer. The buffer must be freed by FreeRawData, together with *pbAligned
+// that tells how it was allocated. The data may go beyond the end of the data file;
+// then the missing part is zeroed and *pbTruncated is set
+static int ReadRawData(TCascFile * hf, DWORD ArchiveOffset, DWORD cbData, LPBYTE * ppbBuffer, LPBYTE * ppbData, bool * pbAligned, bool * pbTruncated)
+{
+    ULONGLONG StreamSize = 0;
+    ULONGLONG ByteOffset;
+    ULONGLONG cbAligned;
+    LPBYTE pbBuffer;
+    DWORD dwAlignMask = FileStream_GetAlignment(hf->pStream) - 1;
+    DWORD dwPadding = ArchiveOffset & dwAlignMask;
+    DWORD cbToRead;
+    DWORD cbLoaded;
+    bool bAligned = (dwAlignMask != 0);
+    int nError = ERROR_SUCCESS;
+
+    // The size comes from the file, the aligned size must not overflow
+    cbAligned = ((ULONGLONG)dwPadding + cbData + dwAlignMask) & ~(ULONGLONG)dwAlignMask;
+    if(cbAligned > 0xFFFFFFFF)
+        return ERROR_FILE_CORRUPT;
+    cbToRead = (DWORD)cbAligned;
+
+    // Allocate the buffer
+    pbBuffer = bAligned ? FileStream_AllocAligned(cbToRead) : CASC_ALLOC(BYTE, cbToRead);
+    if(pbBuffer == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Load the data, together with the alignment
+    ByteOffset = ArchiveOffset - dwPadding;
+    if(!FileStream_Read(hf->pStream, &ByteOffset, pbBuffer, cbToRead))
+    {
+        // Load the part that is in the data file and zero the rest.
+        // Note that just the alignment may go beyond the end of the file
+        nError = GetLastError();
+        if(nError == ERROR_HANDLE_EOF)
+        {
+            FileStream_GetSize(hf->pStream, &StreamSize);
+            if(ByteOffset < StreamSize && (StreamSize - ByteOffset) < cbToRead)
+            {
+                cbLoaded = (DWORD)(StreamSize - ByteOffset);
+                if(FileStream_Read(hf->pStream, &ByteOffset, pbBuffer, cbLoaded))
+                {
+                    memset(pbBuffer + cbLoaded, 0, cbToRead - cbLoaded);
+                    pbTruncated[0] = (cbLoaded < dwPadding + cbData);
+                    nError = ERROR_SUCCESS;
+                }
+            }
+        }
+
+        if(nError != ERROR_SUCCESS)
+        {
+            FreeRawData(pbBuffer, bAligned);
+            return nError;
+        }
+    }
+
+    // Give the data to the caller
+    ppbBuffer[0] = pbBuffer;
+    ppbData[0] = pbBuffer + dwPadding;
+    pbAligned[0] = bAligned;
+    return ERROR_SUCCESS;
+}
+
+// The file is being read front to back. Ask the system to read the following
+// frames in advance. Note that the data files are shared by all open files,
+// so this only covers the range of this file instead of changing the access
+// pattern of the entire data file
+static void AdviseReadAhead(TCascFile * hf, PCASC_FILE_FRAME pFrame)
+{
+    PCASC_FILE_FRAME pLastFrame = hf->pFrames + hf->FrameCount - 1;
+    DWORD RangeBegin = CASCLIB_MAX(pFrame->FrameArchiveOffset, hf->ReadAheadEnd);
+    DWORD RangeEnd = pLastFrame->FrameArchiveOffset + pLastFrame->CompressedSize;
+
+    // Don't advise again until half of the previous range has been read
+    if(hf->ReadAheadEnd >= pFrame->FrameArchiveOffset + (CASC_READAHEAD_SIZE / 2))
+        return;
+
+    RangeEnd = CASCLIB_MIN(RangeEnd, pFrame->FrameArchiveOffset + CASC_READAHEAD_SIZE);
+    if(RangeBegin < RangeEnd)
+    {
+        FileStream_Advise(hf->pStream, RangeBegin, RangeEnd - RangeBegin, STREAM_ADVICE_WILLNEED);
+        hf->ReadAheadEnd = RangeEnd;
+    }
+}
+
+// Loads the frame to the file cache, unless it is there already
+static int EnsureFrameIsCached(TCascFile * hf, PCASC_FILE_FRAME pFrame)
+{
+    LPBYTE pbRawBuffer;
+    LPBYTE pbRawData;
+    DWORD dwFrameStart = pFrame->FrameFileOffset;
+    DWORD dwFrameEnd = pFrame->FrameFileOffset + pFrame->FrameSize;
+    DWORD cbOutBuffer;
+    bool bTruncated = false;
+    bool bAligned = false;
+    int nError;
+
+    // Is the frame in the cache already?
+    if(dwFrameStart == hf->CacheStart && hf->CacheEnd == dwFrameEnd)
+        return ERROR_SUCCESS;
+
+    // If the cache holds the previous frame, the file is read front to back
+    if(pFrame > hf->pFrames && hf->CacheEnd == dwFrameStart && hf->CacheEnd != 0)
+        AdviseReadAhead(hf, pFrame);
+
+    // Shall we reallocate the cache buffer?
+    if(pFrame->FrameSize > hf->cbFileCache)
+    {
+        if(hf->pbFileCache != NULL)
+            CASC_FREE(hf->pbFileCache);
+        hf->cbFileCache = 0;
+
+        hf->pbFileCache = CASC_ALLOC(BYTE, pFrame->FrameSize);
+        if(hf->pbFileCache == NULL)
+            return ERROR_NOT_ENOUGH_MEMORY;
+        hf->cbFileCache = pFrame->FrameSize;
+    }
+
+    // Invalidate the cache until it is filled again
+    hf->CacheStart = hf->CacheEnd = 0;
+
+    // Load the raw file data to memory
+    nError = ReadRawData(hf, pFrame->FrameArchiveOffset, pFrame->CompressedSize, &pbRawBuffer, &pbRawData, &bAligned, &bTruncated);
+    if(nError != ERROR_SUCCESS)
+        return nError;
+
+    // Note: The raw file data size could be less than expected
+    // Happened in WoW build 19342 with the ROOT file. MD5 in the frame header
+    // is zeroed, which means it should not be checked
+    // Frame File: data.029
+    // Frame Offs: 0x013ED9F0 size 0x01325B32
+    // Frame End:  0x02713522
+    // File Size:  0x027134FC
+    if(bTruncated && IsValidMD5(pFrame->md5))
+    {
+        FreeRawData(pbRawBuffer, bAligned);
+        return ERROR_HANDLE_EOF;
+    }
+
+    // Verify the block MD5
+    if(!VerifyDataBlockHash(pbRawData, pFrame->CompressedSize, pFrame->md5))
+    {
+        FreeRawData(pbRawBuffer, bAligned);
+        return ERROR_FILE_CORRUPT;
+    }
+
+    // Decompress the file frame
+    cbOutBuffer = pFrame->FrameSize;
+    nError = CascDecompress(hf->pbFileCache, &cbOutBuffer, pbRawData, pFrame->CompressedSize);
+    FreeRawData(pbRawBuffer, bAligned);
+    if(nError != ERROR_SUCCESS || cbOutBuffer != pFrame->FrameSize)
+        return ERROR_FILE_CORRUPT;
+
+    // Set the start and end of the cache
+    hf->CacheStart = dwFrameStart;
+    hf->CacheEnd = dwFrameEnd;
+    return ERROR_SUCCESS;
+}
+
+// If the frame is stored uncompressed ('N') in a mapped data file,
+// gives the pointer to the frame data in the mapping. Otherwise returns NULL
+static LPBYTE GetMappedFrameData(TCascFile * hf, PCASC_FILE_FRAME pFrame, int * pnError)
+{
+    ULONGLONG StreamSize = 0;
+    LPBYTE pbFrameData;
+    LPBYTE pbMapped;
+
+    // Only frames lying entirely within the mapped file can be used
+    pbMapped = FileStream_GetMappedData(hf->pStream, &StreamSize);
+    if(pbMapped == NULL || (ULONGLONG)pFrame->FrameArchiveOffset + pFrame->CompressedSize > StreamSize)
+        return NULL;
+
+    // The frame must be stored without compression
+    pbFrameData = pbMapped + pFrame->FrameArchiveOffset;
+    if(pFrame->CompressedSize != pFrame->FrameSize + 1 || pbFrameData[0] != 'N')
+        return NULL;
+
+    // Verify the frame MD5, if not done yet. Ask the system to load the frame
+    // first, because the data files are mapped for random access
+    if(pFrame->bVerified == false)
+    {
+        FileStream_Advise(hf->pStream, pFrame->FrameArchiveOffset, pFrame->CompressedSize, STREAM_ADVICE_WILLNEED);
+        if(!VerifyDataBlockHash(pbFrameData, pFrame->CompressedSize, pFrame->md5))
+        {
+            pnError[0] = ERROR_FILE_CORRUPT;
+            return NULL;
+        }
+        pFrame->bVerified = true;
+    }
+
+    return pbFrameData + 1;
+}
+
+//-----------------------------------------------------------------------------
+// Internal functions for opening the data files
+
+// Opens a data file (data.### or a CDN archive). If the storage has been open
+// with CASC_STOR_MAP_DATA_FILES, the file is mapped to memory, so the data
+// of uncompressed frames can be given to the caller without copying
+TFileStream * OpenDataFileStream(TCascStorage * hs, const TCHAR * szFileName)
+{
+    TFileStream * pStream = NULL;
+    DWORD dwStreamFlags;
+
+    if(hs->dwOpenFlags & CASC_STOR_MAP_DATA_FILES)
+        pStream = FileStream_OpenFile(szFileName, STREAM_FLAG_READ_ONLY | STREAM_PROVIDER_FLAT | BASE_PROVIDER_MAP);
+
+    // If the file cannot be mapped (e.g. not enough address space), read it normally
+    if(pStream == NULL)
+    {
+        dwStreamFlags = (hs->dwOpenFlags & CASC_STOR_DIRECT_IO) ? STREAM_FLAG_DIRECT_IO : 0;
+        pStream = FileStream_OpenFile(szFileName, dwStreamFlags | STREAM_FLAG_READ_ONLY | STREAM_FLAG_HANDLE_POOL | STREAM_PROVIDER_FLAT | BASE_PROVIDER_FILE);
+    }
+
+    // Files are read from random places, so the default readahead is of no use.
+    // Files read front to back ask for readahead of their own range (see AdviseReadAhead)
+    if(pStream != NULL)
+        FileStream_Advise(pStream, 0, 0, STREAM_ADVICE_RANDOM);
+    return pStream;
+}
+
+//-----------------------------------------------------------------------------
+// Internal functions for bulk extraction. The raw data of all frames
+// are loaded with a single read, so they can be decoded by another thread
+
+int LoadRawFileData(TCascFile * hf, LPBYTE * ppbRawBuffer, LPBYTE * ppbRawData, PDWORD pcbRawData, bool * pbAligned)
+{
+    PCASC_FILE_FRAME pLastFrame;
+    ULONGLONG RawDataEnd;
+    LPBYTE pbRawBuffer;
+    LPBYTE pbRawData;
+    DWORD cbRawData;
+    bool bTruncated = false;
+    bool bAligned = false;
+    int nError;
+
+    // Make sure that we know all file frames
+    nError = EnsureFrameHeadersLoaded(hf);
+    if(nError != ERROR_SUCCESS)
+        return nError;
+
+    // The frames are stored right after each other. Load all frames at once.
+    // The last frame may go beyond the end of the data file (see EnsureFrameIsCached);
+    // frames with valid MD5 will then fail the check
+    if(hf->FrameCount == 0)
+        return ERROR_BAD_FORMAT;
+    pLastFrame = hf->pFrames + hf->FrameCount - 1;
+    RawDataEnd = (ULONGLONG)pLastFrame->FrameArchiveOffset + pLastFrame->CompressedSize;
+    if(RawDataEnd <= hf->pFrames[0].FrameArchiveOffset || (RawDataEnd - hf->pFrames[0].FrameArchiveOffset) > 0xFFFFFFFF)
+        return ERROR_FILE_CORRUPT;
+    cbRawData = (DWORD)(RawDataEnd - hf->pFrames[0].FrameArchiveOffset);
+    nError = ReadRawData(hf, hf->pFrames[0].FrameArchiveOffset, cbRawData, &pbRawBuffer, &pbRawData, &bAligned, &bTruncated);
+    if(nError != ERROR_SUCCESS)
+        return nError;
+
+    // The raw data are only loaded for bulk extraction, which reads every file
+    // just once. Drop them from the system cache, so they don't push out data
+    // that other readers of the storage need
+    FileStream_Advise(hf->pStream, hf->pFrames[0].FrameArchiveOffset, cbRawData, STREAM_ADVICE_DONTNEED);
+
+    // Give the data to the caller
+    ppbRawBuffer[0] = pbRawBuffer;
+    ppbRawData[0] = pbRawData;
+    pcbRawData[0] = cbRawData;
+    pbAligned[0] = bAligned;
+    return ERROR_SUCCESS;
+}
+
+// Frees the buffer with raw data. The stream may have been reopened without
+// direct I/O in the meantime, so the allocator is given by the caller
+void FreeRawData(LPBYTE pbRawBuffer, bool bAligned)
+{
+    if(bAligned)
+        FileStream_FreeAligned(pbRawBuffer);
+    else
+        CASC_FREE(pbRawBuffer);
+}
+
+// Returns the size of the buffer needed for all decoded frames
+DWORD GetDecodedFileSize(TCascFile * hf)
+{
+    PCASC_FILE_FRAME pLastFrame = hf->pFrames + hf->FrameCount - 1;
+
+    assert(hf->pFrames != NULL);
+    return pLastFrame->FrameFileOffset + pLastFrame->FrameSize;
+}
+
+// Verifies and decompresses all frames loaded by LoadRawFileData
+int DecodeRawFileData(TCascFile * hf, LPBYTE pbRawData, LPBYTE pbFileData)
+{
+    PCASC_FILE_FRAME pFrame = hf->pFrames;
+    LPBYTE pbFrameData;
+    DWORD cbOutBuffer;
+    int nError;
+
+    assert(hf->pFrames != NULL);
+
+    for(DWORD i = 0; i < hf->FrameCount; i++, pFrame++)
+    {
+        // Verify the frame MD5
+        pbFrameData = pbRawData + (pFrame->FrameArchiveOffset - hf->pFrames[0].FrameArchiveOffset);
+        if(!VerifyDataBlockHash(pbFrameData, pFrame->CompressedSize, pFrame->md5))
+            return ERROR_FILE_CORRUPT;
+
+        // Decompress the frame to its place in the file
+        cbOutBuffer = pFrame->FrameSize;
+        nError = CascDecompress(pbFileData + pFrame->FrameFileOffset, &cbOutBuffer, pbFrameData, pFrame->CompressedSize);
+        if(nError != ERROR_SUCCESS || cbOutBuffer != pFrame->FrameSize)
+            return ERROR_FILE_CORRUPT;
+    }
+
+    return ERROR_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 // Public functions
 
@@ -380,16 +766,11 @@ DWORD WINAPI CascSetFilePointer(HANDLE hFile, LONG lFilePos, LONG * plFilePosHig
 bool WINAPI CascReadFile(HANDLE hFile, void * pvBuffer, DWORD dwBytesToRead, PDWORD pdwBytesRead)
 {
     PCASC_FILE_FRAME pFrame = NULL;
-    ULONGLONG StreamSize;
-    ULONGLONG FileOffset;
     TCascFile * hf;
     LPBYTE pbBuffer = (LPBYTE)pvBuffer;
     DWORD dwStartPointer = 0;
     DWORD dwFilePointer = 0;
     DWORD dwEndPointer = 0;
-    DWORD dwFrameSize;
-    DWORD cbOutBuffer;
-    bool bReadResult;
     int nError = ERROR_SUCCESS;
 
     // The buffer must be valid
@@ -440,89 +821,13 @@ bool WINAPI CascReadFile(HANDLE hFile, void * pvBuffer, DWORD dwBytesToRead, PDW
         // Perform block read from each file frame
         while(dwFilePointer < dwEndPointer)
         {
-            LPBYTE pbRawData = NULL;
             DWORD dwFrameStart = pFrame->FrameFileOffset;
             DWORD dwFrameEnd = pFrame->FrameFileOffset + pFrame->FrameSize;
 
-            // Shall we populate the cache with a new data?
-            if(dwFrameStart != hf->CacheStart || hf->CacheEnd != dwFrameEnd)
-            {
-                // Shall we reallocate the cache buffer?
-                if(pFrame->FrameSize > hf->cbFileCache)
-                {
-                    if(hf->pbFileCache != NULL)
-                        CASC_FREE(hf->pbFileCache);
-                    
-                    hf->pbFileCache = CASC_ALLOC(BYTE, pFrame->FrameSize);
-                    hf->cbFileCache = pFrame->FrameSize;
-                }
-
-                // We also need to allocate buffer for the raw data
-                pbRawData = CASC_ALLOC(BYTE, pFrame->CompressedSize);
-                if(pbRawData == NULL)
-                {
-                    nError = ERROR_NOT_ENOUGH_MEMORY;
-                    break;
-                }
-
-                // Load the raw file data to memory
-                FileOffset = pFrame->FrameArchiveOffset;
-                bReadResult = FileStream_Read(hf->pStream, &FileOffset, pbRawData, pFrame->CompressedSize);
-                
-                // Note: The raw file data size could be less than expected
-                // Happened in WoW build 19342 with the ROOT file. MD5 in the frame header
-                // is zeroed, which means it should not be checked
-                // Frame File: data.029
-                // Frame Offs: 0x013ED9F0 size 0x01325B32
-                // Frame End:  0x02713522
-                // File Size:  0x027134FC
-                if(bReadResult == false && GetLastError() == ERROR_HANDLE_EOF && !IsValidMD5(pFrame->md5))
-                {
-                    // Get the size of the remaining file
-                    FileStream_GetSize(hf->pStream, &StreamSize);
-                    dwFrameSize = (DWORD)(StreamSize - FileOffset);
-
-                    // If the frame offset is before EOF and frame end is beyond EOF, correct it
-                    if(FileOffset < StreamSize && dwFrameSize < pFrame->CompressedSize)
-                    {
-                        memset(pbRawData + dwFrameSize, 0, (pFrame->CompressedSize - dwFrameSize));
-                        bReadResult = true;
-                    }
-                }
-
-                // If the read result failed, we cannot finish reading it
-                if(bReadResult == false)
-                {
-                    CASC_FREE(pbRawData);
-                    nError = GetLastError();
-                    break;
-                }
-
-                // Verify the block MD5
-                if(!VerifyDataBlockHash(pbRawData, pFrame->CompressedSize, pFrame->md5))
-                {
-                    CASC_FREE(pbRawData);
-                    nError = ERROR_FILE_CORRUPT;
-                    break;
-                }
-
-                // Decompress the file frame
-                cbOutBuffer = pFrame->FrameSize;
-                nError = CascDecompress(hf->pbFileCache, &cbOutBuffer, pbRawData, pFrame->CompressedSize);
-                if(nError != ERROR_SUCCESS || cbOutBuffer != pFrame->FrameSize)
-                {
-                    CASC_FREE(pbRawData);
-                    nError = ERROR_FILE_CORRUPT;
-                    break;
-                }
-
-                // Set the start and end of the cache
-                hf->CacheStart = dwFrameStart;
-                hf->CacheEnd = dwFrameEnd;
-
-                // Free the decompress buffer, if needed
-                CASC_FREE(pbRawData);
-            }
+            // Make sure that the frame is loaded in the cache
+            nError = EnsureFrameIsCached(hf, pFrame);
+            if(nError != ERROR_SUCCESS)
+                break;
 
             // Copy the decompressed data
             if(dwFrameEnd > dwEndPointer)
@@ -549,3 +854,77 @@ bool WINAPI CascReadFile(HANDLE hFile, void * pvBuffer, DWORD dwBytesToRead, PDW
     return (nError == ERROR_SUCCESS);
 }
 
+// Gives a read-only pointer to the file data at the current file position,
+// up to the end of the file frame, and moves the file position behind it.
+// If the storage has been open with CASC_STOR_MAP_DATA_FILES and the frame
+// is stored uncompressed, the pointer goes directly to the mapped data file
+// and stays valid until the storage is closed. Otherwise, the frame is decoded
+// to the file cache and the pointer is valid until the next read from the file
+bool WINAPI CascGetFileView(HANDLE hFile, const void ** ppvData, PDWORD pcbData)
+{
+    PCASC_FILE_FRAME pFrame;
+    TCascFile * hf;
+    LPBYTE pbFrameData;
+    DWORD dwFrameEnd;
+    int nError = ERROR_SUCCESS;
+
+    // The output pointers must be valid
+    if(ppvData == NULL || pcbData == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    // Validate the file handle
+    if((hf = IsValidFileHandle(hFile)) == NULL)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    // If the file frames are not loaded yet, do it now
+    nError = EnsureFrameHeadersLoaded(hf);
+    if(nError != ERROR_SUCCESS)
+    {
+        SetLastError(nError);
+        return false;
+    }
+
+    // If the file position is at or beyond end of file, there is nothing to give
+    if(hf->FilePointer >= hf->FileSize)
+    {
+        ppvData[0] = NULL;
+        pcbData[0] = 0;
+        return true;
+    }
+
+    // Find the file frame at the file position
+    pFrame = FindFileFrame(hf, hf->FilePointer);
+    if(pFrame == NULL)
+    {
+        SetLastError(ERROR_FILE_CORRUPT);
+        return false;
+    }
+
+    // Prefer the data in the mapped file. If not possible, decode the frame
+    pbFrameData = GetMappedFrameData(hf, pFrame, &nError);
+    if(pbFrameData == NULL && nError == ERROR_SUCCESS)
+    {
+        nError = EnsureFrameIsCached(hf, pFrame);
+        pbFrameData = hf->pbFileCache;
+    }
+
+    if(nError != ERROR_SUCCESS)
+    {
+        SetLastError(nError);
+        return false;
+    }
+
+    // Give the rest of the frame, but not more than the file size
+    dwFrameEnd = CASCLIB_MIN(pFrame->FrameFileOffset + pFrame->FrameSize, hf->FileSize);
+    ppvData[0] = pbFrameData + (hf->FilePointer - pFrame->FrameFileOffset);
+    pcbData[0] = dwFrameEnd - hf->FilePointer;
+    hf->FilePointer = dwFrameEnd;
+    return true;
+}
+
@@ -150,6 +150,31 @@ typedef struct _CASC_DIRECTORY
 
 } CASC_DIRECTORY, *PCASC_DIRECTORY;
 
+// A file that is loaded by a worker thread. Directory files are also parsed
+typedef struct _DIABLO3_LOAD_ITEM
+{
+    LPBYTE pbEncodingKey;                           // Encoding key of the file. NULL if the file is not present
+    const char * szSubDirName;                      // Name of the level-0 directory. NULL if the file is not a directory
+    LPBYTE pbFileData;                              // Content of the loaded file
+    DWORD cbFileData;                               // Length of the loaded file
+
+    DIABLO3_DIR_HEADER DirHeader;                   // Parsed header of the directory file
+    PCASC_DIRECTORY pDirectory;                     // Parsed directory, before it is merged to the root handler
+    PULONGLONG pNameHashes;                         // Hashes of the named entries of the directory
+    int nError;                                     // Result of loading and parsing
+
+} DIABLO3_LOAD_ITEM, *PDIABLO3_LOAD_ITEM;
+
+// Shared context of the worker threads
+typedef struct _DIABLO3_LOAD_CONTEXT
+{
+    TCascStorage * hs;                              // The storage to load the files from
+    PDIABLO3_LOAD_ITEM pItems;                      // Array of files to load
+    DWORD dwItemCount;                              // Number of files to load
+    DWORD dwNextItem;                               // Index of the next file to be picked by a worker
+
+} DIABLO3_LOAD_CONTEXT, *PDIABLO3_LOAD_CONTEXT;
+
 //-----------------------------------------------------------------------------
 // Structure definitions for Diablo3 root file
 
@@ -170,10 +195,11 @@ struct TRootHandler_Diablo3 : public TRootHandler
     DWORD dwFileCountMax;                           // Maximum number of files in the table
     DWORD dwFileCount;                              // Current number of files in the table
 
-    // Linear global list of names
-    char * szFileNames;                             // Pointer to global name buffer
-    size_t cbFileNamesMax;                          // Maximum size of the name buffer
-    size_t cbFileNames;                             // Current size of the name buffer
+    // Global storage of names
+    CASC_ARENA NameArena;                           // Plain names and full names of all files
+
+    // Precomposed full names, indexed by file table index
+    PDWORD pFullNames;                              // Arena offsets of the full names (NULL = create on search)
 };
 
 //-----------------------------------------------------------------------------
@@ -375,6 +401,7 @@ static const char * CreateFileName(
     PDIABLO3_ASSET_INFO pAssetInfo = &UnknownAsset;
     char * szSaveBuffer = szBuffer;
     char * szBufferEnd = szBuffer + MAX_PATH;
+    char szSubName[0x20];
 
     // Retrieve the asset. If the asset is unknown, put a placeholder
     if(dwAssetIndex < DIABLO3_ASSET_COUNT && Assets[dwAssetIndex].szDirectoryName != NULL)
@@ -382,7 +409,7 @@ static const char * CreateFileName(
 
     // Append the level-0 directory name
     if(pParent != NULL)
-        szBuffer = AppendPathElement(szBuffer, szBufferEnd, pRootHandler->szFileNames + pParent->NameOffset, '\\');
+        szBuffer = AppendPathElement(szBuffer, szBufferEnd, ARENA_POINTER(&pRootHandler->NameArena, pParent->NameOffset), '\\');
 
     // Append the level-1 directory name (asset name)
     szBuffer = AppendPathElement(szBuffer, szBufferEnd, pAssetInfo->szDirectoryName, '\\');
@@ -391,17 +418,19 @@ static const char * CreateFileName(
     if(dwSubIndex == 0)
     {
         // Append plain name and extension
-        szBuffer = AppendPathElement(szBuffer, szBufferEnd, pRootHandler->szFileNames + dwNameOffset, '.');
+        szBuffer = AppendPathElement(szBuffer, szBufferEnd, ARENA_POINTER(&pRootHandler->NameArena, dwNameOffset), '.');
         szBuffer = AppendPathElement(szBuffer, szBufferEnd, pAssetInfo->szExtension, 0);
     }
     else
     {
         // Append plain name as subdirectory. The file name is four digits
-        szBuffer = AppendPathElement(szBuffer, szBufferEnd, pRootHandler->szFileNames + dwNameOffset, '\\');
-        szBuffer += sprintf(szBuffer, "%04u.xxx", dwSubIndex - 1);
+        szBuffer = AppendPathElement(szBuffer, szBufferEnd, ARENA_POINTER(&pRootHandler->NameArena, dwNameOffset), '\\');
+        sprintf(szSubName, "%04u.xxx", dwSubIndex - 1);
+        szBuffer = AppendPathElement(szBuffer, szBufferEnd, szSubName, 0);
     }
-    
-    return szSaveBuffer;
+
+    // The name doesn't fit if the terminating zero has not been written
+    return (szBuffer[-1] == 0) ? szSaveBuffer : NULL;
 }
 
 static const char * CreateFileName(
@@ -413,63 +442,32 @@ static const char * CreateFileName(
     char * szSaveBuffer = szBuffer;
     char * szBufferEnd = szBuffer + MAX_PATH;
 
-    // Sanity checks
-    assert(dwFileNameOffset < pRootHandler->cbFileNamesMax);
-
     // Append the level-0 directory name
     if(pParent != NULL)
-        szBuffer = AppendPathElement(szBuffer, szBufferEnd, pRootHandler->szFileNames + pParent->NameOffset, '\\');
+        szBuffer = AppendPathElement(szBuffer, szBufferEnd, ARENA_POINTER(&pRootHandler->NameArena, pParent->NameOffset), '\\');
     
     // Append the rest
-    szBuffer = AppendPathElement(szBuffer, szBufferEnd, pRootHandler->szFileNames + dwFileNameOffset, 0);
-    return szSaveBuffer;
+    szBuffer = AppendPathElement(szBuffer, szBufferEnd, ARENA_POINTER(&pRootHandler->NameArena, dwFileNameOffset), 0);
+    return (szBuffer[-1] == 0) ? szSaveBuffer : NULL;
 }
 
-static bool EnlargeNameBuffer(TRootHandler_Diablo3 * pRootHandler, size_t cbNewSize)
-{
-    char * szFileNames;
-    size_t cbFileNamesMax;
-
-    // We expect it to be already allocated
-    assert(pRootHandler->szFileNames != NULL);
-    assert(pRootHandler->cbFileNamesMax != 0);
-    
-    // Shall we enlarge the table?
-    if(cbNewSize > pRootHandler->cbFileNamesMax)
-    {
-        // Calculate new table size
-        cbFileNamesMax = pRootHandler->cbFileNamesMax;
-        while(cbFileNamesMax < cbNewSize)
-            cbFileNamesMax = cbFileNamesMax << 1;
-
-        // Allocate new table
-        szFileNames = CASC_REALLOC(char, pRootHandler->szFileNames, cbFileNamesMax);
-        if(szFileNames == NULL)
-            return false;
-
-        // Set the new table size
-        pRootHandler->szFileNames = szFileNames;
-        pRootHandler->cbFileNamesMax = cbFileNamesMax;
-    }
-
-    return true;
-}
-
-static char * InsertNamesToBuffer(TRootHandler_Diablo3 * pRootHandler, LPBYTE pbNewNames, size_t cbNewNames)
+// Creates the name of a file entry in a subdirectory. Returns NULL if the entry
+// has no name or if the name doesn't fit into MAX_PATH characters
+static const char * CreateFileName(
+    TRootHandler_Diablo3 * pRootHandler,
+    PCASC_FILE_ENTRY pRootEntry,
+    PCASC_FILE_ENTRY pFileEntry,
+    char * szBuffer)
 {
-    char * szFileName;
+    // Create the file name from the file entry with full name
+    if(pFileEntry->EntryFlags & ENTRY_FLAG_FULL_NAME)
+        return CreateFileName(pRootHandler, pRootEntry, pFileEntry->NameOffset, szBuffer);
 
-    // Try to enlarge the buffer, if needed
-    if(!EnlargeNameBuffer(pRootHandler, pRootHandler->cbFileNames + cbNewNames))
-        return NULL;
-    szFileName = pRootHandler->szFileNames + pRootHandler->cbFileNames;
+    // Create the file name from the file entry with plain name
+    if(pFileEntry->EntryFlags & ENTRY_FLAG_PLAIN_NAME)
+        return CreateFileName(pRootHandler, pRootEntry, pFileEntry->AssetIndex, pFileEntry->NameOffset, pFileEntry->SubIndex, szBuffer);
 
-    // Copy the file name to the name buffer
-    memcpy(szFileName, pbNewNames, cbNewNames);
-    pRootHandler->cbFileNames += cbNewNames;
-
-    // Return the newly allocates name
-    return szFileName;
+    return NULL;
 }
 
 static DWORD InsertFileEntry(
@@ -484,7 +482,7 @@ static DWORD InsertFileEntry(
     DWORD dwTableIndex = pRootHandler->dwFileCount;
     DWORD dwNameOffset;
     char * szPlainName;    
-    char szFileName[MAX_PATH+1];
+    char szFileName[MAX_PATH];
 
     // Make sure that we don't exceed the file limit at this phase
     if(pRootHandler->dwFileCount >= pRootHandler->dwFileCountMax)
@@ -494,22 +492,23 @@ static DWORD InsertFileEntry(
     }
 
     // Insert the plain name to the root handler's global name list
-    szPlainName = InsertNamesToBuffer(pRootHandler, pbPlainName, strlen((char *)pbPlainName) + 1);
+    szPlainName = Arena_Insert(&pRootHandler->NameArena, pbPlainName, strlen((char *)pbPlainName) + 1, &dwNameOffset);
     if(szPlainName != NULL)
     {
-        // Create the full file name 
-        dwNameOffset = (DWORD)(szPlainName - pRootHandler->szFileNames);
-        CreateFileName(pRootHandler, pParent, dwAssetIndex, dwNameOffset, dwSubIndex, szFileName);
-
         // Fill the file entry
         pFileEntry->EncodingKey  = EncodingKey;
-        pFileEntry->FileNameHash = CalcFileNameHash(NULL, szFileName); 
+        pFileEntry->FileNameHash = 0;
         pFileEntry->NameOffset   = dwNameOffset;
         pFileEntry->AssetIndex   = (BYTE)dwAssetIndex;
         pFileEntry->SubIndex     = (USHORT)dwSubIndex;
         pFileEntry->EntryFlags   = ENTRY_FLAG_PLAIN_NAME;
         pRootHandler->dwFileCount++;
 
+        // A file whose full name is too long can't be found by name
+        if(CreateFileName(pRootHandler, pParent, dwAssetIndex, dwNameOffset, dwSubIndex, szFileName) == NULL)
+            return dwTableIndex;
+        pFileEntry->FileNameHash = CalcFileNameHash(NULL, szFileName);
+
         // Verify collisions (debug version only)
         assert(Map_FindObject(pRootHandler->pRootMap, &pFileEntry->FileNameHash, NULL) == NULL);
 
@@ -525,15 +524,14 @@ static DWORD InsertFileEntry(
 
 static DWORD InsertFileEntry(
     TRootHandler_Diablo3 * pRootHandler,
-    PCASC_FILE_ENTRY pParent,
     ENCODING_KEY & EncodingKey,
     LPBYTE pbFileName,
-    DWORD cbFileName)
+    DWORD cbFileName,
+    ULONGLONG FileNameHash)
 {
     PCASC_FILE_ENTRY pFileEntry = pRootHandler->pFileTable + pRootHandler->dwFileCount;
-    char * szSubDirName;
     char * szFileName;
-    DWORD dwNameOffset = (DWORD)pRootHandler->cbFileNames;
+    DWORD dwNameOffset;
     DWORD dwTableIndex = pRootHandler->dwFileCount;
 
     // Make sure that we don't exceed the file limit at this phase
@@ -544,15 +542,12 @@ static DWORD InsertFileEntry(
     }
 
     // First, try to copy the name to the global name buffer
-    szFileName = InsertNamesToBuffer(pRootHandler, pbFileName, cbFileName);
+    szFileName = Arena_Insert(&pRootHandler->NameArena, pbFileName, cbFileName, &dwNameOffset);
     if(szFileName != NULL)
     {
-        // Retrieve the subdirectory name
-        szSubDirName = (pParent != NULL) ? pRootHandler->szFileNames + pParent->NameOffset : NULL;
-
         // Store the info into the file entry
         pFileEntry->EncodingKey  = EncodingKey;
-        pFileEntry->FileNameHash = CalcFileNameHash(szSubDirName, szFileName);
+        pFileEntry->FileNameHash = FileNameHash;
         pFileEntry->EntryFlags   = ENTRY_FLAG_FULL_NAME;
         pFileEntry->AssetIndex   = INVALID_ASSET_INDEX;
         pFileEntry->NameOffset   = dwNameOffset;
@@ -615,10 +610,14 @@ static int ParseNamedFileEntries(
     PCASC_FILE_ENTRY pParent,
     PCASC_DIRECTORY pDirectory,
     LPBYTE pbNamedEntries,
-    LPBYTE pbFileEnd)
+    LPBYTE pbFileEnd,
+    PULONGLONG pNameHashes)
 {
+    ULONGLONG FileNameHash;
+    char * szSubDirName;
     DWORD dwFileIndex;
     DWORD cbNamedEntry;
+    DWORD dwEntryIndex = 0;
 
     // Sanity checks
     assert(pRootHandler->pFileTable != NULL);
@@ -634,18 +633,30 @@ static int ParseNamedFileEntries(
         if(cbNamedEntry == 0)
             return ERROR_FILE_CORRUPT;
 
+        // The name hash may have been calculated by a worker thread
+        if(pNameHashes == NULL)
+        {
+            szSubDirName = (pParent != NULL) ? ARENA_POINTER(&pRootHandler->NameArena, pParent->NameOffset) : NULL;
+            FileNameHash = CalcFileNameHash(szSubDirName, (char *)pSrcEntry->szFileName);
+        }
+        else
+        {
+            FileNameHash = pNameHashes[dwEntryIndex];
+        }
+
         // Insert the named entry to the global file table
         dwFileIndex = InsertFileEntry(pRootHandler,
-                                      pParent,
                                       pSrcEntry->EncodingKey,
                                       pSrcEntry->szFileName,
-                                     (cbNamedEntry - sizeof(ENCODING_KEY)));
+                                     (cbNamedEntry - sizeof(ENCODING_KEY)),
+                                      FileNameHash);
         if(dwFileIndex == INVALID_FILE_INDEX)
             return ERROR_NOT_ENOUGH_MEMORY;
 
         // Insert the named entry to the directory
         pDirectory->Files[pDirectory->FileCount++] = dwFileIndex;
         pbNamedEntries += cbNamedEntry;
+        dwEntryIndex++;
     }
 
     return ERROR_SUCCESS;
@@ -751,19 +762,6 @@ static LPBYTE LoadFileToMemory(TCascStorage * hs, LPBYTE pbEncodingKey, DWORD *
     return pbFileData;
 }
 
-static LPBYTE LoadFileToMemory(TCascStorage * hs, const char * szFileName, DWORD * pcbFileData)
-{
-    LPBYTE pbEncodingKey = NULL;
-    LPBYTE pbFileData = NULL;
-
-    // Try to find encoding key for the file
-    pbEncodingKey = RootHandler_GetKey(hs->pRootHandler, szFileName);
-    if(pbEncodingKey != NULL)
-        pbFileData = LoadFileToMemory(hs, pbEncodingKey, pcbFileData);
-
-    return pbFileData;
-}
-
 static int ParseDirectoryHeader(
     PDIABLO3_DIR_HEADER pDirHeader,
     LPBYTE pbDirFile,
@@ -825,18 +823,152 @@ static int ParseDirectoryHeader(
     return ERROR_SUCCESS;
 }
 
+static void FreeDiablo3Directory(PCASC_DIRECTORY pDirectory)
+{
+    if(pDirectory->pIndexEntries1 != NULL)
+        CASC_FREE(pDirectory->pIndexEntries1);
+    if(pDirectory->pIndexEntries2 != NULL)
+        CASC_FREE(pDirectory->pIndexEntries2);
+    CASC_FREE(pDirectory);
+}
+
+static int HashNamedFileEntries(PDIABLO3_LOAD_ITEM pLoadItem, LPBYTE pbFileEnd)
+{
+    LPBYTE pbNamedEntry;
+    DWORD dwNamedEntries = 0;
+    DWORD cbNamedEntry;
+    DWORD i;
+
+    // Count the named entries. Walk them the same way as ParseNamedFileEntries does
+    for(pbNamedEntry = pLoadItem->DirHeader.pbEntries3; pbNamedEntry < pbFileEnd; pbNamedEntry += cbNamedEntry)
+    {
+        cbNamedEntry = VerifyNamedFileEntry(pbNamedEntry, pbFileEnd);
+        if(cbNamedEntry == 0)
+            return ERROR_FILE_CORRUPT;
+        dwNamedEntries++;
+    }
+
+    // Allocate the array of name hashes
+    pLoadItem->pNameHashes = CASC_ALLOC(ULONGLONG, dwNamedEntries + 1);
+    if(pLoadItem->pNameHashes == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Calculate the hash of each name. This is the costly part of parsing the named entries
+    pbNamedEntry = pLoadItem->DirHeader.pbEntries3;
+    for(i = 0; i < dwNamedEntries; i++)
+    {
+        PDIABLO3_NAMED_ENTRY pSrcEntry = (PDIABLO3_NAMED_ENTRY)pbNamedEntry;
+
+        pLoadItem->pNameHashes[i] = CalcFileNameHash(pLoadItem->szSubDirName, (char *)pSrcEntry->szFileName);
+        pbNamedEntry += VerifyNamedFileEntry(pbNamedEntry, pbFileEnd);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Loads one file and parses it, if it is a directory file.
+// This runs on a worker thread, so it must not touch the root handler
+static void LoadAndParseItem(TCascStorage * hs, PDIABLO3_LOAD_ITEM pLoadItem)
+{
+    LPBYTE pbFileEnd;
+
+    // Files that are not in the storage are skipped
+    if(pLoadItem->pbEncodingKey == NULL)
+    {
+        pLoadItem->nError = ERROR_FILE_NOT_FOUND;
+        return;
+    }
+
+    // Load the entire file to memory
+    pLoadItem->pbFileData = LoadFileToMemory(hs, pLoadItem->pbEncodingKey, &pLoadItem->cbFileData);
+    if(pLoadItem->pbFileData == NULL)
+    {
+        pLoadItem->nError = ERROR_FILE_NOT_FOUND;
+        return;
+    }
+
+    // Only directory files are parsed here
+    if(pLoadItem->szSubDirName != NULL)
+    {
+        pbFileEnd = pLoadItem->pbFileData + pLoadItem->cbFileData;
+
+        // Parse the directory header in order to retrieve the items
+        pLoadItem->nError = ParseDirectoryHeader(&pLoadItem->DirHeader, pLoadItem->pbFileData, pbFileEnd);
+        if(pLoadItem->nError != ERROR_SUCCESS)
+            return;
+
+        // Create the directory structure
+        pLoadItem->pDirectory = CreateDiablo3Directory(&pLoadItem->DirHeader);
+        if(pLoadItem->pDirectory == NULL)
+        {
+            pLoadItem->nError = ERROR_NOT_ENOUGH_MEMORY;
+            return;
+        }
+
+        // Copy the encoding key
+        memcpy(pLoadItem->pDirectory->EncodingKey.Value, pLoadItem->pbEncodingKey, MD5_HASH_SIZE);
+
+        // Prepare the hashes of the named entries
+        if(pLoadItem->DirHeader.pbEntries3 && pLoadItem->DirHeader.dwEntries3 != 0)
+            pLoadItem->nError = HashNamedFileEntries(pLoadItem, pbFileEnd);
+    }
+}
+
+static void LoadItemsWorker(void * pvContext)
+{
+    PDIABLO3_LOAD_CONTEXT pContext = (PDIABLO3_LOAD_CONTEXT)pvContext;
+    DWORD dwItemIndex;
+
+    // Pick the files one by one until there are none left
+    while((dwItemIndex = CascInterlockedIncrement(&pContext->dwNextItem) - 1) < pContext->dwItemCount)
+        LoadAndParseItem(pContext->hs, pContext->pItems + dwItemIndex);
+}
+
+// Loads (and parses) the files on worker threads. The results are stored
+// in the items, so the caller can merge them in a deterministic order
+static void LoadItems(TCascStorage * hs, PDIABLO3_LOAD_ITEM pItems, DWORD dwItemCount)
+{
+    DIABLO3_LOAD_CONTEXT Context;
+    DWORD dwWorkerCount = CascGetProcessorCount();
+
+    // Prepare the worker context
+    Context.hs = hs;
+    Context.pItems = pItems;
+    Context.dwItemCount = dwItemCount;
+    Context.dwNextItem = 0;
+
+    // Don't start more threads than there are files
+    CascRunWorkers(LoadItemsWorker, &Context, CASCLIB_MIN(dwWorkerCount, dwItemCount));
+}
+
+static void FreeLoadItems(PDIABLO3_LOAD_ITEM pItems, DWORD dwItemCount)
+{
+    for(DWORD i = 0; i < dwItemCount; i++)
+    {
+        if(pItems[i].pDirectory != NULL)
+            FreeDiablo3Directory(pItems[i].pDirectory);
+        if(pItems[i].pNameHashes != NULL)
+            CASC_FREE(pItems[i].pNameHashes);
+        if(pItems[i].pbFileData != NULL)
+            CASC_FREE(pItems[i].pbFileData);
+
+        pItems[i].pDirectory = NULL;
+        pItems[i].pNameHashes = NULL;
+        pItems[i].pbFileData = NULL;
+    }
+}
+
 static DWORD ScanDirectoryFile(
     TCascStorage * hs,
+    PDIABLO3_LOAD_ITEM pSubDirs,
+    PDWORD PtrSubDirs,
     LPBYTE pbRootFile,
     LPBYTE pbFileEnd)
 {
     PDIABLO3_NAMED_ENTRY pNamedEntry;
     DIABLO3_DIR_HEADER RootHeader;
-    DIABLO3_DIR_HEADER DirHeader;
-    LPBYTE pbSubDir;
     DWORD dwTotalFileCount;
     DWORD cbNamedEntry;
-    DWORD cbSubDir;
     int nError;
 
     // Parse the directory header in order to retrieve the items
@@ -844,10 +976,14 @@ static DWORD ScanDirectoryFile(
     if(nError != ERROR_SUCCESS)
         return 0;
 
+    // We expect the number of subdirectories to be less than maximum
+    if(RootHeader.dwEntries3 > DIABLO3_MAX_SUBDIRS)
+        return 0;
+
     // Add the root directory's entries
     dwTotalFileCount = RootHeader.dwEntries1 + RootHeader.dwEntries2 + RootHeader.dwEntries3;
 
-    // Parse the named entries
+    // Prepare the loading of all subdirectories
     for(DWORD i = 0; i < RootHeader.dwEntries3; i++)
     {
         // Get the this named entry
@@ -856,18 +992,23 @@ static DWORD ScanDirectoryFile(
         pNamedEntry = (PDIABLO3_NAMED_ENTRY)RootHeader.pbEntries3;
         RootHeader.pbEntries3 += cbNamedEntry;
 
-        // Load the subdirectory to memory
-        pbSubDir = LoadFileToMemory(hs, pNamedEntry->EncodingKey.Value, &cbSubDir);
-        if(pbSubDir != NULL)
+        // The name of the subdirectory stays in the root file
+        pSubDirs[i].pbEncodingKey = pNamedEntry->EncodingKey.Value;
+        pSubDirs[i].szSubDirName = (const char *)pNamedEntry->szFileName;
+    }
+
+    // Load and parse all subdirectories. Each of them is a multi-megabyte file
+    LoadItems(hs, pSubDirs, RootHeader.dwEntries3);
+    PtrSubDirs[0] = RootHeader.dwEntries3;
+
+    // Count the files in the subdirectories
+    for(DWORD i = 0; i < RootHeader.dwEntries3; i++)
+    {
+        if(pSubDirs[i].nError == ERROR_SUCCESS && pSubDirs[i].pDirectory != NULL)
         {
-            // Count the files in the subdirectory
-            if(ParseDirectoryHeader(&DirHeader, pbSubDir, pbSubDir + cbSubDir) == ERROR_SUCCESS)
-            {
-                dwTotalFileCount += DirHeader.dwEntries1 + DirHeader.dwEntries2 + DirHeader.dwEntries3;
-            }
+            PDIABLO3_DIR_HEADER pDirHeader = &pSubDirs[i].DirHeader;
 
-            // Free the subdirectory
-            CASC_FREE(pbSubDir);
+            dwTotalFileCount += pDirHeader->dwEntries1 + pDirHeader->dwEntries2 + pDirHeader->dwEntries3;
         }
     }
 
@@ -901,7 +1042,7 @@ static int ParseDirectoryFile(
 
         // Only the named entries are eligible to be inserted to the global file table
         if(DirHeader.pbEntries3 && DirHeader.dwEntries3 != NULL)
-            nError = ParseNamedFileEntries(pRootHandler, pParent, pDirectory, DirHeader.pbEntries3, pbFileEnd);
+            nError = ParseNamedFileEntries(pRootHandler, pParent, pDirectory, DirHeader.pbEntries3, pbFileEnd, NULL);
     }
     else
     {
@@ -997,6 +1138,7 @@ static int ParsePackagesDat(TRootHandler_Diablo3 * pRootHandler, LPBYTE pbPackag
     char * szSubDirName;
     char * szFileName;
     LPBYTE pbFileName;
+    DWORD dwNameOffset;
 
     // Get the header
     if((pbPackagesDat + sizeof(DIABLO3_PACKAGES_DAT_HEADER)) >= pbPackagesEnd)
@@ -1025,7 +1167,7 @@ static int ParsePackagesDat(TRootHandler_Diablo3 * pRootHandler, LPBYTE pbPackag
                 ULONGLONG FileNameHash;
 
                 // Convert the name to a normalized name
-                szSubDirName = pRootHandler->szFileNames + pParent->NameOffset;
+                szSubDirName = ARENA_POINTER(&pRootHandler->NameArena, pParent->NameOffset);
                 NormalizeFileName_Diablo3(&NameInfo, szSubDirName, (char *)pbFileName);
 
                 // If the name had three backslashes (like "Base\SoundBank\X1_Monster_Westmarch_Rat\0061.fsb"),
@@ -1040,11 +1182,11 @@ static int ParsePackagesDat(TRootHandler_Diablo3 * pRootHandler, LPBYTE pbPackag
                     if(pFileEntry != NULL && (pFileEntry->EntryFlags & ENTRY_FLAG_NAME_MASK) == ENTRY_FLAG_PLAIN_NAME)
                     {
                         // Insert the discovered name to the global name buffer
-                        szFileName = InsertNamesToBuffer(pRootHandler, pbFileName, NameInfo.nNameLength + 1);
+                        szFileName = Arena_Insert(&pRootHandler->NameArena, pbFileName, NameInfo.nNameLength + 1, &dwNameOffset);
                         if(szFileName != NULL)
                         {
                             // Switch the file entry to hae full name
-                            pFileEntry->NameOffset = (DWORD)(szFileName - pRootHandler->szFileNames);
+                            pFileEntry->NameOffset = dwNameOffset;
                             pFileEntry->EntryFlags = (pFileEntry->EntryFlags & ENTRY_FLAG_FLAGS_MASK) | ENTRY_FLAG_FULL_NAME;
                         }
                     }
@@ -1061,6 +1203,52 @@ static int ParsePackagesDat(TRootHandler_Diablo3 * pRootHandler, LPBYTE pbPackag
     return ERROR_SUCCESS;
 }
 
+// Composes the full names of all files once, so the search only needs to copy them.
+// Must be called after the names have been fixed up by CoreTOC.dat and Packages.dat
+static int CreateFullFileNames(TRootHandler_Diablo3 * pRootHandler)
+{
+    PCASC_FILE_ENTRY pRootEntry;
+    PCASC_DIRECTORY pRootDir = pRootHandler->pRootDirectory;
+    PCASC_DIRECTORY pSubDir;
+    PDWORD pFullNames;
+    DWORD dwFileIndex;
+    char szFileName[MAX_PATH];
+
+    // Allocate the array of name offsets. Entries without name stay invalid
+    pFullNames = CASC_ALLOC(DWORD, pRootHandler->dwFileCount);
+    if(pFullNames == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+    for(DWORD i = 0; i < pRootHandler->dwFileCount; i++)
+        pFullNames[i] = CASC_INVALID_ARENA_OFFSET;
+
+    for(DWORD i = 0; i < pRootDir->FileCount; i++)
+    {
+        pRootEntry = pRootHandler->pFileTable + pRootDir->Files[i];
+        pSubDir = pRootHandler->SubDirs[i];
+        if(pSubDir == NULL)
+            continue;
+
+        for(DWORD n = 0; n < pSubDir->FileCount; n++)
+        {
+            dwFileIndex = pSubDir->Files[n];
+
+            // Compose the name. Names that don't fit into the search buffer are skipped
+            if(CreateFileName(pRootHandler, pRootEntry, pRootHandler->pFileTable + dwFileIndex, szFileName) == NULL)
+                continue;
+
+            // Store the name to the arena
+            if(Arena_InsertString(&pRootHandler->NameArena, szFileName, strlen(szFileName), &pFullNames[dwFileIndex]) == NULL)
+            {
+                CASC_FREE(pFullNames);
+                return ERROR_NOT_ENOUGH_MEMORY;
+            }
+        }
+    }
+
+    pRootHandler->pFullNames = pFullNames;
+    return ERROR_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of Diablo III root file
 
@@ -1070,6 +1258,7 @@ static LPBYTE D3Handler_Search(TRootHandler_Diablo3 * pRootHandler, TCascSearch
     PCASC_FILE_ENTRY pFileEntry;
     PCASC_DIRECTORY pRootDir = pRootHandler->pRootDirectory;
     PCASC_DIRECTORY pSubDir;
+    DWORD dwFileIndex;
 
     // Are we still inside the root directory range?
     while(pSearch->IndexLevel1 < pRootDir->FileCount)
@@ -1083,28 +1272,25 @@ static LPBYTE D3Handler_Search(TRootHandler_Diablo3 * pRootHandler, TCascSearch
             while(pSearch->IndexLevel2 < pSubDir->FileCount)
             {
                 // Get the pointer to the file entry
-                pFileEntry = pRootHandler->pFileTable + pSubDir->Files[pSearch->IndexLevel2];
+                dwFileIndex = pSubDir->Files[pSearch->IndexLevel2];
+                pFileEntry = pRootHandler->pFileTable + dwFileIndex;
                 pSearch->IndexLevel2++;
 
-                // Create the file name from the file entry with full name
-                if(pFileEntry->EntryFlags & ENTRY_FLAG_FULL_NAME)
+                // If the full names are precomposed, just copy the name
+                if(pRootHandler->pFullNames != NULL)
                 {
-                    CreateFileName(pRootHandler,
-                                   pRootEntry,
-                                   pFileEntry->NameOffset,
-                                   pSearch->szFileName);
+                    if(pRootHandler->pFullNames[dwFileIndex] == CASC_INVALID_ARENA_OFFSET)
+                        continue;
+
+                    strcpy(pSearch->szFileName, ARENA_POINTER(&pRootHandler->NameArena, pRootHandler->pFullNames[dwFileIndex]));
+                    pSearch->dwRootIndex = dwFileIndex;
                     return pFileEntry->EncodingKey.Value;
                 }
 
-                // Create the file name from the file entry with plain name
-                if(pFileEntry->EntryFlags & ENTRY_FLAG_PLAIN_NAME)
+                // Create the file name from the file entry
+                if(CreateFileName(pRootHandler, pRootEntry, pFileEntry, pSearch->szFileName) != NULL)
                 {
-                    CreateFileName(pRootHandler,
-                                   pRootEntry,
-                                   pFileEntry->AssetIndex,
-                                   pFileEntry->NameOffset,
-                                   pFileEntry->SubIndex,
-                                   pSearch->szFileName);
+                    pSearch->dwRootIndex = dwFileIndex;
                     return pFileEntry->EncodingKey.Value;
                 }
             }
@@ -1124,6 +1310,11 @@ static void D3Handler_EndSearch(TRootHandler_Diablo3 * /* pRootHandler */, TCasc
     // Do nothing
 }
 
+static LPBYTE D3Handler_GetEntryKey(TRootHandler_Diablo3 * pRootHandler, DWORD dwEntryIndex)
+{
+    return pRootHandler->pFileTable[dwEntryIndex].EncodingKey.Value;
+}
+
 static LPBYTE D3Handler_GetKey(TRootHandler_Diablo3 * pRootHandler, const char * szFileName)
 {
     PCASC_FILE_ENTRY pFileEntry;
@@ -1164,10 +1355,13 @@ static void D3Handler_Close(TRootHandler_Diablo3 * pRootHandler)
             CASC_FREE(pRootHandler->pFileTable);
         pRootHandler->pFileTable = NULL;
 
-        // Free the array of the file names
-        if(pRootHandler->szFileNames)
-            CASC_FREE(pRootHandler->szFileNames);
-        pRootHandler->szFileNames = NULL;
+        // Free the precomposed full names
+        if(pRootHandler->pFullNames != NULL)
+            CASC_FREE(pRootHandler->pFullNames);
+        pRootHandler->pFullNames = NULL;
+
+        // Free all file names
+        Arena_Free(&pRootHandler->NameArena);
 
         // Free the root file itself
         CASC_FREE(pRootHandler);
@@ -1245,11 +1439,14 @@ static void DumpRootFile(TDumpContext * dc, LPBYTE pbFileData, LPBYTE pbFileData
 int RootHandler_CreateDiablo3(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFile)
 {
     TRootHandler_Diablo3 * pRootHandler;
+    DIABLO3_LOAD_ITEM SubDirItems[DIABLO3_MAX_SUBDIRS];
+    DIABLO3_LOAD_ITEM DataItems[2];
     LPBYTE pbRootFileEnd = pbRootFile + cbRootFile;
     DWORD dwTotalFileCount;
     DWORD dwRootEntries = 0;
+    DWORD dwSubDirs = 0;
     DWORD i;
-    int nError;
+    int nError = ERROR_SUCCESS;
 
     // Allocate the root handler object
     pRootHandler = CASC_ALLOC(TRootHandler_Diablo3, 1);
@@ -1261,37 +1458,40 @@ int RootHandler_CreateDiablo3(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRoot
     pRootHandler->Search      = (ROOT_SEARCH)D3Handler_Search;
     pRootHandler->EndSearch   = (ROOT_ENDSEARCH)D3Handler_EndSearch;
     pRootHandler->GetKey      = (ROOT_GETKEY)D3Handler_GetKey;
+    pRootHandler->GetEntryKey = (ROOT_GETENTRYKEY)D3Handler_GetEntryKey;
     pRootHandler->Close       = (ROOT_CLOSE)D3Handler_Close;
 
     // Fill-in the flags
     pRootHandler->dwRootFlags |= ROOT_FLAG_HAS_NAMES;
     hs->pRootHandler = pRootHandler;
 
-    // Scan the total number of files in the root directories
-    dwTotalFileCount = ScanDirectoryFile(hs, pbRootFile, pbRootFileEnd);
+    // Load all subdirectories and get the total number of files in them
+    memset(SubDirItems, 0, sizeof(SubDirItems));
+    dwTotalFileCount = ScanDirectoryFile(hs, SubDirItems, &dwSubDirs, pbRootFile, pbRootFileEnd);
     if(dwTotalFileCount == 0)
+    {
+        FreeLoadItems(SubDirItems, dwSubDirs);
         return ERROR_FILE_CORRUPT;
+    }
 
-    // Allocate global buffer for file names
-    pRootHandler->szFileNames = CASC_ALLOC(char, 0x10000);
-    if(pRootHandler->szFileNames == NULL)
-        return ERROR_NOT_ENOUGH_MEMORY;
-    pRootHandler->cbFileNamesMax = 0x10000;
+    // Initialize the storage for file names
+    Arena_Init(&pRootHandler->NameArena);
 
     // Allocate the global linear file table
     // Note: This is about 18 MB of memory for Diablo III PTR build 30013
     pRootHandler->pFileTable = CASC_ALLOC(CASC_FILE_ENTRY, dwTotalFileCount);
     if(pRootHandler->pFileTable == NULL)
-        return ERROR_NOT_ENOUGH_MEMORY;
+        nError = ERROR_NOT_ENOUGH_MEMORY;
     pRootHandler->dwFileCountMax = dwTotalFileCount;
 
     // Create map of ROOT_ENTRY -> FileEntry
     pRootHandler->pRootMap = Map_Create(dwTotalFileCount, sizeof(ULONGLONG), FIELD_OFFSET(CASC_FILE_ENTRY, FileNameHash));
     if(pRootHandler->pRootMap == NULL)
-        return ERROR_NOT_ENOUGH_MEMORY;
+        nError = ERROR_NOT_ENOUGH_MEMORY;
 
     // Create the root directory
-    nError = ParseDirectoryFile(pRootHandler, NULL, hs->RootKey.pbData, pbRootFile, pbRootFileEnd, &pRootHandler->pRootDirectory);
+    if(nError == ERROR_SUCCESS)
+        nError = ParseDirectoryFile(pRootHandler, NULL, hs->RootKey.pbData, pbRootFile, pbRootFileEnd, &pRootHandler->pRootDirectory);
     if(nError == ERROR_SUCCESS)
     {
         PCASC_FILE_ENTRY pRootEntry = pRootHandler->pFileTable;
@@ -1300,65 +1500,67 @@ int RootHandler_CreateDiablo3(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRoot
         dwRootEntries = pRootHandler->pRootDirectory->FileCount;
         assert(dwRootEntries < DIABLO3_MAX_SUBDIRS);
 
-        // Now parse the all root items and load them
+        // Merge the loaded subdirectories in the order of the root directory.
+        // This way, the file table doesn't depend on the number of threads
         for(i = 0; i < dwRootEntries; i++, pRootEntry++)
         {
+            PDIABLO3_LOAD_ITEM pLoadItem = SubDirItems + i;
+
             // Mark the root entry as directory
             pRootEntry->EntryFlags |= ENTRY_FLAG_DIRECTORY_ENTRY;
 
-            // Load the entire file to memory
-            pbRootFile = LoadFileToMemory(hs, pRootEntry->EncodingKey.Value, &cbRootFile);
-            if(pbRootFile != NULL)
-            {
-                PCASC_DIRECTORY pSubDir = NULL;
-
-                nError = ParseDirectoryFile(pRootHandler, 
-                                            pRootEntry,
-                                            pRootEntry->EncodingKey.Value,
-                                            pbRootFile,
-                                            pbRootFile + cbRootFile,
-                                           &pSubDir);
-                
-                if(nError == ERROR_SUCCESS && pSubDir != NULL)
-                    pRootHandler->SubDirs[i] = pSubDir;
+            // Skip the subdirectories that failed to load
+            if(i >= dwSubDirs || pLoadItem->nError != ERROR_SUCCESS || pLoadItem->pDirectory == NULL)
+                continue;
 
-                CASC_FREE(pbRootFile);
+            // Only the named entries are eligible to be inserted to the global file table
+            if(pLoadItem->DirHeader.pbEntries3 && pLoadItem->DirHeader.dwEntries3 != 0)
+            {
+                nError = ParseNamedFileEntries(pRootHandler,
+                                               pRootEntry,
+                                               pLoadItem->pDirectory,
+                                               pLoadItem->DirHeader.pbEntries3,
+                                               pLoadItem->pbFileData + pLoadItem->cbFileData,
+                                               pLoadItem->pNameHashes);
+                if(nError != ERROR_SUCCESS)
+                    break;
             }
+
+            // The root handler owns the directory now
+            pRootHandler->SubDirs[i] = pLoadItem->pDirectory;
+            pLoadItem->pDirectory = NULL;
         }
     }
 
+    // The loaded subdirectory files are not needed anymore
+    FreeLoadItems(SubDirItems, dwSubDirs);
+
     // Vast majorify of files at this moment don't have names.
     // We can load the Base\CoreToC.dat file in order
-    // to get directory asset indexes, file names and extensions
+    // to get directory asset indexes, file names and extensions.
+    // The file Base\Data_D3\PC\Misc\Packages.dat is used to fixup
+    // the names with sub-items. Both files are loaded at once
     if(nError == ERROR_SUCCESS)
     {
-        LPBYTE pbCoreTOC;
-        DWORD cbCoreTOC = 0;
-
-        // Load the entire file to memory
-        pbCoreTOC = LoadFileToMemory(hs, "Base\\CoreTOC.dat", &cbCoreTOC);
-        if(pbCoreTOC != NULL)
-        {
-            ParseCoreTOC(pRootHandler, pbCoreTOC, pbCoreTOC + cbCoreTOC);
-            CASC_FREE(pbCoreTOC);
-        }
+        memset(DataItems, 0, sizeof(DataItems));
+        DataItems[0].pbEncodingKey = RootHandler_GetKey(hs->pRootHandler, "Base\\CoreTOC.dat");
+        DataItems[1].pbEncodingKey = RootHandler_GetKey(hs->pRootHandler, "Base\\Data_D3\\PC\\Misc\\Packages.dat");
+        LoadItems(hs, DataItems, 2);
+
+        // Parse the CoreTOC.dat first, the Packages.dat needs its names
+        if(DataItems[0].pbFileData != NULL)
+            ParseCoreTOC(pRootHandler, DataItems[0].pbFileData, DataItems[0].pbFileData + DataItems[0].cbFileData);
+        if(DataItems[1].pbFileData != NULL)
+            ParsePackagesDat(pRootHandler, DataItems[1].pbFileData, DataItems[1].pbFileData + DataItems[1].cbFileData);
+        FreeLoadItems(DataItems, 2);
+
+        // The names are final now. Compose the full names for the search.
+        // If this fails, the names are created on each search instead
+        CreateFullFileNames(pRootHandler);
     }
 
-    // Load the file Base\Data_D3\PC\Misc\Packages.dat and fixup
-    // the names with sub-items
-    if(nError == ERROR_SUCCESS)
-    {
-        LPBYTE pbPackagesDat;
-        DWORD cbPackagesDat = 0;
-
-        // Load the entire file to memory
-        pbPackagesDat = LoadFileToMemory(hs, "Base\\Data_D3\\PC\\Misc\\Packages.dat", &cbPackagesDat);
-        if(pbPackagesDat != NULL)
-        {
-            ParsePackagesDat(pRootHandler, pbPackagesDat, pbPackagesDat + cbPackagesDat);
-            CASC_FREE(pbPackagesDat);
-        }
-    }
+    // The file table is complete now
+    pRootHandler->dwEntryCount = pRootHandler->dwFileCount;
 
     // Free all remaining file ID lists
     for(i = 0; i < dwRootEntries; i++)
@@ -19,6 +19,12 @@
 
 #define CASC_MAR_SIGNATURE 0x0052414d           //  'MAR\0'
 
+// Use SSE2 for comparing name fragments, if available
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CASC_MNDX_SSE2
+#endif
+
 //-----------------------------------------------------------------------------
 // Local structures
 
@@ -80,6 +86,25 @@ typedef struct _CASC_MNDX_PACKAGES
 
 } CASC_MNDX_PACKAGES, *PCASC_MNDX_PACKAGES;
 
+// Node of the package name trie. Children are kept as a singly linked list
+typedef struct _CASC_MNDX_PACKAGE_NODE
+{
+    DWORD FirstChild;                               // Index of the first child node (0 = none)
+    DWORD NextSibling;                              // Index of the next sibling node (0 = none)
+    DWORD PackageIndex;                             // Index of the package ending at this node, or CASC_INVALID_PACKAGE
+    BYTE  Character;                                // Character of the edge leading to this node
+
+} CASC_MNDX_PACKAGE_NODE, *PCASC_MNDX_PACKAGE_NODE;
+
+// Prefix trie of all package names. Node 0 is the root (empty prefix)
+typedef struct _CASC_MNDX_PACKAGE_TRIE
+{
+    PCASC_MNDX_PACKAGE_NODE pNodes;                 // Array of trie nodes
+    size_t NodeCount;                               // Number of nodes used
+    size_t NodeCountMax;                            // Number of nodes allocated
+
+} CASC_MNDX_PACKAGE_TRIE, *PCASC_MNDX_PACKAGE_TRIE;
+
 // Root file entry for CASC storages with MNDX root file (Heroes of the Storm)
 // Corresponds to the in-file structure
 typedef struct _CASC_ROOT_ENTRY_MNDX
@@ -98,6 +123,10 @@ extern "C" bool _cdecl sub_1958B00_x86(TFileNameDatabase * pDB, TMndxFindResult
 void TestMndxRootFile(PCASC_MNDX_INFO pMndxInfo);
 #endif
 
+#if defined(_DEBUG) && defined(CASCLIB_TEST)
+void TestMndxNameFragments(PCASC_MNDX_INFO pMndxInfo);
+#endif
+
 //-----------------------------------------------------------------------------
 // Local variables
 
@@ -248,6 +277,118 @@ DWORD GetNumberOfSetBits(DWORD Value32)
 
 #define GetNumbrOfSetBits32(x)  (GetNumberOfSetBits(x) >> 0x18)
 
+//-----------------------------------------------------------------------------
+// Local functions - Block comparison of name fragments
+
+#define MNDX_BLOCK_SIZE  0x10                   // Number of characters compared at once
+
+// Returns index of the lowest set bit. The value must not be zero
+static DWORD GetLowestSetBit(DWORD Value32)
+{
+#if defined(_MSC_VER)
+    unsigned long Index;
+
+    _BitScanForward(&Index, Value32);
+    return (DWORD)Index;
+#elif defined(__GNUC__)
+    return (DWORD)__builtin_ctz(Value32);
+#else
+    DWORD Index = 0;
+
+    while((Value32 & 1) == 0)
+    {
+        Value32 >>= 1;
+        Index++;
+    }
+    return Index;
+#endif
+}
+
+// Bit N of the result is set if the N-th characters of the blocks differ
+static DWORD GetMismatchMask16(const char * szBlock1, const char * szBlock2)
+{
+#ifdef CASC_MNDX_SSE2
+    __m128i Block1 = _mm_loadu_si128((const __m128i *)szBlock1);
+    __m128i Block2 = _mm_loadu_si128((const __m128i *)szBlock2);
+
+    return (DWORD)(_mm_movemask_epi8(_mm_cmpeq_epi8(Block1, Block2)) ^ 0xFFFF);
+#else
+    DWORD dwMask = 0;
+
+    for(DWORD i = 0; i < MNDX_BLOCK_SIZE; i++)
+        dwMask |= (DWORD)(szBlock1[i] != szBlock2[i]) << i;
+    return dwMask;
+#endif
+}
+
+// Bit N of the result is set if the N-th character of the block is zero
+static DWORD GetZeroMask16(const char * szBlock)
+{
+#ifdef CASC_MNDX_SSE2
+    __m128i Block = _mm_loadu_si128((const __m128i *)szBlock);
+
+    return (DWORD)_mm_movemask_epi8(_mm_cmpeq_epi8(Block, _mm_setzero_si128()));
+#else
+    DWORD dwMask = 0;
+
+    for(DWORD i = 0; i < MNDX_BLOCK_SIZE; i++)
+        dwMask |= (DWORD)(szBlock[i] == 0) << i;
+    return dwMask;
+#endif
+}
+
+// Bit N of the result is set if the item (ItemIndex + N) is present
+static DWORD GetPresentMask16(TSparseArray & SparseArray, DWORD ItemIndex)
+{
+    PDWORD ItemBits = SparseArray.ItemBits.Uint32Array + (ItemIndex >> 0x05);
+    DWORD dwBitIndex = ItemIndex & 0x1F;
+    DWORD dwMask = ItemBits[0] >> dwBitIndex;
+
+    // The block may span two DWORDs
+    if(dwBitIndex > 0x10)
+        dwMask |= ItemBits[1] << (0x20 - dwBitIndex);
+    return dwMask & 0xFFFF;
+}
+
+// Returns index of the first present item at or after ItemIndex
+static DWORD GetNextPresentItem(TSparseArray & SparseArray, DWORD ItemIndex)
+{
+    PDWORD ItemBits = SparseArray.ItemBits.Uint32Array;
+    DWORD dwDwordIndex = ItemIndex >> 0x05;
+    DWORD dwBits = ItemBits[dwDwordIndex] & (0xFFFFFFFF << (ItemIndex & 0x1F));
+
+    // Skip the DWORDs that have no bit set
+    while(dwBits == 0)
+    {
+        if(((++dwDwordIndex) << 0x05) >= SparseArray.TotalItemCount)
+            return SparseArray.TotalItemCount;
+        dwBits = ItemBits[dwDwordIndex];
+    }
+
+    return (dwDwordIndex << 0x05) + GetLowestSetBit(dwBits);
+}
+
+// Compares one block of a name fragment with the search mask. Bit N of dwEndMask
+// is set if the fragment ends after the N-th character. Returns false if the whole
+// block matched and the fragment continues. Otherwise, returns true, dwLength
+// receives the number of matching characters and bFragmentEnd is true
+// if the fragment ended (i.e. it matched)
+static bool CompareFragmentBlock(const char * szFragment, const char * szSearchMask, DWORD dwEndMask, DWORD & dwLength, bool & bFragmentEnd)
+{
+    DWORD dwMismatch = GetMismatchMask16(szFragment, szSearchMask);
+    DWORD dwIndex;
+
+    // No mismatch and no end of the fragment in this block
+    if((dwMismatch | dwEndMask) == 0)
+        return false;
+
+    // Mismatch takes precedence over the fragment end at the same position
+    dwIndex = GetLowestSetBit(dwMismatch | dwEndMask);
+    bFragmentEnd = ((dwMismatch & (1 << dwIndex)) == 0);
+    dwLength = bFragmentEnd ? (dwIndex + 1) : dwIndex;
+    return true;
+}
+
 //-----------------------------------------------------------------------------
 // Local functions - common
 
@@ -265,6 +406,35 @@ static bool RootFileRead(LPBYTE pbFilePointer, LPBYTE pbFileEnd, void * pvBuffer
     return true;
 }
 
+// Gives a pointer to the data in the ROOT file, so they don't need to be copied.
+// If the data are not aligned well enough to be used in place, a copy is made
+static int RootFileGetData(LPBYTE pbFilePointer, LPBYTE pbFileEnd, DWORD cbData, DWORD dwAlignment, LPBYTE * ppbData, bool * pbDataCopied)
+{
+    LPBYTE pbData;
+
+    // Check whether the data are within the file
+    if(pbFilePointer > pbFileEnd || (size_t)(pbFileEnd - pbFilePointer) < cbData)
+        return ERROR_FILE_CORRUPT;
+
+    // Aligned data can be used directly
+    if(((size_t)pbFilePointer & (dwAlignment - 1)) == 0)
+    {
+        ppbData[0] = pbFilePointer;
+        pbDataCopied[0] = false;
+        return ERROR_SUCCESS;
+    }
+
+    // Misaligned data need to be copied
+    pbData = CASC_ALLOC(BYTE, cbData);
+    if(pbData == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    memcpy(pbData, pbFilePointer, cbData);
+    ppbData[0] = pbData;
+    pbDataCopied[0] = true;
+    return ERROR_SUCCESS;
+}
+
 //-----------------------------------------------------------------------------
 // Local functions - TMndxFindResult
 
@@ -585,6 +755,33 @@ void TGenericArray::InsertOneItem_CHAR(char NewItem)
     FirstValid.Chars[ItemCount++] = NewItem;
 }
 
+// Inserts multiple characters at once
+void TGenericArray::InsertItems_CHARS(const char * NewItems, DWORD NewItemCount)
+{
+    DWORD NewMaxItemCount;
+    DWORD NewTotalCount;
+
+    NewTotalCount = ItemCount + NewItemCount;
+    if(NewTotalCount > MaxItemCount)
+    {
+        NewMaxItemCount = NewTotalCount;
+
+        if(MaxItemCount > (NewTotalCount / 2))
+        {
+            if(MaxItemCount <= (CASC_MAX_ENTRIES(BYTE) / 2))
+                NewMaxItemCount = MaxItemCount + MaxItemCount;
+            else
+                NewMaxItemCount = CASC_MAX_ENTRIES(BYTE);
+        }
+
+        SetMaxItems_CHARS(NewMaxItemCount);
+    }
+
+    // Copy the characters to the slots that have been reserved
+    memcpy(FirstValid.Chars + ItemCount, NewItems, NewItemCount);
+    ItemCount = NewTotalCount;
+}
+
 // HOTS: 1958330, inline
 void TGenericArray::InsertOneItem_PATH_STOP(PATH_STOP & NewItem)
 {
@@ -1126,8 +1323,11 @@ TNameIndexStruct::~TNameIndexStruct()
 bool TNameIndexStruct::CheckNameFragment(TMndxFindResult * pStruct1C, DWORD dwFragOffs)
 {
     TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szFragmentsEnd = NameFragments.CharArray + NameFragments.ItemCount;
     const char * szPathFragment;
     const char * szSearchMask;
+    DWORD dwLength;
+    bool bFragmentEnd;
 
     if(!Struct68.TotalItemCount)
     {
@@ -1136,6 +1336,24 @@ bool TNameIndexStruct::CheckNameFragment(TMndxFindResult * pStruct1C, DWORD dwFr
         szPathFragment = (NameFragments.CharArray + dwFragOffs - pStruct40->CharIndex);
         szSearchMask = pStruct1C->szSearchMask;
 
+        // Compare whole blocks while both the fragment and the search mask are long enough
+        while((pStruct40->CharIndex + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && (szPathFragment + pStruct40->CharIndex + MNDX_BLOCK_SIZE) < szFragmentsEnd)
+        {
+            if(CompareFragmentBlock(szPathFragment + pStruct40->CharIndex,
+                                    szSearchMask + pStruct40->CharIndex,
+                                    GetZeroMask16(szPathFragment + pStruct40->CharIndex + 1),
+                                    dwLength,
+                                    bFragmentEnd))
+            {
+                pStruct40->CharIndex += dwLength;
+                return bFragmentEnd;
+            }
+
+            pStruct40->CharIndex += MNDX_BLOCK_SIZE;
+            if(pStruct40->CharIndex >= pStruct1C->cchSearchMask)
+                return false;
+        }
+
         // Keep searching as long as the name matches with the fragment
         while(szPathFragment[pStruct40->CharIndex] == szSearchMask[pStruct40->CharIndex])
         {
@@ -1157,6 +1375,25 @@ bool TNameIndexStruct::CheckNameFragment(TMndxFindResult * pStruct1C, DWORD dwFr
         szPathFragment = (const char *)(NameFragments.CharArray);
         szSearchMask = pStruct1C->szSearchMask;
 
+        // Compare whole blocks while both the fragment and the search mask are long enough
+        while((pStruct40->CharIndex + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && (dwFragOffs + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && IsFragmentBlockValid(dwFragOffs))
+        {
+            if(CompareFragmentBlock(szPathFragment + dwFragOffs,
+                                    szSearchMask + pStruct40->CharIndex,
+                                    GetPresentMask16(Struct68, dwFragOffs),
+                                    dwLength,
+                                    bFragmentEnd))
+            {
+                pStruct40->CharIndex += dwLength;
+                return bFragmentEnd;
+            }
+
+            pStruct40->CharIndex += MNDX_BLOCK_SIZE;
+            dwFragOffs += MNDX_BLOCK_SIZE;
+            if(dwFragOffs >= pStruct1C->cchSearchMask)
+                return false;
+        }
+
         // Keep searching as long as the name matches with the fragment
         while(szPathFragment[dwFragOffs] == szSearchMask[pStruct40->CharIndex])
         {
@@ -1178,8 +1415,11 @@ bool TNameIndexStruct::CheckNameFragment(TMndxFindResult * pStruct1C, DWORD dwFr
 bool TNameIndexStruct::CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWORD dwFragOffs)
 {
     TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szFragmentsEnd = NameFragments.CharArray + NameFragments.ItemCount;
     const char * szPathFragment;
     const char * szSearchMask;
+    DWORD dwLength;
+    bool bFragmentEnd;
 
     if(!Struct68.TotalItemCount)
     {
@@ -1188,6 +1428,24 @@ bool TNameIndexStruct::CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWO
         szPathFragment = (const char *)(NameFragments.CharArray + dwFragOffs - pStruct40->CharIndex);
         szSearchMask = pStruct1C->szSearchMask;
 
+        // Compare and copy whole blocks while both the fragment and the search mask are long enough
+        while((pStruct40->CharIndex + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && (szPathFragment + pStruct40->CharIndex + MNDX_BLOCK_SIZE) < szFragmentsEnd)
+        {
+            if(CompareFragmentBlock(szPathFragment + pStruct40->CharIndex,
+                                    szSearchMask + pStruct40->CharIndex,
+                                    GetZeroMask16(szPathFragment + pStruct40->CharIndex + 1),
+                                    dwLength,
+                                    bFragmentEnd))
+            {
+                pStruct40->array_00.InsertItems_CHARS(szPathFragment + pStruct40->CharIndex, dwLength);
+                pStruct40->CharIndex += dwLength;
+                return bFragmentEnd;
+            }
+
+            pStruct40->array_00.InsertItems_CHARS(szPathFragment + pStruct40->CharIndex, MNDX_BLOCK_SIZE);
+            pStruct40->CharIndex += MNDX_BLOCK_SIZE;
+        }
+
         // Keep copying as long as we don't reach the end of the search mask
         while(pStruct40->CharIndex < pStruct1C->cchSearchMask)
         {
@@ -1208,11 +1466,7 @@ bool TNameIndexStruct::CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWO
 
         // HOTS: 195A660
         // Now we need to copy the rest of the fragment
-        while(szPathFragment[0] != 0)
-        {
-            pStruct40->array_00.InsertOneItem_CHAR(szPathFragment[0]);
-            szPathFragment++;
-        }
+        pStruct40->array_00.InsertItems_CHARS(szPathFragment, (DWORD)strlen(szPathFragment));
     }
     else
     {
@@ -1221,6 +1475,25 @@ bool TNameIndexStruct::CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWO
         szPathFragment = NameFragments.CharArray;
         szSearchMask = pStruct1C->szSearchMask;
 
+        // Compare and copy whole blocks while both the fragment and the search mask are long enough
+        while((pStruct40->CharIndex + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && (dwFragOffs + MNDX_BLOCK_SIZE) <= pStruct1C->cchSearchMask && IsFragmentBlockValid(dwFragOffs))
+        {
+            if(CompareFragmentBlock(szPathFragment + dwFragOffs,
+                                    szSearchMask + pStruct40->CharIndex,
+                                    GetPresentMask16(Struct68, dwFragOffs),
+                                    dwLength,
+                                    bFragmentEnd))
+            {
+                pStruct40->array_00.InsertItems_CHARS(szPathFragment + dwFragOffs, dwLength);
+                pStruct40->CharIndex += dwLength;
+                return bFragmentEnd;
+            }
+
+            pStruct40->array_00.InsertItems_CHARS(szPathFragment + dwFragOffs, MNDX_BLOCK_SIZE);
+            pStruct40->CharIndex += MNDX_BLOCK_SIZE;
+            dwFragOffs += MNDX_BLOCK_SIZE;
+        }
+
         // Keep copying as long as we don't reach the end of the search mask
         while(dwFragOffs < pStruct1C->cchSearchMask)
         {
@@ -1235,16 +1508,10 @@ bool TNameIndexStruct::CheckAndCopyNameFragment(TMndxFindResult * pStruct1C, DWO
                 return true;
         }
 
-        // Fixup the address of the fragment
-        szPathFragment += dwFragOffs;
-
-        // Now we need to copy the rest of the fragment
-        while(Struct68.IsItemPresent(dwFragOffs++) == 0)
-        {
-            // HOTS: 195A7A6
-            pStruct40->array_00.InsertOneItem_CHAR(szPathFragment[0]);
-            szPathFragment++;
-        }
+        // Now we need to copy the rest of the fragment, up to the next present item
+        // HOTS: 195A7A6
+        dwLength = GetNextPresentItem(Struct68, dwFragOffs) - dwFragOffs;
+        pStruct40->array_00.InsertItems_CHARS(szPathFragment + dwFragOffs, dwLength);
     }
 
     return true;
@@ -1255,33 +1522,30 @@ void TNameIndexStruct::CopyNameFragment(TMndxFindResult * pStruct1C, DWORD dwFra
 {
     TStruct40 * pStruct40 = pStruct1C->pStruct40;
     const char * szPathFragment;
+    DWORD dwLength;
 
     // HOTS: 195A3FA
     if(!Struct68.TotalItemCount)
     {
         // HOTS: 195A40C
         szPathFragment = NameFragments.CharArray + dwFragOffs;
-        while(szPathFragment[0] != 0)
-        {
-            // Insert the character to the path being built
-            pStruct40->array_00.InsertOneItem_CHAR(*szPathFragment++);
-        }
+        pStruct40->array_00.InsertItems_CHARS(szPathFragment, (DWORD)strlen(szPathFragment));
     }
     else
     {
         // HOTS: 195A4B3
-        for(;;)
-        {
-            // Insert the character to the path being built
-            pStruct40->array_00.InsertOneItem_CHAR(NameFragments.CharArray[dwFragOffs]);
-
-            // Keep going as long as the given bit is not set
-            if(Struct68.IsItemPresent(dwFragOffs++))
-                break;
-        }
+        // Copy the fragment up to (and including) the next present item
+        dwLength = GetNextPresentItem(Struct68, dwFragOffs) - dwFragOffs + 1;
+        pStruct40->array_00.InsertItems_CHARS(NameFragments.CharArray + dwFragOffs, dwLength);
     }
 }
 
+// Returns true if a whole block of fragment characters (and their "present" bits) is available
+bool TNameIndexStruct::IsFragmentBlockValid(DWORD dwFragOffs)
+{
+    return ((dwFragOffs + MNDX_BLOCK_SIZE) <= NameFragments.ItemCount && (dwFragOffs + MNDX_BLOCK_SIZE) <= Struct68.TotalItemCount);
+}
+
 // HOTS: 0195A300
 void TNameIndexStruct::ExchangeWith(TNameIndexStruct & Target)
 {
@@ -2771,7 +3035,7 @@ static void MAR_FILE_Destructor(PMAR_FILE pMarFile)
     {
         if(pMarFile->pDatabasePtr != NULL)
             delete pMarFile->pDatabasePtr;
-        if(pMarFile->pbMarData != NULL)
+        if(pMarFile->pbMarData != NULL && pMarFile->bMarDataCopied)
             CASC_FREE(pMarFile->pbMarData);
 
         CASC_FREE(pMarFile);
@@ -2784,6 +3048,7 @@ static void MAR_FILE_Destructor(PMAR_FILE pMarFile)
 // TODO: When working, increment these values to lower number of (re)allocations
 #define CASC_PACKAGES_INIT  0x10
 #define CASC_PACKAGES_DELTA 0x10
+#define CASC_INVALID_PACKAGE 0xFFFFFFFF
 
 static PCASC_MNDX_PACKAGES AllocatePackages(size_t nNameEntries, size_t nNameBufferMax)
 {
@@ -2913,6 +3178,75 @@ static int LoadPackageNames(PCASC_MNDX_INFO pMndxInfo, PCASC_MNDX_PACKAGES * ppP
     return ERROR_SUCCESS;
 }
 
+static DWORD InsertPackageNode(PCASC_MNDX_PACKAGE_TRIE pTrie, DWORD dwParent, BYTE Character)
+{
+    PCASC_MNDX_PACKAGE_NODE pNode;
+    DWORD dwNodeIndex;
+
+    // Look for an existing child with the same character
+    for(dwNodeIndex = pTrie->pNodes[dwParent].FirstChild; dwNodeIndex != 0; dwNodeIndex = pTrie->pNodes[dwNodeIndex].NextSibling)
+    {
+        if(pTrie->pNodes[dwNodeIndex].Character == Character)
+            return dwNodeIndex;
+    }
+
+    // The node array has been sized for the worst case
+    assert(pTrie->NodeCount < pTrie->NodeCountMax);
+    dwNodeIndex = (DWORD)pTrie->NodeCount++;
+
+    // Create new node and link it as the first child of the parent
+    pNode = pTrie->pNodes + dwNodeIndex;
+    pNode->FirstChild = 0;
+    pNode->NextSibling = pTrie->pNodes[dwParent].FirstChild;
+    pNode->PackageIndex = CASC_INVALID_PACKAGE;
+    pNode->Character = Character;
+    pTrie->pNodes[dwParent].FirstChild = dwNodeIndex;
+    return dwNodeIndex;
+}
+
+static int CreatePackageTrie(PCASC_MNDX_PACKAGES pPackages, PCASC_MNDX_PACKAGE_TRIE pTrie)
+{
+    PCASC_MNDX_PACKAGE pPackage = pPackages->Packages;
+    DWORD dwNodeIndex;
+
+    // Each character in the name buffer creates at most one node. Plus the root node
+    pTrie->NodeCountMax = pPackages->NameBufferUsed + 1;
+    pTrie->pNodes = CASC_ALLOC(CASC_MNDX_PACKAGE_NODE, pTrie->NodeCountMax);
+    if(pTrie->pNodes == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Initialize the root node
+    memset(pTrie->pNodes, 0, sizeof(CASC_MNDX_PACKAGE_NODE));
+    pTrie->pNodes[0].PackageIndex = CASC_INVALID_PACKAGE;
+    pTrie->NodeCount = 1;
+
+    // Insert all package names
+    for(size_t i = 0; i < pPackages->NameEntries; i++, pPackage++)
+    {
+        if(pPackage->szFileName != NULL && pPackage->nLength != 0)
+        {
+            dwNodeIndex = 0;
+            for(size_t j = 0; j < pPackage->nLength; j++)
+                dwNodeIndex = InsertPackageNode(pTrie, dwNodeIndex, (BYTE)pPackage->szFileName[j]);
+
+            // If there are more packages with the same name, the first one wins
+            if(pTrie->pNodes[dwNodeIndex].PackageIndex == CASC_INVALID_PACKAGE)
+                pTrie->pNodes[dwNodeIndex].PackageIndex = (DWORD)i;
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static void FreePackageTrie(PCASC_MNDX_PACKAGE_TRIE pTrie)
+{
+    if(pTrie->pNodes != NULL)
+        CASC_FREE(pTrie->pNodes);
+    pTrie->pNodes = NULL;
+    pTrie->NodeCount = 0;
+    pTrie->NodeCountMax = 0;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of root file functions
 
@@ -2920,46 +3254,48 @@ struct TRootHandler_MNDX : public TRootHandler
 {
     CASC_MNDX_INFO MndxInfo;
 
+    LPBYTE pbRootFile;                          // The ROOT file. MAR databases and MNDX entries point into it
     PCASC_ROOT_ENTRY_MNDX * ppValidEntries;
     PCASC_ROOT_ENTRY_MNDX pMndxEntries;
+    bool bMndxEntriesCopied;                    // If true, pMndxEntries is an own copy
     PCASC_MNDX_PACKAGES pPackages;              // Linear list of present packages
+    CASC_MNDX_PACKAGE_TRIE PackageTrie;         // Prefix trie of the package names
+    struct _MNDX_SUBTREE_LIST * pSubtreeLists;  // Subtrees of partitioned searches, one list per partition count
+    CASC_LOCK SubtreeLock;                      // Guards the list of subtree lists
 };
 
 PCASC_MNDX_PACKAGE FindMndxPackage(TRootHandler_MNDX * pRootHandler, const char * szFileName)
 {
-    PCASC_MNDX_PACKAGE pMatching = NULL;
-    PCASC_MNDX_PACKAGE pPackage;
-    size_t nMaxLength = 0;
-    size_t nLength = strlen(szFileName);
+    PCASC_MNDX_PACKAGE_NODE pNodes = pRootHandler->PackageTrie.pNodes;
+    DWORD dwPackageIndex = CASC_INVALID_PACKAGE;
+    DWORD dwNodeIndex = 0;
 
     // Packages must be loaded
     assert(pRootHandler->pPackages != NULL);
-    pPackage = pRootHandler->pPackages->Packages;
+    assert(pNodes != NULL);
 
-    //FILE * fp = fopen("E:\\packages.txt", "wt");
-    //for(size_t i = 0; i < hs->pPackages->NameEntries; i++, pPackage++)
-    //{
-    //    if(pPackage->szFileName != NULL)
-    //        fprintf(fp, "%s\n", pPackage->szFileName);
-    //}
-    //fclose(fp);
-
-    // Find the longest matching name
-    for(size_t i = 0; i < pRootHandler->pPackages->NameEntries; i++, pPackage++)
+    // Walk the trie as long as the name matches. Remember the longest package
+    // that is shorter than the file name itself
+    while(szFileName[0] != 0)
     {
-        if(pPackage->szFileName != NULL && pPackage->nLength < nLength && pPackage->nLength > nMaxLength)
+        if(pNodes[dwNodeIndex].PackageIndex != CASC_INVALID_PACKAGE)
+            dwPackageIndex = pNodes[dwNodeIndex].PackageIndex;
+
+        // Find the child for the next character
+        for(dwNodeIndex = pNodes[dwNodeIndex].FirstChild; dwNodeIndex != 0; dwNodeIndex = pNodes[dwNodeIndex].NextSibling)
         {
-            // Compare the package name
-            if(!strncmp(szFileName, pPackage->szFileName, pPackage->nLength))
-            {
-                pMatching = pPackage;
-                nMaxLength = pPackage->nLength;
-            }
+            if(pNodes[dwNodeIndex].Character == (BYTE)szFileName[0])
+                break;
         }
+
+        // No more matching packages?
+        if(dwNodeIndex == 0)
+            break;
+        szFileName++;
     }
 
     // Give the package pointer or NULL if not found
-    return pMatching;
+    return (dwPackageIndex != CASC_INVALID_PACKAGE) ? &pRootHandler->pPackages->Packages[dwPackageIndex] : NULL;
 }
 
 int SearchMndxInfo(TRootHandler_MNDX * pRootHandler, const char * szFileName, DWORD dwPackage, PCASC_ROOT_ENTRY_MNDX * ppRootEntry)
@@ -3040,47 +3376,381 @@ static LPBYTE FillFindData(TRootHandler_MNDX * pRootHandler, TCascSearch * pSear
     return pRootEntry->EncodingKey;
 }
 
+//-----------------------------------------------------------------------------
+// Partitioned search. The name database is split to subtrees of the MAR trie,
+// and each partition enumerates a contiguous range of them
+
+#define MNDX_SUBTREES_PER_PART  0x10            // Number of subtrees we try to create per one partition
+#define MNDX_MAX_SPLIT_LEVEL    0x08            // Maximum depth of the trie to split at
+
+// One subtree of the name database
+typedef struct _MNDX_SUBTREE
+{
+    DWORD ItemIndex;                            // Index of the subtree root node
+    DWORD NameOffset;                           // Offset of the node path in the name buffer
+    DWORD NameLength;                           // Length of the node path
+    bool  bNodeOnly;                            // If true, only the node itself belongs to this subtree
+
+} MNDX_SUBTREE, *PMNDX_SUBTREE;
+
+// List of subtrees, in the same order as they are enumerated
+typedef struct _MNDX_SUBTREE_LIST
+{
+    PMNDX_SUBTREE pSubtrees;                    // Array of subtrees
+    DWORD SubtreeCount;                         // Number of subtrees
+    DWORD SubtreeMax;                           // Capacity of the subtree array
+
+    char * szNameBuffer;                        // Buffer for node paths
+    DWORD NameBufferUsed;                       // Number of bytes used in the name buffer
+    DWORD NameBufferMax;                        // Capacity of the name buffer
+
+    struct _MNDX_SUBTREE_LIST * pNext;          // Next list kept by the root handler
+    DWORD dwPartCount;                          // Number of partitions the list was made for
+
+} MNDX_SUBTREE_LIST, *PMNDX_SUBTREE_LIST;
+
+// Search context of the MNDX root handler
+struct TMndxSearch
+{
+    TMndxSearch()
+    {
+        pSubtrees = NULL;
+        SubtreeIndex = SubtreeEnd = 0;
+        bSubtreeStarted = false;
+    }
+
+    TMndxFindResult Struct1C;                   // Search structure for the MAR file
+    PMNDX_SUBTREE_LIST pSubtrees;               // Subtrees of the whole database, owned by the root handler. NULL if not partitioned
+    DWORD SubtreeIndex;                         // Index of the current subtree
+    DWORD SubtreeEnd;                           // Index of the first subtree that doesn't belong to the partition
+    bool bSubtreeStarted;                       // true if the current subtree has been started
+};
+
+static void FreeSubtreeList(PMNDX_SUBTREE_LIST pList)
+{
+    if(pList->pSubtrees != NULL)
+        CASC_FREE(pList->pSubtrees);
+    if(pList->szNameBuffer != NULL)
+        CASC_FREE(pList->szNameBuffer);
+    memset(pList, 0, sizeof(MNDX_SUBTREE_LIST));
+}
+
+static bool InsertSubtree(PMNDX_SUBTREE_LIST pList, DWORD ItemIndex, const char * szPath, DWORD cchPath, bool bNodeOnly)
+{
+    PMNDX_SUBTREE pSubtree;
+
+    // Enlarge the subtree array, if needed
+    if(pList->SubtreeCount >= pList->SubtreeMax)
+    {
+        DWORD SubtreeMax = (pList->SubtreeMax != 0) ? (pList->SubtreeMax * 2) : 0x40;
+
+        pSubtree = CASC_REALLOC(MNDX_SUBTREE, pList->pSubtrees, SubtreeMax);
+        if(pSubtree == NULL)
+            return false;
+        pList->pSubtrees = pSubtree;
+        pList->SubtreeMax = SubtreeMax;
+    }
+
+    // Enlarge the name buffer, if needed
+    if((pList->NameBufferUsed + cchPath) > pList->NameBufferMax)
+    {
+        DWORD NameBufferMax = (pList->NameBufferMax != 0) ? pList->NameBufferMax : 0x1000;
+        char * szNameBuffer;
+
+        while(NameBufferMax < (pList->NameBufferUsed + cchPath))
+            NameBufferMax *= 2;
+
+        szNameBuffer = CASC_REALLOC(char, pList->szNameBuffer, NameBufferMax);
+        if(szNameBuffer == NULL)
+            return false;
+        pList->szNameBuffer = szNameBuffer;
+        pList->NameBufferMax = NameBufferMax;
+    }
+
+    // Insert the new subtree
+    pSubtree = pList->pSubtrees + pList->SubtreeCount++;
+    pSubtree->ItemIndex = ItemIndex;
+    pSubtree->NameOffset = pList->NameBufferUsed;
+    pSubtree->NameLength = cchPath;
+    pSubtree->bNodeOnly = bNodeOnly;
+    memcpy(pList->szNameBuffer + pList->NameBufferUsed, szPath, cchPath);
+    pList->NameBufferUsed += cchPath;
+    return true;
+}
+
+// Appends the name fragment of the node to the path being built. Same as in sub_1959460
+static void AppendNodeFragment(TFileNameDatabase * pDB, TMndxFindResult * pStruct1C, DWORD ItemIndex)
+{
+    DWORD FragOffs;
+
+    if(pDB->Struct68_D0.IsItemPresent(ItemIndex))
+    {
+        FragOffs = pDB->GetNameFragmentOffset(ItemIndex);
+        if(pDB->NextDB.pDB != NULL)
+            pDB->NextDB.pDB->sub_1958D70(pStruct1C, FragOffs);
+        else
+            pDB->IndexStruct_174.CopyNameFragment(pStruct1C, FragOffs);
+    }
+    else
+    {
+        pStruct1C->pStruct40->array_00.InsertOneItem_CHAR(pDB->FrgmDist_LoBits.CharArray[ItemIndex]);
+    }
+}
+
+// Replaces the subtree with the node itself (if it has a name) and with all subtrees of its children
+static bool SplitSubtree(TFileNameDatabase * pDB, TMndxFindResult * pStruct1C, PMNDX_SUBTREE_LIST pSrcList, PMNDX_SUBTREE pSubtree, PMNDX_SUBTREE_LIST pTrgList)
+{
+    TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szNodePath = pSrcList->szNameBuffer + pSubtree->NameOffset;
+    DWORD CollisionIndex;
+    DWORD ChildIndex;
+
+    // The node itself is a file name
+    if(pDB->FileNameIndexes.IsItemPresent(pSubtree->ItemIndex))
+    {
+        if(!InsertSubtree(pTrgList, pSubtree->ItemIndex, szNodePath, pSubtree->NameLength, true))
+            return false;
+    }
+
+    // Children of the node have consecutive item indexes
+    CollisionIndex = pDB->sub_1959CB0(pSubtree->ItemIndex) + 1;
+    ChildIndex = CollisionIndex - pSubtree->ItemIndex - 1;
+    while(pDB->Struct68_00.IsItemPresent(CollisionIndex++))
+    {
+        // Create the path of the child node
+        pStruct40->array_00.ItemCount = 0;
+        pStruct40->array_00.InsertItems_CHARS(szNodePath, pSubtree->NameLength);
+        AppendNodeFragment(pDB, pStruct1C, ChildIndex);
+
+        if(!InsertSubtree(pTrgList, ChildIndex, pStruct40->array_00.FirstValid.Chars, pStruct40->array_00.ItemCount, false))
+            return false;
+        ChildIndex++;
+    }
+
+    return true;
+}
+
+static int CreateSubtreeList(TFileNameDatabase * pDB, DWORD dwMinSubtrees, PMNDX_SUBTREE_LIST pList)
+{
+    MNDX_SUBTREE_LIST NewList;
+    TMndxFindResult Struct1C;
+    int nError = ERROR_SUCCESS;
+
+    // Prepare the buffer for building paths
+    Struct1C.CreateStruct40();
+    if(Struct1C.pStruct40 == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+    Struct1C.pStruct40->InitSearchBuffers();
+
+    // Start with the whole database
+    memset(pList, 0, sizeof(MNDX_SUBTREE_LIST));
+    if(!InsertSubtree(pList, 0, "", 0, false))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Split the subtrees level by level until we have enough of them
+    for(DWORD dwLevel = 0; dwLevel < MNDX_MAX_SPLIT_LEVEL && pList->SubtreeCount < dwMinSubtrees; dwLevel++)
+    {
+        memset(&NewList, 0, sizeof(MNDX_SUBTREE_LIST));
+
+        for(DWORD i = 0; i < pList->SubtreeCount; i++)
+        {
+            PMNDX_SUBTREE pSubtree = pList->pSubtrees + i;
+            bool bResult;
+
+            if(pSubtree->bNodeOnly)
+                bResult = InsertSubtree(&NewList, pSubtree->ItemIndex, pList->szNameBuffer + pSubtree->NameOffset, pSubtree->NameLength, true);
+            else
+                bResult = SplitSubtree(pDB, &Struct1C, pList, pSubtree, &NewList);
+
+            if(bResult == false)
+            {
+                nError = ERROR_NOT_ENOUGH_MEMORY;
+                break;
+            }
+        }
+
+        // Stop splitting if there was an error or if nothing could be split
+        if(nError != ERROR_SUCCESS || NewList.SubtreeCount == pList->SubtreeCount)
+        {
+            FreeSubtreeList(&NewList);
+            break;
+        }
+
+        // Switch the lists
+        FreeSubtreeList(pList);
+        *pList = NewList;
+    }
+
+    return nError;
+}
+
+// The subtree list depends only on the name database and the partition count,
+// so all partitions of a search share one list that is kept until the storage is closed
+static PMNDX_SUBTREE_LIST GetSubtreeList(TRootHandler_MNDX * pRootHandler, DWORD dwPartCount)
+{
+    TFileNameDatabase * pDB = pRootHandler->MndxInfo.pMarFile3->pDatabasePtr->pDB;
+    PMNDX_SUBTREE_LIST pList;
+
+    CascLock_Enter(&pRootHandler->SubtreeLock);
+
+    // Reuse the list made for the same partition count
+    for(pList = pRootHandler->pSubtreeLists; pList != NULL; pList = pList->pNext)
+    {
+        if(pList->dwPartCount == dwPartCount)
+            break;
+    }
+
+    // Create a new list
+    if(pList == NULL && (pList = CASC_ALLOC(MNDX_SUBTREE_LIST, 1)) != NULL)
+    {
+        if(CreateSubtreeList(pDB, dwPartCount * MNDX_SUBTREES_PER_PART, pList) == ERROR_SUCCESS)
+        {
+            pList->dwPartCount = dwPartCount;
+            pList->pNext = pRootHandler->pSubtreeLists;
+            pRootHandler->pSubtreeLists = pList;
+        }
+        else
+        {
+            FreeSubtreeList(pList);
+            CASC_FREE(pList);
+            pList = NULL;
+        }
+    }
+
+    CascLock_Leave(&pRootHandler->SubtreeLock);
+    return pList;
+}
+
+static bool MndxSearch_NextInPartition(TFileNameDatabase * pDB, TMndxSearch * pMndxSearch)
+{
+    TMndxFindResult * pStruct1C = &pMndxSearch->Struct1C;
+    TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    PMNDX_SUBTREE pSubtree;
+    PATH_STOP PathStop;
+
+    while(pMndxSearch->SubtreeIndex < pMndxSearch->SubtreeEnd)
+    {
+        pSubtree = pMndxSearch->pSubtrees->pSubtrees + pMndxSearch->SubtreeIndex;
+
+        // When starting the subtree, we put the path of its node
+        // and prepare the search structure the same way sub_1959460 does
+        if(pMndxSearch->bSubtreeStarted == false)
+        {
+            pStruct40->InitSearchBuffers();
+            pStruct40->array_00.InsertItems_CHARS(pMndxSearch->pSubtrees->szNameBuffer + pSubtree->NameOffset, pSubtree->NameLength);
+            pMndxSearch->bSubtreeStarted = true;
+
+            if(pSubtree->bNodeOnly == false)
+            {
+                PathStop.ItemIndex = pSubtree->ItemIndex;
+                PathStop.field_4   = 0;
+                PathStop.field_8   = pStruct40->array_00.ItemCount;
+                PathStop.field_C   = 0xFFFFFFFF;
+                PathStop.field_10  = 0xFFFFFFFF;
+                pStruct40->PathStops.InsertOneItem_PATH_STOP(PathStop);
+                pStruct40->ItemCount = 1;
+            }
+
+            // Report the node itself, if it is a file name
+            if(pDB->FileNameIndexes.IsItemPresent(pSubtree->ItemIndex))
+            {
+                pStruct1C->szFoundPath   = pStruct40->array_00.FirstValid.Chars;
+                pStruct1C->cchFoundPath  = pStruct40->array_00.ItemCount;
+                pStruct1C->FileNameIndex = pDB->FileNameIndexes.GetItemValue(pSubtree->ItemIndex);
+                return true;
+            }
+        }
+
+        // Continue with the rest of the subtree
+        if(pSubtree->bNodeOnly == false && pDB->sub_1959460(pStruct1C))
+            return true;
+
+        // Move to the next subtree
+        pMndxSearch->SubtreeIndex++;
+        pMndxSearch->bSubtreeStarted = false;
+    }
+
+    return false;
+}
+
+static TMndxSearch * CreateMndxSearch(TRootHandler_MNDX * pRootHandler, TCascSearch * pSearch)
+{
+    TMndxSearch * pMndxSearch;
+    DWORD SubtreeCount;
+
+    // Create the new search structure
+    pMndxSearch = new TMndxSearch;
+    if(pMndxSearch == NULL)
+        return NULL;
+
+    // Setup the search mask
+    pMndxSearch->Struct1C.SetSearchPath("", 0);
+
+    // Partitioned search: take our part of the subtrees
+    if(pSearch->dwPartCount != 0)
+    {
+        pMndxSearch->pSubtrees = GetSubtreeList(pRootHandler, pSearch->dwPartCount);
+        if(pMndxSearch->pSubtrees == NULL || pMndxSearch->Struct1C.CreateStruct40() != ERROR_SUCCESS)
+        {
+            delete pMndxSearch;
+            return NULL;
+        }
+
+        SubtreeCount = pMndxSearch->pSubtrees->SubtreeCount;
+        pMndxSearch->SubtreeIndex = (DWORD)(((ULONGLONG)SubtreeCount * pSearch->dwPartIndex) / pSearch->dwPartCount);
+        pMndxSearch->SubtreeEnd = (DWORD)(((ULONGLONG)SubtreeCount * (pSearch->dwPartIndex + 1)) / pSearch->dwPartCount);
+    }
+
+    return pMndxSearch;
+}
+
 static LPBYTE MndxHandler_Search(TRootHandler_MNDX * pRootHandler, TCascSearch * pSearch, PDWORD PtrFileSize, PDWORD /* PtrLocaleFlags */)
 {
-    TMndxFindResult * pStruct1C = NULL;
+    TMndxSearch * pMndxSearch = NULL;
     PCASC_MNDX_INFO pMndxInfo = &pRootHandler->MndxInfo;
     PMAR_FILE pMarFile = pMndxInfo->pMarFile3;
+    LPBYTE pbEncodingKey;
     bool bFindResult = false;
         
     // If the first time, allocate the structure for the search result
     if(pSearch->pRootContext == NULL)
     {
-        // Create the new search structure
-        pStruct1C = new TMndxFindResult;
-        if(pStruct1C == NULL)
+        pSearch->pRootContext = CreateMndxSearch(pRootHandler, pSearch);
+        if(pSearch->pRootContext == NULL)
             return NULL;
-
-        // Setup the search mask
-        pStruct1C->SetSearchPath("", 0);
-        pSearch->pRootContext = pStruct1C;
     }
 
     // Make shortcut for the search structure
     assert(pSearch->pRootContext != NULL);
-    pStruct1C = (TMndxFindResult *)pSearch->pRootContext;
+    pMndxSearch = (TMndxSearch *)pSearch->pRootContext;
 
-    // Search the next file name (our code)
-    pMarFile->pDatabasePtr->sub_1956CE0(pStruct1C, &bFindResult);
-    if(bFindResult == false)
-        return NULL;
+    for(;;)
+    {
+        // Search the next file name, either in the whole database or in the partition
+        if(pSearch->dwPartCount != 0)
+            bFindResult = MndxSearch_NextInPartition(pMarFile->pDatabasePtr->pDB, pMndxSearch);
+        else
+            pMarFile->pDatabasePtr->sub_1956CE0(&pMndxSearch->Struct1C, &bFindResult);
+        if(bFindResult == false)
+            return NULL;
 
-    // Give the file size and encoding key
-    return FillFindData(pRootHandler, pSearch, pStruct1C, PtrFileSize);
+        // Give the file size and encoding key. A partition skips names without
+        // a root entry, so that it doesn't cut off the rest of its subtrees
+        pbEncodingKey = FillFindData(pRootHandler, pSearch, &pMndxSearch->Struct1C, PtrFileSize);
+        if(pbEncodingKey != NULL || pSearch->dwPartCount == 0)
+            return pbEncodingKey;
+    }
 }
 
 static void MndxHandler_EndSearch(TRootHandler_MNDX * /* pRootHandler */, TCascSearch * pSearch)
 {
-
     if(pSearch != NULL)
     {
-        TMndxFindResult * pStruct1C = (TMndxFindResult *)pSearch->pRootContext;
+        TMndxSearch * pMndxSearch = (TMndxSearch *)pSearch->pRootContext;
 
-        delete pStruct1C;
+        if(pMndxSearch != NULL)
+            delete pMndxSearch;
+        pSearch->pRootContext = NULL;
     }
 }
 
@@ -3116,6 +3786,17 @@ static LPBYTE MndxHandler_GetKey(TRootHandler_MNDX * pRootHandler, const char *
 
 static void MndxHandler_Close(TRootHandler_MNDX * pRootHandler)
 {
+    PMNDX_SUBTREE_LIST pList;
+
+    // Free the subtree lists of partitioned searches
+    while((pList = pRootHandler->pSubtreeLists) != NULL)
+    {
+        pRootHandler->pSubtreeLists = pList->pNext;
+        FreeSubtreeList(pList);
+        CASC_FREE(pList);
+    }
+    CascLock_Free(&pRootHandler->SubtreeLock);
+
     if(pRootHandler->MndxInfo.pMarFile1 != NULL)
         MAR_FILE_Destructor(pRootHandler->MndxInfo.pMarFile1);
     if(pRootHandler->MndxInfo.pMarFile2 != NULL)
@@ -3124,10 +3805,15 @@ static void MndxHandler_Close(TRootHandler_MNDX * pRootHandler)
         MAR_FILE_Destructor(pRootHandler->MndxInfo.pMarFile3);
     if(pRootHandler->ppValidEntries != NULL)
         CASC_FREE(pRootHandler->ppValidEntries);
-    if(pRootHandler->pMndxEntries != NULL)
+    if(pRootHandler->pMndxEntries != NULL && pRootHandler->bMndxEntriesCopied)
         CASC_FREE(pRootHandler->pMndxEntries);
     if(pRootHandler->pPackages != NULL)
         CASC_FREE(pRootHandler->pPackages);
+    FreePackageTrie(&pRootHandler->PackageTrie);
+
+    // The ROOT file must be freed after the MAR databases
+    if(pRootHandler->pbRootFile != NULL)
+        CASC_FREE(pRootHandler->pbRootFile);
 
     CASC_FREE(pRootHandler);
 }
@@ -3143,7 +3829,7 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
     FILE_MAR_INFO MarInfo;
     PMAR_FILE pMarFile;
     LPBYTE pbRootFileEnd = pbRootFile + cbRootFile;
-    DWORD cbToAllocate;
+    DWORD cbMndxEntries;
     DWORD dwFilePointer = 0;
     DWORD i;
     int nError = ERROR_SUCCESS;
@@ -3159,6 +3845,7 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
 
     // Fill-in the handler functions
     memset(pRootHandler, 0, sizeof(TRootHandler_MNDX));
+    CascLock_Init(&pRootHandler->SubtreeLock);
     pRootHandler->Search      = (ROOT_SEARCH)MndxHandler_Search;
     pRootHandler->EndSearch   = (ROOT_ENDSEARCH)MndxHandler_EndSearch;
     pRootHandler->GetKey      = (ROOT_GETKEY)MndxHandler_GetKey;
@@ -3166,7 +3853,7 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
     pMndxInfo = &pRootHandler->MndxInfo;
 
     // Fill-in the flags
-    pRootHandler->dwRootFlags |= ROOT_FLAG_HAS_NAMES;
+    pRootHandler->dwRootFlags |= ROOT_FLAG_HAS_NAMES | ROOT_FLAG_PARTITIONED_SEARCH;
 
     // Copy the header into the MNDX info
     pMndxInfo->HeaderVersion = pMndxHeader->HeaderVersion;
@@ -3205,20 +3892,18 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
             break;
         }
 
-        // Allocate space for the MAR data
+        // The MAR data are used directly from the ROOT file
         pMarFile->pDatabasePtr = NULL;
-        pMarFile->pbMarData = CASC_ALLOC(BYTE, MarInfo.MarDataSize);
         pMarFile->cbMarData = MarInfo.MarDataSize;
-        if(pMarFile->pbMarData == NULL)
-        {
-            nError = ERROR_NOT_ENOUGH_MEMORY;
-            break;
-        }
-
-        // Read the MAR data
-        if(!RootFileRead(pbRootFile + MarInfo.MarDataOffset, pbRootFileEnd, pMarFile->pbMarData, pMarFile->cbMarData))
+        nError = RootFileGetData(pbRootFile + MarInfo.MarDataOffset,
+                                 pbRootFileEnd,
+                                 MarInfo.MarDataSize,
+                                 sizeof(ULONGLONG),
+                                &pMarFile->pbMarData,
+                                &pMarFile->bMarDataCopied);
+        if(nError != ERROR_SUCCESS)
         {
-            nError = ERROR_FILE_CORRUPT;
+            CASC_FREE(pMarFile);
             break;
         }
 
@@ -3251,15 +3936,13 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
         nError = pDbPtr->GetFileNameCount(&FileNameCount);
         if(nError == ERROR_SUCCESS && FileNameCount == pMndxInfo->MndxEntriesValid)
         {
-            cbToAllocate = pMndxInfo->MndxEntriesTotal * pMndxInfo->MndxEntrySize;
-            pRootHandler->pMndxEntries = (PCASC_ROOT_ENTRY_MNDX)CASC_ALLOC(BYTE, cbToAllocate);
-            if(pRootHandler->pMndxEntries != NULL)
-            {
-                if(!RootFileRead(pbRootFile + pMndxInfo->MndxEntriesOffset, pbRootFileEnd, pRootHandler->pMndxEntries, cbToAllocate))
-                    nError = ERROR_FILE_CORRUPT;
-            }
-            else
-                nError = ERROR_NOT_ENOUGH_MEMORY;
+            cbMndxEntries = pMndxInfo->MndxEntriesTotal * pMndxInfo->MndxEntrySize;
+            nError = RootFileGetData(pbRootFile + pMndxInfo->MndxEntriesOffset,
+                                     pbRootFileEnd,
+                                     cbMndxEntries,
+                                     sizeof(DWORD),
+                                    (LPBYTE *)&pRootHandler->pMndxEntries,
+                                    &pRootHandler->bMndxEntriesCopied);
         }
         else
             nError = ERROR_FILE_CORRUPT;
@@ -3304,6 +3987,8 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
     if(nError == ERROR_SUCCESS)
     {
         nError = LoadPackageNames(pMndxInfo, &pRootHandler->pPackages);
+        if(nError == ERROR_SUCCESS)
+            nError = CreatePackageTrie(pRootHandler->pPackages, &pRootHandler->PackageTrie);
         pMndxInfo->bRootFileLoaded = (nError == ERROR_SUCCESS);
     }
 
@@ -3313,11 +3998,239 @@ int RootHandler_CreateMNDX(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
 //  TestMndxRootFile(pRootHandler);
 #endif
 
+#if defined(_DEBUG) && defined(CASCLIB_TEST)
+    if(nError == ERROR_SUCCESS)
+        TestMndxNameFragments(pMndxInfo);
+#endif
+
+    // On success, the handler takes the ownership of the ROOT file
+    if(nError == ERROR_SUCCESS)
+        pRootHandler->pbRootFile = pbRootFile;
+
     // Return the result
     hs->pRootHandler = pRootHandler;
     return nError;
 }
 
+//----------------------------------------------------------------------------
+// Unit tests - name fragment functions
+// Compares the block-based name fragment functions with the original
+// character-by-character implementation
+
+#if defined(_DEBUG) && defined(CASCLIB_TEST)
+
+static bool CheckNameFragment_Ref(TNameIndexStruct & IndexStruct, TMndxFindResult * pStruct1C, DWORD dwFragOffs)
+{
+    TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szPathFragment;
+    const char * szSearchMask = pStruct1C->szSearchMask;
+
+    if(!IndexStruct.Struct68.TotalItemCount)
+    {
+        szPathFragment = (IndexStruct.NameFragments.CharArray + dwFragOffs - pStruct40->CharIndex);
+        while(szPathFragment[pStruct40->CharIndex] == szSearchMask[pStruct40->CharIndex])
+        {
+            pStruct40->CharIndex++;
+            if(szPathFragment[pStruct40->CharIndex] == 0)
+                return true;
+            if(pStruct40->CharIndex >= pStruct1C->cchSearchMask)
+                return false;
+        }
+    }
+    else
+    {
+        szPathFragment = (const char *)(IndexStruct.NameFragments.CharArray);
+        while(szPathFragment[dwFragOffs] == szSearchMask[pStruct40->CharIndex])
+        {
+            pStruct40->CharIndex++;
+            if(IndexStruct.Struct68.IsItemPresent(dwFragOffs++))
+                return true;
+            if(dwFragOffs >= pStruct1C->cchSearchMask)
+                return false;
+        }
+    }
+
+    return false;
+}
+
+static bool CheckAndCopyNameFragment_Ref(TNameIndexStruct & IndexStruct, TMndxFindResult * pStruct1C, DWORD dwFragOffs)
+{
+    TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szPathFragment;
+    const char * szSearchMask = pStruct1C->szSearchMask;
+
+    if(!IndexStruct.Struct68.TotalItemCount)
+    {
+        szPathFragment = (const char *)(IndexStruct.NameFragments.CharArray + dwFragOffs - pStruct40->CharIndex);
+        while(pStruct40->CharIndex < pStruct1C->cchSearchMask)
+        {
+            if(szPathFragment[pStruct40->CharIndex] != szSearchMask[pStruct40->CharIndex])
+                return false;
+            pStruct40->array_00.InsertOneItem_CHAR(szPathFragment[pStruct40->CharIndex]);
+            pStruct40->CharIndex++;
+            if(szPathFragment[pStruct40->CharIndex] == 0)
+                return true;
+        }
+
+        szPathFragment += pStruct40->CharIndex;
+        while(szPathFragment[0] != 0)
+            pStruct40->array_00.InsertOneItem_CHAR(*szPathFragment++);
+    }
+    else
+    {
+        szPathFragment = IndexStruct.NameFragments.CharArray;
+        while(dwFragOffs < pStruct1C->cchSearchMask)
+        {
+            if(szPathFragment[dwFragOffs] != szSearchMask[pStruct40->CharIndex])
+                return false;
+            pStruct40->array_00.InsertOneItem_CHAR(szPathFragment[dwFragOffs]);
+            pStruct40->CharIndex++;
+            if(IndexStruct.Struct68.IsItemPresent(dwFragOffs++))
+                return true;
+        }
+
+        szPathFragment += dwFragOffs;
+        while(IndexStruct.Struct68.IsItemPresent(dwFragOffs++) == 0)
+            pStruct40->array_00.InsertOneItem_CHAR(*szPathFragment++);
+    }
+
+    return true;
+}
+
+static void CopyNameFragment_Ref(TNameIndexStruct & IndexStruct, TMndxFindResult * pStruct1C, DWORD dwFragOffs)
+{
+    TStruct40 * pStruct40 = pStruct1C->pStruct40;
+    const char * szPathFragment;
+
+    if(!IndexStruct.Struct68.TotalItemCount)
+    {
+        szPathFragment = IndexStruct.NameFragments.CharArray + dwFragOffs;
+        while(szPathFragment[0] != 0)
+            pStruct40->array_00.InsertOneItem_CHAR(*szPathFragment++);
+    }
+    else
+    {
+        for(;;)
+        {
+            pStruct40->array_00.InsertOneItem_CHAR(IndexStruct.NameFragments.CharArray[dwFragOffs]);
+            if(IndexStruct.Struct68.IsItemPresent(dwFragOffs++))
+                break;
+        }
+    }
+}
+
+static void PrepareFragmentTest(TMndxFindResult & Struct1C, const char * szSearchMask, size_t cchSearchMask, DWORD CharIndex)
+{
+    if(Struct1C.pStruct40 == NULL)
+        Struct1C.CreateStruct40();
+    Struct1C.SetSearchPath(szSearchMask, cchSearchMask);
+    Struct1C.pStruct40->array_00.ItemCount = 0;
+    Struct1C.pStruct40->CharIndex = CharIndex;
+}
+
+static void TestNameFragment(TNameIndexStruct & IndexStruct, DWORD dwFragOffs, const char * szSearchMask, size_t cchSearchMask, DWORD CharIndex)
+{
+    TMndxFindResult Struct1C_1;
+    TMndxFindResult Struct1C_2;
+    TStruct40 * pStruct40_1;
+    TStruct40 * pStruct40_2;
+    bool bResult1;
+    bool bResult2;
+
+    // Exercise CheckNameFragment
+    PrepareFragmentTest(Struct1C_1, szSearchMask, cchSearchMask, CharIndex);
+    PrepareFragmentTest(Struct1C_2, szSearchMask, cchSearchMask, CharIndex);
+    pStruct40_1 = Struct1C_1.pStruct40;
+    pStruct40_2 = Struct1C_2.pStruct40;
+    bResult1 = CheckNameFragment_Ref(IndexStruct, &Struct1C_1, dwFragOffs);
+    bResult2 = IndexStruct.CheckNameFragment(&Struct1C_2, dwFragOffs);
+    assert(bResult1 == bResult2);
+    assert(pStruct40_1->CharIndex == pStruct40_2->CharIndex);
+
+    // Exercise CheckAndCopyNameFragment
+    PrepareFragmentTest(Struct1C_1, szSearchMask, cchSearchMask, CharIndex);
+    PrepareFragmentTest(Struct1C_2, szSearchMask, cchSearchMask, CharIndex);
+    bResult1 = CheckAndCopyNameFragment_Ref(IndexStruct, &Struct1C_1, dwFragOffs);
+    bResult2 = IndexStruct.CheckAndCopyNameFragment(&Struct1C_2, dwFragOffs);
+    assert(bResult1 == bResult2);
+    assert(pStruct40_1->CharIndex == pStruct40_2->CharIndex);
+    assert(pStruct40_1->array_00.ItemCount == pStruct40_2->array_00.ItemCount);
+    assert(memcmp(pStruct40_1->array_00.CharArray, pStruct40_2->array_00.CharArray, pStruct40_1->array_00.ItemCount) == 0);
+
+    // Exercise CopyNameFragment
+    PrepareFragmentTest(Struct1C_1, szSearchMask, cchSearchMask, CharIndex);
+    PrepareFragmentTest(Struct1C_2, szSearchMask, cchSearchMask, CharIndex);
+    CopyNameFragment_Ref(IndexStruct, &Struct1C_1, dwFragOffs);
+    IndexStruct.CopyNameFragment(&Struct1C_2, dwFragOffs);
+    assert(pStruct40_1->array_00.ItemCount == pStruct40_2->array_00.ItemCount);
+    assert(memcmp(pStruct40_1->array_00.CharArray, pStruct40_2->array_00.CharArray, pStruct40_1->array_00.ItemCount) == 0);
+}
+
+static void TestNameFragments(TNameIndexStruct & IndexStruct)
+{
+    TMndxFindResult Struct1C;
+    DWORD dwFragOffs = 0;
+    size_t cchFragment;
+    size_t cchPrefix;
+    char szSearchMask[MAX_PATH + 1];
+
+    Struct1C.CreateStruct40();
+
+    // Check every fragment in the table
+    while(dwFragOffs < IndexStruct.NameFragments.ItemCount)
+    {
+        // Retrieve the complete fragment
+        PrepareFragmentTest(Struct1C, "", 0, 0);
+        CopyNameFragment_Ref(IndexStruct, &Struct1C, dwFragOffs);
+        cchFragment = Struct1C.pStruct40->array_00.ItemCount;
+
+        // Skip empty fragments and fragments that are too long
+        if(cchFragment == 0 || (cchFragment + 0x20) > MAX_PATH)
+        {
+            dwFragOffs = (cchFragment != 0) ? (dwFragOffs + (DWORD)cchFragment) : (dwFragOffs + 1);
+            continue;
+        }
+
+        // Try various search masks that are derived from the fragment
+        for(cchPrefix = 0; cchPrefix < 0x20; cchPrefix += 0x11)
+        {
+            memset(szSearchMask, '/', cchPrefix);
+            memcpy(szSearchMask + cchPrefix, Struct1C.pStruct40->array_00.CharArray, cchFragment);
+            memcpy(szSearchMask + cchPrefix + cchFragment, "/suffix.dds", 12);
+
+            // Exact match, longer mask, truncated mask
+            TestNameFragment(IndexStruct, dwFragOffs, szSearchMask, cchPrefix + cchFragment, (DWORD)cchPrefix);
+            TestNameFragment(IndexStruct, dwFragOffs, szSearchMask, cchPrefix + cchFragment + 11, (DWORD)cchPrefix);
+            TestNameFragment(IndexStruct, dwFragOffs, szSearchMask, cchPrefix + cchFragment / 2, (DWORD)cchPrefix);
+
+            // Mismatch at the end of the fragment
+            szSearchMask[cchPrefix + cchFragment - 1] ^= 0x20;
+            TestNameFragment(IndexStruct, dwFragOffs, szSearchMask, cchPrefix + cchFragment + 11, (DWORD)cchPrefix);
+        }
+
+        // Move to the next fragment
+        dwFragOffs = (IndexStruct.Struct68.TotalItemCount != 0) ? (dwFragOffs + (DWORD)cchFragment) : (dwFragOffs + (DWORD)cchFragment + 1);
+    }
+}
+
+void TestMndxNameFragments(PCASC_MNDX_INFO pMndxInfo)
+{
+    PMAR_FILE MarFiles[3] = {pMndxInfo->pMarFile1, pMndxInfo->pMarFile2, pMndxInfo->pMarFile3};
+
+    for(size_t i = 0; i < 3; i++)
+    {
+        TFileNameDatabase * pDB = MarFiles[i]->pDatabasePtr->pDB;
+
+        // Test the fragments of the database and all its sub-databases
+        while(pDB != NULL)
+        {
+            TestNameFragments(pDB->IndexStruct_174);
+            pDB = pDB->NextDB.pDB;
+        }
+    }
+}
+#endif  // defined(_DEBUG) && defined(CASCLIB_TEST)
+
 //----------------------------------------------------------------------------
 // Unit tests
 
@@ -3584,7 +4497,7 @@ void TestMndxRootFile(PCASC_MNDX_INFO pMndxInfo)
     if(pvListFile != NULL)
     {
         // Check every file in the database
-        while((nLength = ListFile_GetNext(pvListFile, "*", szFileName, MAX_PATH)) != 0)
+        while((nLength = ListFile_GetNext(pvListFile, NULL, szFileName, MAX_PATH)) != 0)
         {
             // Normalize the file name: ToLower + BackSlashToSlash
             NormalizeFileName_LowerSlash(szFileName, szFileName, MAX_PATH);
@@ -15,16 +15,205 @@
 //-----------------------------------------------------------------------------
 // Structure definitions for Overwatch root file
 
+// The ROOT file is a text file. The first line is the header with column names,
+// e.g. "#MD5|CHUNK_ID|FILENAME|INSTALLPATH". Each next line describes one file.
+#define OVR_MAX_COLUMNS         0x10
+#define OVR_INVALID_COLUMN      0xFFFFFFFF
+
+typedef struct _OVR_ROOT_LINE
+{
+    char * ColBegin[OVR_MAX_COLUMNS];               // Begin of each column
+    char * ColEnd[OVR_MAX_COLUMNS];                 // End of each column
+    DWORD dwColumns;                                // Number of columns in the line
+
+} OVR_ROOT_LINE, *POVR_ROOT_LINE;
+
+typedef struct _CASC_OVR_ENTRY
+{
+    ULONGLONG FileNameHash;                         // Jenkins hash of the normalized file name
+    ENCODING_KEY EncodingKey;                       // Encoding key of the file
+    DWORD NameOffset;                               // Offset of the file name in the name arena
+
+} CASC_OVR_ENTRY, *PCASC_OVR_ENTRY;
+
 struct TRootHandler_Ovr : public TRootHandler
 {
-    DWORD dwDummy;
+    // Linear list of all files, in the order of the ROOT file
+    PCASC_OVR_ENTRY pFileTable;
+    DWORD dwFileCountMax;                           // Maximum number of files in the table
+    DWORD dwFileCount;                              // Current number of files in the table
+
+    // Hash table of FileNameHash -> file entry
+    PCASC_MAP pRootMap;
+
+    // Names of all files
+    CASC_ARENA NameArena;
 };
 
+//-----------------------------------------------------------------------------
+// Local functions
+
+// Splits one line of the ROOT file to columns. Returns pointer to the next line
+static char * SplitRootLine(POVR_ROOT_LINE pLine, char * szLinePtr, char * szFileEnd)
+{
+    DWORD dwColumns = 0;
+
+    // Find all column separators up to the end of the line
+    pLine->ColBegin[0] = szLinePtr;
+    while(szLinePtr < szFileEnd && szLinePtr[0] != '\n')
+    {
+        if(szLinePtr[0] == '|' && dwColumns < OVR_MAX_COLUMNS - 1)
+        {
+            pLine->ColEnd[dwColumns++] = szLinePtr;
+            pLine->ColBegin[dwColumns] = szLinePtr + 1;
+        }
+        szLinePtr++;
+    }
+
+    // Close the last column. Cut the CR from CR-LF line endings
+    pLine->ColEnd[dwColumns] = szLinePtr;
+    if(szLinePtr > pLine->ColBegin[dwColumns] && szLinePtr[-1] == '\r')
+        pLine->ColEnd[dwColumns]--;
+    pLine->dwColumns = dwColumns + 1;
+
+    // Skip the end-of-line character
+    return (szLinePtr < szFileEnd) ? szLinePtr + 1 : szLinePtr;
+}
+
+static DWORD FindColumn(POVR_ROOT_LINE pLine, const char * szColumnName)
+{
+    size_t nLength = strlen(szColumnName);
+
+    for(DWORD i = 0; i < pLine->dwColumns; i++)
+    {
+        char * szColBegin = pLine->ColBegin[i];
+
+        // The first column name starts with '#'
+        if(i == 0 && szColBegin < pLine->ColEnd[i] && szColBegin[0] == '#')
+            szColBegin++;
+
+        if((size_t)(pLine->ColEnd[i] - szColBegin) == nLength && !_strnicmp(szColBegin, szColumnName, nLength))
+            return i;
+    }
+
+    return OVR_INVALID_COLUMN;
+}
+
+static bool ConvertStringToEncodingKey(const char * szString, const char * szStringEnd, LPBYTE pbEncodingKey)
+{
+    // The encoding key must have exactly 32 hexadecimal digits
+    if((szStringEnd - szString) != (MD5_HASH_SIZE * 2))
+        return false;
+
+    return (BinaryFromString(szString, MD5_HASH_SIZE * 2, pbEncodingKey) == ERROR_SUCCESS);
+}
+
+static int InsertFileEntry(
+    TRootHandler_Ovr * pRootHandler,
+    const char * szFileName,
+    size_t nLength,
+    LPBYTE pbEncodingKey)
+{
+    PCASC_OVR_ENTRY pFileEntry = pRootHandler->pFileTable + pRootHandler->dwFileCount;
+    DWORD dwNameOffset;
+
+    // Make sure that we don't exceed the file limit
+    if(pRootHandler->dwFileCount >= pRootHandler->dwFileCountMax)
+        return ERROR_FILE_CORRUPT;
+
+    // Duplicate names are only inserted once
+    pFileEntry->FileNameHash = HashStringJenkins(szFileName);
+    if(Map_FindObject(pRootHandler->pRootMap, &pFileEntry->FileNameHash, NULL) != NULL)
+        return ERROR_SUCCESS;
+
+    // Copy the name to the name arena
+    if(Arena_InsertString(&pRootHandler->NameArena, szFileName, nLength, &dwNameOffset) == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    // Fill the file entry
+    memcpy(pFileEntry->EncodingKey.Value, pbEncodingKey, MD5_HASH_SIZE);
+    pFileEntry->NameOffset = dwNameOffset;
+    Map_InsertObject(pRootHandler->pRootMap, pFileEntry, &pFileEntry->FileNameHash);
+    pRootHandler->dwFileCount++;
+    return ERROR_SUCCESS;
+}
+
+static int ParseRootFile(TRootHandler_Ovr * pRootHandler, char * szRootFile, char * szRootFileEnd)
+{
+    OVR_ROOT_LINE Line;
+    DWORD dwFileNameColumn;
+    DWORD dwMD5Column;
+    size_t nLength;
+    char szFileName[MAX_PATH];
+    BYTE EncodingKey[MD5_HASH_SIZE];
+    int nError = ERROR_SUCCESS;
+
+    // Parse the header and find the columns that we need
+    szRootFile = SplitRootLine(&Line, szRootFile, szRootFileEnd);
+    dwMD5Column = FindColumn(&Line, "MD5");
+    dwFileNameColumn = FindColumn(&Line, "FILENAME");
+    if(dwMD5Column == OVR_INVALID_COLUMN || dwFileNameColumn == OVR_INVALID_COLUMN)
+        return ERROR_BAD_FORMAT;
+
+    // Parse all file lines
+    while(szRootFile < szRootFileEnd && nError == ERROR_SUCCESS)
+    {
+        szRootFile = SplitRootLine(&Line, szRootFile, szRootFileEnd);
+        if(dwMD5Column >= Line.dwColumns || dwFileNameColumn >= Line.dwColumns)
+            continue;
+
+        // Skip the lines with invalid encoding key or too long file name
+        nLength = (size_t)(Line.ColEnd[dwFileNameColumn] - Line.ColBegin[dwFileNameColumn]);
+        if(nLength == 0 || nLength >= MAX_PATH)
+            continue;
+        if(!ConvertStringToEncodingKey(Line.ColBegin[dwMD5Column], Line.ColEnd[dwMD5Column], EncodingKey))
+            continue;
+
+        // Insert the file to the tables
+        memcpy(szFileName, Line.ColBegin[dwFileNameColumn], nLength);
+        szFileName[nLength] = 0;
+        nError = InsertFileEntry(pRootHandler, szFileName, nLength, EncodingKey);
+    }
+
+    return nError;
+}
+
 //-----------------------------------------------------------------------------
 // Implementation of Overwatch root file
 
 static LPBYTE OvrHandler_Search(TRootHandler_Ovr * pRootHandler, TCascSearch * pSearch, PDWORD /* PtrFileSize */, PDWORD /* PtrLocaleFlags */)
 {
+    PCASC_OVR_ENTRY pFileEntry;
+    size_t IndexEnd = pRootHandler->dwFileCount;
+    char * szFileName;
+
+    // Partitioned search only goes through its part of the file table
+    if(pSearch->dwPartCount != 0)
+    {
+        if(pSearch->RootSearchPhase == 0)
+        {
+            pSearch->IndexLevel1 = (size_t)(((ULONGLONG)pRootHandler->dwFileCount * pSearch->dwPartIndex) / pSearch->dwPartCount);
+            pSearch->RootSearchPhase++;
+        }
+        IndexEnd = (size_t)(((ULONGLONG)pRootHandler->dwFileCount * (pSearch->dwPartIndex + 1)) / pSearch->dwPartCount);
+    }
+
+    // Go through the file table
+    while(pSearch->IndexLevel1 < IndexEnd)
+    {
+        pFileEntry = pRootHandler->pFileTable + pSearch->IndexLevel1;
+        pSearch->IndexLevel1++;
+
+        // Check the name against the search mask
+        szFileName = ARENA_POINTER(&pRootHandler->NameArena, pFileEntry->NameOffset);
+        if(WildCard_Check(&pSearch->WildCard, szFileName, strlen(szFileName)))
+        {
+            strcpy(pSearch->szFileName, szFileName);
+            pSearch->dwRootIndex = (DWORD)(pFileEntry - pRootHandler->pFileTable);
+            return pFileEntry->EncodingKey.Value;
+        }
+    }
+
     // No more entries
     return NULL;
 }
@@ -34,16 +223,41 @@ static void OvrHandler_EndSearch(TRootHandler_Ovr * /* pRootHandler */, TCascSea
     // Do nothing
 }
 
+static LPBYTE OvrHandler_GetEntryKey(TRootHandler_Ovr * pRootHandler, DWORD dwEntryIndex)
+{
+    return pRootHandler->pFileTable[dwEntryIndex].EncodingKey.Value;
+}
+
 static LPBYTE OvrHandler_GetKey(TRootHandler_Ovr * pRootHandler, const char * szFileName)
 {
+    PCASC_OVR_ENTRY pFileEntry;
+    ULONGLONG FileNameHash;
+
+    // Find the file directly
+    FileNameHash = HashStringJenkins(szFileName);
+    pFileEntry = (PCASC_OVR_ENTRY)Map_FindObject(pRootHandler->pRootMap, &FileNameHash, NULL);
+
     // Return the entry's encoding key or NULL
-    return NULL;
+    return (pFileEntry != NULL) ? pFileEntry->EncodingKey.Value : NULL;
 }
 
 static void OvrHandler_Close(TRootHandler_Ovr * pRootHandler)
 {
     if(pRootHandler != NULL)
     {
+        // Free the file map
+        if(pRootHandler->pRootMap != NULL)
+            Map_Free(pRootHandler->pRootMap);
+        pRootHandler->pRootMap = NULL;
+
+        // Free the file table
+        if(pRootHandler->pFileTable != NULL)
+            CASC_FREE(pRootHandler->pFileTable);
+        pRootHandler->pFileTable = NULL;
+
+        // Free the file names
+        Arena_Free(&pRootHandler->NameArena);
+
         // Free the root file itself
         CASC_FREE(pRootHandler);
     }
@@ -56,6 +270,8 @@ int RootHandler_CreateOverwatch(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRo
 {
     TRootHandler_Ovr * pRootHandler;
     LPBYTE pbRootFileEnd = pbRootFile + cbRootFile;
+    DWORD dwLineCount = 1;
+    int nError = ERROR_SUCCESS;
 
     // Allocate the root handler object
     pRootHandler = CASC_ALLOC(TRootHandler_Ovr, 1);
@@ -67,12 +283,28 @@ int RootHandler_CreateOverwatch(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRo
     pRootHandler->Search      = (ROOT_SEARCH)OvrHandler_Search;
     pRootHandler->EndSearch   = (ROOT_ENDSEARCH)OvrHandler_EndSearch;
     pRootHandler->GetKey      = (ROOT_GETKEY)OvrHandler_GetKey;
+    pRootHandler->GetEntryKey = (ROOT_GETENTRYKEY)OvrHandler_GetEntryKey;
     pRootHandler->Close       = (ROOT_CLOSE)OvrHandler_Close;
 
     // Fill-in the flags
-    pRootHandler->dwRootFlags |= ROOT_FLAG_HAS_NAMES;
+    pRootHandler->dwRootFlags |= ROOT_FLAG_HAS_NAMES | ROOT_FLAG_PARTITIONED_SEARCH;
     hs->pRootHandler = pRootHandler;
-    
-    // Succeeded
-    return ERROR_SUCCESS;
+
+    // Each line describes at most one file
+    for(LPBYTE pbLinePtr = pbRootFile; pbLinePtr < pbRootFileEnd; pbLinePtr++)
+        dwLineCount += (pbLinePtr[0] == '\n') ? 1 : 0;
+
+    // Allocate the linear file table and the hash table
+    Arena_Init(&pRootHandler->NameArena);
+    pRootHandler->pFileTable = CASC_ALLOC(CASC_OVR_ENTRY, dwLineCount);
+    pRootHandler->pRootMap = Map_Create(dwLineCount, sizeof(ULONGLONG), FIELD_OFFSET(CASC_OVR_ENTRY, FileNameHash));
+    if(pRootHandler->pFileTable == NULL || pRootHandler->pRootMap == NULL)
+        nError = ERROR_NOT_ENOUGH_MEMORY;
+    pRootHandler->dwFileCountMax = dwLineCount;
+
+    // Parse the ROOT file
+    if(nError == ERROR_SUCCESS)
+        nError = ParseRootFile(pRootHandler, (char *)pbRootFile, (char *)pbRootFileEnd);
+    pRootHandler->dwEntryCount = pRootHandler->dwFileCount;
+    return nError;
 }
@@ -298,7 +298,7 @@ static LPBYTE WowHandler_Search(TRootHandler_WoW6 * pRootHandler, TCascSearch *
     if(pSearch->RootSearchPhase == ROOT_SEARCH_PHASE_LISTFILE)
     {
         // Keep going through the listfile
-        while(ListFile_GetNext(pSearch->pCache, pSearch->szMask, pSearch->szFileName, MAX_PATH))
+        while(ListFile_GetNext(pSearch->pCache, &pSearch->WildCard, pSearch->szFileName, MAX_PATH))
         {
             // Find the root entry
             pRootEntry = FindRootEntry(pRootHandler->pRootMap, pSearch->szFileName, &TableIndex);
@@ -312,6 +312,7 @@ static LPBYTE WowHandler_Search(TRootHandler_WoW6 * pRootHandler, TCascSearch *
                 // Give the caller the locale mask
                 if(PtrLocaleFlags != NULL)
                     PtrLocaleFlags[0] = pRootEntry->Locales;
+                pSearch->dwRootIndex = (DWORD)(pRootEntry - pRootHandler->pRootEntries);
                 return (LPBYTE)pRootEntry->EncodingKey;
             }
         }
@@ -343,6 +344,7 @@ static LPBYTE WowHandler_Search(TRootHandler_WoW6 * pRootHandler, TCascSearch *
                     // Give the values to the caller
                     if(PtrLocaleFlags != NULL)
                         PtrLocaleFlags[0] = pRootEntry->Locales;
+                    pSearch->dwRootIndex = (DWORD)(pRootEntry - pRootHandler->pRootEntries);
                     return (LPBYTE)pRootEntry->EncodingKey;
                 }
             }
@@ -358,6 +360,11 @@ static LPBYTE WowHandler_Search(TRootHandler_WoW6 * pRootHandler, TCascSearch *
     return NULL;
 }
 
+static LPBYTE WowHandler_GetEntryKey(TRootHandler_WoW6 * pRootHandler, DWORD dwEntryIndex)
+{
+    return (LPBYTE)pRootHandler->pRootEntries[dwEntryIndex].EncodingKey;
+}
+
 static LPBYTE WowHandler_GetKey(TRootHandler_WoW6 * pRootHandler, const char * szFileName)
 {
     PCASC_ROOT_ENTRY pRootEntry;
@@ -415,7 +422,7 @@ static void TRootHandlerWoW6_Dump(
     DWORD i;
 
     // Create the listfile map
-    pListMap = ListFile_CreateMap(szListFile);
+    pListMap = ListFile_CreateMap(szListFile, (hs->dwOpenFlags & CASC_STOR_CACHE_LISTFILE) ? true : false);
 
     // Dump the root entries
     for(pbFilePointer = pbRootFile; pbFilePointer <= pbRootFileEnd; )
@@ -485,6 +492,7 @@ int RootHandler_CreateWoW6(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
     pRootHandler->Search      = (ROOT_SEARCH)WowHandler_Search;
     pRootHandler->EndSearch   = (ROOT_ENDSEARCH)WowHandler_EndSearch;
     pRootHandler->GetKey      = (ROOT_GETKEY)WowHandler_GetKey;
+    pRootHandler->GetEntryKey = (ROOT_GETENTRYKEY)WowHandler_GetEntryKey;
     pRootHandler->Close       = (ROOT_CLOSE)WowHandler_Close;
 
 #ifdef _DEBUG
@@ -509,6 +517,7 @@ int RootHandler_CreateWoW6(TCascStorage * hs, LPBYTE pbRootFile, DWORD cbRootFil
         return ERROR_NOT_ENOUGH_MEMORY;
 
     ParseWowRootFile(pRootHandler, ParseRoot_AddRootEntries, pbRootFile, pbRootFileEnd, dwLocaleMask);
+    pRootHandler->dwEntryCount = pRootHandler->dwFileCount;
 
     //
     // Phase 3: Create map for fast searching
@@ -0,0 +1,162 @@
+/*****************************************************************************/
+/* Arena.cpp                                        Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Chunked storage for file names                                            */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#define __CASCLIB_SELF__
+#include "../CascLib.h"
+#include "../CascCommon.h"
+
+//-----------------------------------------------------------------------------
+// Local functions
+
+static bool InsertNewChunk(PCASC_ARENA pArena)
+{
+    char ** NewChunks;
+    DWORD NewChunkCountMax;
+
+    // Do we have the maximum number of chunks already?
+    if(pArena->ChunkCount >= CASC_ARENA_MAX_CHUNKS)
+        return false;
+
+    // Enlarge the chunk array, if needed
+    if(pArena->ChunkCount >= pArena->ChunkCountMax)
+    {
+        NewChunkCountMax = (pArena->ChunkCountMax != 0) ? (pArena->ChunkCountMax * 2) : 0x10;
+        NewChunks = CASC_REALLOC(char *, pArena->Chunks, NewChunkCountMax);
+        if(NewChunks == NULL)
+            return false;
+
+        pArena->Chunks = NewChunks;
+        pArena->ChunkCountMax = NewChunkCountMax;
+    }
+
+    // Allocate the new chunk
+    pArena->Chunks[pArena->ChunkCount] = CASC_ALLOC(char, CASC_ARENA_CHUNK_SIZE);
+    if(pArena->Chunks[pArena->ChunkCount] == NULL)
+        return false;
+
+    pArena->ChunkCount++;
+    pArena->ChunkUsed = 0;
+    return true;
+}
+
+// Reserves space for an item. Gives the pointer to the item and, optionally, its offset
+static char * AllocateItem(PCASC_ARENA pArena, size_t cbData, PDWORD PtrOffset)
+{
+    char * szTarget;
+
+    // An item must fit into a single chunk
+    if(cbData > CASC_ARENA_CHUNK_SIZE)
+        return NULL;
+
+    // Start a new chunk if the current one has not enough space
+    if(pArena->ChunkCount == 0 || (pArena->ChunkUsed + cbData) > CASC_ARENA_CHUNK_SIZE)
+    {
+        if(!InsertNewChunk(pArena))
+            return NULL;
+    }
+
+    // Give the offset to the caller
+    szTarget = pArena->Chunks[pArena->ChunkCount - 1] + pArena->ChunkUsed;
+    if(PtrOffset != NULL)
+        PtrOffset[0] = ((pArena->ChunkCount - 1) << CASC_ARENA_CHUNK_SHIFT) | pArena->ChunkUsed;
+    pArena->ChunkUsed += (DWORD)cbData;
+    return szTarget;
+}
+
+//-----------------------------------------------------------------------------
+// Public functions
+
+void Arena_Init(PCASC_ARENA pArena)
+{
+    pArena->Chunks = NULL;
+    pArena->ChunkCount = 0;
+    pArena->ChunkCountMax = 0;
+    pArena->ChunkUsed = 0;
+}
+
+// Copies the data to the arena
+char * Arena_Insert(PCASC_ARENA pArena, const void * pvData, size_t cbData, PDWORD PtrOffset)
+{
+    char * szTarget;
+
+    szTarget = AllocateItem(pArena, cbData, PtrOffset);
+    if(szTarget != NULL)
+        memcpy(szTarget, pvData, cbData);
+    return szTarget;
+}
+
+// Copies the string to the arena and terminates it with zero
+char * Arena_InsertString(PCASC_ARENA pArena, const char * szString, size_t cchString, PDWORD PtrOffset)
+{
+    char * szTarget;
+
+    szTarget = AllocateItem(pArena, cchString + 1, PtrOffset);
+    if(szTarget != NULL)
+    {
+        memcpy(szTarget, szString, cchString);
+        szTarget[cchString] = 0;
+    }
+    return szTarget;
+}
+
+// Moves all chunks of the source arena to the end of the target arena.
+// The chunks are not copied. The offsets of the items from the source arena
+// need to be increased by the value given in PtrOffsetBase
+bool Arena_Append(PCASC_ARENA pArena, PCASC_ARENA pSource, PDWORD PtrOffsetBase)
+{
+    char ** NewChunks;
+    DWORD NewChunkCountMax;
+
+    // Check the maximum number of chunks
+    if((pArena->ChunkCount + pSource->ChunkCount) > CASC_ARENA_MAX_CHUNKS)
+        return false;
+
+    // Enlarge the chunk array, if needed
+    if((pArena->ChunkCount + pSource->ChunkCount) > pArena->ChunkCountMax)
+    {
+        NewChunkCountMax = CASCLIB_MAX(pArena->ChunkCountMax * 2, pArena->ChunkCount + pSource->ChunkCount);
+        if(pArena->Chunks != NULL)
+            NewChunks = CASC_REALLOC(char *, pArena->Chunks, NewChunkCountMax);
+        else
+            NewChunks = CASC_ALLOC(char *, NewChunkCountMax);
+        if(NewChunks == NULL)
+            return false;
+
+        pArena->Chunks = NewChunks;
+        pArena->ChunkCountMax = NewChunkCountMax;
+    }
+
+    // Move the chunks. The last chunk of the source becomes the current one
+    PtrOffsetBase[0] = pArena->ChunkCount << CASC_ARENA_CHUNK_SHIFT;
+    if(pSource->ChunkCount != 0)
+    {
+        memcpy(pArena->Chunks + pArena->ChunkCount, pSource->Chunks, pSource->ChunkCount * sizeof(char *));
+        pArena->ChunkCount += pSource->ChunkCount;
+        pArena->ChunkUsed = pSource->ChunkUsed;
+    }
+
+    // The source arena is now empty
+    if(pSource->Chunks != NULL)
+        CASC_FREE(pSource->Chunks);
+    Arena_Init(pSource);
+    return true;
+}
+
+void Arena_Free(PCASC_ARENA pArena)
+{
+    if(pArena->Chunks != NULL)
+    {
+        for(DWORD i = 0; i < pArena->ChunkCount; i++)
+            CASC_FREE(pArena->Chunks[i]);
+        CASC_FREE(pArena->Chunks);
+    }
+
+    Arena_Init(pArena);
+}
@@ -0,0 +1,48 @@
+/*****************************************************************************/
+/* Arena.h                                          Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Chunked storage for file names                                            */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#ifndef __CASC_ARENA_H__
+#define __CASC_ARENA_H__
+
+//-----------------------------------------------------------------------------
+// Structures
+
+// The arena stores names in big chunks that never move, so the inserted
+// names never need to be copied again. Each name is identified by a 32-bit
+// offset: chunk index in the upper bits, position in the chunk in the lower bits
+#define CASC_ARENA_CHUNK_SHIFT      20
+#define CASC_ARENA_CHUNK_SIZE       (1 << CASC_ARENA_CHUNK_SHIFT)
+#define CASC_ARENA_POSITION_MASK    (CASC_ARENA_CHUNK_SIZE - 1)
+#define CASC_ARENA_MAX_CHUNKS       (1 << (32 - CASC_ARENA_CHUNK_SHIFT))
+
+#define CASC_INVALID_ARENA_OFFSET   0xFFFFFFFF
+
+// Converts the offset of an inserted item to a pointer
+#define ARENA_POINTER(pArena, dwOffset) ((pArena)->Chunks[(dwOffset) >> CASC_ARENA_CHUNK_SHIFT] + ((dwOffset) & CASC_ARENA_POSITION_MASK))
+
+typedef struct _CASC_ARENA
+{
+    char ** Chunks;                             // Array of the chunks
+    DWORD ChunkCount;                           // Number of allocated chunks
+    DWORD ChunkCountMax;                        // Capacity of the chunk array
+    DWORD ChunkUsed;                            // Number of bytes used in the last chunk
+
+} CASC_ARENA, *PCASC_ARENA;
+
+//-----------------------------------------------------------------------------
+// Functions
+
+void Arena_Init(PCASC_ARENA pArena);
+char * Arena_Insert(PCASC_ARENA pArena, const void * pvData, size_t cbData, PDWORD PtrOffset);
+char * Arena_InsertString(PCASC_ARENA pArena, const char * szString, size_t cchString, PDWORD PtrOffset);
+bool Arena_Append(PCASC_ARENA pArena, PCASC_ARENA pSource, PDWORD PtrOffsetBase);
+void Arena_Free(PCASC_ARENA pArena);
+
+#endif // __CASC_ARENA_H__
@@ -65,7 +65,7 @@ unsigned char IntToHexChar[] = "0123456789abcdef";
 // GetLastError/SetLastError support for non-Windows platform
 
 #ifndef PLATFORM_WINDOWS
-static int nLastError = ERROR_SUCCESS;
+static __thread int nLastError = ERROR_SUCCESS;     // Per-thread, like on Windows
 
 int GetLastError()
 {
@@ -261,6 +261,17 @@ size_t NormalizeFileName_LowerSlash(char * szTrgFileName, const char * szSrcFile
     return i;
 }
 
+static BYTE HexCharToInt(char chDigit)
+{
+    BYTE OneChar = AsciiToUpperTable_BkSlash[(BYTE)chDigit];
+
+    if('0' <= OneChar && OneChar <= '9')
+        return (BYTE)(OneChar - '0');
+    if('A' <= OneChar && OneChar <= 'F')
+        return (BYTE)(OneChar - 'A' + 10);
+    return 0xFF;
+}
+
 int ConvertDigitToInt32(const TCHAR * szString, PDWORD PtrValue)
 {
     BYTE Digit;
@@ -307,6 +318,27 @@ int ConvertStringToInt32(const TCHAR * szString, size_t nMaxDigits, PDWORD PtrVa
     return ERROR_SUCCESS;
 }
 
+// Converts a string of hexadecimal digits to binary. Anything else than 0-9, A-F and a-f is rejected
+int BinaryFromString(const char * szString, size_t nLength, LPBYTE pbBinary)
+{
+    // The number of digits must be even
+    if(nLength & 0x01)
+        return ERROR_BAD_FORMAT;
+
+    for(size_t i = 0; i < nLength; i += 2)
+    {
+        BYTE DigitOne = HexCharToInt(szString[i]);
+        BYTE DigitTwo = HexCharToInt(szString[i + 1]);
+
+        if(DigitOne > 0x0F || DigitTwo > 0x0F)
+            return ERROR_BAD_FORMAT;
+
+        *pbBinary++ = (DigitOne << 0x04) | DigitTwo;
+    }
+
+    return ERROR_SUCCESS;
+}
+
 char * StringFromBinary(LPBYTE pbBinary, size_t cbBinary, char * szBuffer)
 {
     char * szSaveBuffer = szBuffer;
@@ -361,64 +393,25 @@ const char * GetPlainFileName(const char * szFileName)
     return szPlainName;
 }
 
-bool CheckWildCard(const char * szString, const char * szWildCard)
-{
-    const char * szWildCardPtr;
+//-----------------------------------------------------------------------------
+// Hashing functions
 
-    for(;;)
-    {
-        // If there is '?' in the wildcard, we skip one char
-        while(szWildCard[0] == '?')
-        {
-            if(szString[0] == 0)
-                return false;
+// Calculates the Jenkins hash of the file name, as used by the root files
+ULONGLONG HashStringJenkins(const char * szFileName)
+{
+    char szNormName[MAX_PATH + 1];
+    uint32_t dwHashHigh = 0;
+    uint32_t dwHashLow = 0;
+    size_t nLength;
 
-            szWildCard++;
-            szString++;
-        }
+    // Normalize the file name
+    nLength = NormalizeFileName_UpperBkSlash(szNormName, szFileName, MAX_PATH);
 
-        // Handle '*'
-        szWildCardPtr = szWildCard;
-        if(szWildCardPtr[0] != 0)
-        {
-            if(szWildCardPtr[0] == '*')
-            {
-                szWildCardPtr++;
-
-                if(szWildCardPtr[0] == '*')
-                    continue;
-
-                if(szWildCardPtr[0] == 0)
-                    return true;
-
-                if(AsciiToUpperTable_BkSlash[szWildCardPtr[0]] == AsciiToUpperTable_BkSlash[szString[0]])
-                {
-                    if(CheckWildCard(szString, szWildCardPtr))
-                        return true;
-                }
-            }
-            else
-            {
-                if(AsciiToUpperTable_BkSlash[szWildCardPtr[0]] != AsciiToUpperTable_BkSlash[szString[0]])
-                    return false;
-
-                szWildCard = szWildCardPtr + 1;
-            }
-
-            if(szString[0] == 0)
-                return false;
-            szString++;
-        }
-        else
-        {
-            return (szString[0] == 0) ? true : false;
-        }
-    }
+    // Calculate the HASH value of the normalized file name
+    hashlittle2(szNormName, nLength, &dwHashHigh, &dwHashLow);
+    return ((ULONGLONG)dwHashHigh << 0x20) | dwHashLow;
 }
 
-//-----------------------------------------------------------------------------
-// Hashing functions
-
 bool IsValidMD5(LPBYTE pbMd5)
 {
     BYTE BitSummary = 0;
@@ -48,13 +48,13 @@ size_t NormalizeFileName_LowerSlash(char * szTrgFileName, const char * szSrcFile
 
 int ConvertDigitToInt32(const TCHAR * szString, PDWORD PtrValue);
 int ConvertStringToInt32(const TCHAR * szString, size_t nMaxDigits, PDWORD PtrValue);
+int BinaryFromString(const char * szString, size_t nLength, LPBYTE pbBinary);
 char * StringFromBinary(LPBYTE pbBinary, size_t cbBinary, char * szBuffer);
 char * StringFromMD5(LPBYTE md5, char * szBuffer);
 
 //-----------------------------------------------------------------------------
 // File name utilities
 
-bool CheckWildCard(const char * szString, const char * szWildCard);
 const wchar_t * GetPlainFileName(const wchar_t * szFileName);
 const char * GetPlainFileName(const char * szFileName);
 
@@ -73,6 +73,7 @@ bool VerifyDataBlockHash(void * pvDataBlock, DWORD cbDataBlock, LPBYTE expected_
 typedef bool (*INDEX_FILE_FOUND)(const TCHAR * szFileName, PDWORD IndexArray, PDWORD OldIndexArray, void * pvContext);
 
 bool DirectoryExists(const TCHAR * szDirectory);
+int ForceCreatePath(TCHAR * szFullPath);
 
 int ScanIndexDirectory(
     const TCHAR * szIndexPath,
@@ -38,6 +38,36 @@ bool DirectoryExists(const TCHAR * szDirectory)
     return false;
 }
 
+// Creates all directories on the path to the file. The file itself is not created
+int ForceCreatePath(TCHAR * szFullPath)
+{
+    TCHAR * szPlainName = (TCHAR *)GetPlainFileName(szFullPath) - 1;
+    TCHAR * szPathPart = szFullPath;
+    TCHAR chSaveChar;
+
+    // Skip disk drive and root directory
+    if(szPathPart[0] != 0 && szPathPart[1] == _T(':'))
+        szPathPart += 3;
+
+    while(szPathPart <= szPlainName)
+    {
+        // If there is a delimiter, create the path fragment
+        if(szPathPart[0] == _T('\\') || szPathPart[0] == _T('/'))
+        {
+            chSaveChar = szPathPart[0];
+            szPathPart[0] = 0;
+
+            CREATE_DIRECTORY(szFullPath);
+            szPathPart[0] = chSaveChar;
+        }
+
+        // Move to the next character
+        szPathPart++;
+    }
+
+    return ERROR_SUCCESS;
+}
+
 int ScanIndexDirectory(
     const TCHAR * szIndexPath,
     INDEX_FILE_FOUND pfnOnFileFound,
@@ -46,6 +46,88 @@ static void BaseNone_Init(TFileStream *)
     // Nothing here
 }
 
+//-----------------------------------------------------------------------------
+// Local functions - aligned buffers for direct I/O
+//
+// Files open with STREAM_FLAG_DIRECT_IO can only be read to aligned buffers,
+// from aligned offsets and by aligned lengths. Such buffers are kept in a small
+// pool, because the readers allocate and free them for every file frame
+
+#define ALIGNED_BUFFER_GRANULARITY  0x10000     // Buffer sizes are rounded up to this value
+#define ALIGNED_BUFFER_POOL_MAX     8           // Max number of free buffers kept in the pool
+#define ALIGNED_BUFFER_POOL_SIZE    0x100000    // Larger buffers are not kept in the pool
+
+typedef struct _TAlignedBuffer
+{
+    struct _TAlignedBuffer * pNext;         // Next free buffer in the pool
+    size_t cbBuffer;                        // Size of the buffer, excluding the header block
+
+    // Followed by the rest of the header block (to keep the buffer aligned) and the buffer
+
+} TAlignedBuffer;
+
+typedef struct _TAlignedBufferPool
+{
+    CASC_LOCK Lock;                         // Protects the list of free buffers
+    TAlignedBuffer * pFirst;                // First free buffer
+    DWORD dwFreeBuffers;                    // Number of free buffers
+    bool bInitialized;                      // The lock has been initialized
+
+} TAlignedBufferPool;
+
+static TAlignedBufferPool BufferPool;
+static CASC_ONCE BufferPoolOnce = CASC_ONCE_INIT;
+
+// Called on the first allocation
+static void BufferPool_Init()
+{
+    CascLock_Init(&BufferPool.Lock);
+    BufferPool.bInitialized = true;
+}
+
+static TAlignedBuffer * BufferPool_Alloc(size_t cbBuffer)
+{
+    void * pvBlock = NULL;
+
+#ifdef PLATFORM_WINDOWS
+    pvBlock = VirtualAlloc(NULL, STREAM_DIRECT_IO_ALIGNMENT + cbBuffer, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    if(posix_memalign(&pvBlock, STREAM_DIRECT_IO_ALIGNMENT, STREAM_DIRECT_IO_ALIGNMENT + cbBuffer) != 0)
+        pvBlock = NULL;
+#endif
+
+    if(pvBlock != NULL)
+        ((TAlignedBuffer *)pvBlock)->cbBuffer = cbBuffer;
+    return (TAlignedBuffer *)pvBlock;
+}
+
+static void BufferPool_Free(TAlignedBuffer * pBuffer)
+{
+#ifdef PLATFORM_WINDOWS
+    VirtualFree(pBuffer, 0, MEM_RELEASE);
+#else
+    free(pBuffer);
+#endif
+}
+
+// Frees the pooled buffers and the lock when the library is unloaded
+static void BufferPool_Unload()
+{
+    TAlignedBuffer * pBuffer;
+
+    if(BufferPool.bInitialized)
+    {
+        while((pBuffer = BufferPool.pFirst) != NULL)
+        {
+            BufferPool.pFirst = pBuffer->pNext;
+            BufferPool_Free(pBuffer);
+        }
+        CascLock_Free(&BufferPool.Lock);
+    }
+}
+
+static CASC_UNLOAD BufferPoolUnload = {BufferPool_Unload};
+
 //-----------------------------------------------------------------------------
 // Local functions - base file support
 
@@ -95,6 +177,7 @@ static bool BaseFile_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
         ULARGE_INTEGER FileSize;
         DWORD dwWriteAccess = (dwStreamFlags & STREAM_FLAG_READ_ONLY) ? 0 : FILE_WRITE_DATA | FILE_APPEND_DATA | FILE_WRITE_ATTRIBUTES;
         DWORD dwWriteShare = (dwStreamFlags & STREAM_FLAG_WRITE_SHARE) ? FILE_SHARE_WRITE : 0;
+        DWORD dwNoBuffering = (dwStreamFlags & STREAM_FLAG_DIRECT_IO) ? FILE_FLAG_NO_BUFFERING : 0;
 
         // Open the file
         pStream->Base.File.hFile = CreateFile(szFileName,
@@ -102,7 +185,7 @@ static bool BaseFile_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
                                               FILE_SHARE_READ | dwWriteShare,
                                               NULL,
                                               OPEN_EXISTING,
-                                              0,
+                                              dwNoBuffering,
                                               NULL);
         if(pStream->Base.File.hFile == INVALID_HANDLE_VALUE)
             return false;
@@ -130,6 +213,19 @@ static bool BaseFile_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
             return false;
         }
 
+        // Bypass the system cache, if required. If the file system doesn't support it
+        // (e.g. tmpfs), the file is read through the cache as usual
+        if(dwStreamFlags & STREAM_FLAG_DIRECT_IO)
+        {
+#ifdef PLATFORM_LINUX
+            if(fcntl(handle, F_SETFL, fcntl(handle, F_GETFL) | O_DIRECT) == -1)
+                pStream->dwFlags &= ~STREAM_FLAG_DIRECT_IO;
+#else
+            if(fcntl(handle, F_NOCACHE, 1) == -1)
+                pStream->dwFlags &= ~STREAM_FLAG_DIRECT_IO;
+#endif
+        }
+
         // Get the file size
         if(fstat64(handle, &fileinfo) == -1)
         {
@@ -151,13 +247,16 @@ static bool BaseFile_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
     return true;
 }
 
-static bool BaseFile_Read(
+// Reads the data from the given offset. Reading beyond the end of the file
+// is not an error, the number of bytes read is only smaller than required.
+// Doesn't touch the file position, so more threads can read from the same stream
+static bool BaseFile_ReadAt(
     TFileStream * pStream,                  // Pointer to an open stream
-    ULONGLONG * pByteOffset,                // Pointer to file byte offset. If NULL, it reads from the current position
+    ULONGLONG ByteOffset,                   // File byte offset
     void * pvBuffer,                        // Pointer to data to be read
-    DWORD dwBytesToRead)                    // Number of bytes to read from the file
+    DWORD dwBytesToRead,                    // Number of bytes to read from the file
+    DWORD * pdwBytesRead)                   // Receives the number of bytes read
 {
-    ULONGLONG ByteOffset = (pByteOffset != NULL) ? *pByteOffset : pStream->Base.File.FilePos;
     DWORD dwBytesRead = 0;                  // Must be set by platform-specific code
 
 #ifdef PLATFORM_WINDOWS
@@ -166,11 +265,6 @@ static bool BaseFile_Read(
         // Thus, we can use the OVERLAPPED structure to specify
         // file offset to read from file. This allows us to skip
         // one system call to SetFilePointer
-
-        // Update the byte offset
-        pStream->Base.File.FilePos = ByteOffset;
-
-        // Read the data
         if(dwBytesToRead != 0)
         {
             OVERLAPPED Overlapped;
@@ -178,7 +272,7 @@ static bool BaseFile_Read(
             Overlapped.OffsetHigh = (DWORD)(ByteOffset >> 32);
             Overlapped.Offset = (DWORD)ByteOffset;
             Overlapped.hEvent = NULL;
-            if(!ReadFile(pStream->Base.File.hFile, pvBuffer, dwBytesToRead, &dwBytesRead, &Overlapped))
+            if(!ReadFile(pStream->Base.File.hFile, pvBuffer, dwBytesToRead, &dwBytesRead, &Overlapped) && GetLastError() != ERROR_HANDLE_EOF)
                 return false;
         }
     }
@@ -188,18 +282,11 @@ static bool BaseFile_Read(
     {
         ssize_t bytes_read;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(ByteOffset != pStream->Base.File.FilePos)
-        {
-            lseek64((intptr_t)pStream->Base.File.hFile, (off64_t)(ByteOffset), SEEK_SET);
-            pStream->Base.File.FilePos = ByteOffset;
-        }
-
-        // Perform the read operation
+        // Perform the read operation. We use positioned read, which does not
+        // move the file pointer, so more threads can read from the same stream
         if(dwBytesToRead != 0)
         {
-            bytes_read = read((intptr_t)pStream->Base.File.hFile, pvBuffer, (size_t)dwBytesToRead);
+            bytes_read = pread64((intptr_t)pStream->Base.File.hFile, pvBuffer, (size_t)dwBytesToRead, (off64_t)(ByteOffset));
             if(bytes_read == -1)
             {
                 SetLastError(errno);
@@ -211,6 +298,22 @@ static bool BaseFile_Read(
     }
 #endif
 
+    pdwBytesRead[0] = dwBytesRead;
+    return true;
+}
+
+static bool BaseFile_Read(
+    TFileStream * pStream,                  // Pointer to an open stream
+    ULONGLONG * pByteOffset,                // Pointer to file byte offset. If NULL, it reads from the current position
+    void * pvBuffer,                        // Pointer to data to be read
+    DWORD dwBytesToRead)                    // Number of bytes to read from the file
+{
+    ULONGLONG ByteOffset = (pByteOffset != NULL) ? *pByteOffset : pStream->Base.File.FilePos;
+    DWORD dwBytesRead = 0;
+
+    if(!BaseFile_ReadAt(pStream, ByteOffset, pvBuffer, dwBytesToRead, &dwBytesRead))
+        return false;
+
     // Increment the current file position by number of bytes read
     // If the number of bytes read doesn't match to required amount, return false
     pStream->Base.File.FilePos = ByteOffset + dwBytesRead;
@@ -219,6 +322,65 @@ static bool BaseFile_Read(
     return (dwBytesRead == dwBytesToRead);
 }
 
+// Alignment of reads from a file open for direct I/O
+static DWORD BaseFile_GetAlignment(TFileStream * pStream)
+{
+#ifdef PLATFORM_MAC
+    // Files with F_NOCACHE can be read from any offset
+    CASCLIB_UNUSED(pStream);
+    return 1;
+#else
+    return (pStream->dwFlags & STREAM_FLAG_DIRECT_IO) ? STREAM_DIRECT_IO_ALIGNMENT : 1;
+#endif
+}
+
+// Read from a file open for direct I/O. If the read is not aligned, the aligned range
+// that covers the required data is read to an aligned buffer and the data are copied
+static bool BaseFile_ReadDirect(
+    TFileStream * pStream,                  // Pointer to an open stream
+    ULONGLONG * pByteOffset,                // Pointer to file byte offset. If NULL, it reads from the current position
+    void * pvBuffer,                        // Pointer to data to be read
+    DWORD dwBytesToRead)                    // Number of bytes to read from the file
+{
+    ULONGLONG ByteOffset = (pByteOffset != NULL) ? *pByteOffset : pStream->Base.File.FilePos;
+    ULONGLONG AlignMask = BaseFile_GetAlignment(pStream) - 1;
+    ULONGLONG AlignedOffset = ByteOffset & ~AlignMask;
+    ULONGLONG AlignedEnd = (ByteOffset + dwBytesToRead + AlignMask) & ~AlignMask;
+    LPBYTE pbAligned;
+    DWORD dwAlignedRead = 0;
+    DWORD dwBytesRead = 0;
+    bool bResult;
+
+    // Aligned reads go directly to the caller's buffer
+    if(((ByteOffset | dwBytesToRead | (size_t)pvBuffer) & AlignMask) == 0)
+        return BaseFile_Read(pStream, &ByteOffset, pvBuffer, dwBytesToRead);
+
+    pbAligned = FileStream_AllocAligned((size_t)(AlignedEnd - AlignedOffset));
+    if(pbAligned == NULL)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return false;
+    }
+
+    // The aligned range may go beyond the end of the file. The number of bytes
+    // is taken from this read, the file position may be changed by other threads
+    bResult = BaseFile_ReadAt(pStream, AlignedOffset, pbAligned, (DWORD)(AlignedEnd - AlignedOffset), &dwAlignedRead);
+    if(bResult)
+    {
+        if(AlignedOffset + dwAlignedRead > ByteOffset)
+            dwBytesRead = (DWORD)CASCLIB_MIN(AlignedOffset + dwAlignedRead - ByteOffset, dwBytesToRead);
+        memcpy(pvBuffer, pbAligned + (size_t)(ByteOffset - AlignedOffset), dwBytesRead);
+
+        pStream->Base.File.FilePos = ByteOffset + dwBytesRead;
+        bResult = (dwBytesRead == dwBytesToRead);
+        if(bResult == false)
+            SetLastError(ERROR_HANDLE_EOF);
+    }
+
+    FileStream_FreeAligned(pbAligned);
+    return bResult;
+}
+
 /**
  * \a pStream Pointer to an open stream
  * \a pByteOffset Pointer to file byte offset. If NULL, writes to current position
@@ -259,16 +421,8 @@ static bool BaseFile_Write(TFileStream * pStream, ULONGLONG * pByteOffset, const
     {
         ssize_t bytes_written;
 
-        // If the byte offset is different from the current file position,
-        // we have to update the file position
-        if(ByteOffset != pStream->Base.File.FilePos)
-        {
-            lseek64((intptr_t)pStream->Base.File.hFile, (off64_t)(ByteOffset), SEEK_SET);
-            pStream->Base.File.FilePos = ByteOffset;
-        }
-
-        // Perform the read operation
-        bytes_written = write((intptr_t)pStream->Base.File.hFile, pvBuffer, (size_t)dwBytesToWrite);
+        // Perform the write operation. Like reading, this uses the positioned call
+        bytes_written = pwrite64((intptr_t)pStream->Base.File.hFile, pvBuffer, (size_t)dwBytesToWrite, (off64_t)(ByteOffset));
         if(bytes_written == -1)
         {
             SetLastError(errno);
@@ -395,6 +549,248 @@ static void BaseFile_Close(TFileStream * pStream)
     pStream->Base.File.hFile = INVALID_HANDLE_VALUE;
 }
 
+static void BaseFile_Advise(TFileStream * pStream, ULONGLONG ByteOffset, ULONGLONG Length, DWORD dwAdvice)
+{
+#ifdef PLATFORM_LINUX
+    static const int AdviceValues[] = {POSIX_FADV_NORMAL, POSIX_FADV_RANDOM, POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED};
+
+    if(dwAdvice < sizeof(AdviceValues) / sizeof(AdviceValues[0]))
+        posix_fadvise64((intptr_t)pStream->Base.File.hFile, (off64_t)ByteOffset, (off64_t)Length, AdviceValues[dwAdvice]);
+#else
+    CASCLIB_UNUSED(pStream);
+    CASCLIB_UNUSED(ByteOffset);
+    CASCLIB_UNUSED(Length);
+    CASCLIB_UNUSED(dwAdvice);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Local functions - base file support with pooled handles
+//
+// Read-only files opened with STREAM_FLAG_HANDLE_POOL share a limited number
+// of handles within the process. If the limit is reached, the handle of the
+// least recently used file is closed and the file is reopened on the next read
+
+typedef struct _TFileHandlePool
+{
+    CASC_LOCK Lock;                         // Protects the pool and the list links of the streams
+    TFileStream * pFirst;                   // Most recently used stream with an open handle. Written interlocked
+    TFileStream * pLast;                    // Least recently used stream with an open handle
+    DWORD dwMaxHandles;                     // Maximum number of open handles (CASC_HANDLE_LIMIT_NONE = no limit). Written interlocked
+    DWORD dwOpenHandles;                    // Number of open handles
+    ULONGLONG ReopenCount;                  // Number of handles opened again after they have been closed
+    ULONGLONG CloseCount;                   // Number of handles closed because of the limit
+    bool bInitialized;                      // The lock has been initialized
+
+} TFileHandlePool;
+
+// Flags in the reader count of a stream. Readers check them with the same
+// interlocked increment that holds the handle, so they don't look at the handle
+#define HANDLE_POOL_CLOSING 0x80000000      // The pool is closing the handle
+#define HANDLE_POOL_CLOSED  0x40000000      // The handle is closed
+
+static TFileHandlePool HandlePool;
+static CASC_ONCE HandlePoolOnce = CASC_ONCE_INIT;
+
+// Called when the first stream is open or the limit is set
+static void HandlePool_Init()
+{
+    CascLock_Init(&HandlePool.Lock);
+    CascInterlockedExchange(&HandlePool.dwMaxHandles, CASC_HANDLE_LIMIT_NONE);
+    HandlePool.bInitialized = true;
+}
+
+static void HandlePool_Unload()
+{
+    if(HandlePool.bInitialized)
+        CascLock_Free(&HandlePool.Lock);
+}
+
+static CASC_UNLOAD HandlePoolUnload = {HandlePool_Unload};
+
+// The readers check the first stream without the lock
+static void HandlePool_SetFirst(TFileStream * pStream)
+{
+    CascInterlockedExchangePointer((void **)&HandlePool.pFirst, pStream);
+}
+
+static void HandlePool_Unlink(TFileStream * pStream)
+{
+    if(pStream->Base.Pool.pPrev != NULL)
+        pStream->Base.Pool.pPrev->Base.Pool.pNext = pStream->Base.Pool.pNext;
+    else
+        HandlePool_SetFirst(pStream->Base.Pool.pNext);
+
+    if(pStream->Base.Pool.pNext != NULL)
+        pStream->Base.Pool.pNext->Base.Pool.pPrev = pStream->Base.Pool.pPrev;
+    else
+        HandlePool.pLast = pStream->Base.Pool.pPrev;
+
+    pStream->Base.Pool.pPrev = pStream->Base.Pool.pNext = NULL;
+}
+
+static void HandlePool_LinkFirst(TFileStream * pStream)
+{
+    pStream->Base.Pool.pPrev = NULL;
+    pStream->Base.Pool.pNext = HandlePool.pFirst;
+    if(HandlePool.pFirst != NULL)
+        HandlePool.pFirst->Base.Pool.pPrev = pStream;
+    else
+        HandlePool.pLast = pStream;
+    HandlePool_SetFirst(pStream);
+}
+
+// Closes the least recently used handles until there are at most dwMaxOpen of them.
+// Handles of files that are being read are skipped, so the limit may be exceeded
+// for a short time if all handles are in use. Must be called with the pool lock held
+static void HandlePool_Trim(DWORD dwMaxOpen)
+{
+    TFileStream * pStream = HandlePool.pLast;
+    TFileStream * pPrev;
+
+    while(pStream != NULL && HandlePool.dwOpenHandles > dwMaxOpen)
+    {
+        pPrev = pStream->Base.Pool.pPrev;
+
+        // Readers don't take the lock. The closing flag makes
+        // the readers that come in the meantime wait for the lock
+        if(CascInterlockedCompareExchange(&pStream->Base.Pool.dwReaders, HANDLE_POOL_CLOSING, 0) == 0)
+        {
+            HandlePool_Unlink(pStream);
+            BaseFile_Close(pStream);
+            HandlePool.dwOpenHandles--;
+            HandlePool.CloseCount++;
+            CascInterlockedAdd(&pStream->Base.Pool.dwReaders, HANDLE_POOL_CLOSED - HANDLE_POOL_CLOSING);
+        }
+        pStream = pPrev;
+    }
+}
+
+// Opens the file handle. Must be called with the pool lock held
+static bool HandlePool_OpenHandle(TFileStream * pStream, const TCHAR * szFileName)
+{
+    ULONGLONG FilePos = pStream->Base.File.FilePos;
+
+    // Make space for the new handle
+    if(HandlePool.dwMaxHandles != CASC_HANDLE_LIMIT_NONE)
+        HandlePool_Trim(HandlePool.dwMaxHandles - 1);
+
+    // Open the file. If this is a reopen, keep the file position
+    pStream->Base.File.hFile = INVALID_HANDLE_VALUE;
+    if(!BaseFile_Open(pStream, szFileName, STREAM_FLAG_READ_ONLY | (pStream->dwFlags & STREAM_FLAG_DIRECT_IO)))
+    {
+        pStream->Base.File.hFile = INVALID_HANDLE_VALUE;
+        return false;
+    }
+    pStream->Base.File.FilePos = FilePos;
+
+    // The advice for the whole file is lost with the old handle
+    if(pStream->Base.Pool.dwAdvice != STREAM_ADVICE_NORMAL)
+        BaseFile_Advise(pStream, 0, 0, pStream->Base.Pool.dwAdvice);
+
+    HandlePool_LinkFirst(pStream);
+    HandlePool.dwOpenHandles++;
+
+    // Let the readers in. This also publishes the new handle
+    CascInterlockedAdd(&pStream->Base.Pool.dwReaders, (DWORD)(0 - HANDLE_POOL_CLOSED));
+    return true;
+}
+
+static bool BasePool_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD /* dwStreamFlags */)
+{
+    bool bResult;
+
+    CascOnce_Run(&HandlePoolOnce, HandlePool_Init);
+    CascLock_Enter(&HandlePool.Lock);
+    bResult = HandlePool_OpenHandle(pStream, szFileName);
+    CascLock_Leave(&HandlePool.Lock);
+    return bResult;
+}
+
+static bool BasePool_Read(
+    TFileStream * pStream,                  // Pointer to an open stream
+    ULONGLONG * pByteOffset,                // Pointer to file byte offset. If NULL, it reads from the current position
+    void * pvBuffer,                        // Pointer to data to be read
+    DWORD dwBytesToRead)                    // Number of bytes to read from the file
+{
+    DWORD dwReaders;
+    bool bResult;
+
+    // The number of readers prevents the handle from being closed during the read.
+    // If the handle is open and not being closed, the read needs no lock
+    dwReaders = CascInterlockedIncrement(&pStream->Base.Pool.dwReaders);
+    if((dwReaders & (HANDLE_POOL_CLOSING | HANDLE_POOL_CLOSED)) == 0)
+    {
+        // Only a limited pool needs to know which handle was used last
+        if(CascInterlockedRead(&HandlePool.dwMaxHandles) != CASC_HANDLE_LIMIT_NONE && CascInterlockedReadPointer((void **)&HandlePool.pFirst) != pStream)
+        {
+            CascLock_Enter(&HandlePool.Lock);
+            HandlePool_Unlink(pStream);
+            HandlePool_LinkFirst(pStream);
+            CascLock_Leave(&HandlePool.Lock);
+        }
+    }
+    else
+    {
+        // Open the handle again. The pool doesn't close handles
+        // when its lock is held, so the count can be taken again
+        CascInterlockedDecrement(&pStream->Base.Pool.dwReaders);
+        CascLock_Enter(&HandlePool.Lock);
+        if(pStream->Base.File.hFile == INVALID_HANDLE_VALUE)
+        {
+            if(!HandlePool_OpenHandle(pStream, pStream->szFileName))
+            {
+                CascLock_Leave(&HandlePool.Lock);
+                return false;
+            }
+            HandlePool.ReopenCount++;
+        }
+        else if(HandlePool.pFirst != pStream)
+        {
+            // Another reader has opened the handle in the meantime
+            HandlePool_Unlink(pStream);
+            HandlePool_LinkFirst(pStream);
+        }
+        CascInterlockedIncrement(&pStream->Base.Pool.dwReaders);
+        CascLock_Leave(&HandlePool.Lock);
+    }
+
+    // Read the data. The error code must survive releasing the handle
+    bResult = BaseFile_ReadDirect(pStream, pByteOffset, pvBuffer, dwBytesToRead);
+    CascInterlockedDecrement(&pStream->Base.Pool.dwReaders);
+    return bResult;
+}
+
+static void BasePool_Advise(TFileStream * pStream, ULONGLONG ByteOffset, ULONGLONG Length, DWORD dwAdvice)
+{
+    // Remember the access pattern of the whole file, so it survives reopening the handle
+    if(ByteOffset == 0 && Length == 0 && (dwAdvice == STREAM_ADVICE_NORMAL || dwAdvice == STREAM_ADVICE_RANDOM || dwAdvice == STREAM_ADVICE_SEQUENTIAL))
+    {
+        CascLock_Enter(&HandlePool.Lock);
+        pStream->Base.Pool.dwAdvice = dwAdvice;
+        CascLock_Leave(&HandlePool.Lock);
+    }
+
+    // Advice for a closed handle has no effect. The handle is held
+    // the same way as for reading, so that it stays open during the call
+    if((CascInterlockedIncrement(&pStream->Base.Pool.dwReaders) & (HANDLE_POOL_CLOSING | HANDLE_POOL_CLOSED)) == 0)
+        BaseFile_Advise(pStream, ByteOffset, Length, dwAdvice);
+    CascInterlockedDecrement(&pStream->Base.Pool.dwReaders);
+}
+
+static void BasePool_Close(TFileStream * pStream)
+{
+    CascLock_Enter(&HandlePool.Lock);
+    if(pStream->Base.File.hFile != INVALID_HANDLE_VALUE)
+    {
+        HandlePool_Unlink(pStream);
+        BaseFile_Close(pStream);
+        HandlePool.dwOpenHandles--;
+        CascInterlockedAdd(&pStream->Base.Pool.dwReaders, HANDLE_POOL_CLOSED);
+    }
+    CascLock_Leave(&HandlePool.Lock);
+}
+
 // Initializes base functions for the disk file
 static void BaseFile_Init(TFileStream * pStream)
 {
@@ -406,6 +802,22 @@ static void BaseFile_Init(TFileStream * pStream)
     pStream->BaseGetSize = BaseFile_GetSize;
     pStream->BaseGetPos  = BaseFile_GetPos;
     pStream->BaseClose   = BaseFile_Close;
+    pStream->BaseAdvise  = BaseFile_Advise;
+
+    // Files open for direct I/O need aligned reads
+    if(pStream->dwFlags & STREAM_FLAG_DIRECT_IO)
+        pStream->BaseRead = BaseFile_ReadDirect;
+
+    // Read-only files can have their handle in the handle pool
+    if((pStream->dwFlags & STREAM_FLAG_HANDLE_POOL) && (pStream->dwFlags & STREAM_FLAG_READ_ONLY))
+    {
+        pStream->Base.File.hFile = INVALID_HANDLE_VALUE;
+        pStream->Base.Pool.dwReaders = HANDLE_POOL_CLOSED;
+        pStream->BaseOpen    = BasePool_Open;
+        pStream->BaseRead    = BasePool_Read;
+        pStream->BaseClose   = BasePool_Close;
+        pStream->BaseAdvise  = BasePool_Advise;
+    }
 }
 
 //-----------------------------------------------------------------------------
@@ -477,7 +889,15 @@ static bool BaseMap_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
         // Get the file size
         if(fstat64(handle, &fileinfo) != -1)
         {
-            pStream->Base.Map.pbFile = (LPBYTE)mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+            // Don't allow mapping file of a zero size. Note that mmap reports failure with MAP_FAILED
+            pStream->Base.Map.pbFile = NULL;
+            if(fileinfo.st_size != 0)
+            {
+                pStream->Base.Map.pbFile = (LPBYTE)mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_PRIVATE, handle, 0);
+                if(pStream->Base.Map.pbFile == (LPBYTE)MAP_FAILED)
+                    pStream->Base.Map.pbFile = NULL;
+            }
+
             if(pStream->Base.Map.pbFile != NULL)
             {
                 // time_t is number of seconds since 1.1.1970, UTC.
@@ -516,7 +936,10 @@ static bool BaseMap_Read(
     {
         // Don't allow reading past file size
         if((ByteOffset + dwBytesToRead) > pStream->Base.Map.FileSize)
+        {
+            SetLastError(ERROR_HANDLE_EOF);
             return false;
+        }
 
         // Copy the required data
         memcpy(pvBuffer, pStream->Base.Map.pbFile + (size_t)ByteOffset, dwBytesToRead);
@@ -542,6 +965,31 @@ static void BaseMap_Close(TFileStream * pStream)
     pStream->Base.Map.pbFile = NULL;
 }
 
+static void BaseMap_Advise(TFileStream * pStream, ULONGLONG ByteOffset, ULONGLONG Length, DWORD dwAdvice)
+{
+#if defined(PLATFORM_MAC) || defined(PLATFORM_LINUX)
+    static const int AdviceValues[] = {MADV_NORMAL, MADV_RANDOM, MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED};
+    ULONGLONG EndOffset;
+    size_t PageMask = (size_t)sysconf(_SC_PAGESIZE) - 1;
+    size_t BeginPage;
+
+    // Cut the range to the file size
+    if(ByteOffset >= pStream->Base.Map.FileSize)
+        return;
+    EndOffset = (Length != 0 && Length < (pStream->Base.Map.FileSize - ByteOffset)) ? (ByteOffset + Length) : pStream->Base.Map.FileSize;
+
+    // The begin of the range must be aligned to the page size
+    BeginPage = (size_t)ByteOffset & ~PageMask;
+    if(dwAdvice < sizeof(AdviceValues) / sizeof(AdviceValues[0]))
+        madvise(pStream->Base.Map.pbFile + BeginPage, (size_t)EndOffset - BeginPage, AdviceValues[dwAdvice]);
+#else
+    CASCLIB_UNUSED(pStream);
+    CASCLIB_UNUSED(ByteOffset);
+    CASCLIB_UNUSED(Length);
+    CASCLIB_UNUSED(dwAdvice);
+#endif
+}
+
 // Initializes base functions for the mapped file
 static void BaseMap_Init(TFileStream * pStream)
 {
@@ -551,6 +999,7 @@ static void BaseMap_Init(TFileStream * pStream)
     pStream->BaseGetSize = BaseFile_GetSize;    // Reuse BaseFile function
     pStream->BaseGetPos  = BaseFile_GetPos;     // Reuse BaseFile function
     pStream->BaseClose   = BaseMap_Close;
+    pStream->BaseAdvise  = BaseMap_Advise;
 
     // Mapped files are read-only
     pStream->dwFlags |= STREAM_FLAG_READ_ONLY;
@@ -582,6 +1031,493 @@ static const TCHAR * BaseHttp_ExtractServerName(const TCHAR * szFileName, TCHAR
     return szFileName;
 }
 
+#if defined(PLATFORM_MAC) || defined(PLATFORM_LINUX)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0                      // Mac uses SO_NOSIGPIPE instead
+#endif
+
+#define HTTP_MAX_CONNECTIONS    4           // Maximum number of parallel connections to the server
+#define HTTP_PIPELINE_DEPTH     8           // Maximum number of range requests sent ahead on one connection
+#define HTTP_CHUNK_SIZE         0x40000     // Large reads are split to range requests of this size
+#define HTTP_BUFFER_SIZE        0x4000      // Size of the receive buffer of a connection
+#define HTTP_MAX_HEADER         0x2000      // Maximum length of a response header
+#define HTTP_TIMEOUT            30          // Timeout of connecting, sending and receiving, in seconds
+#define HTTP_CONNECT_ATTEMPTS   2           // Connecting is repeated if it timed out
+
+// One keep-alive connection. The data received beyond the current
+// response stay in the buffer for the next pipelined response
+struct THttpConnection
+{
+    int sock;                               // Connected socket, -1 if not connected
+    bool bInUse;                            // true if a reader has the connection
+    DWORD BufferPos;                        // Position of the first unread byte in the buffer
+    DWORD BufferEnd;                        // End of the received data in the buffer
+    BYTE Buffer[HTTP_BUFFER_SIZE];
+};
+
+// Pool of connections to one server
+struct THttpPool
+{
+    CASC_LOCK Lock;                         // Guards taking and returning the connections
+    CASC_COND Cond;                         // Signalled when a connection is returned
+    struct addrinfo * pAddrInfo;            // Resolved server address
+    char szResource[MAX_PATH];              // The path of the file on the server
+    char szHostName[MAX_PATH];              // Server name, including the port, if any
+    THttpConnection Connections[HTTP_MAX_CONNECTIONS];
+};
+
+// Parsed response header
+struct THttpResponse
+{
+    DWORD dwStatusCode;                     // HTTP status code
+    ULONGLONG ContentLength;                // Length of the response body
+    ULONGLONG TotalLength;                  // Total length of the file from "Content-Range"
+    ULONGLONG FileTime;                     // "Last-Modified" as FILETIME, if present
+    bool bConnectionClose;                  // The server closes the connection after this response
+};
+
+static void HttpConn_Close(THttpConnection * pConn)
+{
+    if(pConn->sock != -1)
+        close(pConn->sock);
+    pConn->sock = -1;
+    pConn->BufferPos = pConn->BufferEnd = 0;
+}
+
+// Connects the socket, waiting at most HTTP_TIMEOUT seconds
+static bool HttpConn_ConnectAddress(int sock, struct addrinfo * pAddr, bool * pbTimedOut)
+{
+    struct pollfd PollFd;
+    socklen_t nLength = sizeof(int);
+    int nFlags = fcntl(sock, F_GETFL, 0);
+    int nSockError = 0;
+    int nResult;
+
+    // Connect without blocking, so that the wait can be limited
+    fcntl(sock, F_SETFL, nFlags | O_NONBLOCK);
+    if(connect(sock, pAddr->ai_addr, pAddr->ai_addrlen) != 0)
+    {
+        if(errno != EINPROGRESS)
+            return false;
+
+        PollFd.fd = sock;
+        PollFd.events = POLLOUT;
+        PollFd.revents = 0;
+        do
+        {
+            nResult = poll(&PollFd, 1, HTTP_TIMEOUT * 1000);
+        }
+        while(nResult == -1 && errno == EINTR);
+
+        if(nResult == 0)
+            pbTimedOut[0] = true;
+        if(nResult <= 0 || getsockopt(sock, SOL_SOCKET, SO_ERROR, &nSockError, &nLength) != 0 || nSockError != 0)
+            return false;
+    }
+
+    // Sending and receiving is blocking, limited by the socket timeouts
+    fcntl(sock, F_SETFL, nFlags);
+    return true;
+}
+
+// Connects to the server. A timeout makes another attempt, as the server
+// may just be busy. Timeouts of send and recv make the request fail
+// and the caller repeats it on a new connection
+static bool HttpConn_Connect(THttpPool * pPool, THttpConnection * pConn)
+{
+    struct addrinfo * pAddr;
+    struct timeval Timeout = {HTTP_TIMEOUT, 0};
+    int nOptValue = 1;
+    bool bTimedOut = true;
+
+    for(DWORD dwAttempt = 0; dwAttempt < HTTP_CONNECT_ATTEMPTS && bTimedOut; dwAttempt++)
+    {
+        // Try all addresses of the server
+        bTimedOut = false;
+        for(pAddr = pPool->pAddrInfo; pAddr != NULL; pAddr = pAddr->ai_next)
+        {
+            pConn->sock = socket(pAddr->ai_family, pAddr->ai_socktype, pAddr->ai_protocol);
+            if(pConn->sock == -1)
+                continue;
+
+            if(HttpConn_ConnectAddress(pConn->sock, pAddr, &bTimedOut))
+            {
+                // A server that stops responding must not block the reader forever
+                setsockopt(pConn->sock, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(struct timeval));
+                setsockopt(pConn->sock, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(struct timeval));
+
+                // Requests are small and sent ahead, don't let them wait for Nagle
+                setsockopt(pConn->sock, IPPROTO_TCP, TCP_NODELAY, &nOptValue, sizeof(int));
+#ifdef SO_NOSIGPIPE
+                setsockopt(pConn->sock, SOL_SOCKET, SO_NOSIGPIPE, &nOptValue, sizeof(int));
+#endif
+                pConn->BufferPos = pConn->BufferEnd = 0;
+                return true;
+            }
+
+            close(pConn->sock);
+            pConn->sock = -1;
+        }
+    }
+
+    return false;
+}
+
+static bool HttpConn_Send(THttpConnection * pConn, const char * szRequest, size_t cbRequest)
+{
+    ssize_t nSent;
+
+    while(cbRequest != 0)
+    {
+        nSent = send(pConn->sock, szRequest, cbRequest, MSG_NOSIGNAL);
+        if(nSent <= 0)
+        {
+            if(nSent == -1 && errno == EINTR)
+                continue;
+            return false;
+        }
+
+        szRequest += nSent;
+        cbRequest -= nSent;
+    }
+
+    return true;
+}
+
+// Receives exactly cbToRead bytes. The buffered data are used first,
+// large reads go directly to the target buffer
+static bool HttpConn_Recv(THttpConnection * pConn, void * pvBuffer, size_t cbToRead)
+{
+    LPBYTE pbBuffer = (LPBYTE)pvBuffer;
+    ssize_t nReceived;
+    size_t cbCopy;
+
+    while(cbToRead != 0)
+    {
+        // Use the buffered data
+        if(pConn->BufferPos < pConn->BufferEnd)
+        {
+            cbCopy = CASCLIB_MIN(cbToRead, (size_t)(pConn->BufferEnd - pConn->BufferPos));
+            memcpy(pbBuffer, pConn->Buffer + pConn->BufferPos, cbCopy);
+            pConn->BufferPos += (DWORD)cbCopy;
+            pbBuffer += cbCopy;
+            cbToRead -= cbCopy;
+            continue;
+        }
+
+        // Receive large blocks directly, small ones through the buffer
+        if(cbToRead >= HTTP_BUFFER_SIZE)
+        {
+            nReceived = recv(pConn->sock, pbBuffer, cbToRead, 0);
+            if(nReceived > 0)
+            {
+                pbBuffer += nReceived;
+                cbToRead -= nReceived;
+                continue;
+            }
+        }
+        else
+        {
+            nReceived = recv(pConn->sock, pConn->Buffer, HTTP_BUFFER_SIZE, 0);
+            if(nReceived > 0)
+            {
+                pConn->BufferPos = 0;
+                pConn->BufferEnd = (DWORD)nReceived;
+                continue;
+            }
+        }
+
+        // Connection closed or failed
+        if(nReceived == -1 && errno == EINTR)
+            continue;
+        return false;
+    }
+
+    return true;
+}
+
+// Converts "Sun, 06 Nov 1994 08:49:37 GMT" to FILETIME
+static ULONGLONG HttpParseTime(const char * szTime)
+{
+    struct tm TimeInfo;
+
+    memset(&TimeInfo, 0, sizeof(struct tm));
+    if(strptime(szTime, "%a, %d %b %Y %H:%M:%S", &TimeInfo) == NULL)
+        return 0;
+
+    // Set the start to 1.1.1970 00:00:00, the same way as for local files
+    return 0x019DB1DED53E8000ULL + (10000000ULL * (ULONGLONG)timegm(&TimeInfo));
+}
+
+// Checks whether a comma-separated header value contains the token, ignoring the case
+static bool HttpHasToken(const char * szValue, const char * szToken)
+{
+    size_t cchToken = strlen(szToken);
+
+    for(;;)
+    {
+        // Skip the separators
+        szValue += strspn(szValue, " \t,");
+        if(szValue[0] == 0)
+            return false;
+
+        if(!strncasecmp(szValue, szToken, cchToken) && strchr(" \t,", szValue[cchToken]) != NULL)
+            return true;
+        szValue += strcspn(szValue, ",");
+    }
+}
+
+static bool HttpConn_ReadResponse(THttpConnection * pConn, THttpResponse * pResponse)
+{
+    char szHeader[HTTP_MAX_HEADER];
+    char * szLine;
+    char * szNextLine;
+    size_t cchHeader = 0;
+
+    // Read the header byte by byte from the buffer, up to the empty line
+    while(cchHeader < 4 || memcmp(szHeader + cchHeader - 4, "\r\n\r\n", 4))
+    {
+        if(cchHeader >= sizeof(szHeader) - 1 || !HttpConn_Recv(pConn, szHeader + cchHeader, 1))
+            return false;
+        cchHeader++;
+    }
+    szHeader[cchHeader] = 0;
+
+    // Parse the status line
+    memset(pResponse, 0, sizeof(THttpResponse));
+    if(strncmp(szHeader, "HTTP/1.", 7) || szHeader[8] != ' ')
+        return false;
+    pResponse->dwStatusCode = (DWORD)strtoul(szHeader + 9, NULL, 10);
+    pResponse->bConnectionClose = (szHeader[7] == '0');
+
+    // Parse the header fields we need
+    for(szLine = strstr(szHeader, "\r\n") + 2; szLine[0] != '\r'; szLine = szNextLine + 2)
+    {
+        szNextLine = strstr(szLine, "\r\n");
+        szNextLine[0] = 0;
+
+        if(!strncasecmp(szLine, "Content-Length:", 15))
+            pResponse->ContentLength = strtoull(szLine + 15, NULL, 10);
+        else if(!strncasecmp(szLine, "Content-Range:", 14) && strchr(szLine, '/') != NULL)
+            pResponse->TotalLength = strtoull(strchr(szLine, '/') + 1, NULL, 10);
+        else if(!strncasecmp(szLine, "Last-Modified:", 14))
+            pResponse->FileTime = HttpParseTime(szLine + 14 + strspn(szLine + 14, " "));
+        else if(!strncasecmp(szLine, "Connection:", 11) && HttpHasToken(szLine + 11, "close"))
+            pResponse->bConnectionClose = true;
+        else if(!strncasecmp(szLine, "Transfer-Encoding:", 18))
+            return false;                   // Chunked responses are not expected for ranges
+    }
+
+    return true;
+}
+
+static bool HttpConn_SendRangeRequest(THttpPool * pPool, THttpConnection * pConn, ULONGLONG StartOffset, ULONGLONG EndOffset)
+{
+    char szRequest[MAX_PATH + 0x200];
+    int nLength;
+
+    // Note that the end of the range is inclusive
+    nLength = snprintf(szRequest, sizeof(szRequest), "GET %s HTTP/1.1\r\n"
+                                                     "Host: %s\r\n"
+                                                     "Range: bytes=%llu-%llu\r\n"
+                                                     "Connection: keep-alive\r\n"
+                                                     "\r\n",
+                                                     pPool->szResource,
+                                                     pPool->szHostName,
+                                                     (unsigned long long)StartOffset,
+                                                     (unsigned long long)(EndOffset - 1));
+    if(nLength <= 0 || nLength >= (int)sizeof(szRequest))
+        return false;
+    return HttpConn_Send(pConn, szRequest, nLength);
+}
+
+// Takes a free connection from the pool. Waits if all connections are in use
+static THttpConnection * HttpPool_Acquire(THttpPool * pPool)
+{
+    THttpConnection * pConn = NULL;
+
+    CascLock_Enter(&pPool->Lock);
+    while(pConn == NULL)
+    {
+        // Prefer connections that are already open
+        for(DWORD i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+        {
+            if(pPool->Connections[i].bInUse == false && (pConn == NULL || pPool->Connections[i].sock != -1))
+                pConn = &pPool->Connections[i];
+        }
+
+        if(pConn == NULL)
+            CascCond_Wait(&pPool->Cond, &pPool->Lock);
+    }
+    pConn->bInUse = true;
+    CascLock_Leave(&pPool->Lock);
+
+    // Connect, if needed
+    if(pConn->sock == -1 && !HttpConn_Connect(pPool, pConn))
+    {
+        CascLock_Enter(&pPool->Lock);
+        pConn->bInUse = false;
+        CascCond_Broadcast(&pPool->Cond);
+        CascLock_Leave(&pPool->Lock);
+        return NULL;
+    }
+
+    return pConn;
+}
+
+static void HttpPool_Release(THttpPool * pPool, THttpConnection * pConn, bool bKeepAlive)
+{
+    if(bKeepAlive == false)
+        HttpConn_Close(pConn);
+
+    CascLock_Enter(&pPool->Lock);
+    pConn->bInUse = false;
+    CascCond_Broadcast(&pPool->Cond);
+    CascLock_Leave(&pPool->Lock);
+}
+
+static void HttpPool_Free(THttpPool * pPool)
+{
+    for(DWORD i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+        HttpConn_Close(&pPool->Connections[i]);
+    if(pPool->pAddrInfo != NULL)
+        freeaddrinfo(pPool->pAddrInfo);
+    CascCond_Free(&pPool->Cond);
+    CascLock_Free(&pPool->Lock);
+    CASC_FREE(pPool);
+}
+
+static THttpPool * HttpPool_Create(const char * szFileName)
+{
+    struct addrinfo Hints;
+    THttpPool * pPool;
+    const char * szResource;
+    const char * szPort = "80";
+    char szServerName[MAX_PATH];
+    char * szPortPtr;
+
+    // Allocate the pool
+    pPool = CASC_ALLOC(THttpPool, 1);
+    if(pPool == NULL)
+        return NULL;
+    memset(pPool, 0, sizeof(THttpPool));
+    CascLock_Init(&pPool->Lock);
+    CascCond_Init(&pPool->Cond);
+    for(DWORD i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+        pPool->Connections[i].sock = -1;
+
+    // Split the URL to the server name and the file path.
+    // Both are copied, the file name may be freed after the stream is open
+    szResource = BaseHttp_ExtractServerName(szFileName, NULL);
+    if((size_t)(szResource - szFileName) >= MAX_PATH || szResource[0] != '/' || strlen(szResource) >= MAX_PATH)
+    {
+        HttpPool_Free(pPool);
+        return NULL;
+    }
+    BaseHttp_ExtractServerName(szFileName, pPool->szHostName);
+    strcpy(pPool->szResource, szResource);
+
+    // The server name may contain the port
+    strcpy(szServerName, pPool->szHostName);
+    if((szPortPtr = strchr(szServerName, ':')) != NULL)
+    {
+        *szPortPtr++ = 0;
+        szPort = szPortPtr;
+    }
+
+    // Resolve the server address
+    memset(&Hints, 0, sizeof(struct addrinfo));
+    Hints.ai_family = AF_UNSPEC;
+    Hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(szServerName, szPort, &Hints, &pPool->pAddrInfo) != 0)
+    {
+        pPool->pAddrInfo = NULL;
+        HttpPool_Free(pPool);
+        return NULL;
+    }
+
+    return pPool;
+}
+
+// Reads a range of the file. The range is split to requests that are sent
+// ahead on one connection, so the server doesn't wait for the next request.
+// If the connection turns out to be closed, it is open again once
+static bool HttpPool_ReadRange(THttpPool * pPool, ULONGLONG ByteOffset, LPBYTE pbBuffer, DWORD dwBytesToRead)
+{
+    THttpConnection * pConn;
+    THttpResponse Response;
+    ULONGLONG EndOffset = ByteOffset + dwBytesToRead;
+    DWORD dwChunkCount = (dwBytesToRead + HTTP_CHUNK_SIZE - 1) / HTTP_CHUNK_SIZE;
+    DWORD dwChunkSize;
+    DWORD dwSent = 0;
+    DWORD dwReceived = 0;
+    bool bRetried = false;
+    bool bKeepAlive = true;
+
+    // Get a connection
+    pConn = HttpPool_Acquire(pPool);
+    if(pConn == NULL)
+        return false;
+
+    while(dwReceived < dwChunkCount)
+    {
+        // Send the requests ahead
+        while(dwSent < dwChunkCount && (dwSent - dwReceived) < HTTP_PIPELINE_DEPTH)
+        {
+            ULONGLONG ChunkOffset = ByteOffset + (ULONGLONG)dwSent * HTTP_CHUNK_SIZE;
+
+            if(!HttpConn_SendRangeRequest(pPool, pConn, ChunkOffset, CASCLIB_MIN(ChunkOffset + HTTP_CHUNK_SIZE, EndOffset)))
+                break;
+            dwSent++;
+        }
+
+        // Receive the next response. The body must be exactly the requested range
+        dwChunkSize = CASCLIB_MIN((DWORD)HTTP_CHUNK_SIZE, dwBytesToRead - dwReceived * HTTP_CHUNK_SIZE);
+        if(dwSent > dwReceived && HttpConn_ReadResponse(pConn, &Response))
+        {
+            if(Response.dwStatusCode != 206 || Response.ContentLength != dwChunkSize)
+            {
+                bKeepAlive = false;
+                break;
+            }
+
+            if(HttpConn_Recv(pConn, pbBuffer + (size_t)dwReceived * HTTP_CHUNK_SIZE, dwChunkSize))
+            {
+                dwReceived++;
+
+                // The server will not answer the remaining requests
+                // on this connection, so it needs to be open again
+                if(Response.bConnectionClose && dwReceived < dwChunkCount)
+                {
+                    HttpConn_Close(pConn);
+                    if(!HttpConn_Connect(pPool, pConn))
+                        break;
+                    dwSent = dwReceived;
+                }
+                else if(Response.bConnectionClose)
+                {
+                    bKeepAlive = false;
+                }
+                continue;
+            }
+        }
+
+        // The connection failed. A kept-alive connection may have been closed
+        // by the server in the meantime, so try once more with a new one
+        HttpConn_Close(pConn);
+        if(bRetried || !HttpConn_Connect(pPool, pConn))
+            break;
+        dwSent = dwReceived;
+        bRetried = true;
+    }
+
+    HttpPool_Release(pPool, pConn, bKeepAlive && dwReceived == dwChunkCount);
+    return (dwReceived == dwChunkCount);
+}
+
+#endif  // defined(PLATFORM_MAC) || defined(PLATFORM_LINUX)
+
 static bool BaseHttp_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD dwStreamFlags)
 {
 #ifdef PLATFORM_WINDOWS
@@ -677,10 +1613,53 @@ static bool BaseHttp_Open(TFileStream * pStream, const TCHAR * szFileName, DWORD
 
 #else
 
-    // Not supported
-    SetLastError(ERROR_NOT_SUPPORTED);
-    pStream = pStream;
-    return false;
+    THttpConnection * pConn;
+    THttpResponse Response;
+    BYTE OneByte;
+    bool bFileAvailable = false;
+
+    // Keep compiler happy
+    dwStreamFlags = dwStreamFlags;
+
+    // Create the pool of connections to the server
+    pStream->Base.Http.pPool = HttpPool_Create(szFileName);
+    if(pStream->Base.Http.pPool == NULL)
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return false;
+    }
+
+    // Ask for the first byte. This verifies that the server supports
+    // random access and gives the total size of the file
+    pConn = HttpPool_Acquire(pStream->Base.Http.pPool);
+    if(pConn != NULL)
+    {
+        if(HttpConn_SendRangeRequest(pStream->Base.Http.pPool, pConn, 0, 1) && HttpConn_ReadResponse(pConn, &Response))
+        {
+            if(Response.dwStatusCode == 206 && Response.ContentLength == 1 && Response.TotalLength != 0)
+            {
+                if(HttpConn_Recv(pConn, &OneByte, 1))
+                {
+                    pStream->Base.Http.FileSize = Response.TotalLength;
+                    pStream->Base.Http.FileTime = Response.FileTime;
+                    pStream->Base.Http.FilePos = 0;
+                    bFileAvailable = true;
+                }
+            }
+        }
+        HttpPool_Release(pStream->Base.Http.pPool, pConn, bFileAvailable && !Response.bConnectionClose);
+    }
+
+    // If the file is not there and is not available for random access,
+    // report error
+    if(bFileAvailable == false)
+    {
+        pStream->BaseClose(pStream);
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return false;
+    }
+
+    return true;
 
 #endif
 }
@@ -751,13 +1730,25 @@ static bool BaseHttp_Read(
 
 #else
 
-    // Not supported
-    pStream = pStream;
-    pByteOffset = pByteOffset;
-    pvBuffer = pvBuffer;
-    dwBytesToRead = dwBytesToRead;
-    SetLastError(ERROR_NOT_SUPPORTED);
-    return false;
+    ULONGLONG ByteOffset = (pByteOffset != NULL) ? *pByteOffset : pStream->Base.Http.FilePos;
+
+    // Reading beyond the end of the file is not possible
+    if(ByteOffset + dwBytesToRead > pStream->Base.Http.FileSize)
+    {
+        SetLastError(ERROR_HANDLE_EOF);
+        return false;
+    }
+
+    // Read the range from the server
+    if(dwBytesToRead != 0 && !HttpPool_ReadRange(pStream->Base.Http.pPool, ByteOffset, (LPBYTE)pvBuffer, dwBytesToRead))
+    {
+        SetLastError(ERROR_HANDLE_EOF);
+        return false;
+    }
+
+    // Increment the current file position by number of bytes read
+    pStream->Base.Http.FilePos = ByteOffset + dwBytesToRead;
+    return true;
 
 #endif
 }
@@ -773,7 +1764,9 @@ static void BaseHttp_Close(TFileStream * pStream)
         InternetCloseHandle(pStream->Base.Http.hInternet);
     pStream->Base.Http.hInternet = NULL;
 #else
-    pStream = pStream;
+    if(pStream->Base.Http.pPool != NULL)
+        HttpPool_Free(pStream->Base.Http.pPool);
+    pStream->Base.Http.pPool = NULL;
 #endif
 }
 
@@ -2413,6 +3406,121 @@ TFileStream * FileStream_OpenFile(
     }
 }
 
+/**
+ * Sets the maximum number of file handles that can be open by the streams
+ * opened with STREAM_FLAG_HANDLE_POOL. The limit is shared by all streams in the process.
+ * If there are more handles open, the least recently used ones are closed
+ *
+ * \a dwMaxHandles Maximum number of open handles. CASC_HANDLE_LIMIT_NONE means no limit
+ */
+bool FileStream_SetHandleLimit(DWORD dwMaxHandles)
+{
+    if(dwMaxHandles == 0)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    CascOnce_Run(&HandlePoolOnce, HandlePool_Init);
+    CascLock_Enter(&HandlePool.Lock);
+    CascInterlockedExchange(&HandlePool.dwMaxHandles, dwMaxHandles);
+    HandlePool_Trim(dwMaxHandles);
+    CascLock_Leave(&HandlePool.Lock);
+    return true;
+}
+
+/**
+ * Retrieves the limit and the usage statistics of the handle pool
+ *
+ * \a pInfo Pointer to structure that receives the information
+ */
+void FileStream_GetHandleInfo(PCASC_FILE_HANDLE_INFO pInfo)
+{
+    CascOnce_Run(&HandlePoolOnce, HandlePool_Init);
+    CascLock_Enter(&HandlePool.Lock);
+    pInfo->dwMaxHandles = HandlePool.dwMaxHandles;
+    pInfo->dwOpenHandles = HandlePool.dwOpenHandles;
+    pInfo->ReopenCount = HandlePool.ReopenCount;
+    pInfo->CloseCount = HandlePool.CloseCount;
+    CascLock_Leave(&HandlePool.Lock);
+}
+
+/**
+ * Allocates a buffer aligned for direct I/O. The buffers are taken from a pool
+ * and must be freed by FileStream_FreeAligned
+ *
+ * \a cbBuffer Required size of the buffer
+ */
+LPBYTE FileStream_AllocAligned(size_t cbBuffer)
+{
+    TAlignedBuffer * pBuffer;
+    TAlignedBuffer ** ppPrev;
+
+    // Try to reuse a free buffer that is big enough
+    CascOnce_Run(&BufferPoolOnce, BufferPool_Init);
+    CascLock_Enter(&BufferPool.Lock);
+    for(ppPrev = &BufferPool.pFirst; (pBuffer = ppPrev[0]) != NULL; ppPrev = &pBuffer->pNext)
+    {
+        if(pBuffer->cbBuffer >= cbBuffer)
+        {
+            ppPrev[0] = pBuffer->pNext;
+            BufferPool.dwFreeBuffers--;
+            break;
+        }
+    }
+    CascLock_Leave(&BufferPool.Lock);
+
+    // Allocate new buffer, if none was found
+    if(pBuffer == NULL)
+        pBuffer = BufferPool_Alloc((cbBuffer + ALIGNED_BUFFER_GRANULARITY - 1) & ~(size_t)(ALIGNED_BUFFER_GRANULARITY - 1));
+    return (pBuffer != NULL) ? ((LPBYTE)pBuffer + STREAM_DIRECT_IO_ALIGNMENT) : NULL;
+}
+
+/**
+ * Returns a buffer allocated by FileStream_AllocAligned to the pool
+ *
+ * \a pbBuffer Pointer to the buffer
+ */
+void FileStream_FreeAligned(LPBYTE pbBuffer)
+{
+    TAlignedBuffer * pBuffer = (TAlignedBuffer *)(pbBuffer - STREAM_DIRECT_IO_ALIGNMENT);
+
+    // Keep the buffer for later use, unless the pool is full.
+    // Large buffers (e.g. raw data of whole files) are freed right away,
+    // so that the pool doesn't hold big blocks of memory forever
+    if(pBuffer->cbBuffer <= ALIGNED_BUFFER_POOL_SIZE)
+    {
+        CascLock_Enter(&BufferPool.Lock);
+        if(BufferPool.dwFreeBuffers < ALIGNED_BUFFER_POOL_MAX)
+        {
+            pBuffer->pNext = BufferPool.pFirst;
+            BufferPool.pFirst = pBuffer;
+            BufferPool.dwFreeBuffers++;
+            pBuffer = NULL;
+        }
+        CascLock_Leave(&BufferPool.Lock);
+    }
+
+    if(pBuffer != NULL)
+        BufferPool_Free(pBuffer);
+}
+
+/**
+ * Returns the alignment needed for reads that bypass the system cache.
+ * Aligned reads to aligned buffers go directly to the disk; other reads
+ * are done through an intermediate buffer. Returns 1 if the stream
+ * has no alignment requirements
+ *
+ * \a pStream Pointer to an open stream
+ */
+DWORD FileStream_GetAlignment(TFileStream * pStream)
+{
+    // Only flat streams over a local file have stream offsets equal to file offsets
+    if((pStream->dwFlags & (BASE_PROVIDER_MASK | STREAM_PROVIDER_MASK)) != (BASE_PROVIDER_FILE | STREAM_PROVIDER_FLAT))
+        return 1;
+    return BaseFile_GetAlignment(pStream);
+}
+
 /**
  * Returns the file name of the stream
  *
@@ -2598,6 +3706,40 @@ bool FileStream_GetSize(TFileStream * pStream, ULONGLONG * pFileSize)
     return pStream->StreamGetSize(pStream, pFileSize);
 }
 
+/**
+ * Returns pointer to the data of a memory-mapped file, or NULL if the stream is not mapped.
+ * The data are valid until the stream is closed
+ *
+ * \a pStream Pointer to an open stream
+ * \a pFileSize Pointer where to store the file size
+ */
+LPBYTE FileStream_GetMappedData(TFileStream * pStream, ULONGLONG * pFileSize)
+{
+    // Only flat streams over a mapped file have the data available as-is
+    if(pStream->BaseRead != BaseMap_Read || (pStream->dwFlags & STREAM_PROVIDER_MASK) != STREAM_PROVIDER_FLAT)
+        return NULL;
+
+    if(pFileSize != NULL)
+        pFileSize[0] = pStream->Base.Map.FileSize;
+    return pStream->Base.Map.pbFile;
+}
+
+/**
+ * Tells the system how the given part of the stream will be accessed.
+ * This is only a hint; streams that don't support it ignore it
+ *
+ * \a pStream Pointer to an open stream
+ * \a ByteOffset Begin of the file range
+ * \a Length Length of the file range. Zero means up to the end of the file
+ * \a dwAdvice One of STREAM_ADVICE_XXX values
+ */
+void FileStream_Advise(TFileStream * pStream, ULONGLONG ByteOffset, ULONGLONG Length, DWORD dwAdvice)
+{
+    // Stream offsets are equal to file offsets only in flat streams
+    if(pStream->BaseAdvise != NULL && (pStream->dwFlags & STREAM_PROVIDER_MASK) == STREAM_PROVIDER_FLAT)
+        pStream->BaseAdvise(pStream, ByteOffset, Length, dwAdvice);
+}
+
 /**
  * Sets the size of a file
  *
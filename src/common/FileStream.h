@@ -61,6 +61,13 @@ typedef void (*STREAM_CLOSE)(
     struct TFileStream * pStream        // Pointer to an open stream
     );
 
+typedef void (*STREAM_ADVISE)(
+    struct TFileStream * pStream,       // Pointer to an open stream
+    ULONGLONG ByteOffset,               // Begin of the file range
+    ULONGLONG Length,                   // Length of the file range. Zero means up to the end of the file
+    DWORD dwAdvice                      // One of STREAM_ADVICE_XXX
+    );
+
 typedef bool (*BLOCK_READ)(
     struct TFileStream * pStream,       // Pointer to a block-oriented stream
     ULONGLONG StartOffset,              // Byte offset of start of the block array
@@ -79,6 +86,18 @@ typedef void (*BLOCK_SAVEMAP)(
     struct TFileStream * pStream        // Pointer to a block-oriented stream
     );
 
+//-----------------------------------------------------------------------------
+// Values for FileStream_Advise
+
+#define STREAM_ADVICE_NORMAL        0       // No special treatment
+#define STREAM_ADVICE_RANDOM        1       // The data will be accessed at random places
+#define STREAM_ADVICE_SEQUENTIAL    2       // The data will be accessed front to back
+#define STREAM_ADVICE_WILLNEED      3       // The data will be needed soon
+#define STREAM_ADVICE_DONTNEED      4       // The data will not be needed again
+
+// Alignment of offsets, lengths and buffers for reading files open with STREAM_FLAG_DIRECT_IO
+#define STREAM_DIRECT_IO_ALIGNMENT  0x1000
+
 //-----------------------------------------------------------------------------
 // Local structures - partial file structure and bitmap footer
 
@@ -147,7 +166,20 @@ union TBaseProviderData
         ULONGLONG FileTime;                 // Last write time
         HANDLE hInternet;                   // Internet handle
         HANDLE hConnect;                    // Connection to the internet server
+        struct THttpPool * pPool;           // Keep-alive connections to the server (non-Windows platforms)
     } Http;
+
+    struct
+    {
+        ULONGLONG FileSize;                 // Size of the file
+        ULONGLONG FilePos;                  // Current file position
+        ULONGLONG FileTime;                 // Last write time
+        HANDLE hFile;                       // File handle. INVALID_HANDLE_VALUE if closed by the handle pool
+        struct TFileStream * pPrev;         // Previous (more recently used) stream with an open handle
+        struct TFileStream * pNext;         // Next (less recently used) stream with an open handle
+        DWORD dwReaders;                    // Number of reads in progress
+        DWORD dwAdvice;                     // Access advice for the whole file, given again when the handle is reopened
+    } Pool;
 };
 
 struct TFileStream
@@ -173,6 +205,7 @@ struct TFileStream
     STREAM_GETSIZE BaseGetSize;             // Pointer to function returning file size
     STREAM_GETPOS  BaseGetPos;              // Pointer to function that returns current file position
     STREAM_CLOSE   BaseClose;               // Pointer to function closing the stream
+    STREAM_ADVISE  BaseAdvise;              // Pointer to function giving access hints to the system (optional)
 
     // Base provider data (file size, file position)
     TBaseProviderData Base;
@@ -228,11 +261,20 @@ bool FileStream_Read(TFileStream * pStream, ULONGLONG * pByteOffset, void * pvBu
 bool FileStream_Write(TFileStream * pStream, ULONGLONG * pByteOffset, const void * pvBuffer, DWORD dwBytesToWrite);
 bool FileStream_SetSize(TFileStream * pStream, ULONGLONG NewFileSize);
 bool FileStream_GetSize(TFileStream * pStream, ULONGLONG * pFileSize);
+LPBYTE FileStream_GetMappedData(TFileStream * pStream, ULONGLONG * pFileSize);
+void FileStream_Advise(TFileStream * pStream, ULONGLONG ByteOffset, ULONGLONG Length, DWORD dwAdvice);
 bool FileStream_GetPos(TFileStream * pStream, ULONGLONG * pByteOffset);
 bool FileStream_GetTime(TFileStream * pStream, ULONGLONG * pFT);
 bool FileStream_GetFlags(TFileStream * pStream, PDWORD pdwStreamFlags);
 bool FileStream_Replace(TFileStream * pStream, TFileStream * pNewStream);
 void FileStream_Close(TFileStream * pStream);
 
+bool FileStream_SetHandleLimit(DWORD dwMaxHandles);
+void FileStream_GetHandleInfo(PCASC_FILE_HANDLE_INFO pInfo);
+
+LPBYTE FileStream_AllocAligned(size_t cbBuffer);
+void FileStream_FreeAligned(LPBYTE pbBuffer);
+DWORD FileStream_GetAlignment(TFileStream * pStream);
+
 
 #endif // __FILESTREAM_H__
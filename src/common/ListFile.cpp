@@ -15,178 +15,68 @@
 //-----------------------------------------------------------------------------
 // Listfile entry structure
 
-#define CACHE_BUFFER_SIZE  0x1000       // Size of the cache buffer
-
-typedef bool (*RELOAD_CACHE)(void * pvCacheContext, LPBYTE pbBuffer, DWORD dwBytesToRead);
-typedef void (*CLOSE_STREAM)(void * pvCacheContext);
-
+// The entire listfile is either memory-mapped or loaded to memory,
+// so the lines can be given to the caller without being copied
 struct TListFileCache
 {
-    RELOAD_CACHE pfnReloadCache;        // Function for reloading the cache
-    CLOSE_STREAM pfnCloseStream;        // Function for closing the stream
-    void  * pvCacheContext;             // Reload context passed to reload function
-    char  * szMask;                     // Self-relative pointer to file mask
-    DWORD   dwFileSize;                 // Total size of the cached file
-    DWORD   dwFilePos;                  // Position of the cache in the file
-    BYTE  * pBegin;                     // The begin of the listfile cache
-    BYTE  * pPos;
-    BYTE  * pEnd;                       // The last character in the file cache
-
-    BYTE Buffer[CACHE_BUFFER_SIZE];
-//  char MaskBuff[1]                    // Followed by the name mask (if any)
+    TFileStream * pStream;              // Stream with the mapped listfile. NULL if the listfile was loaded to memory
+    char * pbAllocated;                 // Listfile data loaded to memory, if the file could not be mapped
+    const char * pBegin;                // The begin of the listfile data
+    const char * pPos;                  // Current position in the listfile data
+    const char * pEnd;                  // The end of the listfile data
 };
 
 //-----------------------------------------------------------------------------
 // Local functions
 
-static bool ReloadCache_ExternalFile(void * pvCacheContext, LPBYTE pbBuffer, DWORD dwBytesToRead)
+// Gives the next line as pointer and length. Newlines are located with memchr,
+// which is vectorized by the C runtime. Empty lines are skipped
+static size_t GetNextLineView(TListFileCache * pCache, const char ** pszLine)
 {
-    TFileStream * pStream = (TFileStream *)pvCacheContext;
-
-    return FileStream_Read(pStream, NULL, pbBuffer, dwBytesToRead);
-}
-
-static void CloseStream_ExternalFile(void * pvCacheContext)
-{
-    TFileStream * pStream = (TFileStream *)pvCacheContext;
-
-    return FileStream_Close(pStream);
-}
-
-
-// Reloads the cache. Returns number of characters
-// that has been loaded into the cache.
-static DWORD ReloadListFileCache(TListFileCache * pCache)
-{
-    DWORD dwBytesToRead = 0;
-
-    // Only do something if the cache is empty
-    if(pCache->pPos >= pCache->pEnd)
-    {
-        // Move the file position forward
-        pCache->dwFilePos += CACHE_BUFFER_SIZE;
-        if(pCache->dwFilePos >= pCache->dwFileSize)
-            return 0;
-
-        // Get the number of bytes remaining
-        dwBytesToRead = pCache->dwFileSize - pCache->dwFilePos;
-        if(dwBytesToRead > CACHE_BUFFER_SIZE)
-            dwBytesToRead = CACHE_BUFFER_SIZE;
-
-        // Load the next data chunk to the cache
-        // If we didn't read anything, it might mean that the block
-        // of the file is not available
-        // We stop reading the file at this point, because the rest
-        // of the listfile is unreliable
-        if(!pCache->pfnReloadCache(pCache->pvCacheContext, pCache->Buffer, dwBytesToRead))
-            return 0;
-
-        // Set the buffer pointers
-        pCache->pBegin =
-        pCache->pPos = &pCache->Buffer[0];
-        pCache->pEnd = pCache->pBegin + dwBytesToRead;
-    }
-
-    return dwBytesToRead;
-}
+    const char * szLineBegin;
+    const char * szLineEnd;
+    const char * szExtraString;
+    const char * szCharPtr;
 
-static size_t ReadListFileLine(TListFileCache * pCache, char * szLine, size_t nMaxChars)
-{
-    char * szLineBegin = szLine;
-    char * szLineEnd = szLine + nMaxChars - 1;
-    char * szExtraString = NULL;
-    
     // Skip newlines, spaces, tabs and another non-printable stuff
-    for(;;)
-    {
-        // If we need to reload the cache, do it
-        if(pCache->pPos == pCache->pEnd)
-        {
-            if(ReloadListFileCache(pCache) == 0)
-                break;
-        }
-
-        // If we found a non-whitespace character, stop
-        if(pCache->pPos[0] > 0x20)
-            break;
-
-        // Skip the character
+    while(pCache->pPos < pCache->pEnd && (BYTE)pCache->pPos[0] <= 0x20)
         pCache->pPos++;
-    }
-
-    // Copy the remaining characters
-    while(szLine < szLineEnd)
-    {
-        // If we need to reload the cache, do it now and resume copying
-        if(pCache->pPos == pCache->pEnd)
-        {
-            if(ReloadListFileCache(pCache) == 0)
-                break;
-        }
-
-        // If we have found a newline, stop loading
-        if(pCache->pPos[0] == 0x0D || pCache->pPos[0] == 0x0A)
-            break;
-
-        // Blizzard listfiles can also contain information about patch:
-        // Pass1\Files\MacOS\unconditional\user\Background Downloader.app\Contents\Info.plist~Patch(Data#frFR#base-frFR,1326)
-        if(pCache->pPos[0] == '~')
-            szExtraString = szLine;
-
-        // Copy the character
-        *szLine++ = *pCache->pPos++;
-    }
-
-    // Terminate line with zero
-    *szLine = 0;
-
-    // If there was extra string after the file name, clear it
-    if(szExtraString != NULL)
-    {
-        if(szExtraString[0] == '~' && szExtraString[1] == 'P')
-        {
-            szLine = szExtraString;
-            *szExtraString = 0;
-        }
-    }
-
-    // Return the length of the line
-    return (szLine - szLineBegin);
+    if(pCache->pPos >= pCache->pEnd)
+        return 0;
+
+    // The line ends with LF. If there is CR before it, the line ends there
+    szLineBegin = pCache->pPos;
+    szLineEnd = (const char *)memchr(szLineBegin, 0x0A, (pCache->pEnd - szLineBegin));
+    if(szLineEnd == NULL)
+        szLineEnd = pCache->pEnd;
+    szCharPtr = (const char *)memchr(szLineBegin, 0x0D, (szLineEnd - szLineBegin));
+    if(szCharPtr != NULL)
+        szLineEnd = szCharPtr;
+    pCache->pPos = szLineEnd;
+
+    // Blizzard listfiles can also contain information about patch:
+    // Pass1\Files\MacOS\unconditional\user\Background Downloader.app\Contents\Info.plist~Patch(Data#frFR#base-frFR,1326)
+    szExtraString = NULL;
+    szCharPtr = szLineBegin;
+    while((szCharPtr = (const char *)memchr(szCharPtr, '~', (szLineEnd - szCharPtr))) != NULL)
+        szExtraString = szCharPtr++;
+
+    // If there was extra string after the file name, cut it
+    if(szExtraString != NULL && (szExtraString + 1) < szLineEnd && szExtraString[1] == 'P')
+        szLineEnd = szExtraString;
+
+    pszLine[0] = szLineBegin;
+    return (szLineEnd - szLineBegin);
 }
 
-static TListFileCache * CreateListFileCache(RELOAD_CACHE pfnReloadCache, CLOSE_STREAM pfnCloseStream, void * pvCacheContext, DWORD dwFileSize)
+// Copies the line to the caller's buffer and terminates it with zero
+static size_t CopyLine(char * szBuffer, size_t nMaxChars, const char * szLine, size_t nLength)
 {
-    TListFileCache * pCache = NULL;
-    DWORD dwBytesToRead;
-
-    // Allocate cache for one file block
-    pCache = (TListFileCache *)CASC_ALLOC(BYTE, sizeof(TListFileCache));
-    if(pCache != NULL)
-    {
-        // Clear the entire structure
-        memset(pCache, 0, sizeof(TListFileCache));
-        pCache->pfnReloadCache = pfnReloadCache;
-        pCache->pfnCloseStream = pfnCloseStream;
-        pCache->pvCacheContext = pvCacheContext;
-        pCache->dwFileSize = dwFileSize;
-
-        // Load the file cache from the file
-        dwBytesToRead = CASCLIB_MIN(CACHE_BUFFER_SIZE, dwFileSize);
-        if(pfnReloadCache(pvCacheContext, pCache->Buffer, dwBytesToRead))
-        {
-            // Allocate pointers
-            pCache->pBegin = pCache->pPos = &pCache->Buffer[0];
-            pCache->pEnd   = pCache->pBegin + dwBytesToRead;
-        }
-        else
-        {
-            ListFile_Free(pCache);
-            pCache = NULL;
-        }
-    }
-
-    // Return the cache
-    return pCache;
+    if(nLength > nMaxChars - 1)
+        nLength = nMaxChars - 1;
+    memcpy(szBuffer, szLine, nLength);
+    szBuffer[nLength] = 0;
+    return nLength;
 }
 
 //-----------------------------------------------------------------------------
@@ -197,29 +87,58 @@ void * ListFile_OpenExternal(const TCHAR * szListFile)
     TListFileCache * pCache;
     TFileStream * pStream;
     ULONGLONG FileSize = 0;
+    LPBYTE pbFileData;
+
+    // Allocate the listfile cache
+    pCache = CASC_ALLOC(TListFileCache, 1);
+    if(pCache == NULL)
+        return NULL;
+    memset(pCache, 0, sizeof(TListFileCache));
 
-    // Open the external listfile
+    // Try to map the listfile to memory first
+    pStream = FileStream_OpenFile(szListFile, STREAM_FLAG_READ_ONLY | BASE_PROVIDER_MAP);
+    if(pStream != NULL)
+    {
+        pbFileData = FileStream_GetMappedData(pStream, &FileSize);
+        if(pbFileData != NULL && FileSize <= 0xFFFFFFFF)
+        {
+            pCache->pStream = pStream;
+            pCache->pBegin = pCache->pPos = (const char *)pbFileData;
+            pCache->pEnd = pCache->pBegin + (size_t)FileSize;
+            return pCache;
+        }
+
+        FileStream_Close(pStream);
+    }
+
+    // If the mapping failed, load the entire listfile to memory
     pStream = FileStream_OpenFile(szListFile, STREAM_FLAG_READ_ONLY);
     if(pStream != NULL)
     {
-        // Retrieve the size of the external listfile
+        // Retrieve the size of the external listfile. An empty listfile is valid
         FileStream_GetSize(pStream, &FileSize);
-        if(0 < FileSize && FileSize <= 0xFFFFFFFF)
-        {                                                               
-            // Create the cache for the listfile
-            pCache = CreateListFileCache(ReloadCache_ExternalFile, CloseStream_ExternalFile, pStream, (DWORD)FileSize);
-            if(pCache != NULL)
+        if(FileSize <= 0xFFFFFFFF)
+        {
+            pCache->pbAllocated = CASC_ALLOC(char, (size_t)FileSize + 1);
+
+            if(pCache->pbAllocated != NULL && FileStream_Read(pStream, NULL, pCache->pbAllocated, (DWORD)FileSize))
+            {
+                pCache->pBegin = pCache->pPos = pCache->pbAllocated;
+                pCache->pEnd = pCache->pBegin + (size_t)FileSize;
+                FileStream_Close(pStream);
                 return pCache;
+            }
         }
 
         // Close the file stream
         FileStream_Close(pStream);
     }
 
+    ListFile_Free(pCache);
     return NULL;
 }
 
-size_t ListFile_GetNextLine(void * pvListFile, char * szBuffer, size_t nMaxChars)
+size_t ListFile_GetNextView(void * pvListFile, const char ** pszLine)
 {
     TListFileCache * pCache = (TListFileCache *)pvListFile;
     size_t nLength = 0;
@@ -228,8 +147,8 @@ size_t ListFile_GetNextLine(void * pvListFile, char * szBuffer, size_t nMaxChars
     // Check for parameters
     if(pCache != NULL)
     {
-        // Read the (next) line
-        nLength = ReadListFileLine(pCache, szBuffer, nMaxChars);
+        // Get the (next) line
+        nLength = GetNextLineView(pCache, pszLine);
         nError = (nLength != 0) ? ERROR_SUCCESS : ERROR_NO_MORE_FILES;
     }
 
@@ -238,37 +157,32 @@ size_t ListFile_GetNextLine(void * pvListFile, char * szBuffer, size_t nMaxChars
     return nLength;
 }
 
-size_t ListFile_GetNext(void * pvListFile, const char * szMask, char * szBuffer, size_t nMaxChars)
+size_t ListFile_GetNextLine(void * pvListFile, char * szBuffer, size_t nMaxChars)
+{
+    const char * szLine;
+    size_t nLength;
+
+    // Read the (next) line
+    nLength = ListFile_GetNextView(pvListFile, &szLine);
+    if(nLength != 0)
+        nLength = CopyLine(szBuffer, nMaxChars, szLine, nLength);
+    return nLength;
+}
+
+size_t ListFile_GetNext(void * pvListFile, PCASC_WILDCARD pWildCard, char * szBuffer, size_t nMaxChars)
 {
-    TListFileCache * pCache = (TListFileCache *)pvListFile;
-    size_t nLength = 0;
-    int nError = ERROR_INVALID_PARAMETER;
+    const char * szLine;
+    size_t nLength;
 
-    // Check for parameters
-    if(pCache != NULL)
+    // Find the next line that matches the mask.
+    // Only the matching lines are copied to the buffer
+    while((nLength = ListFile_GetNextView(pvListFile, &szLine)) != 0)
     {
-        for(;;)
-        {
-            // Read the (next) line
-            nLength = ReadListFileLine(pCache, szBuffer, nMaxChars);
-            if(nLength == 0)
-            {
-                nError = ERROR_NO_MORE_FILES;
-                break;
-            }
-
-            // If some mask entered, check it
-            if(CheckWildCard(szBuffer, szMask))
-            {
-                nError = ERROR_SUCCESS;
-                break;
-            }
-        }
+        if(pWildCard == NULL || WildCard_Check(pWildCard, szLine, nLength))
+            return CopyLine(szBuffer, nMaxChars, szLine, nLength);
     }
 
-    if(nError != ERROR_SUCCESS)
-        SetLastError(nError);
-    return nLength;
+    return 0;
 }
 
 void ListFile_Free(void * pvListFile)
@@ -278,8 +192,10 @@ void ListFile_Free(void * pvListFile)
     // Valid parameter check
     if(pCache != NULL)
     {
-        if(pCache->pfnCloseStream != NULL)
-            pCache->pfnCloseStream(pCache->pvCacheContext);
+        if(pCache->pStream != NULL)
+            FileStream_Close(pCache->pStream);
+        if(pCache->pbAllocated != NULL)
+            CASC_FREE(pCache->pbAllocated);
         CASC_FREE(pCache);
     }
 }
@@ -287,74 +203,289 @@ void ListFile_Free(void * pvListFile)
 //-----------------------------------------------------------------------------
 // Functions for creating a listfile map
 
-#define LISTMAP_INITIAL   0x100000
+// Listfiles smaller than this are not split into parts for the worker threads
+#define LISTMAP_MIN_PART_SIZE   0x100000
+
+// A part of the listfile parsed by one worker thread
+typedef struct _LISTMAP_PART
+{
+    TListFileCache Cache;               // The part of the listfile data
+    PLISTFILE_MAP pListMap;             // Names from this part of the listfile
+    bool bResult;                       // true if all names were inserted
+
+} LISTMAP_PART, *PLISTMAP_PART;
+
+typedef struct _LISTMAP_LOAD_CONTEXT
+{
+    PLISTMAP_PART pParts;               // Parts of the listfile
+    DWORD dwPartCount;                  // Number of parts
+    DWORD dwNextPart;                   // The next part to be parsed
+
+} LISTMAP_LOAD_CONTEXT, *PLISTMAP_LOAD_CONTEXT;
+
+// Encodes the length of a prefix or suffix. Lengths below 0x80 take one byte
+static LPBYTE EncodeLength(LPBYTE pbRecord, size_t nLength)
+{
+    if(nLength < 0x80)
+    {
+        *pbRecord++ = (BYTE)nLength;
+    }
+    else
+    {
+        *pbRecord++ = (BYTE)(0x80 | (nLength & 0x7F));
+        *pbRecord++ = (BYTE)(nLength >> 7);
+    }
+    return pbRecord;
+}
+
+static LPBYTE DecodeLength(LPBYTE pbRecord, size_t * PtrLength)
+{
+    if(pbRecord[0] & 0x80)
+    {
+        PtrLength[0] = (pbRecord[0] & 0x7F) | ((size_t)pbRecord[1] << 7);
+        return pbRecord + 2;
+    }
+
+    PtrLength[0] = pbRecord[0];
+    return pbRecord + 1;
+}
+
+// Applies one name record to the previous name in the buffer.
+// Gives the pointer to the next record
+static LPBYTE ApplyNameRecord(LPBYTE pbRecord, char * szBuffer, size_t * PtrLength)
+{
+    size_t cchPrefix;
+    size_t cchSuffix;
+
+    pbRecord = DecodeLength(pbRecord, &cchPrefix);
+    pbRecord = DecodeLength(pbRecord, &cchSuffix);
+    memcpy(szBuffer + cchPrefix, pbRecord, cchSuffix);
+    szBuffer[cchPrefix + cchSuffix] = 0;
+
+    PtrLength[0] = cchPrefix + cchSuffix;
+    return pbRecord + cchSuffix;
+}
+
+// Decodes the name of a list entry. The buffer must be at least MAX_PATH+1 chars long
+static size_t ListMap_DecodeName(PLISTFILE_MAP pListMap, PLISTFILE_ENTRY pListEntry, char * szBuffer)
+{
+    LPBYTE pbRecord = (LPBYTE)ARENA_POINTER(&pListMap->Names, pListEntry->RestartOffset);
+    LPBYTE pbTarget = (LPBYTE)ARENA_POINTER(&pListMap->Names, pListEntry->NameOffset);
+    size_t nLength = 0;
+
+    // All records of a group are in one chunk, following each other.
+    // Apply them one by one until the record of the entry is reached
+    while(pbRecord <= pbTarget)
+        pbRecord = ApplyNameRecord(pbRecord, szBuffer, &nLength);
+    return nLength;
+}
 
 static PLISTFILE_MAP ListMap_Create()
 {
     PLISTFILE_MAP pListMap;
-    size_t cbToAllocate;
-    
-    // Create buffer for the listfile
-    // Note that because the listfile is quite big and CASC_REALLOC
-    // is a costly operation, we want to have as few reallocs as possible.
-    cbToAllocate = sizeof(LISTFILE_MAP) + LISTMAP_INITIAL;
-    pListMap = (PLISTFILE_MAP)CASC_ALLOC(BYTE, cbToAllocate);
+
+    // The names and entries are stored in arena chunks,
+    // so they never need to be reallocated
+    pListMap = CASC_ALLOC(LISTFILE_MAP, 1);
     if(pListMap != NULL)
     {
-        // Fill the listfile buffer
         memset(pListMap, 0, sizeof(LISTFILE_MAP));
-        pListMap->cbBufferMax = LISTMAP_INITIAL;
+        Arena_Init(&pListMap->Entries);
+        Arena_Init(&pListMap->Names);
     }
 
     return pListMap;
 }
 
-static PLISTFILE_MAP ListMap_InsertName(PLISTFILE_MAP pListMap, const char * szFileName, size_t nLength)
+static bool ListMap_InsertName(PLISTFILE_MAP pListMap, const char * szFileName, size_t nLength)
 {
-    PLISTFILE_ENTRY pListEntry;
+    LISTFILE_ENTRY ListEntry;
+    PCASC_ARENA pNames = &pListMap->Names;
+    BYTE Record[LISTMAP_MAX_RECORD];
+    LPBYTE pbRecord;
     char szFileName2[MAX_PATH+1];
-    size_t cbToAllocate;
-    size_t cbEntrySize;
+    size_t cchPrefix = 0;
     uint32_t dwHashHigh = 0;
     uint32_t dwHashLow = 0;
+    bool bRestart;
 
-    // Make sure there is enough space in the list map
-    cbEntrySize = sizeof(LISTFILE_ENTRY) + nLength;
-    cbEntrySize = ALIGN_TO_SIZE(cbEntrySize, 8);
-    if((pListMap->cbBuffer + cbEntrySize) > pListMap->cbBufferMax)
-    {
-        cbToAllocate = sizeof(LISTFILE_MAP) + (pListMap->cbBufferMax * 3) / 2;
-        pListMap = (PLISTFILE_MAP)CASC_REALLOC(BYTE, pListMap, cbToAllocate);
-        if(pListMap == NULL)
-            return NULL;
+    // Sanity check
+    assert(nLength <= MAX_PATH);
+
+    // Get the name hash. The name is not terminated by zero
+    // if it comes directly from the listfile data
+    for(size_t i = 0; i < nLength; i++)
+        szFileName2[i] = AsciiToUpperTable_BkSlash[(BYTE)szFileName[i]];
+    hashlittle2(szFileName2, nLength, &dwHashHigh, &dwHashLow);
 
-        pListMap->cbBufferMax = (pListMap->cbBufferMax * 3) / 2;
+    // A group of records must not span chunks. Start a new group
+    // if the record might not fit into the current chunk
+    bRestart = (pListMap->dwGroupNames >= LISTMAP_RESTART_INTERVAL) ||
+               (pNames->ChunkCount == 0) ||
+               (pNames->ChunkUsed + LISTMAP_MAX_RECORD) > CASC_ARENA_CHUNK_SIZE;
+
+    // Only store the part that differs from the previous name
+    if(bRestart == false)
+    {
+        while(cchPrefix < nLength && cchPrefix < pListMap->cchPrevName && szFileName[cchPrefix] == pListMap->szPrevName[cchPrefix])
+            cchPrefix++;
     }
 
-    // Get the pointer to the first entry
-    pListEntry = (PLISTFILE_ENTRY)((LPBYTE)(pListMap + 1) + pListMap->cbBuffer);
+    // Create the name record and insert it to the arena
+    pbRecord = EncodeLength(Record, cchPrefix);
+    pbRecord = EncodeLength(pbRecord, nLength - cchPrefix);
+    memcpy(pbRecord, szFileName + cchPrefix, nLength - cchPrefix);
+    pbRecord += nLength - cchPrefix;
+    if(Arena_Insert(pNames, Record, (pbRecord - Record), &ListEntry.NameOffset) == NULL)
+        return false;
 
-    // Get the name hash
-    NormalizeFileName_UpperBkSlash(szFileName2, szFileName, MAX_PATH);
-    hashlittle2(szFileName2, nLength, &dwHashHigh, &dwHashLow);
-    
-    // Calculate the HASH value of the normalized file name
-    pListEntry->FileNameHash = ((ULONGLONG)dwHashHigh << 0x20) | dwHashLow;
-    pListEntry->cbEntrySize = (DWORD)cbEntrySize;
-    memcpy(pListEntry->szFileName, szFileName, nLength);
-    pListEntry->szFileName[nLength] = 0;
-
-    // Move the next entry
-    pListMap->cbBuffer += cbEntrySize;
+    // Start the new group, if needed
+    if(bRestart)
+    {
+        pListMap->dwRestartOffset = ListEntry.NameOffset;
+        pListMap->dwGroupNames = 0;
+    }
+
+    // Insert the list entry
+    ListEntry.FileNameHash = ((ULONGLONG)dwHashHigh << 0x20) | dwHashLow;
+    ListEntry.RestartOffset = pListMap->dwRestartOffset;
+    if(Arena_Insert(&pListMap->Entries, &ListEntry, sizeof(LISTFILE_ENTRY), NULL) == NULL)
+        return false;
+
+    // Remember the name for the next record
+    memcpy(pListMap->szPrevName + cchPrefix, szFileName + cchPrefix, nLength - cchPrefix);
+    pListMap->cchPrevName = nLength;
+    pListMap->dwGroupNames++;
+    pListMap->cbNames += nLength + 1;
     pListMap->nEntries++;
-    return pListMap;
+    return true;
+}
+
+// Moves the names and entries of a listfile part to the main map.
+// The name chunks are moved as they are, only the entries are copied
+static bool ListMap_Merge(PLISTFILE_MAP pListMap, PLISTFILE_MAP pPartMap)
+{
+    LISTFILE_ENTRY ListEntry;
+    PLISTFILE_ENTRY pListEntry;
+    DWORD dwOffsetBase = 0;
+
+    if(!Arena_Append(&pListMap->Names, &pPartMap->Names, &dwOffsetBase))
+        return false;
+
+    for(size_t i = 0; i < pPartMap->nEntries; i++)
+    {
+        pListEntry = (PLISTFILE_ENTRY)ARENA_POINTER(&pPartMap->Entries, i * sizeof(LISTFILE_ENTRY));
+        ListEntry.FileNameHash = pListEntry->FileNameHash;
+        ListEntry.RestartOffset = pListEntry->RestartOffset + dwOffsetBase;
+        ListEntry.NameOffset = pListEntry->NameOffset + dwOffsetBase;
+        if(Arena_Insert(&pListMap->Entries, &ListEntry, sizeof(LISTFILE_ENTRY), NULL) == NULL)
+            return false;
+    }
+
+    // The next inserted name must not refer to the names of the previous part
+    pListMap->dwGroupNames = LISTMAP_RESTART_INTERVAL;
+    pListMap->cbNames += pPartMap->cbNames;
+    pListMap->nEntries += pPartMap->nEntries;
+    return true;
+}
+
+static bool ListMap_InsertNames(PLISTFILE_MAP pListMap, TListFileCache * pCache)
+{
+    const char * szFileName;
+    size_t nLength;
+
+    // Go through the entire listfile and insert each name to the map.
+    // The names are taken directly from the listfile data
+    while((nLength = GetNextLineView(pCache, &szFileName)) != 0)
+    {
+        // Insert the file name to the map
+        if(nLength > MAX_PATH - 1)
+            nLength = MAX_PATH - 1;
+        if(!ListMap_InsertName(pListMap, szFileName, nLength))
+            return false;
+    }
+
+    return true;
+}
+
+static void InsertNamesWorker(void * pvContext)
+{
+    PLISTMAP_LOAD_CONTEXT pContext = (PLISTMAP_LOAD_CONTEXT)pvContext;
+    PLISTMAP_PART pPart;
+    DWORD dwPartIndex;
+
+    // Parse the parts one by one until there are none left
+    while((dwPartIndex = CascInterlockedIncrement(&pContext->dwNextPart) - 1) < pContext->dwPartCount)
+    {
+        pPart = pContext->pParts + dwPartIndex;
+        pPart->pListMap = ListMap_Create();
+        if(pPart->pListMap != NULL)
+            pPart->bResult = ListMap_InsertNames(pPart->pListMap, &pPart->Cache);
+    }
+}
+
+// Splits the listfile into parts on line boundaries, parses and hashes
+// the parts on worker threads, then merges them in the listfile order
+static bool ListMap_LoadListFile(PLISTFILE_MAP pListMap, TListFileCache * pCache)
+{
+    LISTMAP_LOAD_CONTEXT Context;
+    const char * szPartEnd;
+    size_t cbListFile = (pCache->pEnd - pCache->pPos);
+    DWORD dwPartCount;
+    DWORD i;
+    bool bResult = true;
+
+    // Small listfiles are not worth splitting
+    dwPartCount = (DWORD)CASCLIB_MIN((size_t)CascGetProcessorCount(), cbListFile / LISTMAP_MIN_PART_SIZE);
+    if(dwPartCount <= 1)
+        return ListMap_InsertNames(pListMap, pCache);
+
+    // Allocate the parts
+    Context.pParts = CASC_ALLOC(LISTMAP_PART, dwPartCount);
+    if(Context.pParts == NULL)
+        return ListMap_InsertNames(pListMap, pCache);
+    memset(Context.pParts, 0, sizeof(LISTMAP_PART) * dwPartCount);
+    Context.dwPartCount = dwPartCount;
+    Context.dwNextPart = 0;
+
+    // Each part ends after a newline, except the last one
+    for(i = 0; i < dwPartCount; i++)
+    {
+        szPartEnd = pCache->pEnd;
+        if(i < dwPartCount - 1)
+        {
+            szPartEnd = pCache->pPos + (cbListFile * (i + 1)) / dwPartCount;
+            szPartEnd = (const char *)memchr(szPartEnd, 0x0A, (pCache->pEnd - szPartEnd));
+            szPartEnd = (szPartEnd != NULL) ? (szPartEnd + 1) : pCache->pEnd;
+        }
+
+        Context.pParts[i].Cache.pBegin = Context.pParts[i].Cache.pPos = (i > 0) ? Context.pParts[i - 1].Cache.pEnd : pCache->pPos;
+        Context.pParts[i].Cache.pEnd = CASCLIB_MAX(szPartEnd, Context.pParts[i].Cache.pBegin);
+    }
+
+    // Parse the parts
+    CascRunWorkers(InsertNamesWorker, &Context, dwPartCount);
+
+    // Merge the parts in the order of the listfile
+    for(i = 0; i < dwPartCount; i++)
+    {
+        if(bResult)
+            bResult = (Context.pParts[i].pListMap != NULL) && ListMap_Merge(pListMap, Context.pParts[i].pListMap);
+        if(bResult)
+            bResult = Context.pParts[i].bResult;
+        ListFile_FreeMap(Context.pParts[i].pListMap);
+    }
+
+    pCache->pPos = pCache->pEnd;
+    CASC_FREE(Context.pParts);
+    return bResult;
 }
 
 static PLISTFILE_MAP ListMap_Finish(PLISTFILE_MAP pListMap)
 {
+    PLISTFILE_ENTRY * ppListEntries;
     PLISTFILE_ENTRY pListEntry;
     PCASC_MAP pMap;
-    LPBYTE pbEntry;
 
     // Sanity check
     assert(pListMap->pNameMap == NULL);
@@ -367,31 +498,311 @@ static PLISTFILE_MAP ListMap_Finish(PLISTFILE_MAP pListMap)
         return NULL;
     }
 
-    // Fill the map
-    pbEntry = (LPBYTE)(pListMap + 1);
-    for(size_t i = 0; i < pListMap->nEntries; i++)
+    // Fill the map on worker threads. The entries fill the arena chunks without gaps
+    ppListEntries = CASC_ALLOC(PLISTFILE_ENTRY, pListMap->nEntries + 1);
+    if(ppListEntries != NULL)
     {
-        // Get the listfile entry
-        pListEntry = (PLISTFILE_ENTRY)pbEntry;
-        pbEntry += pListEntry->cbEntrySize;
+        for(size_t i = 0; i < pListMap->nEntries; i++)
+            ppListEntries[i] = (PLISTFILE_ENTRY)ARENA_POINTER(&pListMap->Entries, i * sizeof(LISTFILE_ENTRY));
+        Map_InsertObjects(pMap, (void **)ppListEntries, pListMap->nEntries, CascGetProcessorCount());
+        CASC_FREE(ppListEntries);
+    }
+    else
+    {
+        for(size_t i = 0; i < pListMap->nEntries; i++)
+        {
+            // Get the listfile entry
+            pListEntry = (PLISTFILE_ENTRY)ARENA_POINTER(&pListMap->Entries, i * sizeof(LISTFILE_ENTRY));
 
-        // Insert the entry to the map
-        Map_InsertObject(pMap, pListEntry, &pListEntry->FileNameHash);
+            // Insert the entry to the map
+            Map_InsertObject(pMap, pListEntry, &pListEntry->FileNameHash);
+        }
     }
 
     return pListMap;
 }
 
-PLISTFILE_MAP ListFile_CreateMap(const TCHAR * szListFile)
+static int CompareIndexEntries_Hash(const void *, const void * pvEntry1, const void * pvEntry2)
 {
-    PLISTFILE_MAP pListMap = NULL;
-    void * pvListFile;
+    PLISTFILE_INDEX_ENTRY pEntry1 = (PLISTFILE_INDEX_ENTRY)pvEntry1;
+    PLISTFILE_INDEX_ENTRY pEntry2 = (PLISTFILE_INDEX_ENTRY)pvEntry2;
+
+    if(pEntry1->FileNameHash < pEntry2->FileNameHash)
+        return -1;
+    if(pEntry1->FileNameHash > pEntry2->FileNameHash)
+        return +1;
+    return 0;
+}
+
+static TCHAR * CreateIndexFileName(const TCHAR * szListFile)
+{
+    TCHAR * szIndexFile;
+
+    szIndexFile = CASC_ALLOC(TCHAR, _tcslen(szListFile) + 5);
+    if(szIndexFile != NULL)
+    {
+        _tcscpy(szIndexFile, szListFile);
+        _tcscat(szIndexFile, _T(".idx"));
+    }
+
+    return szIndexFile;
+}
+
+// Retrieves size, last write time and identity of the listfile. The time alone is not enough,
+// as the file may be rewritten within its resolution; a file replaced by rename gets a new identity.
+// This doesn't need to read the listfile, so checking the index is cheap even for large listfiles
+static bool GetListFileStamp(const TCHAR * szListFile, PLISTFILE_STAMP pStamp)
+{
+    memset(pStamp, 0, sizeof(LISTFILE_STAMP));
+
+#ifdef PLATFORM_WINDOWS
+    BY_HANDLE_FILE_INFORMATION FileInfo;
+    HANDLE hFile;
+    bool bResult = false;
+
+    hFile = CreateFile(szListFile, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if(hFile != INVALID_HANDLE_VALUE)
+    {
+        if(GetFileInformationByHandle(hFile, &FileInfo))
+        {
+            pStamp->FileSize = MAKE_OFFSET64(FileInfo.nFileSizeHigh, FileInfo.nFileSizeLow);
+            pStamp->FileTime = MAKE_OFFSET64(FileInfo.ftLastWriteTime.dwHighDateTime, FileInfo.ftLastWriteTime.dwLowDateTime);
+            pStamp->FileId = MAKE_OFFSET64(FileInfo.nFileIndexHigh, FileInfo.nFileIndexLow);
+            pStamp->VolumeId = FileInfo.dwVolumeSerialNumber;
+            bResult = true;
+        }
+        CloseHandle(hFile);
+    }
+    return bResult;
+#else
+    struct stat64 fileinfo;
+
+    if(stat64(szListFile, &fileinfo) != 0)
+        return false;
+
+    pStamp->FileSize = (ULONGLONG)fileinfo.st_size;
+#ifdef PLATFORM_MAC
+    pStamp->FileTime = (ULONGLONG)fileinfo.st_mtimespec.tv_sec * 1000000000 + fileinfo.st_mtimespec.tv_nsec;
+#else
+    pStamp->FileTime = (ULONGLONG)fileinfo.st_mtim.tv_sec * 1000000000 + fileinfo.st_mtim.tv_nsec;
+#endif
+    pStamp->FileId = (ULONGLONG)fileinfo.st_ino;
+    pStamp->VolumeId = (ULONGLONG)fileinfo.st_dev;
+    return true;
+#endif
+}
+
+// Moves the completely written index file over the old one
+static bool ReplaceIndexFile(const TCHAR * szTempFile, const TCHAR * szIndexFile)
+{
+#ifdef PLATFORM_WINDOWS
+    return MoveFileEx(szTempFile, szIndexFile, MOVEFILE_REPLACE_EXISTING) ? true : false;
+#else
+    return (rename(szTempFile, szIndexFile) == 0);
+#endif
+}
+
+static void DeleteIndexFile(const TCHAR * szIndexFile)
+{
+#ifdef PLATFORM_WINDOWS
+    DeleteFile(szIndexFile);
+#else
+    remove(szIndexFile);
+#endif
+}
+
+static PLISTFILE_MAP ListMap_LoadIndex(const TCHAR * szIndexFile, PLISTFILE_STAMP pListFileStamp)
+{
+    PLISTFILE_INDEX_HEADER pHeader;
+    PLISTFILE_MAP pListMap;
+    TFileStream * pStream;
+    ULONGLONG FileSize = 0;
+    LPBYTE pbIndexFile;
+
+    // Map the index file to memory
+    pStream = FileStream_OpenFile(szIndexFile, STREAM_FLAG_READ_ONLY | BASE_PROVIDER_MAP);
+    if(pStream == NULL)
+        return NULL;
+    pbIndexFile = FileStream_GetMappedData(pStream, &FileSize);
+    pHeader = (PLISTFILE_INDEX_HEADER)pbIndexFile;
+
+    // The index must belong to the current version of the listfile
+    if(pbIndexFile != NULL && FileSize >= sizeof(LISTFILE_INDEX_HEADER) &&
+       pHeader->Signature == LISTFILE_INDEX_SIGNATURE &&
+       pHeader->Version == LISTFILE_INDEX_VERSION &&
+       !memcmp(&pHeader->ListFile, pListFileStamp, sizeof(LISTFILE_STAMP)) &&
+       FileSize == sizeof(LISTFILE_INDEX_HEADER) + (ULONGLONG)pHeader->EntryCount * sizeof(LISTFILE_INDEX_ENTRY) + pHeader->NameBlobSize &&
+       (pHeader->NameBlobSize == 0 || pbIndexFile[FileSize - 1] == 0))
+    {
+        pListMap = CASC_ALLOC(LISTFILE_MAP, 1);
+        if(pListMap != NULL)
+        {
+            memset(pListMap, 0, sizeof(LISTFILE_MAP));
+            pListMap->pIndexStream = pStream;
+            pListMap->pIndexEntries = (PLISTFILE_INDEX_ENTRY)(pHeader + 1);
+            pListMap->pNameBlob = (const char *)(pListMap->pIndexEntries + pHeader->EntryCount);
+            pListMap->nIndexEntries = pHeader->EntryCount;
+            pListMap->cbNameBlob = pHeader->NameBlobSize;
+            pListMap->nEntries = pHeader->EntryCount;
+            return pListMap;
+        }
+    }
+
+    FileStream_Close(pStream);
+    return NULL;
+}
+
+static void ListMap_SaveIndex(PLISTFILE_MAP pListMap, const TCHAR * szIndexFile, PLISTFILE_STAMP pListFileStamp)
+{
+    PLISTFILE_INDEX_ENTRY * ppIndexEntries;
+    PLISTFILE_INDEX_ENTRY pIndexEntries;
+    PLISTFILE_INDEX_ENTRY pSortedEntries;
+    LISTFILE_INDEX_HEADER Header;
+    PLISTFILE_ENTRY pListEntry;
+    TFileStream * pStream;
     char szFileName[MAX_PATH+1];
+    TCHAR * szTempFile;
+    char * pbNameBlob;
+    size_t cbNameBlob = 0;
     size_t nLength;
+    size_t i;
+    bool bWritten = false;
+
+    // The index uses 32-bit counts and offsets
+    if(pListMap->nEntries == 0 || pListMap->nEntries > 0xFFFFFFFF || pListMap->cbNames > 0xFFFFFFFF)
+        return;
+
+    // Allocate the index entries, the array of pointers for sorting and the name blob
+    pIndexEntries = CASC_ALLOC(LISTFILE_INDEX_ENTRY, pListMap->nEntries * 2);
+    ppIndexEntries = CASC_ALLOC(PLISTFILE_INDEX_ENTRY, pListMap->nEntries);
+    pbNameBlob = CASC_ALLOC(char, pListMap->cbNames);
+    if(pIndexEntries != NULL && ppIndexEntries != NULL && pbNameBlob != NULL)
+    {
+        // Decode the names in the order they were inserted. Each record
+        // only needs to be applied to the previous name
+        for(i = 0; i < pListMap->nEntries; i++)
+        {
+            pListEntry = (PLISTFILE_ENTRY)ARENA_POINTER(&pListMap->Entries, i * sizeof(LISTFILE_ENTRY));
+            ApplyNameRecord((LPBYTE)ARENA_POINTER(&pListMap->Names, pListEntry->NameOffset), szFileName, &nLength);
+
+            pIndexEntries[i].FileNameHash = pListEntry->FileNameHash;
+            pIndexEntries[i].NameOffset = (DWORD)cbNameBlob;
+            pIndexEntries[i].NameLength = (DWORD)nLength;
+            ppIndexEntries[i] = pIndexEntries + i;
+            memcpy(pbNameBlob + cbNameBlob, szFileName, nLength + 1);
+            cbNameBlob += nLength + 1;
+        }
+
+        // Sort the index entries by the name hash
+        qsort_pointer_array((void **)ppIndexEntries, pListMap->nEntries, CompareIndexEntries_Hash, NULL);
+        pSortedEntries = pIndexEntries + pListMap->nEntries;
+        for(i = 0; i < pListMap->nEntries; i++)
+            pSortedEntries[i] = ppIndexEntries[i][0];
+
+        // Prepare the header
+        Header.Signature = LISTFILE_INDEX_SIGNATURE;
+        Header.Version = LISTFILE_INDEX_VERSION;
+        Header.ListFile = pListFileStamp[0];
+        Header.EntryCount = (DWORD)pListMap->nEntries;
+        Header.NameBlobSize = (DWORD)cbNameBlob;
+
+        // Write the index to a temporary file and rename it when complete,
+        // so that readers never see a partially written index
+        szTempFile = CASC_ALLOC(TCHAR, _tcslen(szIndexFile) + 5);
+        if(szTempFile != NULL)
+        {
+            _tcscpy(szTempFile, szIndexFile);
+            _tcscat(szTempFile, _T(".tmp"));
+
+            pStream = FileStream_CreateFile(szTempFile, STREAM_PROVIDER_FLAT | BASE_PROVIDER_FILE);
+            if(pStream != NULL)
+            {
+                bWritten = FileStream_Write(pStream, NULL, &Header, sizeof(LISTFILE_INDEX_HEADER)) &&
+                           FileStream_Write(pStream, NULL, pSortedEntries, (DWORD)(pListMap->nEntries * sizeof(LISTFILE_INDEX_ENTRY))) &&
+                           FileStream_Write(pStream, NULL, pbNameBlob, (DWORD)cbNameBlob);
+                FileStream_Close(pStream);
+
+                // Failing to save the index is not an error; the listfile is just parsed next time
+                if(!bWritten || !ReplaceIndexFile(szTempFile, szIndexFile))
+                    DeleteIndexFile(szTempFile);
+            }
+            CASC_FREE(szTempFile);
+        }
+    }
+
+    // Free the buffers
+    if(pbNameBlob != NULL)
+        CASC_FREE(pbNameBlob);
+    if(ppIndexEntries != NULL)
+        CASC_FREE(ppIndexEntries);
+    if(pIndexEntries != NULL)
+        CASC_FREE(pIndexEntries);
+}
+
+static const char * ListMap_FindIndexEntry(PLISTFILE_MAP pListMap, ULONGLONG FileNameHash)
+{
+    PLISTFILE_INDEX_ENTRY pIndexEntry;
+    size_t nLeft = 0;
+    size_t nRight = pListMap->nIndexEntries;
+    size_t nMiddle;
+
+    // Binary search in the sorted index entries
+    while(nLeft < nRight)
+    {
+        nMiddle = nLeft + (nRight - nLeft) / 2;
+        pIndexEntry = pListMap->pIndexEntries + nMiddle;
+
+        if(pIndexEntry->FileNameHash == FileNameHash)
+        {
+            // The index is an external file, so check that the name lies in the blob
+            // and that it ends exactly where the entry says
+            if(pIndexEntry->NameOffset < pListMap->cbNameBlob &&
+               pIndexEntry->NameLength < pListMap->cbNameBlob - pIndexEntry->NameOffset &&
+               pListMap->pNameBlob[pIndexEntry->NameOffset + pIndexEntry->NameLength] == 0)
+            {
+                return pListMap->pNameBlob + pIndexEntry->NameOffset;
+            }
+            return NULL;
+        }
+
+        if(pIndexEntry->FileNameHash < FileNameHash)
+            nLeft = nMiddle + 1;
+        else
+            nRight = nMiddle;
+    }
+
+    return NULL;
+}
+
+// Creates the map of the listfile names. With bCacheIndex, a binary index
+// is saved next to the listfile and used instead of parsing the listfile next time
+PLISTFILE_MAP ListFile_CreateMap(const TCHAR * szListFile, bool bCacheIndex)
+{
+    PLISTFILE_MAP pListMap = NULL;
+    LISTFILE_STAMP ListFileStamp;
+    LISTFILE_STAMP NewStamp;
+    TCHAR * szIndexFile = NULL;
+    void * pvListFile;
+    bool bLoadComplete;
 
     // Only if the listfile name has been given
     if(szListFile != NULL)
     {
+        // If there is an up-to-date binary index of the listfile, just map it
+        if(bCacheIndex && GetListFileStamp(szListFile, &ListFileStamp))
+        {
+            szIndexFile = CreateIndexFileName(szListFile);
+            if(szIndexFile != NULL)
+            {
+                pListMap = ListMap_LoadIndex(szIndexFile, &ListFileStamp);
+                if(pListMap != NULL)
+                {
+                    CASC_FREE(szIndexFile);
+                    return pListMap;
+                }
+            }
+        }
+
         // Create map for the listfile
         pListMap = ListMap_Create();
         if(pListMap != NULL)
@@ -400,43 +811,71 @@ PLISTFILE_MAP ListFile_CreateMap(const TCHAR * szListFile)
             pvListFile = ListFile_OpenExternal(szListFile);
             if(pvListFile != NULL)
             {
-                // Go through the entire listfile and insert each name to the map
-                while((nLength = ListFile_GetNext(pvListFile, "*", szFileName, MAX_PATH)) != 0)
-                {
-                    // Insert the file name to the map
-                    pListMap = ListMap_InsertName(pListMap, szFileName, nLength);
-                    if(pListMap == NULL)
-                        break;
-                }
+                // Insert all names from the listfile to the map
+                bLoadComplete = ListMap_LoadListFile(pListMap, (TListFileCache *)pvListFile);
 
                 // Finish the listfile map
                 pListMap = ListMap_Finish(pListMap);
 
+                // Save the binary index, so the next time the listfile doesn't need to be parsed.
+                // Don't save the index if some names could not be loaded
+                // or if the listfile has changed while being loaded
+                if(pListMap != NULL && szIndexFile != NULL && bLoadComplete)
+                {
+                    if(GetListFileStamp(szListFile, &NewStamp) && !memcmp(&NewStamp, &ListFileStamp, sizeof(LISTFILE_STAMP)))
+                        ListMap_SaveIndex(pListMap, szIndexFile, &ListFileStamp);
+                }
+
                 // Free the listfile
                 ListFile_Free(pvListFile);
             }
         }
     }
 
+    // Free the name of the index file
+    if(szIndexFile != NULL)
+        CASC_FREE(szIndexFile);
+
     // Return the created map
     return pListMap;
 }
 
+// Note that names decoded from the map are only valid until the next call
 const char * ListFile_FindName(PLISTFILE_MAP pListMap, ULONGLONG FileNameHash)
 {
     PLISTFILE_ENTRY pListEntry = NULL;
+    const char * szFileName;
 
     if(pListMap != NULL)
+    {
+        // Names loaded from the binary index
+        if(pListMap->pIndexStream != NULL)
+        {
+            szFileName = ListMap_FindIndexEntry(pListMap, FileNameHash);
+            return (szFileName != NULL) ? szFileName : "";
+        }
+
+        // The names in the map need to be decoded
         pListEntry = (PLISTFILE_ENTRY)Map_FindObject(pListMap->pNameMap, &FileNameHash, NULL);
-    return (pListEntry != NULL) ? pListEntry->szFileName : "";
+        if(pListEntry != NULL)
+        {
+            ListMap_DecodeName(pListMap, pListEntry, pListMap->szNameBuffer);
+            return pListMap->szNameBuffer;
+        }
+    }
+    return "";
 }
 
 void ListFile_FreeMap(PLISTFILE_MAP pListMap)
 {
     if(pListMap != NULL)
     {
+        if(pListMap->pIndexStream != NULL)
+            FileStream_Close(pListMap->pIndexStream);
         if(pListMap->pNameMap != NULL)
             Map_Free(pListMap->pNameMap);
+        Arena_Free(&pListMap->Entries);
+        Arena_Free(&pListMap->Names);
         CASC_FREE(pListMap);
     }
 }
@@ -14,22 +14,75 @@
 //-----------------------------------------------------------------------------
 // Structures
 
+// The names in the listfile map are front-coded: each name only stores the part
+// that differs from the previous name. Every LISTMAP_RESTART_INTERVAL names
+// the full name is stored again, so a name is decoded in at most that many steps.
+// Each name record is: prefix length, suffix length (1-2 bytes each), suffix
+#define LISTMAP_RESTART_INTERVAL  16
+#define LISTMAP_MAX_RECORD        (2 + 2 + MAX_PATH)
+
 typedef struct _LISTFILE_ENTRY
 {
     ULONGLONG FileNameHash;             // Hash of the file name
-    DWORD cbEntrySize;                  // Length of this entry, in bytes
-    char szFileName[1];                 // File name, aligned to 8-byte boundary
+    DWORD RestartOffset;                // Arena offset of the first name record in the group
+    DWORD NameOffset;                   // Arena offset of the name record of this entry
 
 } LISTFILE_ENTRY, *PLISTFILE_ENTRY;
 
+// Binary index of a listfile. If the storage is open with CASC_STOR_CACHE_LISTFILE,
+// it is created next to the listfile (with ".idx" appended to the name) and is
+// memory-mapped the next time the listfile is used.
+// Layout: LISTFILE_INDEX_HEADER, EntryCount of LISTFILE_INDEX_ENTRY sorted by hash,
+// then the zero-terminated names
+#define LISTFILE_INDEX_SIGNATURE   0x5844494C   // 'LIDX'
+#define LISTFILE_INDEX_VERSION     3
+
+// Identifies the version of the listfile the index was created from
+typedef struct _LISTFILE_STAMP
+{
+    ULONGLONG FileSize;                 // Size of the listfile
+    ULONGLONG FileTime;                 // Last write time, in the finest resolution of the platform
+    ULONGLONG FileId;                   // Inode / file index
+    ULONGLONG VolumeId;                 // Device / volume serial number
+
+} LISTFILE_STAMP, *PLISTFILE_STAMP;
+
+typedef struct _LISTFILE_INDEX_HEADER
+{
+    DWORD Signature;                    // LISTFILE_INDEX_SIGNATURE
+    DWORD Version;                      // LISTFILE_INDEX_VERSION
+    LISTFILE_STAMP ListFile;            // The listfile the index was created from
+    DWORD EntryCount;                   // Number of index entries
+    DWORD NameBlobSize;                 // Total size of the names, in bytes
+
+} LISTFILE_INDEX_HEADER, *PLISTFILE_INDEX_HEADER;
+
+typedef struct _LISTFILE_INDEX_ENTRY
+{
+    ULONGLONG FileNameHash;             // Hash of the normalized file name
+    DWORD NameOffset;                   // Offset of the name in the name blob
+    DWORD NameLength;                   // Length of the name, without the terminating zero
+
+} LISTFILE_INDEX_ENTRY, *PLISTFILE_INDEX_ENTRY;
+
 typedef struct _LISTFILE_MAP
 {
     PCASC_MAP pNameMap;                 // Map of hash-to-name
-    size_t cbBufferMax;                 // Total size of the buffer, in bytes
-    size_t cbBuffer;                    // Current size of the buffer, in bytes
+    TFileStream * pIndexStream;         // Mapped binary index. If not NULL, the names are looked up there
+    PLISTFILE_INDEX_ENTRY pIndexEntries;// Index entries, sorted by hash
+    const char * pNameBlob;             // Names referenced by the index entries
+    size_t nIndexEntries;               // Number of index entries
+    size_t cbNameBlob;                  // Size of the name blob, in bytes
+    CASC_ARENA Entries;                 // Array of LISTFILE_ENTRY, in chunks
+    CASC_ARENA Names;                   // Front-coded name records, in chunks
+    size_t cbNames;                     // Total length of all names, including the terminating zeros
     size_t nEntries;                    // Number of entries
 
-    // First LISTFILE_ENTRY starts here
+    DWORD dwRestartOffset;              // Offset of the first record in the current group
+    DWORD dwGroupNames;                 // Number of names in the current group
+    size_t cchPrevName;                 // Length of the previously inserted name
+    char szPrevName[MAX_PATH+1];        // The previously inserted name
+    char szNameBuffer[MAX_PATH+1];      // Buffer for the names decoded by ListFile_FindName
 
 } LISTFILE_MAP, *PLISTFILE_MAP;
 
@@ -37,14 +90,16 @@ typedef struct _LISTFILE_MAP
 // Functions for parsing an external listfile
 
 void * ListFile_OpenExternal(const TCHAR * szListFile);
+size_t ListFile_GetNextView(void * pvListFile, const char ** pszLine);
 size_t ListFile_GetNextLine(void * pvListFile, char * szBuffer, size_t nMaxChars);
-size_t ListFile_GetNext(void * pvListFile, const char * szMask, char * szBuffer, size_t nMaxChars);
+
+size_t ListFile_GetNext(void * pvListFile, PCASC_WILDCARD pWildCard, char * szBuffer, size_t nMaxChars);
 void ListFile_Free(void * pvListFile);
 
 //-----------------------------------------------------------------------------
 // Functions for creating a listfile map
 
-PLISTFILE_MAP ListFile_CreateMap(const TCHAR * szListFile);
+PLISTFILE_MAP ListFile_CreateMap(const TCHAR * szListFile, bool bCacheIndex);
 const char * ListFile_FindName(PLISTFILE_MAP pListMap, ULONGLONG FileNameHash);
 void ListFile_FreeMap(PLISTFILE_MAP pListMap);
 
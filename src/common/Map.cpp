@@ -43,6 +43,29 @@ static DWORD CalcHashIndex(PCASC_MAP pMap, void * pvKey)
     return (dwHash % pMap->TableSize);
 }
 
+// Context for inserting many objects on worker threads
+typedef struct _MAP_INSERT_CONTEXT
+{
+    PCASC_MAP pMap;
+    void ** ppvObjects;                         // Objects to insert
+    PDWORD HashIndexes;                         // Hash index of each object
+    PDWORD BlockOffsets;                        // [dwRangeCount][dwBlockCount]: number, then position of the objects of the block in the range
+    PDWORD RangeObjects;                        // Object indexes, grouped by range, in the original order
+    PDWORD RangeStart;                          // [dwRangeCount+1]: position of the first object of each range in RangeObjects
+    LPBYTE ObjectDone;                          // Nonzero if the object has been inserted or rejected as duplicate
+    PDWORD RangeItems;                          // Number of objects inserted into each range of the table
+    size_t nObjects;                            // Number of objects
+    DWORD dwBlockCount;                         // Number of blocks of objects for hashing
+    DWORD dwRangeCount;                         // Number of ranges of the hash table
+    DWORD dwNextBlock;                          // The next block to be hashed
+    DWORD dwNextScatter;                        // The next block to be scattered to the ranges
+    DWORD dwNextRange;                          // The next range to be filled
+
+} MAP_INSERT_CONTEXT, *PMAP_INSERT_CONTEXT;
+
+#define MAP_HASH_BLOCK_SIZE     0x10000         // Number of objects hashed by a worker at once
+#define MAP_RANGES_PER_WORKER   8               // The table is split to more ranges than workers for better balance
+
 static bool CompareIdentifier(PCASC_MAP pMap, void * pvObject, void * pvKey)
 {
     // Is it a string table?
@@ -61,6 +84,109 @@ static bool CompareIdentifier(PCASC_MAP pMap, void * pvObject, void * pvKey)
     }
 }
 
+// Returns the range of the hash table that contains the hash index.
+// Range R begins at (TableSize * R / RangeCount)
+static DWORD GetHashRange(PMAP_INSERT_CONTEXT pContext, DWORD dwHashIndex)
+{
+    return (DWORD)((((ULONGLONG)dwHashIndex + 1) * pContext->dwRangeCount - 1) / pContext->pMap->TableSize);
+}
+
+// Phase 1: Calculate the hash indexes of a block of objects
+// and count the objects of the block that fall into each range
+static void HashObjectsWorker(void * pvContext)
+{
+    PMAP_INSERT_CONTEXT pContext = (PMAP_INSERT_CONTEXT)pvContext;
+    PCASC_MAP pMap = pContext->pMap;
+    DWORD dwHashIndex;
+    size_t nStart;
+    size_t nEnd;
+    DWORD dwBlock;
+
+    while((dwBlock = CascInterlockedIncrement(&pContext->dwNextBlock) - 1) < pContext->dwBlockCount)
+    {
+        nStart = (size_t)dwBlock * MAP_HASH_BLOCK_SIZE;
+        nEnd = CASCLIB_MIN(nStart + MAP_HASH_BLOCK_SIZE, pContext->nObjects);
+
+        for(size_t i = nStart; i < nEnd; i++)
+        {
+            dwHashIndex = CalcHashIndex(pMap, (LPBYTE)pContext->ppvObjects[i] + pMap->KeyOffset);
+            pContext->HashIndexes[i] = dwHashIndex;
+            pContext->BlockOffsets[GetHashRange(pContext, dwHashIndex) * pContext->dwBlockCount + dwBlock]++;
+        }
+    }
+}
+
+// Phase 2: Copy the indexes of the objects of a block to their ranges.
+// The objects keep their order within each range
+static void ScatterObjectsWorker(void * pvContext)
+{
+    PMAP_INSERT_CONTEXT pContext = (PMAP_INSERT_CONTEXT)pvContext;
+    PDWORD BlockOffsets;
+    size_t nStart;
+    size_t nEnd;
+    DWORD dwRange;
+    DWORD dwBlock;
+
+    while((dwBlock = CascInterlockedIncrement(&pContext->dwNextScatter) - 1) < pContext->dwBlockCount)
+    {
+        nStart = (size_t)dwBlock * MAP_HASH_BLOCK_SIZE;
+        nEnd = CASCLIB_MIN(nStart + MAP_HASH_BLOCK_SIZE, pContext->nObjects);
+        BlockOffsets = pContext->BlockOffsets + dwBlock;
+
+        for(size_t i = nStart; i < nEnd; i++)
+        {
+            dwRange = GetHashRange(pContext, pContext->HashIndexes[i]);
+            pContext->RangeObjects[BlockOffsets[dwRange * pContext->dwBlockCount]++] = (DWORD)i;
+        }
+    }
+}
+
+// Phase 3: Each worker owns a range of the hash table and inserts the objects
+// whose hash index falls into it. An object that would need a slot beyond
+// the range is left for the calling thread
+static void InsertObjectsWorker(void * pvContext)
+{
+    PMAP_INSERT_CONTEXT pContext = (PMAP_INSERT_CONTEXT)pvContext;
+    PCASC_MAP pMap = pContext->pMap;
+    void * pvKey;
+    size_t i;
+    DWORD dwHashIndex;
+    DWORD dwRangeEnd;
+    DWORD dwRange;
+
+    while((dwRange = CascInterlockedIncrement(&pContext->dwNextRange) - 1) < pContext->dwRangeCount)
+    {
+        dwRangeEnd = (DWORD)(((ULONGLONG)pMap->TableSize * (dwRange + 1)) / pContext->dwRangeCount);
+
+        for(DWORD j = pContext->RangeStart[dwRange]; j < pContext->RangeStart[dwRange + 1]; j++)
+        {
+            i = pContext->RangeObjects[j];
+            dwHashIndex = pContext->HashIndexes[i];
+
+            // Find a free slot within the range
+            pvKey = (LPBYTE)pContext->ppvObjects[i] + pMap->KeyOffset;
+            while(dwHashIndex < dwRangeEnd && pMap->HashTable[dwHashIndex] != NULL)
+            {
+                if(CompareIdentifier(pMap, pMap->HashTable[dwHashIndex], pvKey))
+                    break;
+                dwHashIndex++;
+            }
+
+            // If the range is exhausted, leave the object to the calling thread
+            if(dwHashIndex >= dwRangeEnd)
+                continue;
+
+            // Insert the object, unless there is one with the same key
+            if(pMap->HashTable[dwHashIndex] == NULL)
+            {
+                pMap->HashTable[dwHashIndex] = pContext->ppvObjects[i];
+                pContext->RangeItems[dwRange]++;
+            }
+            pContext->ObjectDone[i] = 1;
+        }
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Public functions
 
@@ -183,6 +309,108 @@ bool Map_InsertObject(PCASC_MAP pMap, void * pvNewObject, void * pvKey)
     return false;
 }
 
+// Inserts many objects at once, on up to dwWorkerCount threads. Lookups give
+// the same results as if the objects were inserted one by one with Map_InsertObject,
+// including which of the objects with the same key is kept. Returns the number of inserted objects
+size_t Map_InsertObjects(PCASC_MAP pMap, void ** ppvObjects, size_t nObjects, DWORD dwWorkerCount)
+{
+    MAP_INSERT_CONTEXT Context;
+    size_t nInserted = 0;
+    DWORD dwPosition = 0;
+    DWORD dwCount;
+
+    // Verify pointer to the map
+    if(pMap == NULL || nObjects == 0)
+        return 0;
+
+    // Prepare the context
+    memset(&Context, 0, sizeof(MAP_INSERT_CONTEXT));
+    Context.pMap = pMap;
+    Context.ppvObjects = ppvObjects;
+    Context.nObjects = nObjects;
+    Context.dwBlockCount = (DWORD)((nObjects + MAP_HASH_BLOCK_SIZE - 1) / MAP_HASH_BLOCK_SIZE);
+    Context.dwRangeCount = dwWorkerCount * MAP_RANGES_PER_WORKER;
+
+    // Small maps, or maps that are not empty, are filled by the calling thread.
+    // Also fall back to that if there is not enough memory
+    if(dwWorkerCount > 1 && Context.dwBlockCount > 1 && pMap->ItemCount == 0 && pMap->TableSize > Context.dwRangeCount && nObjects < 0xFFFFFFFF)
+    {
+        Context.HashIndexes = CASC_ALLOC(DWORD, nObjects);
+        Context.BlockOffsets = CASC_ALLOC(DWORD, (size_t)Context.dwRangeCount * Context.dwBlockCount);
+        Context.RangeObjects = CASC_ALLOC(DWORD, nObjects);
+        Context.RangeStart = CASC_ALLOC(DWORD, Context.dwRangeCount + 1);
+        Context.ObjectDone = CASC_ALLOC(BYTE, nObjects);
+        Context.RangeItems = CASC_ALLOC(DWORD, Context.dwRangeCount);
+    }
+
+    if(Context.HashIndexes != NULL && Context.BlockOffsets != NULL && Context.RangeObjects != NULL &&
+       Context.RangeStart != NULL && Context.ObjectDone != NULL && Context.RangeItems != NULL)
+    {
+        memset(Context.BlockOffsets, 0, (size_t)Context.dwRangeCount * Context.dwBlockCount * sizeof(DWORD));
+        memset(Context.ObjectDone, 0, nObjects);
+        memset(Context.RangeItems, 0, Context.dwRangeCount * sizeof(DWORD));
+
+        // Phase 1: calculate hash indexes and count the objects per block and range
+        CascRunWorkers(HashObjectsWorker, &Context, CASCLIB_MIN(dwWorkerCount, Context.dwBlockCount));
+
+        // Turn the counts into positions in RangeObjects. The blocks of each range
+        // follow each other, so the objects of a range stay in the original order
+        for(DWORD dwRange = 0; dwRange < Context.dwRangeCount; dwRange++)
+        {
+            Context.RangeStart[dwRange] = dwPosition;
+            for(DWORD dwBlock = 0; dwBlock < Context.dwBlockCount; dwBlock++)
+            {
+                dwCount = Context.BlockOffsets[dwRange * Context.dwBlockCount + dwBlock];
+                Context.BlockOffsets[dwRange * Context.dwBlockCount + dwBlock] = dwPosition;
+                dwPosition += dwCount;
+            }
+        }
+        Context.RangeStart[Context.dwRangeCount] = dwPosition;
+
+        // Phase 2: group the objects by range
+        CascRunWorkers(ScatterObjectsWorker, &Context, CASCLIB_MIN(dwWorkerCount, Context.dwBlockCount));
+
+        // Phase 3: fill the ranges of the table
+        CascRunWorkers(InsertObjectsWorker, &Context, dwWorkerCount);
+        for(DWORD i = 0; i < Context.dwRangeCount; i++)
+            pMap->ItemCount += Context.RangeItems[i];
+        nInserted = pMap->ItemCount;
+
+        // Insert the objects that did not fit into their range
+        for(size_t i = 0; i < nObjects; i++)
+        {
+            if(Context.ObjectDone[i] == 0)
+            {
+                if(Map_InsertObject(pMap, ppvObjects[i], (LPBYTE)ppvObjects[i] + pMap->KeyOffset))
+                    nInserted++;
+            }
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < nObjects; i++)
+        {
+            if(Map_InsertObject(pMap, ppvObjects[i], (LPBYTE)ppvObjects[i] + pMap->KeyOffset))
+                nInserted++;
+        }
+    }
+
+    // Free the buffers
+    if(Context.RangeItems != NULL)
+        CASC_FREE(Context.RangeItems);
+    if(Context.ObjectDone != NULL)
+        CASC_FREE(Context.ObjectDone);
+    if(Context.RangeStart != NULL)
+        CASC_FREE(Context.RangeStart);
+    if(Context.RangeObjects != NULL)
+        CASC_FREE(Context.RangeObjects);
+    if(Context.BlockOffsets != NULL)
+        CASC_FREE(Context.BlockOffsets);
+    if(Context.HashIndexes != NULL)
+        CASC_FREE(Context.HashIndexes);
+    return nInserted;
+}
+
 void Map_Free(PCASC_MAP pMap)
 {
     if(pMap != NULL)
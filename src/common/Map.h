@@ -36,6 +36,7 @@ size_t Map_EnumObjects(PCASC_MAP pMap, void **ppvArray);
 void * Map_FindObject2(PCASC_MAP pMap, MAP_COMPARE pfnCompare, void * pvIdentifier, PDWORD PtrIndex);
 void * Map_FindObject(PCASC_MAP pMap, void * pvKey, PDWORD PtrIndex);
 bool Map_InsertObject(PCASC_MAP pMap, void * pvNewObject, void * pvKey);
+size_t Map_InsertObjects(PCASC_MAP pMap, void ** ppvObjects, size_t nObjects, DWORD dwWorkerCount);
 void Map_Free(PCASC_MAP pMap);
 
 #endif // __HASHTOPTR_H__
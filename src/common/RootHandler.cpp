@@ -42,6 +42,63 @@ LPBYTE RootHandler_GetKey(TRootHandler * pRootHandler, const char * szFileName)
     return pRootHandler->GetKey(pRootHandler, szFileName);
 }
 
+// Joins each root entry with its encoding entry and index entry.
+// The search then doesn't need to look them up for every found file
+int RootHandler_CreateJoin(TCascStorage * hs)
+{
+    PCASC_ENCODING_ENTRY pEncodingEntry;
+    PCASC_ROOT_JOIN pJoinTable;
+    TRootHandler * pRootHandler = hs->pRootHandler;
+    QUERY_KEY EncodingKey;
+    QUERY_KEY IndexKey;
+    DWORD EncodingIndex;
+    int nError = ERROR_SUCCESS;
+
+    // Only if the root handler can give us the root entries
+    if(pRootHandler == NULL || pRootHandler->GetEntryKey == NULL || pRootHandler->dwEntryCount == 0)
+        return ERROR_NOT_SUPPORTED;
+
+    // The join is created only once, even if more threads search at once
+    CascLock_Enter(&hs->StorageLock);
+    if(pRootHandler->pJoinTable == NULL)
+    {
+        pJoinTable = CASC_ALLOC(CASC_ROOT_JOIN, pRootHandler->dwEntryCount);
+        if(pJoinTable != NULL)
+        {
+            memset(pJoinTable, 0, sizeof(CASC_ROOT_JOIN) * pRootHandler->dwEntryCount);
+
+            for(DWORD i = 0; i < pRootHandler->dwEntryCount; i++)
+            {
+                // Find the encoding entry
+                EncodingKey.pbData = pRootHandler->GetEntryKey(pRootHandler, i);
+                EncodingKey.cbData = MD5_HASH_SIZE;
+                if(EncodingKey.pbData == NULL)
+                    continue;
+                pEncodingEntry = FindEncodingEntry(hs, &EncodingKey, &EncodingIndex);
+                if(pEncodingEntry == NULL)
+                    continue;
+
+                // Find the index entry
+                IndexKey.pbData = GET_INDEX_KEY(pEncodingEntry);
+                IndexKey.cbData = MD5_HASH_SIZE;
+                pJoinTable[i].pIndexEntry = FindIndexEntry(hs, &IndexKey);
+                pJoinTable[i].pEncodingEntry = pEncodingEntry;
+                pJoinTable[i].EncodingIndex = EncodingIndex;
+                pJoinTable[i].FileSize = ConvertBytesToInteger_4(pEncodingEntry->FileSizeBE);
+            }
+
+            pRootHandler->pJoinTable = pJoinTable;
+        }
+        else
+        {
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+        }
+    }
+    CascLock_Leave(&hs->StorageLock);
+
+    return nError;
+}
+
 void RootHandler_Dump(TCascStorage * hs, LPBYTE pbRootHandler, DWORD cbRootHandler, const TCHAR * szNameFormat, const TCHAR * szListFile, int nDumpLevel)
 {
     TDumpContext * dc;
@@ -65,6 +122,11 @@ void RootHandler_Close(TRootHandler * pRootHandler)
     // Check if the root structure is allocated at all
     if(pRootHandler != NULL)
     {
+        // Free the join table
+        if(pRootHandler->pJoinTable != NULL)
+            CASC_FREE(pRootHandler->pJoinTable);
+        pRootHandler->pJoinTable = NULL;
+
         pRootHandler->Close(pRootHandler);
     }
 }
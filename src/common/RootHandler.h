@@ -19,6 +19,9 @@
 #define CASC_OVERWATCH_ROOT_SIGNATURE   0x35444D23  // '#MD5'
 
 #define ROOT_FLAG_HAS_NAMES             0x00000001  // The root file contains file names
+#define ROOT_FLAG_PARTITIONED_SEARCH    0x00000002  // The root handler can split the search into independent parts
+
+#define CASC_INVALID_ROOT_INDEX         0xFFFFFFFF  // The root handler didn't report the index of the found entry
 
 #define DUMP_LEVEL_ROOT_FILE                    1   // Dump root file
 #define DUMP_LEVEL_ENCODING_FILE                2   // Dump root file + encoding file
@@ -44,6 +47,11 @@ typedef LPBYTE (*ROOT_GETKEY)(
     const char * szFileName                         // Pointer to the name of a file
     );
 
+typedef LPBYTE (*ROOT_GETENTRYKEY)(
+    struct TRootHandler * pRootHandler,             // Pointer to an initialized root handler
+    DWORD dwEntryIndex                              // Index of the root entry (0 to dwEntryCount - 1)
+    );
+
 typedef void (*ROOT_DUMP)(
     struct _TCascStorage * hs,                      // Pointer to the open storage
     TDumpContext * dc,                              // Opened dump context
@@ -57,14 +65,27 @@ typedef void (*ROOT_CLOSE)(
     struct TRootHandler * pRootHandler              // Pointer to an initialized root handler
     );
 
+// Root entry joined with its encoding entry and index entry
+typedef struct _CASC_ROOT_JOIN
+{
+    struct _CASC_ENCODING_ENTRY * pEncodingEntry;   // Encoding entry of the file (NULL if not in the encoding table)
+    struct _CASC_INDEX_ENTRY * pIndexEntry;         // Index entry of the file, gives the file location (NULL if not present)
+    DWORD EncodingIndex;                            // Index of the encoding entry in the encoding map
+    DWORD FileSize;                                 // File size, from the encoding entry
+
+} CASC_ROOT_JOIN, *PCASC_ROOT_JOIN;
+
 struct TRootHandler
 {
     ROOT_SEARCH    Search;                          // Performs the root file search
     ROOT_ENDSEARCH EndSearch;                       // Performs cleanup after searching
     ROOT_GETKEY    GetKey;                          // Retrieves encoding key for a file name
+    ROOT_GETENTRYKEY GetEntryKey;                   // Retrieves encoding key of a root entry (optional)
     ROOT_DUMP      Dump;
     ROOT_CLOSE     Close;                           // Closing the root file
 
+    PCASC_ROOT_JOIN pJoinTable;                     // Joined root entries, indexed by root entry index (NULL if not created)
+    DWORD dwEntryCount;                             // Number of root entries accessible by GetEntryKey
     DWORD dwRootFlags;                              // Root flags - see the ROOT_FLAG_XXX
 };
 
@@ -74,6 +95,7 @@ struct TRootHandler
 LPBYTE RootHandler_Search(TRootHandler * pRootHandler, struct _TCascSearch * pSearch, PDWORD PtrFileSize, PDWORD PtrLocaleFlags);
 void   RootHandler_EndSearch(TRootHandler * pRootHandler, struct _TCascSearch * pSearch);
 LPBYTE RootHandler_GetKey(TRootHandler * pRootHandler, const char * szFileName);
+int    RootHandler_CreateJoin(struct _TCascStorage * hs);
 void   RootHandler_Dump(struct _TCascStorage * hs, LPBYTE pbRootHandler, DWORD cbRootHandler, const TCHAR * szNameFormat, const TCHAR * szListFile, int nDumpLevel);
 void   RootHandler_Close(TRootHandler * pRootHandler);
 
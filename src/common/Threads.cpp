@@ -0,0 +1,338 @@
+/*****************************************************************************/
+/* Threads.cpp                                      Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Portable locks, interlocked counters and worker threads                   */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#define __CASCLIB_SELF__
+#include "../CascLib.h"
+#include "../CascCommon.h"
+
+//-----------------------------------------------------------------------------
+// Local structures
+
+typedef struct _CASC_WORKER_INFO
+{
+    CASC_WORKER_ROUTINE PfnWorker;
+    void * pvContext;
+} CASC_WORKER_INFO, *PCASC_WORKER_INFO;
+
+//-----------------------------------------------------------------------------
+// Local functions
+
+#ifdef PLATFORM_WINDOWS
+static DWORD WINAPI WorkerThreadProc(LPVOID lpParameter)
+{
+    PCASC_WORKER_INFO pWorkerInfo = (PCASC_WORKER_INFO)lpParameter;
+
+    pWorkerInfo->PfnWorker(pWorkerInfo->pvContext);
+    return 0;
+}
+#else
+static void * WorkerThreadProc(void * pvParameter)
+{
+    PCASC_WORKER_INFO pWorkerInfo = (PCASC_WORKER_INFO)pvParameter;
+
+    pWorkerInfo->PfnWorker(pWorkerInfo->pvContext);
+    return NULL;
+}
+#endif
+
+#ifdef PLATFORM_WINDOWS
+static BOOL CALLBACK OnceCallback(PINIT_ONCE /* pOnce */, PVOID pvParameter, PVOID * /* ppvContext */)
+{
+    ((CASC_ONCE_ROUTINE)pvParameter)();
+    return TRUE;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Locks
+
+void CascLock_Init(PCASC_LOCK pLock)
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeCriticalSection(&pLock->Section);
+#else
+    pthread_mutex_init(&pLock->Mutex, NULL);
+#endif
+}
+
+void CascLock_Enter(PCASC_LOCK pLock)
+{
+#ifdef PLATFORM_WINDOWS
+    EnterCriticalSection(&pLock->Section);
+#else
+    pthread_mutex_lock(&pLock->Mutex);
+#endif
+}
+
+void CascLock_Leave(PCASC_LOCK pLock)
+{
+#ifdef PLATFORM_WINDOWS
+    LeaveCriticalSection(&pLock->Section);
+#else
+    pthread_mutex_unlock(&pLock->Mutex);
+#endif
+}
+
+void CascLock_Free(PCASC_LOCK pLock)
+{
+#ifdef PLATFORM_WINDOWS
+    DeleteCriticalSection(&pLock->Section);
+#else
+    pthread_mutex_destroy(&pLock->Mutex);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Condition variables
+
+void CascCond_Init(PCASC_COND pCond)
+{
+#ifdef PLATFORM_WINDOWS
+    InitializeConditionVariable(&pCond->Cond);
+#else
+    pthread_cond_init(&pCond->Cond, NULL);
+#endif
+}
+
+// The lock must be held by the caller. It is released while waiting
+void CascCond_Wait(PCASC_COND pCond, PCASC_LOCK pLock)
+{
+#ifdef PLATFORM_WINDOWS
+    SleepConditionVariableCS(&pCond->Cond, &pLock->Section, INFINITE);
+#else
+    pthread_cond_wait(&pCond->Cond, &pLock->Mutex);
+#endif
+}
+
+void CascCond_Broadcast(PCASC_COND pCond)
+{
+#ifdef PLATFORM_WINDOWS
+    WakeAllConditionVariable(&pCond->Cond);
+#else
+    pthread_cond_broadcast(&pCond->Cond);
+#endif
+}
+
+void CascCond_Free(PCASC_COND pCond)
+{
+#ifdef PLATFORM_WINDOWS
+    // Windows condition variables need no cleanup
+    pCond = pCond;
+#else
+    pthread_cond_destroy(&pCond->Cond);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// One-time initialization
+
+// Calls the routine exactly once. Other threads wait until it finishes
+void CascOnce_Run(PCASC_ONCE pOnce, CASC_ONCE_ROUTINE PfnInit)
+{
+#ifdef PLATFORM_WINDOWS
+    InitOnceExecuteOnce(&pOnce->Once, OnceCallback, (PVOID)PfnInit, NULL);
+#else
+    pthread_once(&pOnce->Once, PfnInit);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Thread-local slots
+
+bool CascTls_Init(PCASC_TLS pTls, CASC_TLS_DESTRUCTOR PfnDestructor)
+{
+#ifdef PLATFORM_WINDOWS
+    pTls->dwIndex = FlsAlloc(PfnDestructor);
+    return (pTls->dwIndex != FLS_OUT_OF_INDEXES);
+#else
+    return (pthread_key_create(&pTls->Key, PfnDestructor) == 0);
+#endif
+}
+
+void * CascTls_GetValue(PCASC_TLS pTls)
+{
+#ifdef PLATFORM_WINDOWS
+    return FlsGetValue(pTls->dwIndex);
+#else
+    return pthread_getspecific(pTls->Key);
+#endif
+}
+
+void CascTls_SetValue(PCASC_TLS pTls, void * pvValue)
+{
+#ifdef PLATFORM_WINDOWS
+    FlsSetValue(pTls->dwIndex, pvValue);
+#else
+    pthread_setspecific(pTls->Key, pvValue);
+#endif
+}
+
+// Note that on Windows, this calls the destructor for all non-NULL values.
+// On other platforms, the values must be freed by the caller
+void CascTls_Free(PCASC_TLS pTls)
+{
+#ifdef PLATFORM_WINDOWS
+    FlsFree(pTls->dwIndex);
+#else
+    pthread_key_delete(pTls->Key);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Interlocked counters. All but the compare-exchange return the new value
+
+DWORD CascInterlockedIncrement(PDWORD PtrValue)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)InterlockedIncrement((LONG *)PtrValue);
+#else
+    return __sync_add_and_fetch(PtrValue, 1);
+#endif
+}
+
+DWORD CascInterlockedDecrement(PDWORD PtrValue)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)InterlockedDecrement((LONG *)PtrValue);
+#else
+    return __sync_sub_and_fetch(PtrValue, 1);
+#endif
+}
+
+DWORD CascInterlockedAdd(PDWORD PtrValue, DWORD dwAddend)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)InterlockedExchangeAdd((LONG *)PtrValue, (LONG)dwAddend) + dwAddend;
+#else
+    return __sync_add_and_fetch(PtrValue, dwAddend);
+#endif
+}
+
+// Stores the new value if the current one equals the comparand. Returns the original value
+DWORD CascInterlockedCompareExchange(PDWORD PtrValue, DWORD dwNewValue, DWORD dwComparand)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)InterlockedCompareExchange((LONG *)PtrValue, (LONG)dwNewValue, (LONG)dwComparand);
+#else
+    return __sync_val_compare_and_swap(PtrValue, dwComparand, dwNewValue);
+#endif
+}
+
+// Stores the new value. Returns the original value
+DWORD CascInterlockedExchange(PDWORD PtrValue, DWORD dwNewValue)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)InterlockedExchange((LONG *)PtrValue, (LONG)dwNewValue);
+#else
+    return __atomic_exchange_n(PtrValue, dwNewValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Reads a value stored by the interlocked functions without writing to it
+DWORD CascInterlockedRead(PDWORD PtrValue)
+{
+#ifdef PLATFORM_WINDOWS
+    return (DWORD)(*(volatile LONG *)PtrValue);
+#else
+    return __atomic_load_n(PtrValue, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Publishes the pointer. Returns the previous value
+void * CascInterlockedExchangePointer(void ** PtrTarget, void * pvValue)
+{
+#ifdef PLATFORM_WINDOWS
+    return InterlockedExchangePointer(PtrTarget, pvValue);
+#else
+    return __atomic_exchange_n(PtrTarget, pvValue, __ATOMIC_ACQ_REL);
+#endif
+}
+
+// Reads a pointer published by CascInterlockedExchangePointer. Doesn't write
+// to the memory, so it is cheap even if many threads read the same pointer
+void * CascInterlockedReadPointer(void ** PtrTarget)
+{
+#ifdef PLATFORM_WINDOWS
+    return *(void * volatile *)PtrTarget;
+#else
+    return __atomic_load_n(PtrTarget, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Worker threads
+
+DWORD CascGetProcessorCount()
+{
+    DWORD dwProcessorCount = 1;
+
+#ifdef PLATFORM_WINDOWS
+    SYSTEM_INFO SystemInfo;
+
+    GetSystemInfo(&SystemInfo);
+    dwProcessorCount = SystemInfo.dwNumberOfProcessors;
+#else
+    long nProcessorCount = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(nProcessorCount > 0)
+        dwProcessorCount = (DWORD)nProcessorCount;
+#endif
+
+    return CASCLIB_MAX(dwProcessorCount, 1);
+}
+
+// Runs the worker routine on up to dwWorkerCount threads, including the calling one,
+// and waits until all of them finish. If a thread cannot be created, the work
+// is done by the remaining ones. Returns the number of threads that ran the routine.
+DWORD CascRunWorkers(CASC_WORKER_ROUTINE PfnWorker, void * pvContext, DWORD dwWorkerCount)
+{
+    CASC_WORKER_INFO WorkerInfo;
+#ifdef PLATFORM_WINDOWS
+    HANDLE Threads[CASC_MAX_WORKER_THREADS];
+#else
+    pthread_t Threads[CASC_MAX_WORKER_THREADS];
+#endif
+    DWORD dwThreads = 0;
+
+    // Prepare the worker information
+    WorkerInfo.PfnWorker = PfnWorker;
+    WorkerInfo.pvContext = pvContext;
+    dwWorkerCount = CASCLIB_MIN(dwWorkerCount, CASC_MAX_WORKER_THREADS);
+
+    // Start the extra threads. The calling thread is the first worker
+    for(DWORD i = 1; i < dwWorkerCount; i++)
+    {
+#ifdef PLATFORM_WINDOWS
+        Threads[dwThreads] = CreateThread(NULL, 0, WorkerThreadProc, &WorkerInfo, 0, NULL);
+        if(Threads[dwThreads] == NULL)
+            break;
+#else
+        if(pthread_create(&Threads[dwThreads], NULL, WorkerThreadProc, &WorkerInfo) != 0)
+            break;
+#endif
+        dwThreads++;
+    }
+
+    // Do our part of the work
+    PfnWorker(pvContext);
+
+    // Wait for all other workers
+    for(DWORD i = 0; i < dwThreads; i++)
+    {
+#ifdef PLATFORM_WINDOWS
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+#else
+        pthread_join(Threads[i], NULL);
+#endif
+    }
+
+    return dwThreads + 1;
+}
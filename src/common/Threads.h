@@ -0,0 +1,124 @@
+/*****************************************************************************/
+/* Threads.h                                        Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Portable locks, interlocked counters and worker threads                   */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#ifndef __CASC_THREADS_H__
+#define __CASC_THREADS_H__
+
+#ifndef PLATFORM_WINDOWS
+#include <pthread.h>
+#endif
+
+//-----------------------------------------------------------------------------
+// Defines
+
+#define CASC_MAX_WORKER_THREADS     0x20        // Maximum number of worker threads
+
+//-----------------------------------------------------------------------------
+// Structures
+
+typedef struct _CASC_LOCK
+{
+#ifdef PLATFORM_WINDOWS
+    CRITICAL_SECTION Section;
+#else
+    pthread_mutex_t Mutex;
+#endif
+} CASC_LOCK, *PCASC_LOCK;
+
+// Condition variable. Always used together with a CASC_LOCK
+typedef struct _CASC_COND
+{
+#ifdef PLATFORM_WINDOWS
+    CONDITION_VARIABLE Cond;
+#else
+    pthread_cond_t Cond;
+#endif
+} CASC_COND, *PCASC_COND;
+
+// Thread-local slot. Each thread has its own value, initially NULL.
+// When a thread exits, the destructor is called for its value, if not NULL
+typedef struct _CASC_TLS
+{
+#ifdef PLATFORM_WINDOWS
+    DWORD dwIndex;
+#else
+    pthread_key_t Key;
+#endif
+} CASC_TLS, *PCASC_TLS;
+
+typedef void (WINAPI * CASC_TLS_DESTRUCTOR)(void * pvValue);
+
+// One-time initialization. Define statically with CASC_ONCE_INIT
+typedef struct _CASC_ONCE
+{
+#ifdef PLATFORM_WINDOWS
+    INIT_ONCE Once;
+#else
+    pthread_once_t Once;
+#endif
+} CASC_ONCE, *PCASC_ONCE;
+
+#ifdef PLATFORM_WINDOWS
+#define CASC_ONCE_INIT  { INIT_ONCE_STATIC_INIT }
+#else
+#define CASC_ONCE_INIT  { PTHREAD_ONCE_INIT }
+#endif
+
+typedef void (*CASC_ONCE_ROUTINE)();
+
+// Calls the routine when the library is unloaded or the process ends.
+// Define statically, e.g. "static CASC_UNLOAD Unload = {Routine};"
+struct CASC_UNLOAD
+{
+    ~CASC_UNLOAD()
+    {
+        PfnUnload();
+    }
+
+    CASC_ONCE_ROUTINE PfnUnload;
+};
+
+// Worker routine. Called once for each worker thread. The worker
+// is supposed to pick work items until there are none left
+typedef void (*CASC_WORKER_ROUTINE)(void * pvContext);
+
+//-----------------------------------------------------------------------------
+// Functions
+
+void CascLock_Init(PCASC_LOCK pLock);
+void CascLock_Enter(PCASC_LOCK pLock);
+void CascLock_Leave(PCASC_LOCK pLock);
+void CascLock_Free(PCASC_LOCK pLock);
+
+void CascCond_Init(PCASC_COND pCond);
+void CascCond_Wait(PCASC_COND pCond, PCASC_LOCK pLock);
+void CascCond_Broadcast(PCASC_COND pCond);
+void CascCond_Free(PCASC_COND pCond);
+
+void CascOnce_Run(PCASC_ONCE pOnce, CASC_ONCE_ROUTINE PfnInit);
+
+bool  CascTls_Init(PCASC_TLS pTls, CASC_TLS_DESTRUCTOR PfnDestructor);
+void * CascTls_GetValue(PCASC_TLS pTls);
+void  CascTls_SetValue(PCASC_TLS pTls, void * pvValue);
+void  CascTls_Free(PCASC_TLS pTls);
+
+DWORD CascInterlockedIncrement(PDWORD PtrValue);
+DWORD CascInterlockedDecrement(PDWORD PtrValue);
+DWORD CascInterlockedAdd(PDWORD PtrValue, DWORD dwAddend);
+DWORD CascInterlockedCompareExchange(PDWORD PtrValue, DWORD dwNewValue, DWORD dwComparand);
+DWORD CascInterlockedExchange(PDWORD PtrValue, DWORD dwNewValue);
+DWORD CascInterlockedRead(PDWORD PtrValue);
+void * CascInterlockedExchangePointer(void ** PtrTarget, void * pvValue);
+void * CascInterlockedReadPointer(void ** PtrTarget);
+
+DWORD CascGetProcessorCount();
+DWORD CascRunWorkers(CASC_WORKER_ROUTINE PfnWorker, void * pvContext, DWORD dwWorkerCount);
+
+#endif // __CASC_THREADS_H__
@@ -0,0 +1,223 @@
+/*****************************************************************************/
+/* WildCard.cpp                                     Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Search masks compiled for fast matching                                   */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#define __CASCLIB_SELF__
+#include "../CascLib.h"
+#include "../CascCommon.h"
+
+//-----------------------------------------------------------------------------
+// Local functions
+
+// Compares the part with a string that has not been normalized
+static bool ComparePart(PCASC_WILDCARD_PART pPart, const char * szString)
+{
+    for(size_t i = 0; i < pPart->cchText; i++)
+    {
+        if(pPart->szText[i] != '?' && pPart->szText[i] != (char)AsciiToUpperTable_BkSlash[(BYTE)szString[i]])
+            return false;
+    }
+
+    return true;
+}
+
+// Compares the part with a normalized string
+static bool ComparePart_Normalized(PCASC_WILDCARD_PART pPart, const char * szString)
+{
+    if(pPart->bHasQuestionMark == false)
+        return (memcmp(pPart->szText, szString, pPart->cchText) == 0);
+
+    for(size_t i = 0; i < pPart->cchText; i++)
+    {
+        if(pPart->szText[i] != '?' && pPart->szText[i] != szString[i])
+            return false;
+    }
+
+    return true;
+}
+
+// Finds the first occurence of the part in the normalized string.
+// Candidates for the match are located with memchr
+static const char * FindPart(PCASC_WILDCARD_PART pPart, const char * szString, const char * szStringEnd)
+{
+    const char * szLastStart = szStringEnd - pPart->cchText;
+    char chFirst = pPart->szText[0];
+
+    while(szString <= szLastStart)
+    {
+        // Skip to the next position with the first character of the part
+        if(chFirst != '?')
+        {
+            szString = (const char *)memchr(szString, chFirst, (szLastStart - szString) + 1);
+            if(szString == NULL)
+                return NULL;
+        }
+
+        if(ComparePart_Normalized(pPart, szString))
+            return szString;
+        szString++;
+    }
+
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Public functions
+
+int WildCard_Compile(PCASC_WILDCARD pWildCard, const char * szMask)
+{
+    PCASC_WILDCARD_PART pPart;
+    size_t nMaxParts = 1;
+    size_t cchMask;
+    char * szPatternPtr;
+
+    // Clear the structure
+    memset(pWildCard, 0, sizeof(CASC_WILDCARD));
+    cchMask = strlen(szMask);
+
+    // Count the maximum number of parts
+    for(size_t i = 0; i < cchMask; i++)
+        nMaxParts += (szMask[i] == '*') ? 1 : 0;
+
+    // Allocate the normalized pattern and the parts
+    pWildCard->szPattern = CASC_ALLOC(char, cchMask + 1);
+    pWildCard->Parts = CASC_ALLOC(CASC_WILDCARD_PART, nMaxParts);
+    if(pWildCard->szPattern == NULL || pWildCard->Parts == NULL)
+    {
+        WildCard_Free(pWildCard);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Normalize the mask so that it can be compared with normalized names
+    NormalizeFileName_UpperBkSlash(pWildCard->szPattern, szMask, cchMask);
+    pWildCard->bLeadingStar = (cchMask != 0 && szMask[0] == '*');
+    pWildCard->bTrailingStar = (cchMask != 0 && szMask[cchMask - 1] == '*');
+
+    // Split the pattern to parts. Multiple '*' in a row are just one '*'
+    szPatternPtr = pWildCard->szPattern;
+    while(szPatternPtr[0] != 0)
+    {
+        // Skip the stars
+        while(szPatternPtr[0] == '*')
+            szPatternPtr++;
+        if(szPatternPtr[0] == 0)
+            break;
+
+        // Find the end of the part
+        pPart = pWildCard->Parts + pWildCard->PartCount++;
+        pPart->szText = szPatternPtr;
+        while(szPatternPtr[0] != 0 && szPatternPtr[0] != '*')
+        {
+            if(szPatternPtr[0] == '?')
+                pPart->bHasQuestionMark = true;
+            szPatternPtr++;
+        }
+
+        pPart->cchText = (szPatternPtr - pPart->szText);
+        pWildCard->cchMinLength += pPart->cchText;
+    }
+
+    // Masks like "*" or "**" match everything
+    pWildCard->bMatchAll = (pWildCard->PartCount == 0 && pWildCard->bLeadingStar);
+    return ERROR_SUCCESS;
+}
+
+bool WildCard_Check(PCASC_WILDCARD pWildCard, const char * szString, size_t cchString)
+{
+    PCASC_WILDCARD_PART pPart;
+    const char * szNormPtr;
+    const char * szNormEnd;
+    size_t nFirstPart = 0;
+    size_t nLastPart = pWildCard->PartCount;
+    size_t nBegin = 0;
+    size_t nEnd = cchString;
+    char szNormBuffer[MAX_PATH + 1];
+    char * szNormName = szNormBuffer;
+    bool bResult = true;
+
+    // Fast path for the most common mask
+    if(pWildCard->bMatchAll)
+        return true;
+    if(cchString < pWildCard->cchMinLength)
+        return false;
+
+    // Empty mask only matches empty string
+    if(pWildCard->PartCount == 0)
+        return (cchString == 0);
+
+    // If the mask does not begin with '*', the first part is the prefix
+    if(pWildCard->bLeadingStar == false)
+    {
+        pPart = pWildCard->Parts;
+        if(!ComparePart(pPart, szString))
+            return false;
+
+        // A mask without '*' must match the entire string
+        if(pWildCard->PartCount == 1 && pWildCard->bTrailingStar == false)
+            return (cchString == pPart->cchText);
+
+        nBegin = pPart->cchText;
+        nFirstPart++;
+    }
+
+    // If the mask does not end with '*', the last part is the suffix (e.g. the extension)
+    if(pWildCard->bTrailingStar == false && nFirstPart < nLastPart)
+    {
+        pPart = pWildCard->Parts + nLastPart - 1;
+        if((nEnd - nBegin) < pPart->cchText || !ComparePart(pPart, szString + nEnd - pPart->cchText))
+            return false;
+
+        nEnd -= pPart->cchText;
+        nLastPart--;
+    }
+
+    // The remaining parts are searched for in the rest of the string.
+    // Taking the leftmost match of each part is always correct
+    if(nFirstPart < nLastPart)
+    {
+        // Normalize the part of the string between the prefix and the suffix.
+        // Names that don't fit to the buffer on the stack are rare
+        if((nEnd - nBegin) > MAX_PATH)
+        {
+            szNormName = CASC_ALLOC(char, nEnd - nBegin);
+            if(szNormName == NULL)
+                return false;
+        }
+        for(size_t i = nBegin; i < nEnd; i++)
+            szNormName[i - nBegin] = (char)AsciiToUpperTable_BkSlash[(BYTE)szString[i]];
+        szNormPtr = szNormName;
+        szNormEnd = szNormName + (nEnd - nBegin);
+
+        for(size_t i = nFirstPart; i < nLastPart; i++)
+        {
+            pPart = pWildCard->Parts + i;
+            szNormPtr = FindPart(pPart, szNormPtr, szNormEnd);
+            if(szNormPtr == NULL)
+            {
+                bResult = false;
+                break;
+            }
+            szNormPtr += pPart->cchText;
+        }
+
+        if(szNormName != szNormBuffer)
+            CASC_FREE(szNormName);
+    }
+
+    return bResult;
+}
+
+void WildCard_Free(PCASC_WILDCARD pWildCard)
+{
+    if(pWildCard->szPattern != NULL)
+        CASC_FREE(pWildCard->szPattern);
+    if(pWildCard->Parts != NULL)
+        CASC_FREE(pWildCard->Parts);
+    memset(pWildCard, 0, sizeof(CASC_WILDCARD));
+}
@@ -0,0 +1,48 @@
+/*****************************************************************************/
+/* WildCard.h                                       Copyright (c) agent 2026 */
+/*---------------------------------------------------------------------------*/
+/* Search masks compiled for fast matching                                   */
+/*---------------------------------------------------------------------------*/
+/*   Date    Ver   Who  Comment                                              */
+/* --------  ----  ---  -------                                              */
+/* 19.10.26  1.00  agent  Created                                            */
+/*****************************************************************************/
+
+#ifndef __CASC_WILDCARD_H__
+#define __CASC_WILDCARD_H__
+
+//-----------------------------------------------------------------------------
+// Structures
+
+// Literal part of the mask between two '*'. May contain '?'
+typedef struct _CASC_WILDCARD_PART
+{
+    const char * szText;                        // Text of the part, normalized (upper case, backslashes)
+    size_t cchText;                             // Length of the part
+    bool bHasQuestionMark;                      // If false, the part can be compared with memcmp
+
+} CASC_WILDCARD_PART, *PCASC_WILDCARD_PART;
+
+// The mask is split to parts once, so matching a name does not need
+// any backtracking: the first part is a prefix, the last part is a suffix
+// and the parts in the middle are searched for from left to right
+typedef struct _CASC_WILDCARD
+{
+    char * szPattern;                           // Normalized copy of the mask. The parts point into it
+    PCASC_WILDCARD_PART Parts;                  // Parts of the mask, as separated by '*'
+    size_t PartCount;                           // Number of parts
+    size_t cchMinLength;                        // Length of the shortest name that can match
+    bool bLeadingStar;                          // The mask begins with '*'
+    bool bTrailingStar;                         // The mask ends with '*'
+    bool bMatchAll;                             // The mask is "*"
+
+} CASC_WILDCARD, *PCASC_WILDCARD;
+
+//-----------------------------------------------------------------------------
+// Functions
+
+int  WildCard_Compile(PCASC_WILDCARD pWildCard, const char * szMask);
+bool WildCard_Check(PCASC_WILDCARD pWildCard, const char * szString, size_t cchString);
+void WildCard_Free(PCASC_WILDCARD pWildCard);
+
+#endif // __CASC_WILDCARD_H__
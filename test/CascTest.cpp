@@ -52,41 +52,33 @@ static const char szCircleChar[] = "|/-\\";
 
 #if defined(_MSC_VER) && defined(_DEBUG)
 #define GET_TICK_COUNT()  GetTickCount()
+#elif defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+#define GET_TICK_COUNT()  GetTickCountPosix()
 #else
 #define GET_TICK_COUNT()  0
 #endif
 
+// Raw data of one file for measuring decompression speed
+struct TRawFileData
+{
+    HANDLE hFile;
+    LPBYTE pbRawBuffer;
+    LPBYTE pbRawData;
+    bool bAligned;
+};
+
 //-----------------------------------------------------------------------------
 // Local functions
 
-static int ForceCreatePath(TCHAR * szFullPath)
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+static DWORD GetTickCountPosix()
 {
-    TCHAR * szPlainName = (TCHAR *)GetPlainFileName(szFullPath) - 1;
-    TCHAR * szPathPart = szFullPath;
-    TCHAR chSaveChar;
-
-    // Skip disk drive and root directory
-    if(szPathPart[0] != 0 && szPathPart[1] == _T(':'))
-        szPathPart += 3;
-
-    while(szPathPart <= szPlainName)
-    {
-        // If there is a delimiter, create the path fragment
-        if(szPathPart[0] == _T('\\') || szPathPart[0] == _T('/'))
-        {
-            chSaveChar = szPathPart[0];
-            szPathPart[0] = 0;
-
-            CREATE_DIRECTORY(szFullPath);
-            szPathPart[0] = chSaveChar;
-        }
-
-        // Move to the next character
-        szPathPart++;
-    }
+    struct timespec ts;
 
-    return ERROR_SUCCESS;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (DWORD)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 }
+#endif
 
 static int ExtractFile(HANDLE hStorage, const char * szFileName, const TCHAR * szLocalPath, DWORD dwLocaleFlags)
 {
@@ -175,6 +167,209 @@ static int ExtractFile(HANDLE hStorage, const char * szFileName, const TCHAR * s
     return nError;
 }
 
+// Character-by-character wildcard matcher. Used as the reference for WildCard_Check
+static bool CheckWildCard(const char * szString, const char * szWildCard)
+{
+    const char * szLastStar = NULL;
+    const char * szStarString = NULL;
+
+    while(szString[0] != 0)
+    {
+        if(szWildCard[0] == '*')
+        {
+            // Remember the star; it matches nothing so far
+            szLastStar = szWildCard++;
+            szStarString = szString;
+        }
+        else if(szWildCard[0] != 0 && (szWildCard[0] == '?' || AsciiToUpperTable_BkSlash[(BYTE)szWildCard[0]] == AsciiToUpperTable_BkSlash[(BYTE)szString[0]]))
+        {
+            szWildCard++;
+            szString++;
+        }
+        else if(szLastStar != NULL)
+        {
+            // Let the last star match one more character
+            szWildCard = szLastStar + 1;
+            szString = ++szStarString;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // The rest of the mask may only be stars
+    while(szWildCard[0] == '*')
+        szWildCard++;
+    return (szWildCard[0] == 0);
+}
+
+// Random number generator with a fixed seed, so a failed test can be repeated
+static DWORD GetRandomNumber(PDWORD PtrSeed)
+{
+    PtrSeed[0] = PtrSeed[0] * 1103515245 + 12345;
+    return (PtrSeed[0] >> 16) & 0x7FFF;
+}
+
+static void StoreBigEndian32(DWORD dwValue, LPBYTE pbBuffer)
+{
+    pbBuffer[0] = (BYTE)(dwValue >> 0x18);
+    pbBuffer[1] = (BYTE)(dwValue >> 0x10);
+    pbBuffer[2] = (BYTE)(dwValue >> 0x08);
+    pbBuffer[3] = (BYTE)(dwValue >> 0x00);
+}
+
+// Creates a file in the CDN directory structure, e.g. "Work/Cdn/data/xx/yy/xxyy..."
+static bool CreateCdnFile(const TCHAR * szDataPath, const TCHAR * szSubDir, LPBYTE pbKey, const TCHAR * szExtension, LPBYTE pbData, DWORD cbData)
+{
+    TFileStream * pStream;
+    TCHAR szFileName[MAX_PATH];
+    TCHAR * szFilePtr = szFileName;
+    bool bResult = false;
+
+    _tcscpy(szFilePtr, szDataPath);
+    szFilePtr += _tcslen(szFilePtr);
+    *szFilePtr++ = _T('/');
+    _tcscpy(szFilePtr, szSubDir);
+    szFilePtr += _tcslen(szFilePtr);
+    szFilePtr = AppendBlobText(szFilePtr, pbKey, 1, _T('/'));
+    szFilePtr = AppendBlobText(szFilePtr, pbKey + 1, 1, _T('/'));
+    szFilePtr = AppendBlobText(szFilePtr, pbKey, MD5_HASH_SIZE, _T('/'));
+    _tcscpy(szFilePtr, szExtension);
+
+    if((pStream = FileStream_CreateFile(szFileName, 0)) == NULL)
+    {
+        ForceCreatePath(szFileName);
+        pStream = FileStream_CreateFile(szFileName, 0);
+    }
+
+    if(pStream != NULL)
+    {
+        bResult = FileStream_Write(pStream, NULL, pbData, cbData);
+        FileStream_Close(pStream);
+    }
+    return bResult;
+}
+
+// Creates an archive index with 4 KB blocks. With bArchiveGroup, it is the index of an archive group
+// and the entries contain the archive index
+static bool CreateCdnArchiveIndex(const TCHAR * szDataPath, LPBYTE pbKey, PCASC_ARCHIVE_ENTRY pEntries, LPBYTE pbEntryKeys, DWORD dwEntryCount, bool bArchiveGroup, BYTE Version)
+{
+    LPBYTE pbIndex;
+    LPBYTE pbEntry;
+    DWORD dwEntrySize = MD5_HASH_SIZE + 4 + (bArchiveGroup ? 6 : 4);
+    DWORD dwEntriesPerBlock = 0x1000 / dwEntrySize;
+    DWORD dwBlockCount = (dwEntryCount + dwEntriesPerBlock - 1) / dwEntriesPerBlock;
+    DWORD cbIndex = dwBlockCount * (0x1000 + MD5_HASH_SIZE + 8) + 28;
+    bool bResult = false;
+
+    pbIndex = CASC_ALLOC(BYTE, cbIndex);
+    if(pbIndex != NULL)
+    {
+        // Blocks of entries. The rest of each block is zeros. The block keys and checksums are not verified
+        memset(pbIndex, 0, cbIndex);
+        for(DWORD i = 0; i < dwEntryCount; i++)
+        {
+            pbEntry = pbIndex + (i / dwEntriesPerBlock) * 0x1000 + (i % dwEntriesPerBlock) * dwEntrySize;
+            memcpy(pbEntry, pbEntryKeys + i * MD5_HASH_SIZE, MD5_HASH_SIZE);
+            StoreBigEndian32(pEntries[i].EncodedSize, pbEntry + MD5_HASH_SIZE);
+            if(bArchiveGroup)
+            {
+                pbEntry[MD5_HASH_SIZE + 4] = (BYTE)(pEntries[i].ArchiveIndex >> 0x08);
+                pbEntry[MD5_HASH_SIZE + 5] = (BYTE)(pEntries[i].ArchiveIndex);
+                StoreBigEndian32(pEntries[i].ArchiveOffset, pbEntry + MD5_HASH_SIZE + 6);
+            }
+            else
+            {
+                StoreBigEndian32(pEntries[i].ArchiveOffset, pbEntry + MD5_HASH_SIZE + 4);
+            }
+        }
+
+        // The footer
+        pbEntry = pbIndex + cbIndex - 28;
+        pbEntry[8] = Version;
+        pbEntry[11] = 4;
+        pbEntry[12] = bArchiveGroup ? 6 : 4;
+        pbEntry[13] = 4;
+        pbEntry[14] = MD5_HASH_SIZE;
+        pbEntry[15] = 8;
+        pbEntry[16] = (BYTE)(dwEntryCount >> 0x00);
+        pbEntry[17] = (BYTE)(dwEntryCount >> 0x08);
+        pbEntry[18] = (BYTE)(dwEntryCount >> 0x10);
+        pbEntry[19] = (BYTE)(dwEntryCount >> 0x18);
+
+        bResult = CreateCdnFile(szDataPath, _T("data"), pbKey, _T(".index"), pbIndex, cbIndex);
+        CASC_FREE(pbIndex);
+    }
+    return bResult;
+}
+
+// Wraps a frame into an 'F' frame without the frame table
+static DWORD MakeNestedFrame(LPBYTE pbFrame, LPBYTE pbInner, DWORD cbInner)
+{
+    memmove(pbFrame + 9, pbInner, cbInner);
+    memcpy(pbFrame, "FBLTE\0\0\0\0", 9);
+    return 9 + cbInner;
+}
+
+// Wraps a frame into an 'F' frame with a frame table of one frame
+static DWORD MakeTableFrame(LPBYTE pbFrame, LPBYTE pbInner, DWORD cbInner, DWORD cbDecompressed)
+{
+    memmove(pbFrame + 0x25, pbInner, cbInner);
+    memcpy(pbFrame, "FBLTE", 5);
+    StoreBigEndian32(0x0C + 0x18, pbFrame + 5);
+    StoreBigEndian32(0x0F000001, pbFrame + 9);
+    StoreBigEndian32(cbInner, pbFrame + 0x0D);
+    StoreBigEndian32(cbDecompressed, pbFrame + 0x11);
+    CalculateDataBlockHash(pbFrame + 0x25, cbInner, pbFrame + 0x15);
+    return 0x25 + cbInner;
+}
+
+// Codec that replaces the built-in 'N' codec in the test
+static int WINAPI Decompress_Test(void * pvOutBuffer, PDWORD pcbOutBuffer, void * /* pvInBuffer */, DWORD /* cbInBuffer */)
+{
+    if(*pcbOutBuffer < 4)
+        return ERROR_INSUFFICIENT_BUFFER;
+    memcpy(pvOutBuffer, "Test", 4);
+    *pcbOutBuffer = 4;
+    return ERROR_SUCCESS;
+}
+
+// Context for registering a codec while other threads decompress
+struct TCodecRaceContext
+{
+    DWORD dwNextWorker;
+    DWORD dwErrors;
+};
+
+static void CodecRaceWorker(void * pvContext)
+{
+    TCodecRaceContext * pContext = (TCodecRaceContext *)pvContext;
+    BYTE Frame[] = {'N', 'D', 'a', 't', 'a'};
+    BYTE Buffer[4];
+    DWORD cbBuffer;
+
+    // The first worker switches the codec, the others decompress
+    if(CascInterlockedIncrement(&pContext->dwNextWorker) == 1)
+    {
+        for(DWORD i = 0; i < 100000; i++)
+            CascRegisterCodec('N', (i & 1) ? NULL : Decompress_Test);
+        CascRegisterCodec('N', NULL);
+    }
+    else
+    {
+        for(DWORD i = 0; i < 100000; i++)
+        {
+            // Either codec may be used, but the result must be one of them
+            cbBuffer = sizeof(Buffer);
+            if(CascDecompress(Buffer, &cbBuffer, Frame, sizeof(Frame)) != ERROR_SUCCESS || cbBuffer != 4)
+                CascInterlockedIncrement(&pContext->dwErrors);
+            else if(memcmp(Buffer, "Data", 4) && memcmp(Buffer, "Test", 4))
+                CascInterlockedIncrement(&pContext->dwErrors);
+        }
+    }
+}
+
 //-----------------------------------------------------------------------------
 // Testing functions
 
@@ -285,10 +480,276 @@ static int TestOpenStorage_EnumFiles(const TCHAR * szStorage, const TCHAR * szLi
             // Close the search handle
             CascFindClose(hFind);
             LogHelper.PrintProgress("");
+            LogHelper.PrintMessage("Enumerated %u files in %u ms", dwFoundFiles, dwTickCount);
+        }
+    }
+
+    // Close storage and return
+    if(hStorage != NULL)
+        CascCloseStorage(hStorage);
+    return nError;
+}
+
+// One file found by a search. The lists of found files are sorted and compared,
+// so the partitioned and batched searches are checked file by file
+struct TFoundFile
+{
+    BYTE  EncodingKey[MD5_HASH_SIZE];
+    DWORD dwNameHash;
+};
+
+struct TFoundFiles
+{
+    TFoundFile * pItems;
+    DWORD dwCount;
+    DWORD dwMaxCount;
+};
+
+static DWORD HashFoundName(const char * szFileName)
+{
+    DWORD dwHash = 0x811C9DC5;
+
+    // FNV-1a. Files without name get zero
+    if(szFileName == NULL || szFileName[0] == 0)
+        return 0;
+    while(szFileName[0] != 0)
+        dwHash = (dwHash ^ (BYTE)(*szFileName++)) * 0x01000193;
+    return dwHash;
+}
+
+static bool InsertFoundFile(TFoundFiles * pFiles, LPBYTE EncodingKey, const char * szFileName)
+{
+    TFoundFile * pNewItems;
+
+    if(pFiles->dwCount >= pFiles->dwMaxCount)
+    {
+        pFiles->dwMaxCount = (pFiles->dwMaxCount != 0) ? (pFiles->dwMaxCount * 2) : 0x1000;
+        if(pFiles->pItems != NULL)
+            pNewItems = CASC_REALLOC(TFoundFile, pFiles->pItems, pFiles->dwMaxCount);
+        else
+            pNewItems = CASC_ALLOC(TFoundFile, pFiles->dwMaxCount);
+        if(pNewItems == NULL)
+            return false;
+        pFiles->pItems = pNewItems;
+    }
+
+    memcpy(pFiles->pItems[pFiles->dwCount].EncodingKey, EncodingKey, MD5_HASH_SIZE);
+    pFiles->pItems[pFiles->dwCount].dwNameHash = HashFoundName(szFileName);
+    pFiles->dwCount++;
+    return true;
+}
+
+// Adds all files of an open search to the list and closes the search.
+// The first file has already been found by CascFindFirstFile*
+static int CollectFoundFiles(HANDLE hFind, PCASC_FIND_DATA pFindData, TFoundFiles * pFiles, bool bNamedOnly)
+{
+    int nError = ERROR_SUCCESS;
+
+    if(hFind != NULL)
+    {
+        do
+        {
+            if(bNamedOnly == false || pFindData->szFileName[0] != 0)
+            {
+                if(!InsertFoundFile(pFiles, pFindData->EncodingKey, pFindData->szFileName))
+                {
+                    nError = ERROR_NOT_ENOUGH_MEMORY;
+                    break;
+                }
+            }
+        }
+        while(CascFindNextFile(hFind, pFindData));
+        CascFindClose(hFind);
+    }
+
+    return nError;
+}
+
+static int CompareFoundFile(const void * pvItem1, const void * pvItem2)
+{
+    return memcmp(pvItem1, pvItem2, sizeof(TFoundFile));
+}
+
+// Both searches must have found the same files, in any order
+static int CompareFoundFiles(TLogHelper & LogHelper, TFoundFiles * pFiles, TFoundFiles * pExpected, const char * szSearchName)
+{
+    if(pFiles->dwCount != pExpected->dwCount)
+        return LogHelper.PrintErrorVa("%s found %u files instead of %u", szSearchName, pFiles->dwCount, pExpected->dwCount);
+
+    if(pFiles->dwCount != 0)
+    {
+        qsort(pFiles->pItems, pFiles->dwCount, sizeof(TFoundFile), CompareFoundFile);
+        qsort(pExpected->pItems, pExpected->dwCount, sizeof(TFoundFile), CompareFoundFile);
+        if(memcmp(pFiles->pItems, pExpected->pItems, pFiles->dwCount * sizeof(TFoundFile)))
+            return LogHelper.PrintErrorVa("%s found different files than expected", szSearchName);
+    }
+
+    return ERROR_SUCCESS;
+}
+
+static void FreeFoundFiles(TFoundFiles * pFiles)
+{
+    if(pFiles->pItems != NULL)
+        CASC_FREE(pFiles->pItems);
+    memset(pFiles, 0, sizeof(TFoundFiles));
+}
+
+static int TestOpenStorage_EnumFilesPart(const TCHAR * szStorage, DWORD dwPartCount)
+{
+    CASC_FIND_DATA FindData;
+    TLogHelper LogHelper("OpenForEnumPart");
+    TFoundFiles NamedFiles = {NULL, 0, 0};
+    TFoundFiles PartFiles = {NULL, 0, 0};
+    HANDLE hStorage;
+    int nError = ERROR_SUCCESS;
+
+    // Open the storage directory
+    LogHelper.PrintProgress(_T("Opening storage \"%s\"..."), szStorage);
+    if(!CascOpenStorage(szStorage, 0, &hStorage))
+    {
+        assert(GetLastError() != ERROR_SUCCESS);
+        nError = GetLastError();
+    }
+
+    // Collect the named files using the normal search
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("Searching storage ...");
+        nError = CollectFoundFiles(CascFindFirstFile(hStorage, "*", &FindData, NULL), &FindData, &NamedFiles, true);
+    }
+
+    // Collect the files in all parts. The threads would do the same, each with its own part
+    for(DWORD dwPartIndex = 0; dwPartIndex < dwPartCount && nError == ERROR_SUCCESS; dwPartIndex++)
+    {
+        LogHelper.PrintProgress("Searching part %u of %u ...", dwPartIndex + 1, dwPartCount);
+        nError = CollectFoundFiles(CascFindFirstFilePart(hStorage, "*", &FindData, dwPartIndex, dwPartCount), &FindData, &PartFiles, false);
+    }
+
+    // All parts together must give the same files as the normal search
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("");
+        nError = CompareFoundFiles(LogHelper, &PartFiles, &NamedFiles, "Partitioned search");
+    }
+
+    // Close storage and return
+    FreeFoundFiles(&PartFiles);
+    FreeFoundFiles(&NamedFiles);
+    if(hStorage != NULL)
+        CascCloseStorage(hStorage);
+    return nError;
+}
+
+static int TestOpenStorage_EnumEncodingKeys(const TCHAR * szStorage, DWORD dwPartCount)
+{
+    CASC_FIND_DATA FindData;
+    TLogHelper LogHelper("OpenForEnumKeys");
+    TFoundFiles AllKeys = {NULL, 0, 0};
+    TFoundFiles PartKeys = {NULL, 0, 0};
+    HANDLE hStorage;
+    int nError = ERROR_SUCCESS;
+
+    // Open the storage directory
+    LogHelper.PrintProgress(_T("Opening storage \"%s\"..."), szStorage);
+    if(!CascOpenStorage(szStorage, 0, &hStorage))
+    {
+        assert(GetLastError() != ERROR_SUCCESS);
+        nError = GetLastError();
+    }
+
+    // Collect all encoding keys as one part
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("Searching encoding keys ...");
+        nError = CollectFoundFiles(CascFindFirstEncodingKeyPart(hStorage, &FindData, 0, 1), &FindData, &AllKeys, false);
+    }
+
+    // Collect the keys in all parts. The threads would do the same, each with its own part
+    for(DWORD dwPartIndex = 0; dwPartIndex < dwPartCount && nError == ERROR_SUCCESS; dwPartIndex++)
+    {
+        LogHelper.PrintProgress("Searching part %u of %u ...", dwPartIndex + 1, dwPartCount);
+        nError = CollectFoundFiles(CascFindFirstEncodingKeyPart(hStorage, &FindData, dwPartIndex, dwPartCount), &FindData, &PartKeys, false);
+    }
+
+    // All parts together must give the same keys as the complete table
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("");
+        nError = CompareFoundFiles(LogHelper, &PartKeys, &AllKeys, "Partitioned key search");
+    }
+
+    // Close storage and return
+    FreeFoundFiles(&PartKeys);
+    FreeFoundFiles(&AllKeys);
+    if(hStorage != NULL)
+        CascCloseStorage(hStorage);
+    return nError;
+}
+
+static int TestOpenStorage_EnumFilesBatch(const TCHAR * szStorage, const TCHAR * szListFile = NULL)
+{
+    CASC_FIND_ITEM FindItems[0x400];
+    CASC_FIND_DATA FindData;
+    TLogHelper LogHelper("OpenForEnumBatch");
+    TFoundFiles SingleFiles = {NULL, 0, 0};
+    TFoundFiles BatchFiles = {NULL, 0, 0};
+    HANDLE hStorage;
+    HANDLE hFind;
+    DWORD dwItemCount = 0;
+    DWORD dwTickCount = 0;
+    char szNameBuffer[0x10000];
+    int nError = ERROR_SUCCESS;
+
+    // Open the storage directory
+    LogHelper.PrintProgress(_T("Opening storage \"%s\"..."), szStorage);
+    if(!CascOpenStorage(szStorage, 0, &hStorage))
+    {
+        assert(GetLastError() != ERROR_SUCCESS);
+        nError = GetLastError();
+    }
+
+    // Collect the files using the normal search
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("Searching storage ...");
+        nError = CollectFoundFiles(CascFindFirstFile(hStorage, "*", &FindData, szListFile), &FindData, &SingleFiles, false);
+    }
+
+    // Collect the files using the batched search. The first file comes from CascFindFirstFile
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("Searching storage in batches ...");
+        hFind = CascFindFirstFile(hStorage, "*", &FindData, szListFile);
+        if(hFind != NULL)
+        {
+            dwTickCount = GET_TICK_COUNT();
+            InsertFoundFile(&BatchFiles, FindData.EncodingKey, FindData.szFileName);
+            while(CascFindNextFiles(hFind, FindItems, sizeof(FindItems) / sizeof(CASC_FIND_ITEM), szNameBuffer, sizeof(szNameBuffer), &dwItemCount))
+            {
+                for(DWORD i = 0; i < dwItemCount; i++)
+                {
+                    const char * szFileName = (FindItems[i].NameOffset != CASC_INVALID_NAME_OFFSET) ? (szNameBuffer + FindItems[i].NameOffset) : NULL;
+
+                    if(!InsertFoundFile(&BatchFiles, FindItems[i].EncodingKey, szFileName))
+                        nError = ERROR_NOT_ENOUGH_MEMORY;
+                }
+            }
+            dwTickCount = GET_TICK_COUNT() - dwTickCount;
+            CascFindClose(hFind);
         }
     }
 
+    // Both searches must give the same files
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("");
+        nError = CompareFoundFiles(LogHelper, &BatchFiles, &SingleFiles, "Batched search");
+        LogHelper.PrintMessage("Enumerated %u files in batches in %u ms", BatchFiles.dwCount, dwTickCount);
+    }
+
     // Close storage and return
+    FreeFoundFiles(&BatchFiles);
+    FreeFoundFiles(&SingleFiles);
     if(hStorage != NULL)
         CascCloseStorage(hStorage);
     return nError;
@@ -313,8 +774,9 @@ static int TestOpenStorage_ExtractFiles(const TCHAR * szStorage, const TCHAR * s
 
     if(nError == ERROR_SUCCESS)
     {
+        // Extract the files in the order as they are stored in the data files
         LogHelper.PrintProgress("Searching storage ...");
-        hFind = CascFindFirstFile(hStorage, "*", &FindData, szListFile);
+        hFind = CascFindFirstFileEx(hStorage, "*", &FindData, szListFile, CASC_FIND_SORT_BY_LOCATION);
         if(hFind != INVALID_HANDLE_VALUE)
         {
             // Search the storage
@@ -344,31 +806,917 @@ static int TestOpenStorage_ExtractFiles(const TCHAR * szStorage, const TCHAR * s
     return nError;
 }
 
-static int Hack()
+static bool WINAPI ExtractProgressCallback(void * pvUserData, PCASC_EXTRACT_PROGRESS pProgress)
 {
-/*
-    HANDLE hFile;
-    BYTE Buffer[0x100];
-    hash_state md5_state;
-    LPBYTE pbStartHash = &Buffer[BLTE_HEADER_DELTA];
-    BYTE md5_hash[MD5_HASH_SIZE];
-    uint32_t dwHashHigh = 0;
-    uint32_t dwHashLow = 0;
-    DWORD dwBytesRead = 0;
+    TLogHelper * pLogHelper = (TLogHelper *)pvUserData;
 
-    hFile = CreateFile(_T("e:\\Multimedia\\MPQs\\2014 - WoW\\18888\\Data\\data\\data.017"), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
-    if(hFile != INVALID_HANDLE_VALUE)
-    {
-        SetFilePointer(hFile, 0x34CBFE8C, NULL, FILE_BEGIN);
-        ReadFile(hFile, Buffer, sizeof(Buffer), &dwBytesRead, NULL);
-        CloseHandle(hFile);
+    if(pProgress->nError != ERROR_SUCCESS)
+        pLogHelper->PrintError("Extracting %s .. Failed", pProgress->szFileName);
+    else if((pProgress->dwFilesExtracted % 100) == 0)
+        pLogHelper->PrintProgress("Extracted %u files ...", pProgress->dwFilesExtracted);
+    return true;
+}
 
-        for(int i = 1; i < 4+4+16; i++)
-        {
-            dwHashHigh = dwHashLow = 0;
-            hashlittle2(pbStartHash, i, &dwHashHigh, &dwHashLow);
+static int TestOpenStorage_ExtractFilesMT(const TCHAR * szStorage, const TCHAR * szTargetDir, const TCHAR * szListFile, DWORD dwThreadCount, DWORD dwOpenFlags)
+{
+    TLogHelper LogHelper("ExtractFilesMT");
+    HANDLE hStorage;
+    DWORD dwTickCount = 0;
+    int nError = ERROR_SUCCESS;
 
-            md5_init(&md5_state);
+    // Open the storage directory
+    LogHelper.PrintProgress("Opening storage ...");
+    if(!CascOpenStorageEx(szStorage, 0, dwOpenFlags, &hStorage))
+    {
+        assert(GetLastError() != ERROR_SUCCESS);
+        nError = GetLastError();
+    }
+
+    if(nError == ERROR_SUCCESS)
+    {
+        // Extract all files using the library pipeline and measure the time
+        dwTickCount = GET_TICK_COUNT();
+        if(!CascExtractFiles(hStorage, "*", szListFile, szTargetDir, dwThreadCount, ExtractProgressCallback, &LogHelper))
+            nError = GetLastError();
+        dwTickCount = GET_TICK_COUNT() - dwTickCount;
+
+        LogHelper.PrintProgress("");
+        LogHelper.PrintMessage("Extraction with %u threads (open flags %08X) took %u ms", dwThreadCount, dwOpenFlags, dwTickCount);
+    }
+
+    // Close storage and return
+    if(hStorage != NULL)
+        CascCloseStorage(hStorage);
+    return nError;
+}
+
+// Decompresses all frames with the given codec. Gives the number of decompressed bytes
+static int DecompressFrames(TRawFileData * pFiles, DWORD dwFileCount, LPBYTE pbOutBuffer, BYTE CodecId, ULONGLONG * PtrBytes)
+{
+    PCASC_FILE_FRAME pFrame;
+    TCascFile * hf;
+    LPBYTE pbFrameData;
+    DWORD cbFrame;
+    int nError;
+
+    for(DWORD i = 0; i < dwFileCount; i++)
+    {
+        hf = (TCascFile *)pFiles[i].hFile;
+        pFrame = hf->pFrames;
+
+        for(DWORD j = 0; j < hf->FrameCount; j++, pFrame++)
+        {
+            pbFrameData = pFiles[i].pbRawData + (pFrame->FrameArchiveOffset - hf->pFrames[0].FrameArchiveOffset);
+            if(pFrame->CompressedSize > 1 && pbFrameData[0] == CodecId)
+            {
+                cbFrame = pFrame->FrameSize;
+                nError = CascDecompress(pbOutBuffer, &cbFrame, pbFrameData, pFrame->CompressedSize);
+                if(nError != ERROR_SUCCESS || cbFrame != pFrame->FrameSize)
+                    return ERROR_FILE_CORRUPT;
+                PtrBytes[0] += cbFrame;
+            }
+        }
+    }
+
+    return ERROR_SUCCESS;
+}
+
+// Loads the raw frames of the first files of the storage, then decompresses
+// the frames of each codec over and over. Only the decompression is measured,
+// so the codecs and the inflate backends (see CascDecompress.cpp) can be compared
+static int TestOpenStorage_DecompressSpeed(const TCHAR * szStorage, DWORD dwMaxFiles, DWORD dwPassCount)
+{
+    CASC_FIND_DATA FindData;
+    TRawFileData * pFiles = NULL;
+    TLogHelper LogHelper("DecompressSpeed");
+    TCascFile * hf;
+    ULONGLONG BytesDecompressed;
+    HANDLE hStorage = NULL;
+    HANDLE hFind;
+    LPBYTE pbOutBuffer = NULL;
+    DWORD dwFileCount = 0;
+    DWORD dwTickCount = 0;
+    DWORD cbOutBuffer = 0;
+    DWORD cbRawData;
+    bool bCodecUsed[0x100] = {false};
+    bool bFileFound = true;
+    int nError = ERROR_SUCCESS;
+
+    // Open the storage directory
+    LogHelper.PrintProgress(_T("Opening storage \"%s\"..."), szStorage);
+    if(!CascOpenStorage(szStorage, 0, &hStorage))
+    {
+        assert(GetLastError() != ERROR_SUCCESS);
+        nError = GetLastError();
+    }
+
+    // Allocate the array of files
+    if(nError == ERROR_SUCCESS)
+    {
+        pFiles = CASC_ALLOC(TRawFileData, dwMaxFiles);
+        if(pFiles == NULL)
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Load the raw data of the files
+    if(nError == ERROR_SUCCESS)
+    {
+        LogHelper.PrintProgress("Loading raw data ...");
+        hFind = CascFindFirstFile(hStorage, "*", &FindData, NULL);
+        if(hFind != NULL)
+        {
+            while(bFileFound && dwFileCount < dwMaxFiles)
+            {
+                TRawFileData & RawFile = pFiles[dwFileCount];
+
+                if(CascOpenFile(hStorage, FindData.szFileName, 0, 0, &RawFile.hFile))
+                {
+                    hf = (TCascFile *)RawFile.hFile;
+                    if(LoadRawFileData(hf, &RawFile.pbRawBuffer, &RawFile.pbRawData, &cbRawData, &RawFile.bAligned) == ERROR_SUCCESS)
+                    {
+                        // Remember the codecs and the largest frame
+                        for(DWORD i = 0; i < hf->FrameCount; i++)
+                        {
+                            if(hf->pFrames[i].CompressedSize > 1)
+                                bCodecUsed[RawFile.pbRawData[hf->pFrames[i].FrameArchiveOffset - hf->pFrames[0].FrameArchiveOffset]] = true;
+                            cbOutBuffer = CASCLIB_MAX(cbOutBuffer, hf->pFrames[i].FrameSize);
+                        }
+                        dwFileCount++;
+                    }
+                    else
+                    {
+                        CascCloseFile(RawFile.hFile);
+                    }
+                }
+
+                bFileFound = CascFindNextFile(hFind, &FindData);
+            }
+
+            CascFindClose(hFind);
+        }
+
+        // Allocate buffer for the largest frame
+        pbOutBuffer = CASC_ALLOC(BYTE, cbOutBuffer);
+        if(pbOutBuffer == NULL)
+            nError = ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    // Measure each codec separately
+    for(DWORD CodecId = 0; CodecId < 0x100 && nError == ERROR_SUCCESS; CodecId++)
+    {
+        if(bCodecUsed[CodecId])
+        {
+            LogHelper.PrintProgress("Decompressing '%c' frames ...", CodecId);
+            BytesDecompressed = 0;
+
+            dwTickCount = GET_TICK_COUNT();
+            for(DWORD dwPass = 0; dwPass < dwPassCount && nError == ERROR_SUCCESS; dwPass++)
+                nError = DecompressFrames(pFiles, dwFileCount, pbOutBuffer, (BYTE)CodecId, &BytesDecompressed);
+            dwTickCount = GET_TICK_COUNT() - dwTickCount;
+
+            LogHelper.PrintProgress("");
+            if(nError != ERROR_SUCCESS)
+            {
+                LogHelper.PrintMessage("Failed to decompress a '%c' frame", CodecId);
+                break;
+            }
+
+            LogHelper.PrintMessage("Codec '%c': %u MB from %u files in %u ms (%u MB/s)",
+                                   CodecId,
+                                   (DWORD)(BytesDecompressed >> 20),
+                                   dwFileCount,
+                                   dwTickCount,
+                                   (dwTickCount != 0) ? (DWORD)((BytesDecompressed * 1000 / dwTickCount) >> 20) : 0);
+        }
+    }
+
+    // Free the loaded files
+    for(DWORD i = 0; i < dwFileCount; i++)
+    {
+        FreeRawData(pFiles[i].pbRawBuffer, pFiles[i].bAligned);
+        CascCloseFile(pFiles[i].hFile);
+    }
+
+    if(pbOutBuffer != NULL)
+        CASC_FREE(pbOutBuffer);
+    if(pFiles != NULL)
+        CASC_FREE(pFiles);
+    if(hStorage != NULL)
+        CascCloseStorage(hStorage);
+    return nError;
+}
+
+// Decompresses hand-made frames: LZ4 blocks, nested BLTE and damaged data
+static int TestDecompress()
+{
+    TLogHelper LogHelper("Decompress");
+    TCodecRaceContext RaceContext = {0, 0};
+    BYTE Frame[0x200];
+    BYTE Output[0x100];
+    DWORD cbFrame;
+    DWORD cbOutput;
+    int nResult;
+    int nError = ERROR_SUCCESS;
+
+    // LZ4 frames have 16-byte blocks. The second frame has a block that is a match of the previous block;
+    // the match ends exactly at the end of the block
+    static const BYTE LZ4_Independent[] = {'4', 1, 0, 0, 0, 0, 0, 0, 0, 32, 4,
+        0xF0, 0x01, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+        0xF0, 0x01, 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p'};
+    static const BYTE LZ4_Linked[] = {'4', 1, 0, 0, 0, 0, 0, 0, 0, 35, 4,
+        0xF0, 0x01, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+        0x0C, 0x10, 0x00,
+        0x30, 'x', 'y', 'z'};
+    static const BYTE Uncompressed[] = {'N', 'H', 'e', 'l', 'l', 'o'};
+
+    struct
+    {
+        const char * szName;
+        const BYTE * pbFrame;
+        DWORD cbFrame;
+        int nExpected;
+        const char * szExpected;
+        DWORD cbExpected;
+    } Tests[] =
+    {
+        {"independent LZ4 blocks", LZ4_Independent, sizeof(LZ4_Independent), ERROR_SUCCESS, "ABCDEFGHIJKLMNOPabcdefghijklmnop", 32},
+        {"linked LZ4 blocks", LZ4_Linked, sizeof(LZ4_Linked), ERROR_SUCCESS, "ABCDEFGHIJKLMNOPABCDEFGHIJKLMNOPxyz", 35},
+        {"truncated LZ4 block", LZ4_Linked, sizeof(LZ4_Linked) - 1, ERROR_FILE_CORRUPT, NULL, 0},
+        {"truncated LZ4 header", LZ4_Linked, 6, ERROR_BAD_FORMAT, NULL, 0},
+        {"empty frame", LZ4_Linked, 0, ERROR_FILE_CORRUPT, NULL, 0},
+    };
+
+    for(size_t i = 0; i < sizeof(Tests) / sizeof(Tests[0]) && nError == ERROR_SUCCESS; i++)
+    {
+        cbOutput = sizeof(Output);
+        memcpy(Frame, Tests[i].pbFrame, Tests[i].cbFrame);
+        nResult = CascDecompress(Output, &cbOutput, Frame, Tests[i].cbFrame);
+        if(nResult != Tests[i].nExpected || (nResult == ERROR_SUCCESS && (cbOutput != Tests[i].cbExpected || memcmp(Output, Tests[i].szExpected, cbOutput))))
+        {
+            LogHelper.PrintMessage("Wrong result of the %s (error %u)", Tests[i].szName, nResult);
+            nError = ERROR_CAN_NOT_COMPLETE;
+        }
+    }
+
+    // 'F' frames without frame table, nested up to the limit and one level more
+    for(DWORD dwNesting = 1; dwNesting <= 9 && nError == ERROR_SUCCESS; dwNesting++)
+    {
+        memcpy(Frame, Uncompressed, sizeof(Uncompressed));
+        cbFrame = sizeof(Uncompressed);
+        for(DWORD i = 0; i < dwNesting; i++)
+            cbFrame = MakeNestedFrame(Frame, Frame, cbFrame);
+
+        cbOutput = sizeof(Output);
+        nResult = CascDecompress(Output, &cbOutput, Frame, cbFrame);
+        if((dwNesting <= 8) ? (nResult != ERROR_SUCCESS || cbOutput != 5 || memcmp(Output, "Hello", 5)) : (nResult != ERROR_FILE_CORRUPT))
+        {
+            LogHelper.PrintMessage("Wrong result of %u nested frames (error %u)", dwNesting, nResult);
+            nError = ERROR_CAN_NOT_COMPLETE;
+        }
+    }
+
+    // 'F' frame with a frame table: valid, with an empty inner frame and truncated
+    if(nError == ERROR_SUCCESS)
+    {
+        cbFrame = MakeTableFrame(Frame, (LPBYTE)Uncompressed, sizeof(Uncompressed), 5);
+        cbOutput = sizeof(Output);
+        nResult = CascDecompress(Output, &cbOutput, Frame, cbFrame);
+        if(nResult != ERROR_SUCCESS || cbOutput != 5 || memcmp(Output, "Hello", 5))
+            nError = ERROR_CAN_NOT_COMPLETE;
+
+        cbOutput = sizeof(Output);
+        if(nError == ERROR_SUCCESS && CascDecompress(Output, &cbOutput, Frame, cbFrame - 1) != ERROR_FILE_CORRUPT)
+            nError = ERROR_CAN_NOT_COMPLETE;
+
+        cbFrame = MakeTableFrame(Frame, (LPBYTE)Uncompressed, 0, 0);
+        cbOutput = sizeof(Output);
+        if(nError == ERROR_SUCCESS && CascDecompress(Output, &cbOutput, Frame, cbFrame) != ERROR_FILE_CORRUPT)
+            nError = ERROR_CAN_NOT_COMPLETE;
+
+        if(nError != ERROR_SUCCESS)
+            LogHelper.PrintMessage("Wrong result of a frame with frame table");
+    }
+
+    // A registered codec replaces the built-in one until it is unregistered
+    if(nError == ERROR_SUCCESS)
+    {
+        CascRegisterCodec('N', Decompress_Test);
+        cbOutput = sizeof(Output);
+        nResult = CascDecompress(Output, &cbOutput, (LPBYTE)Uncompressed, sizeof(Uncompressed));
+        if(nResult != ERROR_SUCCESS || cbOutput != 4 || memcmp(Output, "Test", 4))
+            nError = ERROR_CAN_NOT_COMPLETE;
+
+        CascRegisterCodec('N', NULL);
+        cbOutput = sizeof(Output);
+        nResult = CascDecompress(Output, &cbOutput, (LPBYTE)Uncompressed, sizeof(Uncompressed));
+        if(nResult != ERROR_SUCCESS || cbOutput != 5 || memcmp(Output, "Hello", 5))
+            nError = ERROR_CAN_NOT_COMPLETE;
+
+        if(nError != ERROR_SUCCESS)
+            LogHelper.PrintMessage("The registered codec was not used");
+    }
+
+    // Register the codec while other threads decompress
+    if(nError == ERROR_SUCCESS)
+    {
+        CascRunWorkers(CodecRaceWorker, &RaceContext, 4);
+        if(RaceContext.dwErrors != 0)
+        {
+            LogHelper.PrintMessage("%u frames failed while the codec was being registered", RaceContext.dwErrors);
+            nError = ERROR_CAN_NOT_COMPLETE;
+        }
+    }
+
+    return nError;
+}
+
+// Compares the compiled masks with the reference matcher on random names and masks,
+// including names longer than MAX_PATH
+static int TestWildCards()
+{
+    TLogHelper LogHelper("WildCards");
+    CASC_WILDCARD WildCard;
+    const char * szCharacters = "aB/\\.x?*";
+    DWORD dwSeed = 0x12345678;
+    size_t nLength;
+    char szString[MAX_PATH * 2];
+    char szMask[0x40];
+    bool bExpected;
+    bool bMatch;
+    int nError = ERROR_SUCCESS;
+
+    static const char * EdgeCases[][2] =
+    {
+        {"", ""}, {"", "*"}, {"", "?"}, {"a", ""}, {"a", "**"}, {"ab", "*?"}, {"ab", "?*?"},
+        {"abc", "*?c"}, {"abc", "a*?"}, {"abc", "a?*c"}, {"a", "a*a"}, {"aa", "a*a"},
+        {"DATA\\file.txt", "data/*.TXT"}, {"data/file.txt", "DATA\\FILE.???"}, {"x.txt", "*.txt*"},
+        {"abab", "*ab*ab"}, {"abab", "*ab*ab*"}, {"aab", "*a?b"}, {"ab", "a**b"}, {"a*b", "a?b"}
+    };
+
+    // Fixed cases first
+    for(size_t i = 0; i < sizeof(EdgeCases) / sizeof(EdgeCases[0]) && nError == ERROR_SUCCESS; i++)
+    {
+        nError = WildCard_Compile(&WildCard, EdgeCases[i][1]);
+        if(nError == ERROR_SUCCESS)
+        {
+            bMatch = WildCard_Check(&WildCard, EdgeCases[i][0], strlen(EdgeCases[i][0]));
+            bExpected = CheckWildCard(EdgeCases[i][0], EdgeCases[i][1]);
+            if(bMatch != bExpected)
+            {
+                LogHelper.PrintMessage("Mask %s, name %s: %u instead of %u", EdgeCases[i][1], EdgeCases[i][0], bMatch, bExpected);
+                nError = ERROR_CAN_NOT_COMPLETE;
+            }
+            WildCard_Free(&WildCard);
+        }
+    }
+
+    // Random names and masks. The characters are few, so that the masks often match
+    for(DWORD i = 0; i < 200000 && nError == ERROR_SUCCESS; i++)
+    {
+        // Every 16th name is longer than MAX_PATH
+        nLength = (i & 0x0F) ? (GetRandomNumber(&dwSeed) % 16) : (MAX_PATH + GetRandomNumber(&dwSeed) % MAX_PATH);
+        for(size_t j = 0; j < nLength; j++)
+            szString[j] = szCharacters[GetRandomNumber(&dwSeed) % 6];
+        szString[nLength] = 0;
+
+        // The mask is either a random string or the name with some characters replaced
+        nLength = GetRandomNumber(&dwSeed) % 12;
+        for(size_t j = 0; j < nLength; j++)
+            szMask[j] = szCharacters[GetRandomNumber(&dwSeed) % 9];
+        szMask[nLength] = 0;
+        if((i & 0x03) == 0)
+        {
+            nLength = strlen(szString);
+            if(nLength < sizeof(szMask))
+            {
+                strcpy(szMask, szString);
+                for(size_t j = 0; j < nLength; j++)
+                {
+                    if((GetRandomNumber(&dwSeed) % 4) == 0)
+                        szMask[j] = szCharacters[6 + GetRandomNumber(&dwSeed) % 3];
+                }
+            }
+        }
+
+        nError = WildCard_Compile(&WildCard, szMask);
+        if(nError == ERROR_SUCCESS)
+        {
+            bMatch = WildCard_Check(&WildCard, szString, strlen(szString));
+            bExpected = CheckWildCard(szString, szMask);
+            if(bMatch != bExpected)
+            {
+                // The log buffer is too small for the long names, so only print their beginning
+                LogHelper.PrintMessage("Mask %s, name \"%.100s\" (%u characters): %u instead of %u", szMask, szString, (DWORD)strlen(szString), bMatch, bExpected);
+                nError = ERROR_CAN_NOT_COMPLETE;
+            }
+            WildCard_Free(&WildCard);
+        }
+    }
+
+    return nError;
+}
+
+// Lookup of files in a synthetic mirror of the CDN. The archive indexes are created
+// by the test; each pass uses a different way of loading them
+static int TestCdnArchives()
+{
+    TLogHelper LogHelper("CdnArchives");
+    PCASC_ARCHIVE_ENTRY pEntry;
+    CASC_ARCHIVE_ENTRY Entries[300];
+    TCascStorage * hs;
+    TFileStream * pStream;
+    const TCHAR * szDataPath = _T("Work/Cdn");
+    QUERY_KEY ArchiveKeys[3];
+    QUERY_KEY QueryKey;
+    BYTE ArchiveKeyData[3][MD5_HASH_SIZE];
+    BYTE GroupKeyData[2][MD5_HASH_SIZE];
+    BYTE EntryKeys[300][MD5_HASH_SIZE];
+    BYTE UnknownKey[MD5_HASH_SIZE];
+    BYTE Buffer[0x10];
+    DWORD dwOffsetDelta;
+    DWORD dwSeed = 0x87654321;
+    int nError = ERROR_SUCCESS;
+
+    // Random keys of the archives, the groups and the files
+    for(size_t i = 0; i < MD5_HASH_SIZE; i++)
+    {
+        for(size_t j = 0; j < 3; j++)
+            ArchiveKeyData[j][i] = (BYTE)GetRandomNumber(&dwSeed);
+        for(size_t j = 0; j < 300; j++)
+            EntryKeys[j][i] = (BYTE)GetRandomNumber(&dwSeed);
+        GroupKeyData[0][i] = (BYTE)GetRandomNumber(&dwSeed);
+        GroupKeyData[1][i] = (BYTE)GetRandomNumber(&dwSeed);
+        UnknownKey[i] = (BYTE)GetRandomNumber(&dwSeed);
+    }
+
+    // The first 200 files are in archive 0 (two blocks of the index), the rest in archive 1.
+    // Archive 2 has no index
+    for(DWORD i = 0; i < 300; i++)
+    {
+        Entries[i].ArchiveIndex = (i < 200) ? 0 : 1;
+        Entries[i].ArchiveOffset = i * 0x100;
+        Entries[i].EncodedSize = 0x10 + i;
+    }
+    for(DWORD i = 0; i < 3; i++)
+    {
+        ArchiveKeys[i].pbData = ArchiveKeyData[i];
+        ArchiveKeys[i].cbData = MD5_HASH_SIZE;
+    }
+
+    // Indexes of the single archives, the archive 1 itself and a loose file
+    if(!CreateCdnArchiveIndex(szDataPath, ArchiveKeyData[0], Entries, EntryKeys[0], 200, false, 1) ||
+       !CreateCdnArchiveIndex(szDataPath, ArchiveKeyData[1], Entries + 200, EntryKeys[200], 100, false, 1) ||
+       !CreateCdnFile(szDataPath, _T("data"), ArchiveKeyData[1], _T(""), (LPBYTE)"Archive 1", 9) ||
+       !CreateCdnFile(szDataPath, _T("data"), EntryKeys[0], _T(""), (LPBYTE)"Loose file", 10))
+        return LogHelper.PrintError("Failed to create the CDN files");
+
+    // Index of a group with the offsets moved by one, so we know which index has been used.
+    // The second group has a bad footer, so the indexes of the single archives must be used instead
+    for(DWORD i = 0; i < 300; i++)
+        Entries[i].ArchiveOffset++;
+    if(!CreateCdnArchiveIndex(szDataPath, GroupKeyData[0], Entries, EntryKeys[0], 300, true, 1) ||
+       !CreateCdnArchiveIndex(szDataPath, GroupKeyData[1], Entries, EntryKeys[0], 300, true, 2))
+        return LogHelper.PrintError("Failed to create the CDN files");
+    for(DWORD i = 0; i < 300; i++)
+        Entries[i].ArchiveOffset--;
+
+    // Pass 0: single archives, pass 1: archive group, pass 2: damaged archive group
+    for(DWORD dwPass = 0; dwPass < 3 && nError == ERROR_SUCCESS; dwPass++)
+    {
+        hs = CASC_ALLOC(TCascStorage, 1);
+        if(hs == NULL)
+            return ERROR_NOT_ENOUGH_MEMORY;
+        memset(hs, 0, sizeof(TCascStorage));
+        CascLock_Init(&hs->StorageLock);
+        CascLock_Init(&hs->ArchiveLock);
+        hs->szDataPath = CascNewStr(szDataPath, 0);
+        hs->pArchiveArray = ArchiveKeys;
+        hs->ArchiveCount = 3;
+        if(dwPass != 0)
+        {
+            hs->ArchiveGroup.pbData = GroupKeyData[dwPass - 1];
+            hs->ArchiveGroup.cbData = MD5_HASH_SIZE;
+        }
+        dwOffsetDelta = (dwPass == 1) ? 1 : 0;
+
+        // All files must be found where the index says
+        if(LoadArchiveIndexes(hs) != ERROR_SUCCESS || hs->ArchiveEntryCount != 300)
+        {
+            LogHelper.PrintMessage("Pass %u: the archive indexes were not loaded", dwPass);
+            nError = ERROR_CAN_NOT_COMPLETE;
+        }
+
+        for(DWORD i = 0; i < 300 && nError == ERROR_SUCCESS; i++)
+        {
+            QueryKey.pbData = EntryKeys[i];
+            QueryKey.cbData = MD5_HASH_SIZE;
+            pEntry = FindArchiveEntry(hs, &QueryKey);
+            if(pEntry == NULL || pEntry->ArchiveIndex != Entries[i].ArchiveIndex ||
+                                 pEntry->ArchiveOffset != Entries[i].ArchiveOffset + dwOffsetDelta ||
+                                 pEntry->EncodedSize != Entries[i].EncodedSize)
+            {
+                LogHelper.PrintMessage("Pass %u: wrong archive entry of file %u", dwPass, i);
+                nError = ERROR_CAN_NOT_COMPLETE;
+            }
+        }
+
+        // A file that is not in any index
+        QueryKey.pbData = UnknownKey;
+        QueryKey.cbData = MD5_HASH_SIZE;
+        if(nError == ERROR_SUCCESS && FindArchiveEntry(hs, &QueryKey) != NULL)
+        {
+            LogHelper.PrintMessage("Pass %u: found a file that is not in the archives", dwPass);
+            nError = ERROR_CAN_NOT_COMPLETE;
+        }
+
+        // Open the archive and the loose file
+        if(nError == ERROR_SUCCESS && dwPass == 0)
+        {
+            memset(Buffer, 0, sizeof(Buffer));
+            if((pStream = OpenArchiveStream(hs, 1)) != NULL)
+            {
+                FileStream_Read(pStream, NULL, Buffer, 9);
+                FileStream_Close(pStream);
+            }
+
+            QueryKey.pbData = EntryKeys[0];
+            if((pStream = OpenLooseFileStream(hs, &QueryKey)) != NULL)
+            {
+                FileStream_Read(pStream, NULL, Buffer + 9, 6);
+                FileStream_Close(pStream);
+            }
+
+            if(memcmp(Buffer, "Archive 1Loose ", 15))
+            {
+                LogHelper.PrintMessage("Failed to read the archive or the loose file");
+                nError = ERROR_CAN_NOT_COMPLETE;
+            }
+        }
+
+        FreeArchiveIndexes(hs);
+        CascLock_Free(&hs->ArchiveLock);
+        CascLock_Free(&hs->StorageLock);
+        CASC_FREE(hs->szDataPath);
+        CASC_FREE(hs);
+    }
+
+    return nError;
+}
+
+// Names from the storage must not be extracted out of the target directory.
+// Each accepted name is written to the target directory, like the extraction does
+static int TestExtractedFileNames()
+{
+    TLogHelper LogHelper("ExtractedFileNames");
+    TFileStream * pStream;
+    const TCHAR * szTargetDir = _T("Work");     // Must have 4 characters
+    TCHAR * szLocalFile;
+    int nResult;
+    int nError = ERROR_SUCCESS;
+
+    static const struct
+    {
+        const char * szFileName;
+        bool bAccepted;
+    } TestNames[] =
+    {
+        {"ExtractTest\\File.txt",          true},
+        {"ExtractTest/Sub/File.txt",       true},
+        {"ExtractTest\\..File.txt",        true},
+        {"ExtractTest\\File..",            true},
+        {"",                               false},
+        {"..\\..\\etc\\x",                 false},
+        {"../../etc/x",                    false},
+        {"ExtractTest\\..\\..\\x",         false},
+        {"ExtractTest/../x",               false},
+        {"ExtractTest\\.\\x",              false},
+        {"ExtractTest\\\\x",               false},
+        {"ExtractTest\\x\\",               false},
+        {"..",                             false},
+        {".",                              false},
+        {"/tmp/x",                         false},
+        {"\\Windows\\x",                   false},
+        {"C:\\Windows\\x",                 false},
+        {"C:x",                            false},
+        {"ExtractTest\\x:stream",          false},
+    };
+
+    for(size_t i = 0; i < sizeof(TestNames) / sizeof(TestNames[0]); i++)
+    {
+        szLocalFile = NULL;
+        nResult = CreateExtractedFileName(szTargetDir, TestNames[i].szFileName, &szLocalFile);
+        if((nResult == ERROR_SUCCESS) != TestNames[i].bAccepted)
+        {
+            LogHelper.PrintMessage("Wrong result for %s", TestNames[i].szFileName);
+            nError = ERROR_CAN_NOT_COMPLETE;
+            break;
+        }
+
+        // Write the accepted name
+        if(szLocalFile != NULL)
+        {
+            if(_tcsncmp(szLocalFile, szTargetDir, 4) || szLocalFile[4] != _T(PATH_SEPARATOR))
+            {
+                LogHelper.PrintMessage("The name is not in the target directory: %s", szLocalFile);
+                nError = ERROR_CAN_NOT_COMPLETE;
+            }
+
+            if((pStream = FileStream_CreateFile(szLocalFile, 0)) == NULL)
+            {
+                ForceCreatePath(szLocalFile);
+                pStream = FileStream_CreateFile(szLocalFile, 0);
+            }
+            if(pStream == NULL)
+                nError = LogHelper.PrintError("Failed to create the file", szLocalFile);
+            else
+                FileStream_Close(pStream);
+
+            remove(szLocalFile);
+            CASC_FREE(szLocalFile);
+            if(nError != ERROR_SUCCESS)
+                break;
+        }
+    }
+
+    return nError;
+}
+
+// Reads random ranges of a file from a HTTP server and compares them with the local copy.
+// Serve the file over the loopback, e.g. with any server supporting range requests
+static int TestHttpStream(const TCHAR * szUrl, const TCHAR * szLocalFile)
+{
+    TLogHelper LogHelper("HttpStream");
+    TFileStream * pRemote = NULL;
+    TFileStream * pLocal = NULL;
+    ULONGLONG RemoteSize = 0;
+    ULONGLONG LocalSize = 0;
+    ULONGLONG ByteOffset;
+    LPBYTE pbRemote = NULL;
+    LPBYTE pbLocal = NULL;
+    DWORD dwBytesToRead;
+    int nError = ERROR_SUCCESS;
+
+    // Open both files
+    pLocal = FileStream_OpenFile(szLocalFile, STREAM_FLAG_READ_ONLY);
+    pRemote = FileStream_OpenFile(szUrl, STREAM_FLAG_READ_ONLY | BASE_PROVIDER_HTTP);
+    if(pLocal == NULL || pRemote == NULL)
+        nError = LogHelper.PrintError("Failed to open the file");
+
+    // Compare the sizes
+    if(nError == ERROR_SUCCESS)
+    {
+        FileStream_GetSize(pLocal, &LocalSize);
+        FileStream_GetSize(pRemote, &RemoteSize);
+        if(LocalSize != RemoteSize || LocalSize == 0)
+            nError = LogHelper.PrintError("The file size doesn't match");
+    }
+
+    // Compare random ranges. Some of them are large, to test the pipelined requests
+    if(nError == ERROR_SUCCESS)
+    {
+        pbRemote = CASC_ALLOC(BYTE, 0x400000);
+        pbLocal = CASC_ALLOC(BYTE, 0x400000);
+        for(DWORD i = 0; pbRemote != NULL && pbLocal != NULL && i < 0x100; i++)
+        {
+            dwBytesToRead = (DWORD)CASCLIB_MIN((ULONGLONG)(((i & 0x0F) == 0) ? (rand() % 0x400000) : (rand() % 0x2000)), LocalSize);
+            ByteOffset = (ULONGLONG)rand() % (LocalSize - dwBytesToRead + 1);
+
+            if(!FileStream_Read(pRemote, &ByteOffset, pbRemote, dwBytesToRead) || !FileStream_Read(pLocal, &ByteOffset, pbLocal, dwBytesToRead))
+            {
+                nError = LogHelper.PrintError("Failed to read the file");
+                break;
+            }
+
+            if(memcmp(pbRemote, pbLocal, dwBytesToRead))
+            {
+                nError = LogHelper.PrintError("The file data doesn't match");
+                break;
+            }
+        }
+    }
+
+    // Free buffers and close the files
+    if(pbLocal != NULL)
+        CASC_FREE(pbLocal);
+    if(pbRemote != NULL)
+        CASC_FREE(pbRemote);
+    if(pRemote != NULL)
+        FileStream_Close(pRemote);
+    if(pLocal != NULL)
+        FileStream_Close(pLocal);
+    return nError;
+}
+
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+
+// Minimal range server for TestHttpStream_Loopback. Serves one connection at a time,
+// answers pipelined requests and closes the connection after every 7th response
+struct TLoopbackServer
+{
+    pthread_t Thread;
+    LPBYTE pbData;
+    size_t cbData;
+    DWORD dwResponses;
+    volatile bool bStop;
+    int ListenSock;
+};
+
+static bool LoopbackSend(int sock, const void * pvData, size_t cbData)
+{
+    const char * pbData = (const char *)pvData;
+    ssize_t nSent;
+
+    while(cbData != 0)
+    {
+        if((nSent = send(sock, pbData, cbData, MSG_NOSIGNAL)) <= 0)
+            return false;
+        pbData += nSent;
+        cbData -= nSent;
+    }
+    return true;
+}
+
+static bool LoopbackServeRequest(TLoopbackServer * pServer, int sock, char * szRequest)
+{
+    unsigned long long StartOffset = 0;
+    unsigned long long EndOffset = 0;
+    char szHeader[0x200];
+    char * szRange;
+    bool bClose;
+    int nLength;
+
+    // Only range requests within the file are expected
+    if((szRange = strstr(szRequest, "Range: bytes=")) == NULL || sscanf(szRange + 13, "%llu-%llu", &StartOffset, &EndOffset) != 2)
+        return false;
+    if(StartOffset > EndOffset || StartOffset >= pServer->cbData)
+        return false;
+    EndOffset = CASCLIB_MIN(EndOffset, (unsigned long long)(pServer->cbData - 1));
+
+    bClose = ((++pServer->dwResponses % 7) == 0);
+    nLength = snprintf(szHeader, sizeof(szHeader), "HTTP/1.1 206 Partial Content\r\n"
+                                                   "Content-Range: bytes %llu-%llu/%llu\r\n"
+                                                   "Content-Length: %llu\r\n"
+                                                   "%s"
+                                                   "\r\n",
+                                                   StartOffset,
+                                                   EndOffset,
+                                                   (unsigned long long)pServer->cbData,
+                                                   EndOffset - StartOffset + 1,
+                                                   bClose ? "Connection: close\r\n" : "");
+    if(!LoopbackSend(sock, szHeader, nLength) || !LoopbackSend(sock, pServer->pbData + StartOffset, (size_t)(EndOffset - StartOffset + 1)))
+        return false;
+    return !bClose;
+}
+
+static void * LoopbackServerThread(void * pvServer)
+{
+    TLoopbackServer * pServer = (TLoopbackServer *)pvServer;
+    char szBuffer[0x2000];
+    char * szEnd;
+    size_t cchBuffer;
+    ssize_t nReceived;
+    int sock;
+
+    while((sock = accept(pServer->ListenSock, NULL, NULL)) != -1 && pServer->bStop == false)
+    {
+        // Receive the requests. Answer each complete one, keep the rest
+        for(cchBuffer = 0; (nReceived = recv(sock, szBuffer + cchBuffer, sizeof(szBuffer) - cchBuffer - 1, 0)) > 0; )
+        {
+            cchBuffer += nReceived;
+            szBuffer[cchBuffer] = 0;
+
+            while((szEnd = strstr(szBuffer, "\r\n\r\n")) != NULL)
+            {
+                szEnd[2] = 0;
+                if(!LoopbackServeRequest(pServer, sock, szBuffer))
+                    break;
+                cchBuffer -= (szEnd + 4 - szBuffer);
+                memmove(szBuffer, szEnd + 4, cchBuffer + 1);
+            }
+
+            // The connection was closed by us. Drain the requests sent ahead,
+            // so that closing the socket doesn't reset the last response
+            if(szEnd != NULL || cchBuffer >= sizeof(szBuffer) - 1)
+            {
+                shutdown(sock, SHUT_WR);
+                while(recv(sock, szBuffer, sizeof(szBuffer), 0) > 0);
+                break;
+            }
+        }
+        close(sock);
+    }
+
+    if(sock != -1)
+        close(sock);
+    return NULL;
+}
+
+// Runs TestHttpStream against the range server above, so it needs no external server
+static int TestHttpStream_Loopback()
+{
+    TLogHelper LogHelper("HttpStreamLoopback");
+    TLoopbackServer Server;
+    struct sockaddr_in Address;
+    socklen_t cbAddress = sizeof(Address);
+    const char * szLocalFile = "HttpStreamLoopback.bin";
+    FILE * fp;
+    char szUrl[0x80];
+    bool bServerStarted = false;
+    int sock;
+    int nError = ERROR_SUCCESS;
+
+    // Prepare the file to be served
+    memset(&Server, 0, sizeof(TLoopbackServer));
+    Server.cbData = 0x1000000;
+    Server.pbData = CASC_ALLOC(BYTE, Server.cbData);
+    Server.ListenSock = socket(AF_INET, SOCK_STREAM, 0);
+    if(Server.pbData == NULL || Server.ListenSock == -1)
+        nError = LogHelper.PrintError("Failed to prepare the server");
+
+    if(nError == ERROR_SUCCESS)
+    {
+        for(size_t i = 0; i < Server.cbData; i++)
+            Server.pbData[i] = (BYTE)(rand() >> 4);
+
+        if((fp = fopen(szLocalFile, "wb")) == NULL || fwrite(Server.pbData, 1, Server.cbData, fp) != Server.cbData)
+            nError = LogHelper.PrintError("Failed to create the local copy", szLocalFile);
+        if(fp != NULL)
+            fclose(fp);
+    }
+
+    // Listen on a free port of the loopback
+    if(nError == ERROR_SUCCESS)
+    {
+        memset(&Address, 0, sizeof(Address));
+        Address.sin_family = AF_INET;
+        Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(Server.ListenSock, (struct sockaddr *)&Address, sizeof(Address)) != 0 ||
+           listen(Server.ListenSock, 4) != 0 ||
+           getsockname(Server.ListenSock, (struct sockaddr *)&Address, &cbAddress) != 0 ||
+           pthread_create(&Server.Thread, NULL, LoopbackServerThread, &Server) != 0)
+        {
+            nError = LogHelper.PrintError("Failed to start the server");
+        }
+        else
+        {
+            bServerStarted = true;
+        }
+    }
+
+    // Run the test
+    if(nError == ERROR_SUCCESS)
+    {
+        sprintf(szUrl, "http://127.0.0.1:%u/HttpStreamLoopback.bin", (unsigned int)ntohs(Address.sin_port));
+        nError = TestHttpStream(szUrl, szLocalFile);
+    }
+
+    // Wake the server from accept() and let it stop
+    if(bServerStarted)
+    {
+        Server.bStop = true;
+        if((sock = socket(AF_INET, SOCK_STREAM, 0)) != -1)
+        {
+            connect(sock, (struct sockaddr *)&Address, sizeof(Address));
+            close(sock);
+        }
+        pthread_join(Server.Thread, NULL);
+    }
+
+    if(Server.ListenSock != -1)
+        close(Server.ListenSock);
+    if(Server.pbData != NULL)
+        CASC_FREE(Server.pbData);
+    remove(szLocalFile);
+    return nError;
+}
+
+#endif  // defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+
+static int Hack()
+{
+/*
+    HANDLE hFile;
+    BYTE Buffer[0x100];
+    hash_state md5_state;
+    LPBYTE pbStartHash = &Buffer[BLTE_HEADER_DELTA];
+    BYTE md5_hash[MD5_HASH_SIZE];
+    uint32_t dwHashHigh = 0;
+    uint32_t dwHashLow = 0;
+    DWORD dwBytesRead = 0;
+
+    hFile = CreateFile(_T("e:\\Multimedia\\MPQs\\2014 - WoW\\18888\\Data\\data\\data.017"), GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if(hFile != INVALID_HANDLE_VALUE)
+    {
+        SetFilePointer(hFile, 0x34CBFE8C, NULL, FILE_BEGIN);
+        ReadFile(hFile, Buffer, sizeof(Buffer), &dwBytesRead, NULL);
+        CloseHandle(hFile);
+
+        for(int i = 1; i < 4+4+16; i++)
+        {
+            dwHashHigh = dwHashLow = 0;
+            hashlittle2(pbStartHash, i, &dwHashHigh, &dwHashLow);
+
+            md5_init(&md5_state);
             md5_process(&md5_state, pbStartHash, i);
             md5_done(&md5_state, md5_hash);
 
@@ -400,6 +1748,28 @@ int main(int argc, char * argv[])
 //  if(nError == ERROR_SUCCESS)
 //      nError = Hack();
 
+    // Decompression of damaged and unusual frames
+    if(nError == ERROR_SUCCESS)
+        nError = TestDecompress();
+
+    // Compiled search masks must match like the reference matcher
+    if(nError == ERROR_SUCCESS)
+        nError = TestWildCards();
+
+    // Lookup of files in the indexes of the CDN archives
+    if(nError == ERROR_SUCCESS)
+        nError = TestCdnArchives();
+
+    // Names of extracted files must stay in the target directory
+    if(nError == ERROR_SUCCESS)
+        nError = TestExtractedFileNames();
+
+    // Test the HTTP stream against a range server on the loopback
+#if defined(PLATFORM_LINUX) || defined(PLATFORM_MAC)
+    if(nError == ERROR_SUCCESS)
+        nError = TestHttpStream_Loopback();
+#endif
+
 //  if(nError == ERROR_SUCCESS)
 //      nError = TestOpenStorage_OpenFile(MAKE_PATH("2014 - WoW/18888/Data"), "SPELLS\\T_VFX_BLOOD06B.BLP");
 
@@ -427,6 +1797,15 @@ int main(int argc, char * argv[])
     //if(nError == ERROR_SUCCESS)
     //    nError = TestOpenStorage_EnumFiles(MAKE_PATH("2014 - Heroes of the Storm/31726/HeroesData"), NULL);
 
+    //if(nError == ERROR_SUCCESS)
+    //    nError = TestOpenStorage_EnumFilesPart(MAKE_PATH("2014 - Heroes of the Storm/31726/HeroesData"), 8);
+
+    //if(nError == ERROR_SUCCESS)
+    //    nError = TestOpenStorage_EnumEncodingKeys(MAKE_PATH("2014 - Heroes of the Storm/31726/HeroesData"), 8);
+
+    //if(nError == ERROR_SUCCESS)
+    //    nError = TestOpenStorage_EnumFilesBatch(MAKE_PATH("2014 - Heroes of the Storm/31726/HeroesData"), NULL);
+
     //if(nError == ERROR_SUCCESS)
     //    nError = TestOpenStorage_EnumFiles(MAKE_PATH("2014 - WoW/18865/Data"), szListFile);
 
@@ -461,6 +1840,22 @@ int main(int argc, char * argv[])
 //  if(nError == ERROR_SUCCESS)
 //      nError = TestOpenStorage_ExtractFiles(MAKE_PATH("2015 - Diablo III/Data"), _T("Work"), NULL);
 
+    // Compare the single-threaded extraction against the pipeline
+//  if(nError == ERROR_SUCCESS)
+//      nError = TestOpenStorage_ExtractFilesMT(MAKE_PATH("2014 - Heroes of the Storm/30414/HeroesData"), _T("Work"), NULL, 1, 0);
+
+//  if(nError == ERROR_SUCCESS)
+//      nError = TestOpenStorage_ExtractFilesMT(MAKE_PATH("2014 - Heroes of the Storm/30414/HeroesData"), _T("Work"), NULL, 0, 0);
+
+    // Compare buffered reads against reads that bypass the system cache.
+    // Drop the system cache before each run to compare cold reads
+//  if(nError == ERROR_SUCCESS)
+//      nError = TestOpenStorage_ExtractFilesMT(MAKE_PATH("2014 - Heroes of the Storm/30414/HeroesData"), _T("Work"), NULL, 0, CASC_STOR_DIRECT_IO);
+
+    // Measure the decompression speed of each codec. Build with WITH_LIBDEFLATE to compare the ZLIB backends
+//  if(nError == ERROR_SUCCESS)
+//      nError = TestOpenStorage_DecompressSpeed(MAKE_PATH("2014 - Heroes of the Storm/30414/HeroesData"), 10000, 10);
+
 #ifdef _MSC_VER                                                          
     _CrtDumpMemoryLeaks();
 #endif  // _MSC_VER